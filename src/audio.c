@@ -11,17 +11,27 @@
 #include <SDL2/SDL.h>
 #include <SDL_thread.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 #include "ubee512.h"
 #include "gui.h"
 #include "audio.h"
+#include "audiofile.h"
 #include "z80api.h"
+#include "sched.h"
 #include "function.h"
+#include "support.h"
 
 //==============================================================================
 // structures and variables
 //==============================================================================
 
 static SDL_AudioSpec wanted, obtained;
+static int audio_frame_bytes = 2;       /* bytes in each output sample */
 
 static void audio_fill(void *udata, Uint8 *stream, int len);
 
@@ -30,36 +40,25 @@ extern emu_t emu;
 //==============================================================================
 // constants
 //==============================================================================
-#define MAX_AUDIO_BUFFERS 10    /* 20480 bytes, or about 1/2 a second */
+#define MAX_AUDIO_BUFFERS 10    /* ring holds this many work buffers, or
+                                 * about 1/5 of a second */
+#define AUDIO_WAIT_MS 100       /* longest a producer thread waits for
+                                 * room in the ring */
 #define DEBUG_MIXER 0           /* set to 1 to debug the operation of
                                  * the mixer function */
 #define DEBUG_AUDIO 0           /* set to 1 to debug the operation of
                                  * the audio thread */
-#define DEBUG_AUDIO_MUTEXES 0
 #define DEBUG_DISCARD_SAMPLES 0 /* set to 1 to throw samples away
                                  * instead of adding them to the audio
                                  * buffers. */
-#define NUM_AUDIO_SOURCES 5
-
-//==============================================================================
-// macros
-//==============================================================================
-#if DEBUG_AUDIO_MUTEXES
-#define DEBUG_MUTEX(name, what, x) \
-do { \
- uint64_t now, then = time_get_ms(); \
- (x); \
- now = time_get_ms(); \
- if (now - then >= 2) \
-    { \
-     xprintf(name ": %s: waited %llu ms for lock (line %d: %s)\n", \
-             what, now - then, __LINE__, #x); \
-     assert(now - then <= 5); \
-    } \
-} while(0)
-#else
-#  define DEBUG_MUTEX(name, what, x) (x)
-#endif
+#define NUM_AUDIO_SOURCES 8
+#define AUDIO_BUS_SIZE 512      /* samples mixed on the bus at a time */
+#define AUDIO_ADAPT_SAMPLES 512 /* largest SDL callback size in
+                                 * adaptive mode */
+#define AUDIO_ADAPT_MAX 328     /* most the read rate is stretched or
+                                 * squeezed, 1/65536 units (0.5%) */
+#define AUDIO_ADAPT_SHRINK_MS 1000 /* how often the jitter allowance is
+                                    * reduced */
 
 //==============================================================================
 // global variables
@@ -70,6 +69,7 @@ audio_t audio =
  .vol_percent = AUDIO_VOLUME_PERCENT, // default audio volume
  .samples = AUDIO_SAMPLES,            // number of samples in each audio frame
  .frequency = AUDIO_FREQUENCY,        // audio sampling rate
+ .format = AUDIO_FORMAT,              // output sample format
 };
 static audio_source_t audio_sources[NUM_AUDIO_SOURCES];
 int audio_samples = AUDIO_SAMPLES; /* size of the SDL audio buffer.
@@ -77,23 +77,69 @@ int audio_samples = AUDIO_SAMPLES; /* size of the SDL audio buffer.
                                     * size of the audio buffers */
 static uint64_t audio_tstates_last = 0; /* Z80 tstate count at the
                                          * start of each frame */
+static void audio_schedule (void);
+static void audio_update_event (void);
+static sched_event_t audio_event = {0, audio_update_event, "audio", 0};
+static uint64_t audio_file_remainder;   /* T-states not yet written to
+                                         * the audio file, scaled by the
+                                         * audio frequency */
+
+// When writing an audio file the sources are mixed by the CPU thread and
+// the mixed bus is passed on to the audio device through this ring.
+typedef struct audio_file_bus_t
+{
+ int32_t *ring;               /* mixed samples for the audio device */
+ uint32_t mask;
+ uint32_t head;               /* written by the CPU thread */
+ uint32_t tail;               /* read by the audio thread */
+ uint32_t start;              /* samples queued before playing starts */
+ int playing;
+}audio_file_bus_t;
+
+static audio_file_bus_t audio_file_bus;
 #if DEBUG_AUDIO
 static uint64_t audio_fill_last;
 static int audio_fill_expected_delay = 0;
 #endif
 static int audio_master_volume = SDL_MIX_MAXVOLUME;
 
+// Adaptive mode.  The lateness of the audio callbacks and of the CPU
+// thread's source updates is measured, in samples, and sources are held
+// at a queue level that just covers a frame of samples, a callback and
+// the worst recent lateness.
+typedef struct audio_adapt_t
+{
+ uint64_t last;               /* time of the last event */
+ uint64_t shrunk;             /* time the jitter last shrank */
+ int jitter;                  /* worst recent lateness, samples */
+}audio_adapt_t;
+
+static audio_adapt_t audio_adapt_fill;   /* audio callbacks */
+static audio_adapt_t audio_adapt_update; /* source updates */
+static int audio_adapt_target;  /* queue level sources are held at */
+
+typedef struct audio_gain_t
+{
+ char name[16];               /* name of the audio source */
+ int gain;                    /* gain in percent */
+}audio_gain_t;
+
+static audio_gain_t audio_gains[NUM_AUDIO_SOURCES];
+static int audio_gains_count;
+
 extern gui_t gui;
 extern gui_status_t gui_status;
+extern audiofile_t audiofile;
 
 //==============================================================================
 // internal function prototypes
 //==============================================================================
 int audio_allocate_buffers(audio_scratch_t *a, int len);
 int audio_deallocate_buffers(audio_scratch_t *a);
-int audio_source_play(audio_scratch_t *a, void *udata, Uint8 *stream, int len);
-void audio_next_dirty_buffer(audio_scratch_t *a);
-void audio_recycle_buffer(audio_scratch_t *a, audio_buffer_t *buf);
+int audio_source_play(audio_scratch_t *a, int32_t *bus, int n, int mult);
+static int audio_file_bus_init (void);
+static void audio_file_bus_put (int32_t *bus, int n);
+static void audio_file_bus_get (int32_t *bus, int n);
 #if DEBUG_MIXER
 void audio_dumpstream(const char *what, AUDIO_BUFTYP *data, Uint32 len);
 #endif
@@ -144,13 +190,36 @@ void audio_command (int cmd)
 //==============================================================================
 int audio_init (void)
 {
+ if (audiofile_open() != 0)
+    return -1;
+
+ // when writing an audio file the samples are mixed by
+ // audio_sources_update() instead, timed by the Z80 and not by the
+ // device.
+ if (audiofile.fp)
+    {
+     audio_file_remainder = 0;
+     audio.adapt = 0;
+    }
+
  // set the audio format desired
- wanted.format = AUDIO_FORMAT;
+ wanted.format = audio.format;
  wanted.channels = AUDIO_CHANNELS;
  wanted.freq = audio.frequency;
  wanted.samples = audio.samples;
+ if (audio.adapt && wanted.samples > AUDIO_ADAPT_SAMPLES)
+    wanted.samples = AUDIO_ADAPT_SAMPLES;
  wanted.callback = audio_fill;
  wanted.userdata = NULL;
+
+ // no audio device is used in headless mode, samples are discarded by
+ // audio_put_work_buffer() as they are produced unless written to an
+ // audio file.
+ if (emu.headless)
+    {
+     obtained = wanted;
+     return 0;
+    }
 #if DEBUG_AUDIO
  audio_fill_expected_delay = wanted.samples * 1000 / wanted.freq;
  xprintf("audio_init: wanted "
@@ -162,11 +231,21 @@ int audio_init (void)
          audio_fill_expected_delay
          );
 #endif
- if (SDL_OpenAudio(&wanted, &obtained) < 0)
+ // SDL converts the samples if the device does not support the format
+ if (SDL_OpenAudio(&wanted, NULL) < 0)
     {
      xprintf("audio_init: Couldn't open audio: %s\n", SDL_GetError());
      return -1;
     }
+ obtained = wanted;
+ audio_frame_bytes = ((wanted.format == AUDIO_F32SYS) ? 4 : 2) *
+                     wanted.channels;
+ if (audiofile.fp && audio_file_bus_init() != 0)
+    {
+     xprintf("audio_init: Couldn't allocate the audio file bus\n");
+     SDL_CloseAudio();
+     return -1;
+    }
 #if DEBUG_AUDIO
  audio_fill_expected_delay = wanted.samples * 1000 / wanted.freq;
  xprintf("audio_init: wanted "
@@ -190,6 +269,9 @@ int audio_init (void)
          );
  audio_fill_last = time_get_ms();
 #endif
+ memset(&audio_adapt_fill, 0, sizeof(audio_adapt_fill));
+ memset(&audio_adapt_update, 0, sizeof(audio_adapt_update));
+ audio_adapt_target = obtained.freq / emu.framerate + obtained.samples;
  audio_set_master_volume(100);
  SDL_PauseAudio(0);
  return 0;
@@ -203,7 +285,15 @@ int audio_init (void)
 //==============================================================================
 int audio_deinit (void)
 {
- SDL_CloseAudio();
+ if (emu.verbose && audio.adapt && ! emu.headless)
+    xprintf("audio_deinit: adaptive latency %d ms\n",
+            (audio_adapt_target + obtained.samples) * 1000 / obtained.freq);
+ if (! emu.headless)
+    SDL_CloseAudio();
+ if (audiofile.fp)
+    audiofile_close();
+ free(audio_file_bus.ring);
+ audio_file_bus.ring = NULL;
 
  return 0;
 }
@@ -217,6 +307,68 @@ int audio_deinit (void)
 int audio_reset (void)
 {
  audio_tstates_last = z80api_get_tstates();
+ audio_schedule();
+ return 0;
+}
+
+//==============================================================================
+// Get the gain of an audio source.
+//
+//   pass: const char *name             name of the audio source
+// return: int                          gain in percent
+//==============================================================================
+static int audio_get_gain (const char *name)
+{
+ int i;
+
+ for (i = 0; i < audio_gains_count; i++)
+    {
+     if (strcmp(audio_gains[i].name, name) == 0)
+        return audio_gains[i].gain;
+    }
+
+ return AUDIO_GAIN_PERCENT;
+}
+
+//==============================================================================
+// Set the gain of an audio source.
+//
+// The gain is kept for when the source is registered and changed at once
+// if it is already registered.
+//
+//   pass: char *name                   name of the audio source
+//         int percent                  gain in percent
+// return: int                          0 if no errors, else -1
+//==============================================================================
+int audio_set_gain (char *name, int percent)
+{
+ audio_source_t *p;
+ int i;
+
+ for (i = 0; i < audio_gains_count; i++)
+    {
+     if (strcmp(audio_gains[i].name, name) == 0)
+        break;
+    }
+
+ if (i == audio_gains_count)
+    {
+     if (i == NUM_AUDIO_SOURCES)
+        return -1;
+     strncpy(audio_gains[i].name, name, sizeof(audio_gains[i].name));
+     audio_gains[i].name[sizeof(audio_gains[i].name)-1] = 0;
+     audio_gains_count++;
+    }
+ audio_gains[i].gain = percent;
+
+ for (p = &audio_sources[0];
+      p < &audio_sources[sizeof(audio_sources)/sizeof(audio_sources[0])];
+      ++p)
+    {
+     if (p->buf && (strcmp(p->name, name) == 0))
+        p->gain = percent;
+    }
+
  return 0;
 }
 
@@ -234,114 +386,354 @@ void audio_set_master_volume (int percent)
 }
 
 //==============================================================================
-// Mix the buffered data from all of the registered audio sources into
-// the output buffer.
+// Measure the lateness of an event in adaptive mode.  The time since the
+// last event less the time expected is converted to samples and the
+// jitter allowance raised to it.  The allowance is reduced by 1/8 each
+// second so the latency shrinks back once the events are steady again.
 //
-//   pass: void *udata
-//         Uint8 *stream        A pointer to the audio buffer to be filled
-//         int len              The length (in bytes) of the audio buffer
+// Each audio_adapt_t is only written by one thread.
+//
+//   pass: audio_adapt_t *ad
+//         int expected                 expected time between events in ms
 // return: void
+//==============================================================================
+static void audio_adapt_late (audio_adapt_t *ad, int expected)
+{
+ uint64_t now = time_get_ms();
+ int jitter = ad->jitter;
+ int late;
+
+ if (ad->last)
+    {
+     late = ((int)(now - ad->last) - expected) * obtained.freq / 1000;
+     if (late > jitter)
+        jitter = late;
+    }
+ ad->last = now;
+
+ if (now - ad->shrunk >= AUDIO_ADAPT_SHRINK_MS)
+    {
+     jitter -= jitter / 8;
+     ad->shrunk = now;
+    }
+
+ __atomic_store_n(&ad->jitter, jitter, __ATOMIC_RELAXED);
+}
+
+//==============================================================================
+// Adaptive mode read step for a source.  The source's average queue level
+// is compared with the target level and the rate the ring is read at is
+// stretched or squeezed by up to AUDIO_ADAPT_MAX to bring it back.  The
+// trim accumulates the error to take up a steady difference between the
+// emulated and the output sample clocks.
 //
-// When this function runs, SDL's internal audio mutex is locked.
+//   pass: audio_source_t *p
+//         uint32_t avail               samples in the source's ring
+// return: int                          read step, 16.16 fixed point
 //==============================================================================
-static void audio_fill (void *udata, Uint8 *stream, int len)
+static int audio_adapt_step (audio_source_t *p, uint32_t avail)
+{
+ int adj;
+
+ p->level += ((int)avail - p->level) / 8;
+ p->trim += (p->level - audio_adapt_target) * 256 / audio_adapt_target;
+ if (p->trim > AUDIO_ADAPT_MAX * 256)
+    p->trim = AUDIO_ADAPT_MAX * 256;
+ else
+    if (p->trim < -AUDIO_ADAPT_MAX * 256)
+       p->trim = -AUDIO_ADAPT_MAX * 256;
+ adj = (p->level - audio_adapt_target) * AUDIO_ADAPT_MAX /
+       audio_adapt_target + p->trim / 256;
+ if (adj > AUDIO_ADAPT_MAX)
+    adj = AUDIO_ADAPT_MAX;
+ else
+    if (adj < -AUDIO_ADAPT_MAX)
+       adj = -AUDIO_ADAPT_MAX;
+
+ return 65536 + adj;
+}
+
+//==============================================================================
+// Adaptive mode source play function.  As audio_source_play() but the
+// ring is read with a fractional step, interpolating between samples, so
+// the source's queue level is held at the target level without dropping
+// samples or waiting.
+//
+//   pass: audio_source_t *p    A pointer to the audio source
+//         int32_t *bus         the mixing bus
+//         int n                number of samples to mix
+//         int mult             multiplier for the source's samples
+// return: int                  0 if there were no samples to play, non 0
+//                              otherwise.
+//==============================================================================
+static int audio_source_stretch (audio_source_t *p, int32_t *bus, int n,
+                                 int mult)
+{
+ audio_scratch_t *a = p->buf;
+ uint32_t head;
+ uint32_t tail;
+ uint32_t avail;
+ uint32_t pos;
+ int step;
+ int s0, s1;
+ int i;
+
+ head = __atomic_load_n(&a->head, __ATOMIC_ACQUIRE);
+ tail = a->tail;
+ avail = head - tail;
+ if (avail == 0)
+    return 0;
+
+ step = audio_adapt_step(p, avail);
+ pos = p->phase;
+ for (i = 0; i < n; i++)
+    {
+     // the sample after the read position is needed to interpolate
+     if ((pos >> 16) + 1 >= avail)
+        {
+         a->underruns++;
+         break;
+        }
+     s0 = a->ring[(tail + (pos >> 16)) & a->mask];
+     s1 = a->ring[(tail + (pos >> 16) + 1) & a->mask];
+     if (mult)
+        bus[i] += (s0 + (int)((int64_t)(s1 - s0) * (pos & 0xffff) / 65536)) *
+                  mult / (1 << AUDIO_SHIFT);
+     pos += step;
+    }
+
+ p->phase = pos & 0xffff;
+ __atomic_store_n(&a->tail, tail + (pos >> 16), __ATOMIC_RELEASE);
+ return 1;
+}
+
+//==============================================================================
+// Mix the buffered data from all of the registered audio sources into
+// the mixing bus.
+//
+// Each source's samples are scaled by the master volume and the source's
+// gain and added to a 32 bit bus, where a sample at full volume and 100%
+// gain has a 16 bit range.  The bus is only clipped once, when it is
+// converted to the output format.
+//
+//   pass: int32_t *bus         the mixing bus
+//         int n                number of samples to mix
+// return: void
+//==============================================================================
+static void audio_mix (int32_t *bus, int n)
 {
  audio_source_t *p;
+ int mult;
 
-#if DEBUG_AUDIO
- {
-  uint64_t now = time_get_ms();
-  xprintf("audio_fill: start %llums filling %d, "
-          "%llums since last update%s\n",
-          now, len,
-          now - audio_fill_last,
-                                // tolerate 2ms of error before
-                                // declaring an audio update late
-          (now - audio_fill_last > audio_fill_expected_delay + 2) ?
-          " [late]" : "");
-  audio_fill_last = now;
- }
-#endif
+ memset(bus, 0, n * sizeof(bus[0]));
 
- //
- // Mix the audio for the active sources.
- //
  for (p = &audio_sources[0];
       p < &audio_sources[sizeof(audio_sources)/sizeof(audio_sources[0])];
       ++p)
     {
      if (p->buf)
         {
-         DEBUG_MUTEX("audio_fill",
-                     p->name,
-                     SDL_LockMutex(p->buf->mutex));
          switch (p->state)
             {
              case AUDIO_SOURCE_QUIESCENT:
+                if (__atomic_load_n(&p->buf->head, __ATOMIC_ACQUIRE) !=
+                    p->buf->tail)
+                   {
+                    p->count = p->holdoff_count;
+                    p->state = AUDIO_SOURCE_BUFFERING;
+                   }
+                break;
+             case AUDIO_SOURCE_BUFFERING:
                 {
-                 int new_samples;
-                 new_samples = p->buf->new_samples;
-                 if (new_samples)
+                 // in adaptive mode playing starts as soon as the
+                 // target queue level is reached, the holdoff time is
+                 // the longest wait.
+                 uint32_t avail =
+                    __atomic_load_n(&p->buf->head, __ATOMIC_ACQUIRE) -
+                    p->buf->tail;
+                 if ((audio.adapt && avail >= (uint32_t)audio_adapt_target) ||
+                     p->count < n)
                     {
-                     p->count = p->holdoff_count;
-                     p->state = AUDIO_SOURCE_BUFFERING;
+                     p->level = avail;
+                     p->trim = 0;
+                     p->phase = 0;
+                     p->state = AUDIO_SOURCE_PLAYING;
                     }
+                 else
+                    p->count -= n;
+                 break;
                 }
-                break;
-             case AUDIO_SOURCE_BUFFERING:
-                if (p->count < len)
-                   p->state = AUDIO_SOURCE_PLAYING;
-                else
-                   p->count -= len;
-                break;
              case AUDIO_SOURCE_PLAYING:
                 {
                  int result;
 #if DEBUG_AUDIO
-                 xprintf("audio_fill: %s: "
-                         "new %d length %d\n",
+                 xprintf("audio_mix: %s: %d samples to drain\n",
                          p->name,
-                         p->buf->new_samples, p->buf->len);
-                 xprintf("audio_fill: %s: %d samples to drain\n",
-                         p->name, p->buf->drain_len);
+                         __atomic_load_n(&p->buf->head, __ATOMIC_ACQUIRE) -
+                         p->buf->tail);
 #endif
-                 result = audio_source_play(p->buf, udata, stream, len);
-                 p->buf->new_samples = 0;
+                 mult = audio.mute ? 0 :
+                        2 * audio_master_volume * p->gain / 100;
+                 if (audio.adapt)
+                    result = audio_source_stretch(p, bus, n, mult);
+                 else
+                    result = audio_source_play(p->buf, bus, n, mult);
                  /* An audio source that has stopped generating new
                     samples will cause audio_source_play to return 0
                     once all of the outstanding samples have been
                     drained . */
-                 if (result == 0 && p->sync)
+                 if (result == 0 && p->sync && ! audiofile.fp)
                     p->state = AUDIO_SOURCE_QUIESCENT;
                  break;
                 }
              default:
                 assert(0);      // should never happen
             }
-         //
-         // Signal producer thread if it is blocked waiting for
-         // buffers to become available.
-         //
-         {
-          int signal_producer;
-          signal_producer = (p->buf->num_clean > 0);
 #if DEBUG_AUDIO
-          xprintf("audio_fill: %s: "
-                  "clean %d dirty %d new %d state %d\n",
-                  p->name,
-                  p->buf->num_clean, p->buf->num_dirty,
-                  p->buf->new_samples, (int)p->state);
+         xprintf("audio_mix: %s: state %d overruns %u underruns %u\n",
+                 p->name, (int)p->state,
+                 p->buf->overruns, p->buf->underruns);
 #endif
-          DEBUG_MUTEX("audio_fill", p->name, SDL_UnlockMutex(p->buf->mutex));
-          if (signal_producer)
-             SDL_CondSignal(p->buf->cond);
-         }
         }
     }
+}
 
-#if DEBUG_MIXER
- audio_dumpstream("result", stream, len);
+//==============================================================================
+// Convert the mixing bus to signed 16 bit samples.
+//
+//   pass: int32_t *bus         the mixing bus
+//         int16_t *out         output samples
+//         int n                number of samples
+// return: void
+//==============================================================================
+static void audio_bus_s16 (int32_t *bus, int16_t *out, int n)
+{
+ int i = 0;
+
+#if defined(__SSE2__)
+ for (; i + 8 <= n; i += 8)
+    _mm_storeu_si128((__m128i *)&out[i],
+                     _mm_packs_epi32(_mm_loadu_si128((__m128i *)&bus[i]),
+                                     _mm_loadu_si128((__m128i *)&bus[i + 4])));
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+ for (; i + 8 <= n; i += 8)
+    vst1q_s16(&out[i], vcombine_s16(vqmovn_s32(vld1q_s32(&bus[i])),
+                                    vqmovn_s32(vld1q_s32(&bus[i + 4]))));
 #endif
+ for (; i < n; i++)
+    {
+     if (bus[i] > 32767)
+        out[i] = 32767;
+     else
+        if (bus[i] < -32768)
+           out[i] = -32768;
+        else
+           out[i] = bus[i];
+    }
+}
+
+//==============================================================================
+// Convert the mixing bus to 32 bit float samples.
+//
+//   pass: int32_t *bus         the mixing bus
+//         float *out           output samples
+//         int n                number of samples
+// return: void
+//==============================================================================
+static void audio_bus_f32 (int32_t *bus, float *out, int n)
+{
+ int i = 0;
+
+#if defined(__SSE2__)
+ __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+ __m128 max = _mm_set1_ps(1.0f);
+ __m128 min = _mm_set1_ps(-1.0f);
+
+ for (; i + 4 <= n; i += 4)
+    _mm_storeu_ps(&out[i],
+                  _mm_max_ps(min, _mm_min_ps(max,
+                  _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((__m128i *)&bus[i])),
+                             scale))));
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+ float32x4_t max = vdupq_n_f32(1.0f);
+ float32x4_t min = vdupq_n_f32(-1.0f);
+
+ for (; i + 4 <= n; i += 4)
+    vst1q_f32(&out[i],
+              vmaxq_f32(min, vminq_f32(max,
+              vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(&bus[i])), 1.0f / 32768.0f))));
+#endif
+ for (; i < n; i++)
+    {
+     out[i] = bus[i] * (1.0f / 32768.0f);
+     if (out[i] > 1.0f)
+        out[i] = 1.0f;
+     else
+        if (out[i] < -1.0f)
+           out[i] = -1.0f;
+    }
+}
+
+//==============================================================================
+// Fill the output buffer.  The sources are mixed on the bus and converted
+// to the output format a block at a time.
+//
+//   pass: void *udata
+//         Uint8 *stream        A pointer to the audio buffer to be filled
+//         int len              The length (in bytes) of the audio buffer
+// return: void
+//
+// When this function runs, SDL's internal audio mutex is locked.  No other
+// locks are taken, the samples are read from each source's ring, or from
+// the audio file bus when writing an audio file.
+//==============================================================================
+static void audio_fill (void *udata, Uint8 *stream, int len)
+{
+ int32_t bus[AUDIO_BUS_SIZE];
+ int frames;
+ int n;
+
+#if DEBUG_AUDIO
+ {
+  uint64_t now = time_get_ms();
+  xprintf("audio_fill: start %llums filling %d, "
+          "%llums since last update%s\n",
+          now, len,
+          now - audio_fill_last,
+                                // tolerate 2ms of error before
+                                // declaring an audio update late
+          (now - audio_fill_last > audio_fill_expected_delay + 2) ?
+          " [late]" : "");
+  audio_fill_last = now;
+ }
+#endif
+
+ if (audio.adapt)
+    {
+     audio_adapt_late(&audio_adapt_fill,
+                      obtained.samples * 1000 / obtained.freq);
+     audio_adapt_target = obtained.freq / emu.framerate + obtained.samples +
+                          audio_adapt_fill.jitter +
+                          __atomic_load_n(&audio_adapt_update.jitter,
+                                          __ATOMIC_RELAXED);
+    }
+
+ frames = len / audio_frame_bytes;
+ while (frames)
+    {
+     n = (frames < AUDIO_BUS_SIZE) ? frames : AUDIO_BUS_SIZE;
+     if (audiofile.fp)
+        audio_file_bus_get(bus, n);
+     else
+        audio_mix(bus, n);
+     if (wanted.format == AUDIO_F32SYS)
+        audio_bus_f32(bus, (float *)stream, n);
+     else
+        audio_bus_s16(bus, (int16_t *)stream, n);
+     stream += n * audio_frame_bytes;
+     frames -= n;
+    }
+
 #if DEBUG_AUDIO
  {
   uint64_t now;
@@ -352,49 +744,59 @@ static void audio_fill (void *udata, Uint8 *stream, int len)
 }
 
 //==============================================================================
-// Audio source play function.  Mixes the data for the specified audio
-// source accumulated since the last call into the supplied sound
-// buffer.
+// Audio source play function.  Adds the data for the specified audio
+// source accumulated since the last call to the mixing bus.
 //
 //   pass: audio_scratch_t *a   A pointer to the audio source structure
-//         void *udata
-//         Uint8 *stream        A pointer to the audio buffer to be filled
-//         int len              The length (in bytes) of the audio buffer
+//         int32_t *bus         the mixing bus
+//         int n                number of samples to mix
+//         int mult             multiplier for the source's samples
 // return: int                  0 if there were no samples to play, non 0
 //                              otherwise.
 //
-// This function assumes that the mutex for the specified audio
-// source, a->mutex, has already been locked.
+// This function is called from the SDL audio thread, the consumer of the
+// source's ring.  The samples are taken from the ring without a lock.
 //==============================================================================
-int audio_source_play (audio_scratch_t *a, void *udata, Uint8 *stream, int len)
+int audio_source_play (audio_scratch_t *a, int32_t *bus, int n, int mult)
 {
- if (a->num_dirty == 0)
+ AUDIO_BUFTYP *s;
+ uint32_t head;
+ uint32_t tail;
+ uint32_t avail;
+ int i, j;
+
+ head = __atomic_load_n(&a->head, __ATOMIC_ACQUIRE);
+ tail = a->tail;
+ avail = head - tail;
+ if (avail == 0)
     return 0;
-    
- int volume = audio.mute ? 0 : audio_master_volume;
 
- while (len && a->num_dirty)
+ if (avail < (uint32_t)n)
+    {
+     a->underruns++;
+     n = avail;
+    }
+
+ while (n)
     {
-     if (a->dirty[0]->drain_count)
+     i = a->mask + 1 - (tail & a->mask);
+     if (i > n)
+        i = n;
+     s = &a->ring[tail & a->mask];
+#if DEBUG_MIXER
+     audio_dumpstream("source", s, i);
+#endif
+     if (mult)
         {
-         int i = a->dirty[0]->drain_count;
-         if (i > len)
-            i = len;
-         SDL_MixAudio(stream,
-         a->dirty[0]->samples + a->dirty[0]->count - a->dirty[0]->drain_count,
-         i, volume);
-         len -= i;
-         a->dirty[0]->drain_count -= i;
-         stream += i;
-         if (!a->dirty[0]->drain_count)
-            {
-             audio_recycle_buffer(a, a->dirty[0]);
-             audio_next_dirty_buffer(a);
-            }
+         for (j = 0; j < i; j++)
+            bus[j] += s[j] * mult / (1 << AUDIO_SHIFT);
         }
-     else
-        break;
+     bus += i;
+     tail += i;
+     n -= i;
     }
+
+ __atomic_store_n(&a->tail, tail, __ATOMIC_RELEASE);
  return 1;
 }
 
@@ -425,8 +827,7 @@ int audio_register(audio_scratch_t *a, const char *name,
  audio_source_t *p;
 
  res = audio_allocate_buffers(a, audio.frequency / emu.framerate);
- a->mutex = SDL_CreateMutex();
- a->cond = SDL_CreateCond();
+ a->wait = ! synchronous;
  assert(res == 0);
  SDL_LockAudio();               /* lock out audio thread, the audio
                                  * sources array is changing */
@@ -442,13 +843,16 @@ int audio_register(audio_scratch_t *a, const char *name,
          p->clock_func = clock_func;
          p->data = data;
          p->sync = synchronous;
+         p->gain = audio_get_gain(name);
          // The holdoff time needs to be converted to a minimum number
          // of samples that need to be played before audio from this
          // audio source can be mixed into the output stream
          p->holdoff_count = holdoff_time_ms * wanted.freq / 1000;
          p->count = 0;
+         // when writing an audio file the sources are mixed in step
+         // with the Z80 so none are held off
          p->state =
-            p->sync && p->holdoff_count > 0 ?
+            p->sync && p->holdoff_count > 0 && ! audiofile.fp ?
             AUDIO_SOURCE_QUIESCENT : AUDIO_SOURCE_PLAYING;
          if (p->clock_func && emu.cpuclock != 0)
              (*p->clock_func)(emu.cpuclock);
@@ -477,6 +881,9 @@ int audio_deregister(audio_scratch_t *a)
     {
      if (p->buf == a)
         {
+         if (emu.verbose && (a->overruns || a->underruns))
+            xprintf("audio_deregister: %s: %u overruns, %u underruns\n",
+                    p->name, a->overruns, a->underruns);
 #if DEBUG_AUDIO
          xprintf("audio_deregister: %s\n", p->name);
 #endif
@@ -486,14 +893,13 @@ int audio_deregister(audio_scratch_t *a)
          p->clock_func = NULL;
          p->data = NULL;
          p->sync = 0;
+         p->gain = 0;
          p->holdoff_count = 0;
          p->count = 0;
          p->state = AUDIO_SOURCE_QUIESCENT;
         }
     }
  SDL_UnlockAudio();
- SDL_DestroyMutex(a->mutex);
- SDL_DestroyCond(a->cond);
  audio_deallocate_buffers(a);
  return 0;                      /* success */
 }
@@ -520,50 +926,47 @@ void audio_clock(int cpuclock)
         continue;
      if (!p->clock_func)
         continue;
-     SDL_LockMutex(p->buf->mutex); // lock out the source
+     // the audio thread only reads the ring, so the source's clock
+     // values can be changed without locking it out
      (*p->clock_func)(cpuclock);
-     SDL_UnlockMutex(p->buf->mutex);
     }
 }
 
 
+//==============================================================================
+// Allocate the work buffer and sample ring of an audio source.
+//
+// The ring holds up to MAX_AUDIO_BUFFERS work buffers of samples, its size
+// is rounded up to a power of 2.
+//
+//   pass: audio_scratch_t *    pointer to audio buffer structure
+//         int len              size of the work buffer, 0 for the default
+// return: int                  0 if no errors, else -1
+//==============================================================================
 int audio_allocate_buffers(audio_scratch_t *a, int len)
 {
- int i;
+ uint32_t size;
 
  a->len = len ? len : AUDIO_SAMPLES;
- a->num_clean = MAX_AUDIO_BUFFERS;      /* number of clean buffers available */
- a->clean = calloc(a->num_clean, sizeof(a->clean[0]));
- /* assume that the number of dirty buffers will never be more than
-  * the number of clean buffers we started with */
- a->dirty = calloc(a->num_clean, sizeof(a->dirty[0]));
- for (i = 0; i < a->num_clean; ++i)
-    a->clean[i] = malloc(sizeof(*a->clean[0]) +
-                         a->len * sizeof(a->clean[0]->samples[0]));
- a->num_dirty = 0;
+ a->limit = MAX_AUDIO_BUFFERS * a->len;
+ for (size = 1; size < a->limit; size <<= 1)
+    ;
+ a->mask = size - 1;
+ a->head = a->tail = 0;
+ a->overruns = a->underruns = 0;
+ a->ring = calloc(size, sizeof(a->ring[0]));
+ a->work = malloc(sizeof(*a->work) + a->len * sizeof(a->work->samples[0]));
  a->cur_buf = NULL;
- return 0;
+ return (a->ring && a->work) ? 0 : -1;
 }
 
 int audio_deallocate_buffers(audio_scratch_t *a)
 {
- int i;
-
- for (i = 0; i < a->num_clean; ++i)
-    free(a->clean[i]);
- free(a->clean);
- a->num_clean = 0;
- a->clean = NULL;
- for (i = 0; i < a->num_dirty; ++i)
-    free(a->dirty[i]);
- free(a->dirty);
- a->num_dirty = 0;
- a->dirty = NULL;
- if (a->cur_buf)                /* a working buffer has been allocated? */
-    {
-     free(a->cur_buf);
-     a->cur_buf = NULL;
-    }
+ free(a->ring);
+ a->ring = NULL;
+ free(a->work);
+ a->work = NULL;
+ a->cur_buf = NULL;
  return 0;
 }
 
@@ -572,109 +975,75 @@ int audio_deallocate_buffers(audio_scratch_t *a)
 //
 //   pass: audio_scratch_t *    pointer to audio buffer structure
 //      
-// return: AUDIO_BUFTYP *       pointer to a buffer of length a->len
+// return: void
 //
-// This function locks the audio buffer mutex.  If there are no clean buffers
-// available, this function will pause until one becomes available.
+// The work buffer belongs to the producer so this never waits.
 //==============================================================================
 void audio_get_work_buffer(audio_scratch_t *a)
 {
- SDL_LockMutex(a->mutex);
- assert(a->num_clean + a->num_dirty >= MAX_AUDIO_BUFFERS - 1);
  assert(!a->cur_buf);
- /* If there are no clean buffers, wait for one to become
-  * available */
- while (!a->num_clean)
-    {
-#if DEBUG_AUDIO
-     uint64_t then, delay;
-
-     then = time_get_ms();
-#endif
-     SDL_CondWait(a->cond, a->mutex);
-#if DEBUG_AUDIO
-     delay = time_get_ms() - then;
-     if (delay > 2)             /* conservative */
-        xprintf("audio_get_buffer: "
-                "waited from %llu to %llu (%llu ms) for a clean buffer\n",
-                then, then + delay, delay);
-#endif
-    }
- a->cur_buf = a->clean[--a->num_clean];
- a->cur_buf->count = a->cur_buf->drain_count = 0;
- assert(a->num_clean >= 0 &&
-        a->num_clean <= MAX_AUDIO_BUFFERS);
- SDL_UnlockMutex(a->mutex);
+ a->cur_buf = a->work;
+ a->cur_buf->count = 0;
 }
 
 //==============================================================================
-// Put a full buffer on the dirty buffers queue
+// Copy the work buffer into the ring for the audio thread to play.
 //
 //   pass: audio_scratch_t *    pointer to audio buffer structure
-//         AUDIO_BUFTYP *       pointer to a buffer of length a->len
 //      
 // return: void
 //
-// This function locks the audio buffer mutex.
+// If the ring does not have room for the samples they are dropped and an
+// overrun counted, the CPU thread never waits for the audio thread.  A
+// source producing samples on its own thread (see audio_register()) waits
+// up to AUDIO_WAIT_MS for room instead as the ring is what paces it.
 //==============================================================================
 void audio_put_work_buffer(audio_scratch_t *a)
 {
- SDL_LockMutex(a->mutex);
- a->cur_buf->drain_count = a->cur_buf->count;
- a->dirty[a->num_dirty++] = a->cur_buf;
+ uint32_t head;
+ uint32_t tail;
+ uint32_t n;
+ uint32_t i;
+ uint64_t then = 0;
+
+ n = a->cur_buf->count;
  a->cur_buf = NULL;
- assert(a->num_clean + a->num_dirty >= MAX_AUDIO_BUFFERS - 1);
- assert(a->num_dirty >= 0 &&
-        a->num_dirty <= MAX_AUDIO_BUFFERS);
- SDL_UnlockMutex(a->mutex);
-}
 
-//==============================================================================
-// This function updates the dirty buffers queue.  It assumes that the dirty
-// buffer at the head of the queue has already been added to the clean buffers
-// queue.
-//
-//   pass: audio_scratch_t *    pointer to audio buffer structure
-//      
-// return: void
-//
-// This function is intended to be called from the SDL audio thread.
-// It assumes that the audio buffer mutex a->mutex has already been
-// locked.
-//==============================================================================
-void audio_next_dirty_buffer(audio_scratch_t *a)
-{
- if (a->num_dirty)
+ // with no audio thread or audio file to drain the ring the samples are
+ // discarded.
+ if (emu.headless && audiofile.fp == NULL)
+    return;
+
+ head = a->head;
+ for (;;)
     {
-     // shuffle the dirty buffer pointers down.
-     memcpy(&a->dirty[0],
-            &a->dirty[1],
-            (MAX_AUDIO_BUFFERS - 1) * sizeof(a->dirty[0]));
-     a->num_dirty--;
-     assert(a->num_dirty >= 0 &&
-            a->num_dirty <= MAX_AUDIO_BUFFERS);
+     tail = __atomic_load_n(&a->tail, __ATOMIC_ACQUIRE);
+     if (a->limit - (head - tail) >= n)
+        break;
+     if (! a->wait)
+        {
+         a->overruns++;
+         return;
+        }
+     if (! then)
+        then = time_get_ms();
+     else
+        if (time_get_ms() - then >= AUDIO_WAIT_MS)
+           {
+            a->overruns++;
+            return;
+           }
+     SDL_Delay(1);
     }
-}
 
-//==============================================================================
-// This function adds a drained, previously dirty buffer, to the tail of the
-// clean buffers queue.
-//
-//   pass: audio_scratch_t *    pointer to audio buffer structure
-//         AUDIO_BUFTYP *       pointer to a buffer of length a->len
-//      
-// return: void
-//
-// This function is intended to be called from the SDL audio thread.
-// It assumes that the audio buffer mutex a->mutex has already been
-// locked.
-//
-//==============================================================================
-void audio_recycle_buffer(audio_scratch_t *a, audio_buffer_t *buf)
-{
- a->clean[a->num_clean++] = buf;
- assert(a->num_clean >= 0 &&
-        a->num_clean <= MAX_AUDIO_BUFFERS);
+ i = a->mask + 1 - (head & a->mask);
+ if (i > n)
+    i = n;
+ memcpy(&a->ring[head & a->mask], a->work->samples,
+        i * sizeof(a->ring[0]));
+ memcpy(a->ring, a->work->samples + i, (n - i) * sizeof(a->ring[0]));
+
+ __atomic_store_n(&a->head, head + n, __ATOMIC_RELEASE);
 }
 
 #if DEBUG_MIXER
@@ -693,7 +1062,7 @@ void audio_dumpstream(const char *what, AUDIO_BUFTYP *data, Uint32 len)
         {
          if (*data != lastsample)
             {
-             xprintf("%5d x %02x ", c, lastsample);
+             xprintf("%5d x %6d ", c, lastsample);
              c = 1;
              lastsample = *data;
             }
@@ -701,7 +1070,7 @@ void audio_dumpstream(const char *what, AUDIO_BUFTYP *data, Uint32 len)
             c++;
          data++;
         }
-     xprintf("%5d x %02x ", c, lastsample);
+     xprintf("%5d x %6d ", c, lastsample);
     }
  else
     xprintf("(empty)");
@@ -710,6 +1079,160 @@ void audio_dumpstream(const char *what, AUDIO_BUFTYP *data, Uint32 len)
 #endif
 
 
+//==============================================================================
+// Allocate the ring passing the mixed samples to the audio device when
+// writing an audio file.  It holds MAX_AUDIO_BUFFERS frames like a
+// source's ring.
+//
+//   pass: void
+// return: int                          0 if no errors, else -1
+//==============================================================================
+static int audio_file_bus_init (void)
+{
+ uint32_t size;
+
+ for (size = 1; size < MAX_AUDIO_BUFFERS * obtained.freq / emu.framerate;
+      size <<= 1)
+    ;
+ audio_file_bus.mask = size - 1;
+ audio_file_bus.head = audio_file_bus.tail = 0;
+ audio_file_bus.start = obtained.freq / emu.framerate + obtained.samples;
+ audio_file_bus.playing = 0;
+ audio_file_bus.ring = calloc(size, sizeof(audio_file_bus.ring[0]));
+ return audio_file_bus.ring ? 0 : -1;
+}
+
+//==============================================================================
+// Pass mixed samples on to the audio device.  Called from the CPU thread,
+// the samples are dropped if the audio device has fallen behind.
+//
+//   pass: int32_t *bus         the mixing bus
+//         int n                number of samples
+// return: void
+//==============================================================================
+static void audio_file_bus_put (int32_t *bus, int n)
+{
+ uint32_t head = audio_file_bus.head;
+ uint32_t tail = __atomic_load_n(&audio_file_bus.tail, __ATOMIC_ACQUIRE);
+ int i;
+
+ if (audio_file_bus.mask + 1 - (head - tail) < (uint32_t)n)
+    return;
+ for (i = 0; i < n; i++)
+    audio_file_bus.ring[head++ & audio_file_bus.mask] = bus[i];
+ __atomic_store_n(&audio_file_bus.head, head, __ATOMIC_RELEASE);
+}
+
+//==============================================================================
+// Get mixed samples for the audio device.  Called from the audio thread,
+// silence is played until a frame and a callback of samples are queued,
+// and again after the ring runs dry.
+//
+//   pass: int32_t *bus         the mixing bus
+//         int n                number of samples
+// return: void
+//==============================================================================
+static void audio_file_bus_get (int32_t *bus, int n)
+{
+ uint32_t head = __atomic_load_n(&audio_file_bus.head, __ATOMIC_ACQUIRE);
+ uint32_t tail = audio_file_bus.tail;
+ uint32_t avail = head - tail;
+ int i;
+
+ if (! audio_file_bus.playing && avail >= audio_file_bus.start)
+    audio_file_bus.playing = 1;
+ if (! audio_file_bus.playing)
+    avail = 0;
+ else
+    if (avail < (uint32_t)n)
+       audio_file_bus.playing = 0;
+
+ for (i = 0; i < n; i++)
+    bus[i] = ((uint32_t)i < avail) ?
+             audio_file_bus.ring[tail++ & audio_file_bus.mask] : 0;
+ __atomic_store_n(&audio_file_bus.tail, tail, __ATOMIC_RELEASE);
+}
+
+//==============================================================================
+// Write the samples for an interval of Z80 time to the audio file.  The
+// sources are mixed as audio_fill() does for the audio device, but the
+// number of samples is set by the T-states that have passed so the file
+// is the same at any emulation speed.  Unless headless the mixed samples
+// are also passed on to the audio device.
+//
+//   pass: uint64_t cycles              Z80 T-states since the last call
+// return: void
+//==============================================================================
+static void audio_file_mix (uint64_t cycles)
+{
+ int32_t bus[AUDIO_BUS_SIZE];
+ int16_t s16[AUDIO_BUS_SIZE];
+ float f32[AUDIO_BUS_SIZE];
+ uint64_t frames;
+ int n;
+
+ if (emu.cpuclock == 0)
+    return;
+
+ frames = cycles * audio.frequency + audio_file_remainder;
+ audio_file_remainder = frames % emu.cpuclock;
+ frames /= emu.cpuclock;
+
+ while (frames)
+    {
+     n = (frames < AUDIO_BUS_SIZE) ? frames : AUDIO_BUS_SIZE;
+     audio_mix(bus, n);
+     if (audio.format == AUDIO_F32SYS)
+        {
+         audio_bus_f32(bus, f32, n);
+         audiofile_write(f32, n);
+        }
+     else
+        {
+         audio_bus_s16(bus, s16, n);
+         audiofile_write(s16, n);
+        }
+     if (audio_file_bus.ring)
+        audio_file_bus_put(bus, n);
+     frames -= n;
+    }
+}
+
+//==============================================================================
+// Schedule the next update of the synchronous audio sources a frame of Z80
+// time after the last one.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void audio_schedule (void)
+{
+ int period;
+
+ if (emu.framerate == 0)
+    return;
+ period = emu.cpuclock / emu.framerate;
+ if (period > 0)
+    sched_add(&audio_event, audio_tstates_last + period);
+}
+
+//==============================================================================
+// Audio update event.  Called by the scheduler each frame of Z80 time so
+// the sources are updated at the same T-states whatever the Z80 block size
+// or emulation speed.  The host time used is kept for the benchmark report.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void audio_update_event (void)
+{
+ uint64_t t = time_get_ns();
+
+ audio_sources_update();
+ audio.update_ns += time_get_ns() - t;
+ audio_schedule();
+}
+
 //==============================================================================
 // This function calls the audio sources' generation function to
 // generate the audio samples for the.last frame interval
@@ -727,6 +1250,9 @@ void audio_sources_update(void)
  uint64_t tstates_cur = z80api_get_tstates();
  const audio_source_t *p;
 
+ if (audio.adapt && ! emu.headless)
+    audio_adapt_late(&audio_adapt_update, 1000 / emu.framerate);
+
 #if DEBUG_AUDIO
  xprintf("audio_sources_update: start %lld\n", time_get_ms());
 #endif
@@ -739,24 +1265,27 @@ void audio_sources_update(void)
          (*p->audio_func)(p->buf, p->data,
                           audio_tstates_last,
                           tstates_cur - audio_tstates_last);
+         // the audio file is mixed up to the current time so a part
+         // filled work buffer is passed on now
+         if (audiofile.fp && audio_has_work_buffer(p->buf) &&
+             p->buf->cur_buf->count)
+            audio_put_work_buffer(p->buf);
         }
 #if DEBUG_AUDIO
      if (p->buf)
         {
-         // The audio thread will change the audio buffer structure,
-         // so the buffer mutex needs to be locked before we touch it
-         SDL_LockMutex(p->buf->mutex);
          xprintf("audio_sources_update: %s: "
-                 "clean %d dirty %d new %d state %d\n",
+                 "ring %u overruns %u underruns %u state %d\n",
                  p->name,
-                 p->buf->num_clean, p->buf->num_dirty,
-                 p->buf->new_samples, (int)p->state);
-//           assert(p->buf->new_samples <= p->buf->len);
-         SDL_UnlockMutex(p->buf->mutex);
+                 p->buf->head -
+                 __atomic_load_n(&p->buf->tail, __ATOMIC_ACQUIRE),
+                 p->buf->overruns, p->buf->underruns, (int)p->state);
         }
 #endif
 
     }
+ if (audiofile.fp)
+    audio_file_mix(tstates_cur - audio_tstates_last);
  audio_tstates_last = tstates_cur;
 #if DEBUG_AUDIO
  xprintf("audio_sources_update: end %lld\n", time_get_ms());
@@ -6,11 +6,14 @@
 #include "z80.h"
 
 #define AUDIO_VOLUME_PERCENT 45
+#define AUDIO_GAIN_PERCENT 100
 #define AUDIO_FREQUENCY 44100
-#define AUDIO_FORMAT AUDIO_U8
+#define AUDIO_FORMAT AUDIO_S16SYS       /* default output format */
 #define AUDIO_CHANNELS 1
-#define AUDIO_BUFTYP uint8_t
-#define AUDIO_MAXVAL 127
+#define AUDIO_BUFTYP int16_t            /* samples produced by each source */
+#define AUDIO_MAXVAL 127                /* largest source output level */
+#define AUDIO_SHIFT 8                   /* fraction bits kept below a level
+                                         * step in each sample */
 
 // The value used for AUDIO_SAMPLES has been revised with version 2.7.0 as
 // other changes have been made that can affect the audio quality. A very
@@ -47,6 +50,9 @@ typedef struct audio_t
  int samples;
  int frequency;
  int mode;
+ int format;
+ int adapt;
+ uint64_t update_ns;           /* host time used updating the sources */
 }audio_t;
 
 /*-------------------------------------------------------------------*/
@@ -56,35 +62,40 @@ void audio_command (int cmd);
 /* ======================================================================== */
 /*  LIMIT            -- Limiter function for digital sample output.         */
 /* ======================================================================== */
-static inline AUDIO_BUFTYP audio_limit(int16_t s)
+static inline AUDIO_BUFTYP audio_limit(int s)
 {
- if (s >  127) return  128 + 127;
- if (s < -128) return  128 - 128;
- return 128 + s;
+ if (s >  32767) return  32767;
+ if (s < -32768) return -32768;
+ return s;
 }
 
 typedef struct audio_buffer_t
 {
  int count;                   /* number of samples in this buffer */
- int drain_count;             /* number of samples to drain */
  AUDIO_BUFTYP samples[0];     /* the samples themselves */
 }audio_buffer_t;
 
+// Samples are passed from the thread producing them to the SDL audio
+// thread through a single producer, single consumer ring.  The head is only
+// written by the producer and the tail only by the audio thread so neither
+// side takes a lock.  The producer fills a work buffer and copies it into
+// the ring when it is full or flushed.
 typedef struct audio_scratch_t
 {
- int num_clean;
- audio_buffer_t **clean;      /* array of clean buffers */
- int num_dirty;
- audio_buffer_t **dirty;      /* array of dirty buffers */
- audio_buffer_t *cur_buf;     /* Current sound buffer. */
- int len;                     /* size of each buffer */
- SDL_mutex *mutex;            /* mutex protecting accesses to the
-                               * clean and dirty buffer arrays */
- SDL_cond *cond;              /* condition variable for
-                               * signalling */
- unsigned int new_samples;    /* debugging variable, recording the
-                               * number of new samples added per
-                               * frame */
+ AUDIO_BUFTYP *ring;          /* ring of samples to be played */
+ uint32_t mask;               /* ring size - 1, the size is a power of 2 */
+ uint32_t limit;              /* most samples held in the ring */
+ uint32_t head;               /* next sample written, producer only */
+ uint32_t tail;               /* next sample played, audio thread only */
+ int wait;                    /* producer may wait for room in the
+                               * ring (not the CPU thread) */
+ audio_buffer_t *work;        /* the work buffer */
+ audio_buffer_t *cur_buf;     /* work buffer if in use, else NULL */
+ int len;                     /* size of the work buffer */
+ unsigned int overruns;       /* work buffers dropped as the ring was
+                               * full */
+ unsigned int underruns;      /* audio callbacks where the ring ran out
+                               * of samples part way through */
 }audio_scratch_t;
 
 typedef enum
@@ -116,9 +127,17 @@ typedef struct audio_source_t
  int holdoff_count;           /* number of samples which need to be
                                *  generated before this source
                                *  starts playing */
+ int gain;                    /* gain in percent applied when
+                               * mixing */
  /* -- members below here are changed by the audio thread -- */
  int count;                   /* sample count */
  audio_source_state_t state;  /* state of this audio source */
+ int level;                   /* average samples queued in the ring
+                               * (adaptive mode) */
+ int trim;                    /* long term read rate correction, 1/256
+                               * units of the step (adaptive mode) */
+ uint32_t phase;              /* fraction of a sample read past the
+                               * ring's tail (adaptive mode) */
 }audio_source_t;
 
 // Audio circular buffer constants
@@ -171,13 +190,13 @@ static inline int audio_circularbuf_samples_remaining(audio_circularbuf_t *cb, i
  return bufsize - 1 - audio_circularbuf_samples(cb, bufsize);
 }
 
-/* put a sample into the circular buffer */
+/* put a sample into the circular buffer, s is scaled by 1<<AUDIO_SHIFT */
 static inline void audio_circularbuf_put_sample(audio_circularbuf_t *cb, int mask, int s)
 {
  if (cb->tau)
     {
-     cb->decay -= (s * (1<<16) + cb->decay) / cb->tau;
-     cb->buf[cb->head++ & mask] = audio_limit(s + (cb->decay / (1<<16)));
+     cb->decay -= (s * (1<<8) + cb->decay) / cb->tau;
+     cb->buf[cb->head++ & mask] = audio_limit(s + (cb->decay / (1<<8)));
     }
  else
     cb->buf[cb->head++ & mask] = audio_limit(s);
@@ -194,6 +213,7 @@ int audio_register(audio_scratch_t *a, const char *name,
                    int holdoff_time_ms);
 int audio_deregister(audio_scratch_t *a);
 void audio_set_master_volume(int percent);
+int audio_set_gain(char *name, int percent);
 void audio_get_work_buffer(audio_scratch_t *a);
 void audio_put_work_buffer(audio_scratch_t *a);
 void audio_sources_update(void);
@@ -202,14 +222,12 @@ void audio_drain_samples(audio_scratch_t *a, audio_circularbuf_t *sc);
 static inline void audio_put_sample(audio_scratch_t *a, AUDIO_BUFTYP sample)
 {
  a->cur_buf->samples[a->cur_buf->count++] = sample;
- a->new_samples++;
 }
 
 static inline void audio_put_samples(audio_scratch_t *a, AUDIO_BUFTYP sample, int n)
 {
  while (n--)
     a->cur_buf->samples[a->cur_buf->count++] = sample;
- a->new_samples += n;
 }
 
 static inline int audio_space_remaining(audio_scratch_t *a)
@@ -0,0 +1,495 @@
+//******************************************************************************
+//*                                  uBee512                                   *
+//*       An emulator for the Microbee Z80 ROM, FDD and HDD based models       *
+//*                                                                            *
+//*                        Audio file sink (WAV/FLAC) module                   *
+//*                                                                            *
+//*                          Copyright (C) 2026 agent                          *
+//******************************************************************************
+//
+// Writes the mixed output of the audio sources to a file instead of the
+// audio device.  Samples are written as the emulation produces them and
+// are timed by Z80 T-states, not the wall clock, so the file is the same
+// in turbo and headless runs as in a real time run.
+//
+// A file name ending in ".flac" is written as 16 bit mono FLAC, any other
+// name as a mono WAV file in the audio sample format (16 bit PCM or 32 bit
+// float).  FLAC frames use the fixed second order predictor with a single
+// Rice partition, or verbatim samples if that is smaller.  The headers are
+// rewritten with the final sizes (and the FLAC MD5 signature) on closing.
+//
+//==============================================================================
+/*
+ *  uBee512 - An emulator for the Microbee Z80 ROM, FDD and HDD based models.
+ *  Copyright (C) 2026 agent
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+//==============================================================================
+// ChangeLog (most recent entries are at top)
+//==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Created a new file to write the audio output to a WAV or FLAC file.
+//==============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#include "audiofile.h"
+#include "audio.h"
+#include "support.h"
+#include "tape.h"
+#include "md5.h"
+#include "ubee512.h"
+
+//==============================================================================
+// structures and variables
+//==============================================================================
+audiofile_t audiofile;
+
+extern emu_t emu;
+extern audio_t audio;
+
+typedef struct bits_t
+{
+ uint8_t *buf;
+ int pos;                       // whole bytes written
+ uint64_t acc;                  // bits not yet written
+ int n;                         // number of bits in acc
+}bits_t;
+
+static wav_t wav;
+static struct md5_ctx md5;
+
+static int16_t block[AUDIOFILE_FLAC_BLOCK];
+static int32_t residual[AUDIOFILE_FLAC_BLOCK];
+static int block_n;
+static uint32_t frame_number;
+
+// a frame is never larger than the verbatim encoding and its headers
+static uint8_t frame[AUDIOFILE_FLAC_BLOCK * 4 + 32];
+
+//==============================================================================
+// Append bits to a bit stream, most significant first.
+//
+//   pass: bits_t *b
+//         uint32_t v                   value
+//         int n                        number of bits (0-32)
+// return: void
+//==============================================================================
+static void audiofile_bits (bits_t *b, uint32_t v, int n)
+{
+ b->acc = (b->acc << n) | (v & (((uint64_t)1 << n) - 1));
+ b->n += n;
+ while (b->n >= 8)
+    {
+     b->n -= 8;
+     b->buf[b->pos++] = (uint8_t)(b->acc >> b->n);
+    }
+}
+
+//==============================================================================
+// Pad a bit stream with 0 bits to a byte boundary.
+//
+//   pass: bits_t *b
+// return: void
+//==============================================================================
+static void audiofile_align (bits_t *b)
+{
+ if (b->n)
+    audiofile_bits(b, 0, 8 - b->n);
+}
+
+//==============================================================================
+// Append a FLAC frame number in the extended UTF-8 coding.
+//
+//   pass: bits_t *b
+//         uint32_t v
+// return: void
+//==============================================================================
+static void audiofile_utf8 (bits_t *b, uint32_t v)
+{
+ int n;
+
+ if (v < 0x80)
+    {
+     audiofile_bits(b, v, 8);
+     return;
+    }
+
+ // n continuation bytes hold 6 bits each, the first byte 6-n bits
+ for (n = 1; n < 6 && v >= ((uint32_t)1 << (5 * n + 6)); n++)
+    ;
+ audiofile_bits(b, ((0xff << (7 - n)) & 0xff) | (v >> (6 * n)), 8);
+ while (n--)
+    audiofile_bits(b, 0x80 | ((v >> (6 * n)) & 0x3f), 8);
+}
+
+//==============================================================================
+// FLAC frame header CRC-8 (polynomial x^8 + x^2 + x + 1).
+//
+//   pass: const uint8_t *p
+//         int len
+// return: int                          CRC
+//==============================================================================
+static int audiofile_crc8 (const uint8_t *p, int len)
+{
+ int crc = 0;
+ int i;
+
+ while (len--)
+    {
+     crc ^= *p++;
+     for (i = 0; i < 8; i++)
+        crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) & 0xff : (crc << 1) & 0xff;
+    }
+ return crc;
+}
+
+//==============================================================================
+// FLAC frame CRC-16 (polynomial x^16 + x^15 + x^2 + 1).
+//
+//   pass: const uint8_t *p
+//         int len
+// return: int                          CRC
+//==============================================================================
+static int audiofile_crc16 (const uint8_t *p, int len)
+{
+ int crc = 0;
+ int i;
+
+ while (len--)
+    {
+     crc ^= *p++ << 8;
+     for (i = 0; i < 8; i++)
+        crc = (crc & 0x8000) ? ((crc << 1) ^ 0x8005) & 0xffff :
+                               (crc << 1) & 0xffff;
+    }
+ return crc;
+}
+
+//==============================================================================
+// Write the FLAC stream marker and STREAMINFO block.
+//
+//   pass: const uint8_t *digest        MD5 of the samples (16 bytes)
+// return: void
+//==============================================================================
+static void audiofile_flac_header (const uint8_t *digest)
+{
+ uint8_t hdr[42];
+ bits_t b = {hdr, 0, 0, 0};
+ int i;
+
+ audiofile_bits(&b, 0x664c6143, 32);          // "fLaC"
+ audiofile_bits(&b, 0x80, 8);                 // last block, STREAMINFO
+ audiofile_bits(&b, 34, 24);                  // block length
+ audiofile_bits(&b, AUDIOFILE_FLAC_BLOCK, 16);// minimum block size
+ audiofile_bits(&b, AUDIOFILE_FLAC_BLOCK, 16);// maximum block size
+ audiofile_bits(&b, 0, 24);                   // frame sizes unknown
+ audiofile_bits(&b, 0, 24);
+ audiofile_bits(&b, audio.frequency, 20);
+ audiofile_bits(&b, 0, 3);                    // 1 channel
+ audiofile_bits(&b, 15, 5);                   // 16 bits per sample
+ audiofile_bits(&b, (uint32_t)(audiofile.samples >> 32), 4);
+ audiofile_bits(&b, (uint32_t)audiofile.samples, 32);
+ for (i = 0; i < 16; i++)
+    audiofile_bits(&b, digest[i], 8);
+
+ fwrite(hdr, 1, b.pos, audiofile.fp);
+}
+
+//==============================================================================
+// Encode and write the buffered samples as one FLAC frame.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void audiofile_flac_frame (void)
+{
+ bits_t b = {frame, 0, 0, 0};
+ uint8_t le[AUDIOFILE_FLAC_BLOCK * 2];
+ uint64_t best;
+ uint64_t size;
+ uint32_t u;
+ uint32_t q;
+ int order;
+ int best_k;
+ int k;
+ int i;
+ int n = block_n;
+
+ if (n == 0)
+    return;
+
+ // the MD5 signature is of the little endian samples
+ for (i = 0; i < n; i++)
+    {
+     le[i * 2] = block[i] & 0xff;
+     le[i * 2 + 1] = (block[i] >> 8) & 0xff;
+    }
+ md5_process_bytes(le, n * 2, &md5);
+
+ // residual of the fixed predictor, folded to unsigned
+ order = (n > 2) ? 2 : 0;
+ for (i = order; i < n; i++)
+    {
+     if (order)
+        residual[i] = block[i] - 2 * block[i - 1] + block[i - 2];
+     else
+        residual[i] = block[i];
+     residual[i] = (int32_t)(((uint32_t)residual[i] << 1) ^
+                   (uint32_t)(residual[i] >> 31));
+    }
+
+ // find the Rice parameter giving the fewest bits, -1 for verbatim
+ best = (uint64_t)n * 16;
+ best_k = -1;
+ for (k = 0; k < 15; k++)
+    {
+     size = 16 * order + 10 + (uint64_t)(k + 1) * (n - order);
+     for (i = order; i < n; i++)
+        size += (uint32_t)residual[i] >> k;
+     if (size < best)
+        {
+         best = size;
+         best_k = k;
+        }
+    }
+
+ // frame header
+ audiofile_bits(&b, 0xfff8, 16);              // sync, fixed block size
+ audiofile_bits(&b, 0x7, 4);                  // block size-1 at the end
+ audiofile_bits(&b, 0x0, 4);                  // sample rate in STREAMINFO
+ audiofile_bits(&b, 0x0, 4);                  // mono
+ audiofile_bits(&b, 0x4, 3);                  // 16 bits per sample
+ audiofile_bits(&b, 0, 1);
+ audiofile_utf8(&b, frame_number++);
+ audiofile_bits(&b, n - 1, 16);
+ audiofile_bits(&b, audiofile_crc8(frame, b.pos), 8);
+
+ // subframe
+ if (best_k < 0)
+    {
+     audiofile_bits(&b, 0x02, 8);             // VERBATIM
+     for (i = 0; i < n; i++)
+        audiofile_bits(&b, (uint16_t)block[i], 16);
+    }
+ else
+    {
+     audiofile_bits(&b, (0x08 | order) << 1, 8); // FIXED of order
+     for (i = 0; i < order; i++)
+        audiofile_bits(&b, (uint16_t)block[i], 16);
+     audiofile_bits(&b, 0, 2);                // Rice coding, 4 bit parameter
+     audiofile_bits(&b, 0, 4);                // partition order 0
+     audiofile_bits(&b, best_k, 4);
+     for (i = order; i < n; i++)
+        {
+         u = (uint32_t)residual[i];
+         q = u >> best_k;
+         while (q >= 24)
+            {
+             audiofile_bits(&b, 0, 24);
+             q -= 24;
+            }
+         audiofile_bits(&b, 1, q + 1);        // unary quotient
+         audiofile_bits(&b, u, best_k);
+        }
+    }
+
+ audiofile_align(&b);
+ audiofile_bits(&b, audiofile_crc16(frame, b.pos), 16);
+
+ fwrite(frame, 1, b.pos, audiofile.fp);
+ block_n = 0;
+}
+
+//==============================================================================
+// Write the WAV header with the current data size.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void audiofile_wav_header (void)
+{
+ int bytes = audiofile.flt ? 4 : 2;
+ uint32_t size = (uint32_t)(audiofile.samples * bytes);
+
+ memcpy(&wav.chunk_id, "RIFF", 4);
+ memcpy(&wav.format, "WAVE", 4);
+
+ memcpy(&wav.sub_chunk1_id, "fmt ", 4);
+ wav.sub_chunk1_size = host_to_leu32(16);
+ wav.audio_format = host_to_leu16(audiofile.flt ? 3 : 1); // PCM or IEEE float
+ wav.num_channels = host_to_leu16(1);
+ wav.sample_rate = host_to_leu32(audio.frequency);
+ wav.byte_rate = host_to_leu32(audio.frequency * bytes);
+ wav.block_align = host_to_leu16(bytes);
+ wav.bits_per_sample = host_to_leu16(bytes * 8);
+
+ memcpy(&wav.sub_chunk2_id, "data", 4);
+ wav.sub_chunk2_size = host_to_leu32(size);
+ wav.chunk_size = host_to_leu32(36 + size);
+
+ fwrite(&wav, sizeof(wav), 1, audiofile.fp);
+}
+
+//==============================================================================
+// Audio file open.  Does nothing if no file name has been set.  Must be
+// called after the audio frequency and format are known.
+//
+//   pass: void
+// return: int                          0 if success, -1 if error
+//==============================================================================
+int audiofile_open (void)
+{
+ uint8_t digest[16];
+ char *ext;
+
+ if (audiofile.file[0] == 0)
+    return 0;
+
+ ext = strrchr(audiofile.file, '.');
+ audiofile.flac = (ext != NULL && strcasecmp(ext, ".flac") == 0);
+ audiofile.flt = ! audiofile.flac && audio.format == AUDIO_F32SYS;
+
+ audiofile.fp = fopen(audiofile.file, "wb");
+ if (audiofile.fp == NULL)
+    {
+     xprintf("audiofile_open: Unable to create sound file: %s\n",
+     audiofile.file);
+     return -1;
+    }
+
+ audiofile.samples = 0;
+ block_n = 0;
+ frame_number = 0;
+
+ // the headers are written again with the sizes when closed
+ if (audiofile.flac)
+    {
+     md5_init_ctx(&md5);
+     memset(digest, 0, sizeof(digest));
+     audiofile_flac_header(digest);
+    }
+ else
+    audiofile_wav_header();
+
+ return 0;
+}
+
+//==============================================================================
+// Audio file close.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int audiofile_close (void)
+{
+ uint8_t digest[16];
+
+ if (audiofile.fp == NULL)
+    return 0;
+
+ if (audiofile.flac)
+    {
+     audiofile_flac_frame();
+     md5_finish_ctx(&md5, digest);
+     fseek(audiofile.fp, 0, SEEK_SET);
+     audiofile_flac_header(digest);
+    }
+ else
+    {
+     fseek(audiofile.fp, 0, SEEK_SET);
+     audiofile_wav_header();
+    }
+
+ fclose(audiofile.fp);
+ audiofile.fp = NULL;
+
+ if (emu.verbose)
+    xprintf("audiofile_close: %u samples written to %s\n",
+    (unsigned int)audiofile.samples, audiofile.file);
+ return 0;
+}
+
+//==============================================================================
+// Write mixed samples to the audio file.  The samples are in the audio
+// format, signed 16 bit or 32 bit float.  Float samples are converted for
+// FLAC files.
+//
+//   pass: const void *samples
+//         int n                        number of samples
+// return: void
+//==============================================================================
+void audiofile_write (const void *samples, int n)
+{
+ const int16_t *s16 = samples;
+ const float *f32 = samples;
+ union { float f; uint32_t u; } v;
+ uint8_t buf[512 * 4];
+ int s;
+ int i;
+
+ if (audiofile.fp == NULL)
+    return;
+
+ audiofile.samples += n;
+
+ if (audiofile.flac)
+    {
+     for (i = 0; i < n; i++)
+        {
+         if (audio.format == AUDIO_F32SYS)
+            {
+             s = (int)(f32[i] * 32768.0f);
+             block[block_n++] = (s > 32767) ? 32767 :
+                                (s < -32768) ? -32768 : s;
+            }
+         else
+            block[block_n++] = s16[i];
+         if (block_n == AUDIOFILE_FLAC_BLOCK)
+            audiofile_flac_frame();
+        }
+     return;
+    }
+
+ // WAV data is little endian
+ while (n)
+    {
+     for (i = 0; i < n && i < 512; i++)
+        {
+         if (audiofile.flt)
+            {
+             v.f = f32[i];
+             buf[i * 4] = v.u & 0xff;
+             buf[i * 4 + 1] = (v.u >> 8) & 0xff;
+             buf[i * 4 + 2] = (v.u >> 16) & 0xff;
+             buf[i * 4 + 3] = (v.u >> 24) & 0xff;
+            }
+         else
+            {
+             buf[i * 2] = s16[i] & 0xff;
+             buf[i * 2 + 1] = (s16[i] >> 8) & 0xff;
+            }
+        }
+     fwrite(buf, audiofile.flt ? 4 : 2, i, audiofile.fp);
+     s16 += i;
+     f32 += i;
+     n -= i;
+    }
+}
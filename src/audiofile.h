@@ -0,0 +1,26 @@
+/* Audio File Sink Header */
+
+#ifndef HEADER_AUDIOFILE_H
+#define HEADER_AUDIOFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "ubee512.h"
+
+#define AUDIOFILE_FLAC_BLOCK 4096       // samples in each FLAC frame
+
+typedef struct audiofile_t
+{
+ char file[SSIZE1];             // output file name, WAV or FLAC (.flac)
+ FILE *fp;                      // output file if open
+ int flac;                      // file is FLAC rather than WAV
+ int flt;                       // samples are 32 bit float, else 16 bit
+ uint64_t samples;              // samples written
+}audiofile_t;
+
+int audiofile_open (void);
+int audiofile_close (void);
+void audiofile_write (const void *samples, int n);
+
+#endif     /* HEADER_AUDIOFILE_H */
@@ -31,6 +31,12 @@
  */
 //==============================================================================
 // ChangeLog (most recent entries are at top)
+// v6.0.0 - 16 October 2026, agent
+// - Added psg_snapshot() function for machine snapshots.
+// - psg_iterate() passes output level changes to the band limited step
+//   synthesizer (blep.c) in place of writing every sample to a circular
+//   buffer.
+//
 // v4.7.0 - 17 June 2010, K Duckmanton
 // - Initial implementation
 //==============================================================================
@@ -46,8 +52,10 @@ static const char rcs_id[]="$Id: ay38910.c,v 1.1.1.4 2011/03/27 06:04:42 krd Exp
 
 #include "ubee512.h"
 #include "audio.h"
+#include "blep.h"
 #include "function.h"
 #include "ay38910.h"
+#include "snapshot.h"
 
 #define PSG_COUNTER_RELOAD 0
 
@@ -78,13 +86,12 @@ int psg_init(ay_3_8910_t *psg)
  /* set the initial state of all noise and tone bits to 1, to allow
   * the noise mixing logic to work correctly */
  psg->state = PSG_CHANNEL_A | PSG_CHANNEL_B | PSG_CHANNEL_C | PSG_NOISE_BIT;
- audio_circularbuf_init(&psg->scratch);
- return 0;
+ return blep_init(&psg->blep);
 }
 
 int psg_deinit(ay_3_8910_t *psg)
 {
- audio_circularbuf_deinit(&psg->scratch);
+ blep_deinit(&psg->blep);
  return 0;
 }
 
@@ -456,33 +463,45 @@ int psg_tick(ay_3_8910_t *psg)
 }
 
 /* ======================================================================== */
-/*  PSG_ITERATE -- generate the requested number of samples into the
- *  sample buffer.  Returns the number of samples actually generated,
- *  or -1 if the sample buffer is full and needs to be drained.  */
+/*  PSG_ITERATE -- run the requested number of sample periods.  Only the
+ *  changes of the output level are passed on, to the band limited step
+ *  synthesizer, which renders them at the output sample rate.  */
 /* ======================================================================== */
-int psg_iterate(ay_3_8910_t *psg, int samples)
+void psg_iterate(ay_3_8910_t *psg, int samples)
 {
- int do_samp;
-
- if (samples <= 0)
-    return 0;           /* no samples to generate! */
- audio_circularbuf_normalise(&psg->scratch, AUDIO_CIRCULARBUF_MASK);
- do_samp = audio_circularbuf_samples_remaining(&psg->scratch,
-                                               AUDIO_CIRCULARBUF_SIZE);
- // the circular buffer is deemed to be full when only 1 sample is
- // left - i.e. head is just behind tail
- if (do_samp <= 1)
-    return -1;          /* sample buffer is full */
- if (do_samp > samples)
-    do_samp = samples;  /* generate no more samples than
-                         * requested (but can generate
-                         * fewer!) */
- assert(do_samp > 0 && do_samp <= samples &&
-        do_samp < AUDIO_CIRCULARBUF_SIZE);
- samples = do_samp;
- while (do_samp--)
-    audio_circularbuf_put_sample(&psg->scratch,
-                                 AUDIO_CIRCULARBUF_MASK,
-                                 psg_tick(psg));
- return samples;
+ while (samples-- > 0)
+    {
+     int level = psg_tick(psg);
+
+     blep_level(&psg->blep, ++psg->ticks, level);
+    }
+}
+
+/* ======================================================================== */
+/*  PSG_SNAPSHOT -- save or load the registers, generator and envelope
+ *  state as part of the owning peripheral's snapshot chunk.  Output
+ *  level changes not yet rendered are discarded on loading.  */
+/* ======================================================================== */
+void psg_snapshot(ay_3_8910_t *psg)
+{
+ int i;
+
+ snapshot_data(psg->reg, sizeof(psg->reg));
+ for (i = 0; i < 3; i++)
+    {
+     snapshot_u16(&psg->tone_current[i]);
+     snapshot_u16(&psg->tone_per[i]);
+    }
+ snapshot_u8(&psg->noise_current);
+ snapshot_u8(&psg->noise_per);
+ snapshot_u16(&psg->envelope_current);
+ snapshot_u16(&psg->envelope_per);
+ snapshot_u8(&psg->state);
+ snapshot_u8(&psg->envelope_state);
+ snapshot_u8(&psg->envelope_amplitude);
+ snapshot_u32(&psg->noise);
+ snapshot_u64(&psg->ticks);
+
+ if (snapshot_loading())
+    blep_clear(&psg->blep, psg->ticks);
 }
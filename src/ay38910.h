@@ -86,8 +86,9 @@ typedef struct ay_3_8910_t {
     // noise generator register
     uint32_t noise;
 
-    // buffer for samples
-    audio_circularbuf_t scratch;
+    // output level changes and the sample period count they are at
+    blep_t blep;
+    uint64_t ticks;
 } ay_3_8910_t;
 
 int psg_init(ay_3_8910_t *psg);
@@ -97,9 +98,14 @@ uint8_t psg_r(ay_3_8910_t *psg, uint8_t reg);
 void psg_w(ay_3_8910_t *psg, uint8_t reg, uint8_t data);
 
 /* ======================================================================== */
-/*  PSG_ITERATE -- generate the requested number of samples into the
- *  sample buffer  */
+/*  PSG_ITERATE -- run the requested number of sample periods, passing
+ *  output level changes to the band limited step synthesizer  */
 /* ======================================================================== */
-int psg_iterate(ay_3_8910_t *psg, int samples);
+void psg_iterate(ay_3_8910_t *psg, int samples);
+
+/* ======================================================================== */
+/*  PSG_SNAPSHOT -- save or load the PSG state for a machine snapshot       */
+/* ======================================================================== */
+void psg_snapshot(ay_3_8910_t *psg);
 
 #endif /* _ay38910_h */
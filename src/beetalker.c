@@ -9,11 +9,13 @@
 
 #include "ubee512.h"
 #include "audio.h"
+#include "audiofile.h"
 #include "sp0256.h"
 #include "parint.h"
 #include "beetalker.h"
 #include "z80api.h"
 #include "pio.h"
+#include "snapshot.h"
 
 //==============================================================================
 // constants
@@ -40,11 +42,16 @@ void beetalker_w (uint8_t data);
 uint8_t beetalker_r(void);
 void beetalker_ready(void);
 int beetalker_worker(void *data);
+int beetalker_tick(audio_scratch_t *buf, const void *data,
+                   uint64_t start, uint64_t cycles);
+void beetalker_snapshot (void);
 
 //==============================================================================
 // structures and variables
 //==============================================================================
 extern audio_t audio;
+extern audiofile_t audiofile;
+extern emu_t emu;
 
 beetalker_t beetalker;
 
@@ -57,6 +64,7 @@ parint_ops_t beetalker_ops = {
  .strobe = &pio_porta_strobe,
  .read = NULL,
  .write = &beetalker_w,
+ .snapshot = &beetalker_snapshot,
 };
 
 extern modio_t modio;
@@ -95,6 +103,24 @@ int beetalker_init (void)
  audio_circularbuf_set_decay_constant(&beetalker.sp0256.scratch,
                                       0);
 
+ beetalker.sp0256_mutex = SDL_CreateMutex();
+
+ /* -------------------------------------------------------------------- */
+ /*  When writing an audio file the samples are generated in step with   */
+ /*  the Z80 so the speech is timed the same at any emulation speed.     */
+ /* -------------------------------------------------------------------- */
+ if (audiofile.fp)
+    {
+     beetalker.remainder = 0;
+     if (audio_register(&beetalker.snd_buf,
+                        "beetalker",
+                        beetalker_tick, NULL,
+                        NULL,   /* sound pitch is independent of CPU speed */
+                        1, 0))
+        return -1;
+     return 0;
+    }
+
  /* -------------------------------------------------------------------- */
  /*  Register this as a sound peripheral with the SND driver.            */
  /* -------------------------------------------------------------------- */
@@ -108,7 +134,6 @@ int beetalker_init (void)
  /* -------------------------------------------------------------------- */
  /*  Fire off a worker thread to continuously generate samples.          */
  /* -------------------------------------------------------------------- */
- beetalker.sp0256_mutex = SDL_CreateMutex();
  beetalker.workerthread = SDL_CreateThread(beetalker_worker, NULL);
  if (!beetalker.workerthread)
     return -1;
@@ -178,6 +203,29 @@ void beetalker_ready(void)
  SDL_UnlockMutex(beetalker.sp0256_mutex);
 }
 
+//==============================================================================
+// Save or load the BeeTalker state for a machine snapshot.
+//
+// The SP0256 is locked so the worker thread is not part way through
+// generating samples while its state is changed.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void beetalker_snapshot (void)
+{
+ if (snapshot_chunk("TALK"))
+    return;
+
+ SDL_LockMutex(beetalker.sp0256_mutex);
+
+ snapshot_u8(&beetalker.data);
+ snapshot_u64(&beetalker.remainder);
+ sp0256_snapshot(&beetalker.sp0256);
+
+ SDL_UnlockMutex(beetalker.sp0256_mutex);
+}
+
 //==============================================================================
 // Beetalker worker thread.  Continuously runs the sp0256 core generating
 // samples for the sound thread to pick up.
@@ -228,3 +276,44 @@ int beetalker_worker(void *data)
 
  return 0;                      /* successful termination */
 }
+
+//==============================================================================
+// Beetalker tick.  Used instead of the worker thread when writing an audio
+// file, generates the samples for the Z80 cycles that have passed.
+//
+//   pass: audio_scratch_t *buf
+//         const void *data
+//         uint64_t start               Z80 T-state count at the start
+//         uint64_t cycles              number of T-states to generate
+// return: int                          0
+//==============================================================================
+int beetalker_tick(audio_scratch_t *buf, const void *data,
+                   uint64_t start, uint64_t cycles)
+{
+ uint64_t n;
+ int samples;
+ int r;
+
+ if (emu.cpuclock == 0)
+    return 0;
+
+ n = cycles * BEETALKER_SAMPLE_RATE + beetalker.remainder;
+ beetalker.remainder = n % emu.cpuclock;
+ samples = n / emu.cpuclock;
+
+ while (samples > 0)
+    {
+     r = sp0256_iterate(&beetalker.sp0256, samples);
+     if (r == -2)
+        beetalker_strobe(); /* the speech processor can accept more data */
+     else if (r == -1)
+        audio_drain_samples(buf, &beetalker.sp0256.scratch);
+     else if (r == 0 && beetalker.sp0256.halted)
+        break;              /* nothing to say */
+     else if (r > 0)
+        samples -= r;
+    }
+
+ audio_drain_samples(buf, &beetalker.sp0256.scratch);
+ return 0;
+}
@@ -6,6 +6,8 @@ typedef struct {
    SDL_Thread *workerthread;
    int terminate;               /* flag set if the worker thread is to terminate */
    uint32_t workerthreadid;     /* thread ID of the worker thread. */
+   uint64_t remainder;          /* CPU clocks not yet converted to samples,
+                                 * scaled by the sample rate */
 
    audio_scratch_t snd_buf;        /* Sound circular buffer.                        */
 
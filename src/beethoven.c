@@ -33,6 +33,11 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added beethoven_snapshot() function for machine snapshots.
+// - The AY-3-8910 output level changes are rendered by the band limited
+//   step synthesizer (blep.c) once per block of Z80 instructions.
+//
 // v5.0.0 - 13 July 2010, K Duckmanton
 // - Removed all references to the 'sound' global variable and replaced them
 //   with references to the 'audio' global instead.
@@ -54,11 +59,13 @@
 
 #include "ubee512.h"
 #include "audio.h"
+#include "blep.h"
 #include "ay38910.h"
 #include "parint.h"
 #include "beethoven.h"
 #include "z80api.h"
 #include "pio.h"
+#include "snapshot.h"
 
 //==============================================================================
 // constants
@@ -82,10 +89,9 @@ void beethoven_strobe (void);
 void beethoven_w (uint8_t data);
 uint8_t beethoven_r(void);
 void beethoven_ready(void);
-void beethoven_drain_samples(audio_scratch_t *a, audio_circularbuf_t *cb);
-void beethoven_init_rate_conversion(audio_circularbuf_t *cb, int dst_rate, int src_rate);
 int beethoven_tick(audio_scratch_t *a, const void *data,
                    uint64_t start, uint64_t cycles);
+void beethoven_snapshot (void);
 
 //==============================================================================
 // structures and variables
@@ -103,6 +109,7 @@ parint_ops_t beethoven_ops = {
  .strobe = NULL,                // Not used, see comments in beethoven_ready()
  .read = &beethoven_r,
  .write = &beethoven_w,
+ .snapshot = &beethoven_snapshot,
 };
 
 extern modio_t modio;
@@ -152,12 +159,8 @@ int beethoven_init (void)
                     ))
     return -1;
 
- audio_circularbuf_set_rate_conversion(&beethoven.ay_3_8910.scratch,
-                                       audio.frequency,
-                                       BEETHOVEN_SAMPLE_RATE);
-
- audio_circularbuf_set_decay_constant(&beethoven.ay_3_8910.scratch,
-                                      BEETHOVEN_DECAY_CONSTANT);
+ blep_set_rate(&beethoven.ay_3_8910.blep, BEETHOVEN_SAMPLE_RATE);
+ blep_set_decay_constant(&beethoven.ay_3_8910.blep, BEETHOVEN_DECAY_CONSTANT);
 
  return 0;                      /* success! */
 }
@@ -271,6 +274,68 @@ void beethoven_ready(void)
  beethoven.addrsel = !beethoven.addrsel; /* address flipflop */
 }
 
+//==============================================================================
+// Save or load the Beethoven state for a machine snapshot.
+//
+// The AY register writes not yet applied by beethoven_tick() are kept with
+// the AY-3-8910 state.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void beethoven_snapshot (void)
+{
+ beethoven_t *b = &beethoven;
+ ay_update_le_t *p;
+ uint32_t count = 0;
+
+ if (snapshot_chunk("BEET"))
+    return;
+
+ snapshot_u8(&b->addrsel);
+ snapshot_u8(&b->address);
+ snapshot_u64(&b->cycles_remainder);
+ psg_snapshot(&b->ay_3_8910);
+
+ for (p = b->ay_update_head; p; p = p->next)
+    count++;
+ snapshot_u32(&count);
+
+ if (! snapshot_loading())
+    {
+     for (p = b->ay_update_head; p; p = p->next)
+        {
+         snapshot_u64(&p->when);
+         snapshot_u8(&p->address);
+         snapshot_u8(&p->data);
+        }
+     return;
+    }
+
+ while (b->ay_update_head)
+    {
+     p = b->ay_update_head->next;
+     free(b->ay_update_head);
+     b->ay_update_head = p;
+    }
+ b->ay_update_tail = NULL;
+
+ while (count-- && ! snapshot_failed())
+    {
+     p = malloc(sizeof(*p));
+     snapshot_u64(&p->when);
+     snapshot_u8(&p->address);
+     snapshot_u8(&p->data);
+     p->next = NULL;
+
+     if (!b->ay_update_head)
+        b->ay_update_head = p;
+     else
+        b->ay_update_tail->next = p;
+     b->ay_update_tail = p;
+    }
+}
+
 //==============================================================================
 // Beethoven tick function.  Registered as a callback function in
 // beethoven_init() and called by audio_sources_update()
@@ -319,52 +384,47 @@ int beethoven_tick(audio_scratch_t *buf, const void *data,
  // now generate samples
  while (num_samples)
     {
-     int samples_generated;
      int n;
      ay_update_le_t *ayup, *ayuq;
 
-     audio_drain_samples(&b->snd_buf, &b->ay_3_8910.scratch);
-     do {
-      /* apply all register updates that are due. */
-      for (ayup = b->ay_update_head;
-           ayup && ayup->when <= frame_start;)
-         {
-          if (modio.beethoven)
-             {
-              xprintf("Beethoven: register update (z80 tstates %llu) r%02o = %02x\n",
-                      ayup->when, ayup->address, ayup->data);
-             }
-          psg_w(&b->ay_3_8910, ayup->address, ayup->data);
-          ayuq = ayup->next;
-          free(ayup);
-          ayup = ayuq;
-         }
-      b->ay_update_head = ayup;
-      if (ayup == NULL)         /* list now empty */
-         b->ay_update_tail = ayup;
-      if (ayup == NULL)
-         n = num_samples;       /* generate the requested number of
-                                 * samples */
-      else
-         {
-          /* ceil((when - frame_start) / ticks_per_sample) */
-          n = (ayup->when - frame_start +
-               ticks_per_sample - 1) / ticks_per_sample;
-          if (n > num_samples)
-             n = num_samples;   /* generate no more than the number of
-                                 * samples originally requested */
-         }
-      samples_generated = psg_iterate(&b->ay_3_8910, n);
-      if (samples_generated <= 0)
-         ;                      /* the buffer needs draining */
-      else
-         {
-          frame_start += samples_generated * ticks_per_sample;
-          num_samples -= samples_generated;
-         }
-     } while (samples_generated > 0);
+     /* apply all register updates that are due. */
+     for (ayup = b->ay_update_head;
+          ayup && ayup->when <= frame_start;)
+        {
+         if (modio.beethoven)
+            {
+             xprintf("Beethoven: register update (z80 tstates %llu) r%02o = %02x\n",
+                     ayup->when, ayup->address, ayup->data);
+            }
+         psg_w(&b->ay_3_8910, ayup->address, ayup->data);
+         ayuq = ayup->next;
+         free(ayup);
+         ayup = ayuq;
+        }
+     b->ay_update_head = ayup;
+     if (ayup == NULL)         /* list now empty */
+        b->ay_update_tail = ayup;
+     if (ayup == NULL)
+        n = num_samples;       /* generate the requested number of
+                                * samples */
+     else
+        {
+         /* ceil((when - frame_start) / ticks_per_sample) */
+         n = (ayup->when - frame_start +
+              ticks_per_sample - 1) / ticks_per_sample;
+         if (n > num_samples)
+            n = num_samples;   /* generate no more than the number of
+                                * samples originally requested */
+        }
+     psg_iterate(&b->ay_3_8910, n);
+     frame_start += n * ticks_per_sample;
+     num_samples -= n;
     }
 
+ // render this block's samples
+ blep_end_frame(&b->ay_3_8910.blep, b->ay_3_8910.ticks);
+ blep_read(&b->ay_3_8910.blep, &b->snd_buf);
+
  return 1;                      /* beethoven always generates
                                  * output */
 }
@@ -0,0 +1,371 @@
+//******************************************************************************
+//*                                  uBee512                                   *
+//*       An emulator for the Microbee Z80 ROM, FDD and HDD based models       *
+//*                                                                            *
+//*                  Band limited step (BLEP) synthesis module                 *
+//*                                                                            *
+//*                          Copyright (C) 2026 agent                          *
+//******************************************************************************
+//
+// Audio sources that only produce square waves or hold a level between
+// writes (the speaker, DACs and the tone and noise generators of the sound
+// chips) are described by the times at which their output level changes.
+//
+// Rather than stepping the output once per sample, a source passes each
+// level change with the input clock (T-state or chip clock) it happened at
+// to blep_step().  The change is added into a buffer of output sample
+// deltas as a windowed sinc impulse placed at the exact sub-sample
+// position, so the integrated output is a band limited step with no energy
+// above the output Nyquist frequency.  Changes far shorter than a sample
+// period, as produced at high Z80 clock rates, no longer alias.
+//
+// Once per block of Z80 instructions the source marks the end of the
+// block with blep_end_frame() and blep_read() integrates the completed
+// samples into the source's audio work buffers in one pass.
+//
+// The impulse is tabled for BLEP_PHASES sub-sample positions with
+// BLEP_TAPS taps each, every phase summing exactly to 1 << BLEP_SHIFT so
+// the output settles on the input level with no drift.  The output is
+// delayed by BLEP_TAPS/2 samples.  Samples are written to the work
+// buffers with AUDIO_SHIFT bits of fraction below the input level so the
+// filtered edges are not rounded back to whole level steps.
+//
+//==============================================================================
+/*
+ *  uBee512 - An emulator for the Microbee Z80 ROM, FDD and HDD based models.
+ *  Copyright (C) 2026 agent
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+//==============================================================================
+// ChangeLog (most recent entries are at top)
+//==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Created a new file to synthesize band limited steps for the audio
+//   sources.
+//==============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "blep.h"
+#include "audio.h"
+#include "ubee512.h"
+
+//==============================================================================
+// constants
+//==============================================================================
+#define BLEP_PI     3.14159265358979323846
+#define BLEP_CUTOFF 0.90        // pass band as a fraction of Nyquist
+
+//==============================================================================
+// structures and variables
+//==============================================================================
+extern audio_t audio;
+
+static int32_t kernel[BLEP_PHASES][BLEP_TAPS];
+static int kernel_made;
+
+//==============================================================================
+// Sine by Taylor series, only used to build the kernel so libm isn't
+// needed.
+//
+//   pass: double x                     angle in radians
+// return: double                       sin(x)
+//==============================================================================
+static double blep_sin (double x)
+{
+ double x2;
+ double term;
+ double sum;
+ int i;
+
+ while (x > BLEP_PI)
+    x -= 2 * BLEP_PI;
+ while (x < -BLEP_PI)
+    x += 2 * BLEP_PI;
+
+ x2 = x * x;
+ sum = term = x;
+ for (i = 1; i < 12; i++)
+    {
+     term *= -x2 / ((2 * i) * (2 * i + 1));
+     sum += term;
+    }
+ return sum;
+}
+
+//==============================================================================
+// Build the impulse kernel.  Each phase is a Blackman windowed sinc
+// centred BLEP_TAPS/2 plus the phase fraction taps in, scaled to sum to
+// exactly 1 << BLEP_SHIFT.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void blep_make_kernel (void)
+{
+ double h[BLEP_TAPS];
+ double t;
+ double w;
+ double total;
+ int sum;
+ int max;
+ int p;
+ int i;
+
+ for (p = 0; p < BLEP_PHASES; p++)
+    {
+     total = 0;
+     for (i = 0; i < BLEP_TAPS; i++)
+        {
+         t = i - (BLEP_TAPS / 2 + (double)p / BLEP_PHASES);
+         w = t / (BLEP_TAPS / 2);
+         if (w <= -1.0 || w >= 1.0)
+            w = 0;
+         else
+            w = 0.42 + 0.5 * blep_sin(BLEP_PI * w + BLEP_PI / 2) +
+                0.08 * blep_sin(2 * BLEP_PI * w + BLEP_PI / 2);
+         if (t == 0)
+            h[i] = BLEP_CUTOFF;
+         else
+            h[i] = blep_sin(BLEP_PI * BLEP_CUTOFF * t) / (BLEP_PI * t);
+         h[i] *= w;
+         total += h[i];
+        }
+
+     sum = 0;
+     max = 0;
+     for (i = 0; i < BLEP_TAPS; i++)
+        {
+         kernel[p][i] = (int32_t)(h[i] / total * (1 << BLEP_SHIFT) +
+                                  (h[i] < 0 ? -0.5 : 0.5));
+         sum += kernel[p][i];
+         if (kernel[p][i] > kernel[p][max])
+            max = i;
+        }
+     // put the rounding error on the largest tap
+     kernel[p][max] += (1 << BLEP_SHIFT) - sum;
+    }
+ kernel_made = 1;
+}
+
+//==============================================================================
+// BLEP initialise.  The input clock rate is 0 until blep_set_rate() is
+// called and until then no time passes.
+//
+//   pass: blep_t *b
+// return: int                          0 if success, -1 if error
+//==============================================================================
+int blep_init (blep_t *b)
+{
+ if (! kernel_made)
+    blep_make_kernel();
+
+ memset(b, 0, sizeof(*b));
+ b->buf = calloc(BLEP_BUFFER_SIZE + BLEP_TAPS, sizeof(int32_t));
+ if (b->buf == NULL)
+    return -1;
+ return 0;
+}
+
+//==============================================================================
+// BLEP de-initialise.
+//
+//   pass: blep_t *b
+// return: int                          0
+//==============================================================================
+int blep_deinit (blep_t *b)
+{
+ free(b->buf);
+ b->buf = NULL;
+ return 0;
+}
+
+//==============================================================================
+// Set the input clock rate, the output rate is the audio frequency.  The
+// caller should mark the end of a frame first if time has passed at the
+// old rate.
+//
+//   pass: blep_t *b
+//         int clock                    input clocks per second
+// return: void
+//==============================================================================
+void blep_set_rate (blep_t *b, int clock)
+{
+ if (clock <= 0)
+    {
+     b->factor = 0;
+     b->clocks_max = 0;
+     return;
+    }
+
+ b->factor = ((uint64_t)audio.frequency << 32) / clock;
+ if (b->factor)
+    b->clocks_max = ((uint64_t)BLEP_BUFFER_SIZE << 32) / b->factor;
+ else
+    b->clocks_max = 0;
+}
+
+//==============================================================================
+// Set the time constant the output decays towards 0 with.  Square wave
+// sources would otherwise hold a DC level while idle.
+//
+//   pass: blep_t *b
+//         int tau                      time constant in ms, 0 for none
+// return: void
+//==============================================================================
+void blep_set_decay_constant (blep_t *b, int tau)
+{
+ b->tau = audio.frequency * tau / 1000;
+}
+
+//==============================================================================
+// Discard all pending output and restart from a level of 0 at the time
+// passed.
+//
+//   pass: blep_t *b
+//         uint64_t time                input clock to restart from
+// return: void
+//==============================================================================
+void blep_clear (blep_t *b, uint64_t time)
+{
+ memset(b->buf, 0, (BLEP_BUFFER_SIZE + BLEP_TAPS) * sizeof(int32_t));
+ b->offset = 0;
+ b->time = time;
+ b->avail = 0;
+ b->level = 0;
+ b->sum = 0;
+ b->decay = 0;
+}
+
+//==============================================================================
+// Position of an input clock time in output samples from the time mark.
+// Times before the mark are taken as the mark and times past the end of
+// the buffer as its end.
+//
+//   pass: blep_t *b
+//         uint64_t time
+// return: uint64_t                     32.32 fixed point sample position
+//==============================================================================
+static uint64_t blep_position (blep_t *b, uint64_t time)
+{
+ uint64_t clocks = 0;
+
+ if (time > b->time)
+    clocks = time - b->time;
+ if (clocks > b->clocks_max)
+    clocks = b->clocks_max;
+ return b->offset + clocks * b->factor;
+}
+
+//==============================================================================
+// Add a level change at an input clock time.
+//
+//   pass: blep_t *b
+//         uint64_t time                input clock of the change
+//         int delta                    change in level
+// return: void
+//==============================================================================
+void blep_step (blep_t *b, uint64_t time, int delta)
+{
+ uint64_t pos;
+ int32_t *out;
+ int32_t *k;
+ int i;
+
+ pos = blep_position(b, time);
+ i = b->avail + (int)(pos >> 32);
+ if (i > BLEP_BUFFER_SIZE)
+    i = BLEP_BUFFER_SIZE;
+
+ out = b->buf + i;
+ k = kernel[(pos >> (32 - BLEP_PHASE_BITS)) & (BLEP_PHASES - 1)];
+ for (i = 0; i < BLEP_TAPS; i++)
+    out[i] += k[i] * delta;
+}
+
+//==============================================================================
+// Mark the end of a frame, the output samples up to the time passed become
+// available to blep_read().
+//
+//   pass: blep_t *b
+//         uint64_t time                input clock at the end of the frame
+// return: void
+//==============================================================================
+void blep_end_frame (blep_t *b, uint64_t time)
+{
+ uint64_t pos;
+
+ pos = blep_position(b, time);
+ b->avail += (int)(pos >> 32);
+ if (b->avail > BLEP_BUFFER_SIZE)
+    b->avail = BLEP_BUFFER_SIZE;
+ b->offset = pos & 0xffffffff;
+ if (time > b->time)
+    b->time = time;
+}
+
+//==============================================================================
+// Integrate the available samples into the audio source's work buffers.
+// Full work buffers are passed on, the last one is left under
+// construction.
+//
+//   pass: blep_t *b
+//         audio_scratch_t *a
+// return: int                          number of samples written
+//==============================================================================
+int blep_read (blep_t *b, audio_scratch_t *a)
+{
+ int32_t *in = b->buf;
+ int n = b->avail;
+ int count;
+ int s;
+
+ while (in < b->buf + n)
+    {
+     if (! audio_has_work_buffer(a))
+        audio_get_work_buffer(a);
+     count = audio_space_remaining(a);
+     if (count > b->buf + n - in)
+        count = b->buf + n - in;
+     while (count--)
+        {
+         b->sum += *in++;
+         s = b->sum / (1 << (BLEP_SHIFT - AUDIO_SHIFT));
+         if (b->tau)
+            {
+             b->decay -= (s * (1 << 8) + b->decay) / b->tau;
+             s += b->decay / (1 << 8);
+            }
+         audio_put_sample(a, audio_limit(s));
+        }
+     if (audio_space_remaining(a) == 0)
+        audio_put_work_buffer(a);
+    }
+
+ // move the impulse tails still to be read to the front
+ if (n)
+    {
+     memmove(b->buf, b->buf + n,
+             (BLEP_BUFFER_SIZE + BLEP_TAPS - n) * sizeof(int32_t));
+     memset(b->buf + BLEP_BUFFER_SIZE + BLEP_TAPS - n, 0,
+            n * sizeof(int32_t));
+    }
+ b->avail = 0;
+ return n;
+}
@@ -0,0 +1,49 @@
+/* Band Limited Step Synthesis Header */
+
+#ifndef HEADER_BLEP_H
+#define HEADER_BLEP_H
+
+#include <stdint.h>
+
+#include "audio.h"
+
+#define BLEP_PHASE_BITS  5
+#define BLEP_PHASES      (1 << BLEP_PHASE_BITS)
+#define BLEP_TAPS        16
+#define BLEP_SHIFT       15
+#define BLEP_BUFFER_SIZE 4096
+
+typedef struct blep_t
+{
+ int32_t *buf;                  // level changes, one entry per output sample
+ uint64_t factor;               // output samples per input clock (32.32)
+ uint64_t clocks_max;           // input clocks filling the buffer
+ uint64_t offset;               // sample fraction at the time mark (0.32)
+ uint64_t time;                 // input clock of the time mark
+ int avail;                     // whole samples ready to be read
+ int level;                     // current input level
+ int32_t sum;                   // output integrator
+ int tau;                       // decay time constant in samples, 0=none
+ int decay;
+}blep_t;
+
+int blep_init (blep_t *b);
+int blep_deinit (blep_t *b);
+void blep_set_rate (blep_t *b, int clock);
+void blep_set_decay_constant (blep_t *b, int tau);
+void blep_clear (blep_t *b, uint64_t time);
+void blep_step (blep_t *b, uint64_t time, int delta);
+void blep_end_frame (blep_t *b, uint64_t time);
+int blep_read (blep_t *b, audio_scratch_t *a);
+
+/* change the input level at an input clock time */
+static inline void blep_level (blep_t *b, uint64_t time, int level)
+{
+ if (level != b->level)
+    {
+     blep_step(b, time, level - b->level);
+     b->level = level;
+    }
+}
+
+#endif     /* HEADER_BLEP_H */
@@ -0,0 +1,655 @@
+//******************************************************************************
+//*                                  uBee512                                   *
+//*       An emulator for the Microbee Z80 ROM, FDD and HDD based models       *
+//*                                                                            *
+//*                            Frame capture module                            *
+//*                                                                            *
+//*                          Copyright (C) 2026 agent                          *
+//******************************************************************************
+//
+// Captures displayed frames to files so the screen output can be checked
+// without a display, such as when running under CI with the off screen
+// video type (--video-type=offscreen).
+//
+// A frame is captured every --capture-every frames, when the screen RAM
+// or the CRTC display registers have changed (--capture-changed) and when
+// --capture-frame is used.  The --capture-format may be:
+//
+// png  : each frame is written to its own PNG file.  The frame number
+//        replaces a '%d' in the file name, otherwise it's added before the
+//        extension.  The image data is compressed with zlib when uBee512 is
+//        built with it, otherwise stored.
+// raw  : frames are appended to the file as 24 bit RGB pixels with no
+//        header, the frame size is reported when the file is opened.  The
+//        file may be a named pipe read by a video encoder.
+// text : the displayed characters are taken straight from the screen RAM
+//        and appended to the file, each frame preceded by a frame line.
+//
+// When the render thread is in use the frame captured is the last one it
+// has drawn.
+//
+//==============================================================================
+/*
+ *  uBee512 - An emulator for the Microbee Z80 ROM, FDD and HDD based models.
+ *  Copyright (C) 2026 agent
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+//==============================================================================
+// ChangeLog (most recent entries are at top)
+//==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Created a new file to capture frames as PNG, raw RGB or text.
+//==============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#ifdef USE_ZZLIB
+#include <zlib.h>
+#endif
+
+#include "capture.h"
+#include "ubee512.h"
+#include "support.h"
+#include "crtc.h"
+#include "vdu.h"
+#include "video.h"
+#include "render.h"
+
+//==============================================================================
+// constants
+//==============================================================================
+#define CAPTURE_TEXT_MAX 256    // most characters in a text line
+
+//==============================================================================
+// structures and variables
+//==============================================================================
+capture_t capture;
+
+static FILE *stream;            // raw or text stream
+static char stream_file[SSIZE1];
+static int stream_format;
+static int stream_w;
+static int stream_h;
+
+static int frame;               // frames seen
+
+static crtc_frame_t last_crtc;
+static struct
+{
+ uint8_t scr_ram[SCR_RAM_SIZE];
+ uint8_t col_ram[COL_RAM_SIZE];
+ uint8_t att_ram[ATT_RAM_SIZE];
+ uint8_t pcg_ram[PCG_RAM_SIZE];
+}last;
+
+static uint8_t *image;          // RGB rows
+static int image_size;
+static uint8_t *packed;         // zlib stream of the PNG rows
+static int packed_size;
+
+static uint32_t crc_table[256];
+
+extern SDL_Surface *screen;
+extern vdu_t vdu;
+extern video_t video;
+
+//==============================================================================
+// Capture initialise.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int capture_init (void)
+{
+ uint32_t c;
+ int i;
+ int j;
+
+ for (i = 0; i < 256; i++)
+    {
+     c = i;
+     for (j = 0; j < 8; j++)
+        c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+     crc_table[i] = c;
+    }
+
+ return 0;
+}
+
+//==============================================================================
+// Capture de-initialise.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int capture_deinit (void)
+{
+ if (stream)
+    {
+     fclose(stream);
+     stream = NULL;
+    }
+
+ free(image);
+ free(packed);
+ image = packed = NULL;
+ image_size = packed_size = 0;
+
+ return 0;
+}
+
+//==============================================================================
+// Capture reset.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int capture_reset (void)
+{
+ return 0;
+}
+
+//==============================================================================
+// Make sure a buffer is at least the size needed.
+//
+//   pass: uint8_t **buf                buffer
+//         int *have                    current buffer size
+//         int size                     size needed
+// return: int                          0 if no error, -1 if error
+//==============================================================================
+static int capture_buffer (uint8_t **buf, int *have, int size)
+{
+ uint8_t *p;
+
+ if (size <= *have)
+    return 0;
+
+ p = realloc(*buf, size);
+ if (! p)
+    {
+     xprintf("capture: Unable to allocate memory\n");
+     return -1;
+    }
+ *buf = p;
+ *have = size;
+
+ return 0;
+}
+
+//==============================================================================
+// Check if the screen has changed since the last frame.
+//
+// The screen, colour, attribute and PCG RAM and the CRTC display values are
+// compared with copies from the last frame and the copies are updated.
+//
+//   pass: crtc_frame_t *f              CRTC display values
+// return: int                          1 if changed, else 0
+//==============================================================================
+static int capture_changed (crtc_frame_t *f)
+{
+ int changed;
+
+ changed = (f->video != last_crtc.video) ||
+           (f->disp_start != last_crtc.disp_start) ||
+           (f->hdisp != last_crtc.hdisp) ||
+           (f->vdisp != last_crtc.vdisp) ||
+           (f->scans_per_row != last_crtc.scans_per_row) ||
+           memcmp(f->row_start, last_crtc.row_start, sizeof(f->row_start));
+ last_crtc = *f;
+
+ if (memcmp(last.scr_ram, vdu.scr_ram, sizeof(last.scr_ram)))
+    {
+     memcpy(last.scr_ram, vdu.scr_ram, sizeof(last.scr_ram));
+     changed = 1;
+    }
+ if (memcmp(last.col_ram, vdu.col_ram, sizeof(last.col_ram)))
+    {
+     memcpy(last.col_ram, vdu.col_ram, sizeof(last.col_ram));
+     changed = 1;
+    }
+ if (memcmp(last.att_ram, vdu.att_ram, sizeof(last.att_ram)))
+    {
+     memcpy(last.att_ram, vdu.att_ram, sizeof(last.att_ram));
+     changed = 1;
+    }
+ if (memcmp(last.pcg_ram, vdu.pcg_ram, sizeof(last.pcg_ram)))
+    {
+     memcpy(last.pcg_ram, vdu.pcg_ram, sizeof(last.pcg_ram));
+     changed = 1;
+    }
+
+ return changed;
+}
+
+//==============================================================================
+// Convert the displayed part of the screen surface to 24 bit RGB rows.
+//
+// The render lock must be held.
+//
+//   pass: uint8_t *d                   destination
+//         int w                        width in pixels
+//         int h                        height in pixels
+//         int filter                   put a PNG filter byte before each row
+// return: void
+//==============================================================================
+static void capture_rgb (uint8_t *d, int w, int h, int filter)
+{
+ SDL_PixelFormat *f = screen->format;
+ SDL_Color *c;
+ uint8_t *p;
+ uint32_t v;
+ int x;
+ int y;
+
+ if (SDL_MUSTLOCK(screen))
+    SDL_LockSurface(screen);
+
+ for (y = 0; y < h; y++)
+    {
+     p = (uint8_t *)screen->pixels + y * screen->pitch;
+     if (filter)
+        *d++ = 0;
+     switch (f->BytesPerPixel)
+        {
+         case 1 :
+            for (x = 0; x < w; x++)
+               {
+                c = &f->palette->colors[p[x]];
+                *d++ = c->r;
+                *d++ = c->g;
+                *d++ = c->b;
+               }
+            break;
+         default :
+            for (x = 0; x < w; x++)
+               {
+                switch (f->BytesPerPixel)
+                   {
+                    case 2 :
+                       v = ((uint16_t *)p)[x];
+                       break;
+                    case 3 :
+                       v = p[x*3] | (p[x*3+1] << 8) | (p[x*3+2] << 16);
+                       break;
+                    default :
+                       v = ((uint32_t *)p)[x];
+                       break;
+                   }
+                *d++ = ((v & f->Rmask) >> f->Rshift) << f->Rloss;
+                *d++ = ((v & f->Gmask) >> f->Gshift) << f->Gloss;
+                *d++ = ((v & f->Bmask) >> f->Bshift) << f->Bloss;
+               }
+            break;
+        }
+    }
+
+ if (SDL_MUSTLOCK(screen))
+    SDL_UnlockSurface(screen);
+}
+
+//==============================================================================
+// Compress the PNG rows into a zlib stream.
+//
+// If zlib is not available the rows are stored in uncompressed deflate
+// blocks, this is still a valid zlib stream and costs little more than a
+// copy.
+//
+//   pass: int size                     size of the rows in image
+// return: int                          zlib stream size, -1 if error
+//==============================================================================
+static int capture_deflate (int size)
+{
+#ifdef USE_ZZLIB
+ uLongf len;
+
+ len = compressBound(size);
+ if (capture_buffer(&packed, &packed_size, len) == -1)
+    return -1;
+ if (compress2(packed, &len, image, size, Z_BEST_SPEED) != Z_OK)
+    return -1;
+
+ return len;
+#else
+ uint8_t *d;
+ uint32_t a = 1;
+ uint32_t b = 0;
+ int n;
+ int i;
+ int j;
+
+ if (capture_buffer(&packed, &packed_size,
+    size + (size / 65535 + 1) * 5 + 6) == -1)
+    return -1;
+
+ d = packed;
+ *d++ = 0x78;
+ *d++ = 0x01;
+ for (i = 0; i < size; i += n)
+    {
+     n = size - i;
+     if (n > 65535)
+        n = 65535;
+     *d++ = (i + n == size);
+     *d++ = n;
+     *d++ = n >> 8;
+     *d++ = ~n;
+     *d++ = ~n >> 8;
+     memcpy(d, &image[i], n);
+     d += n;
+
+     // Adler-32, 5552 bytes is the most that can be summed before the
+     // modulo is needed.
+     for (j = 0; j < n; j++)
+        {
+         a += image[i+j];
+         b += a;
+         if ((j % 5552) == 5551)
+            {
+             a %= 65521;
+             b %= 65521;
+            }
+        }
+     a %= 65521;
+     b %= 65521;
+    }
+ *d++ = b >> 8;
+ *d++ = b;
+ *d++ = a >> 8;
+ *d++ = a;
+
+ return d - packed;
+#endif
+}
+
+//==============================================================================
+// Write a PNG chunk.
+//
+//   pass: FILE *fp                     file
+//         char *type                   chunk type
+//         uint8_t *data                chunk data
+//         int len                      chunk data length
+// return: void
+//==============================================================================
+static void capture_chunk (FILE *fp, char *type, uint8_t *data, int len)
+{
+ uint8_t b[4];
+ uint32_t crc = 0xffffffff;
+ int i;
+
+ b[0] = len >> 24;
+ b[1] = len >> 16;
+ b[2] = len >> 8;
+ b[3] = len;
+ fwrite(b, 1, 4, fp);
+ fwrite(type, 1, 4, fp);
+ fwrite(data, 1, len, fp);
+
+ for (i = 0; i < 4; i++)
+    crc = crc_table[(crc ^ type[i]) & 0xff] ^ (crc >> 8);
+ for (i = 0; i < len; i++)
+    crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+ crc ^= 0xffffffff;
+
+ b[0] = crc >> 24;
+ b[1] = crc >> 16;
+ b[2] = crc >> 8;
+ b[3] = crc;
+ fwrite(b, 1, 4, fp);
+}
+
+//==============================================================================
+// Make the PNG file name for the current frame.
+//
+//   pass: char *path                   file name
+//         int size                     size of path
+// return: void
+//==============================================================================
+static void capture_path (char *path, int size)
+{
+ char *p;
+
+ p = strstr(capture.file, "%d");
+ if (p)
+    {
+     snprintf(path, size, "%.*s%06d%s", (int)(p - capture.file),
+              capture.file, frame, p + 2);
+     return;
+    }
+
+ p = strrchr(capture.file, '.');
+ if ((! p) || strchr(p, '/') || strchr(p, '\\'))
+    p = capture.file + strlen(capture.file);
+ snprintf(path, size, "%.*s-%06d%s", (int)(p - capture.file),
+          capture.file, frame, p);
+}
+
+//==============================================================================
+// Capture the frame to a PNG file.
+//
+//   pass: int w                        width in pixels
+//         int h                        height in pixels
+// return: void
+//==============================================================================
+static void capture_png (int w, int h)
+{
+ static const uint8_t sig[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+ char path[SSIZE1];
+ uint8_t hdr[13];
+ FILE *fp;
+ int size;
+ int len;
+
+ size = (w * 3 + 1) * h;
+ if (capture_buffer(&image, &image_size, size) == -1)
+    return;
+ render_lock();
+ capture_rgb(image, w, h, 1);
+ render_unlock();
+ len = capture_deflate(size);
+ if (len == -1)
+    {
+     xprintf("capture: Unable to compress frame %d\n", frame);
+     return;
+    }
+
+ capture_path(path, sizeof(path));
+ fp = fopen(path, "wb");
+ if (! fp)
+    {
+     xprintf("capture: Unable to create file: %s\n", path);
+     return;
+    }
+
+ hdr[0] = w >> 24;
+ hdr[1] = w >> 16;
+ hdr[2] = w >> 8;
+ hdr[3] = w;
+ hdr[4] = h >> 24;
+ hdr[5] = h >> 16;
+ hdr[6] = h >> 8;
+ hdr[7] = h;
+ hdr[8] = 8;                    // bit depth
+ hdr[9] = 2;                    // RGB colour type
+ hdr[10] = 0;                   // compression
+ hdr[11] = 0;                   // filter
+ hdr[12] = 0;                   // no interlace
+
+ fwrite(sig, 1, sizeof(sig), fp);
+ capture_chunk(fp, "IHDR", hdr, sizeof(hdr));
+ capture_chunk(fp, "IDAT", packed, len);
+ capture_chunk(fp, "IEND", NULL, 0);
+ fclose(fp);
+}
+
+//==============================================================================
+// Open the raw or text stream if it's not already open.
+//
+// The stream is reopened if the file name or format has changed.
+//
+//   pass: void
+// return: int                          0 if no error, -1 if error
+//==============================================================================
+static int capture_stream (void)
+{
+ if (stream && ((strcmp(stream_file, capture.file) != 0) ||
+    (stream_format != capture.format)))
+    {
+     fclose(stream);
+     stream = NULL;
+    }
+
+ if (stream)
+    return 0;
+
+ stream = fopen(capture.file, (capture.format == CAPTURE_TEXT) ? "w" : "wb");
+ if (! stream)
+    {
+     xprintf("capture: Unable to create file: %s\n", capture.file);
+     capture.file[0] = 0;
+     return -1;
+    }
+ strcpy(stream_file, capture.file);
+ stream_format = capture.format;
+ stream_w = stream_h = 0;
+
+ return 0;
+}
+
+//==============================================================================
+// Append the frame to the raw stream.
+//
+//   pass: int w                        width in pixels
+//         int h                        height in pixels
+// return: void
+//==============================================================================
+static void capture_raw (int w, int h)
+{
+ int size;
+
+ if (capture_stream() == -1)
+    return;
+
+ if ((w != stream_w) || (h != stream_h))
+    {
+     stream_w = w;
+     stream_h = h;
+     xprintf("capture: raw stream %s is %dx%d rgb24 from frame %d\n",
+             stream_file, w, h, frame);
+    }
+
+ size = w * 3 * h;
+ if (capture_buffer(&image, &image_size, size) == -1)
+    return;
+ render_lock();
+ capture_rgb(image, w, h, 0);
+ render_unlock();
+ fwrite(image, 1, size, stream);
+}
+
+//==============================================================================
+// Append the displayed characters to the text stream.
+//
+// Characters are taken from the screen RAM, those that are not printable
+// ASCII (including PCG characters) are shown as '.'.
+//
+//   pass: crtc_frame_t *f              CRTC display values
+// return: void
+//==============================================================================
+static void capture_text (crtc_frame_t *f)
+{
+ char line[CAPTURE_TEXT_MAX + 1];
+ int addr;
+ int w;
+ int c;
+ int x;
+ int y;
+
+ if (capture_stream() == -1)
+    return;
+
+ w = f->hdisp;
+ if (w > CAPTURE_TEXT_MAX)
+    w = CAPTURE_TEXT_MAX;
+
+ fprintf(stream, "frame %d\n", frame);
+ for (y = 0; y < f->vdisp; y++)
+    {
+     addr = (f->rows ? f->row_start[y] : f->disp_start) + y * f->hdisp;
+     for (x = 0; x < w; x++)
+        {
+         c = vdu.scr_ram[(addr + x) & vdu.scr_mask];
+         line[x] = ((c >= ' ') && (c < 0x7f)) ? c : '.';
+        }
+     line[x] = '\n';
+     fwrite(line, 1, x + 1, stream);
+    }
+ fflush(stream);
+}
+
+//==============================================================================
+// Capture the frame if required.  This is called once a frame after the
+// display has been updated.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void capture_frame (void)
+{
+ crtc_frame_t f;
+ int take;
+ int w;
+ int h;
+
+ frame++;
+
+ if (! capture.file[0])
+    return;
+
+ crtc_frame(&f);
+ take = capture.trigger ||
+        (capture.every && ((frame % capture.every) == 0));
+ if (capture.changed && capture_changed(&f))
+    take = 1;
+ if (! take)
+    return;
+ capture.trigger = 0;
+
+ if (capture.format == CAPTURE_TEXT)
+    {
+     capture_text(&f);
+     return;
+    }
+
+ if (! screen)
+    return;
+ w = f.hdisp * 8;
+ h = f.vdisp * f.scans_per_row * video.yscale;
+ if (w > screen->w)
+    w = screen->w;
+ if (h > screen->h)
+    h = screen->h;
+ if ((w <= 0) || (h <= 0))
+    return;
+
+ if (capture.format == CAPTURE_RAW)
+    capture_raw(w, h);
+ else
+    capture_png(w, h);
+}
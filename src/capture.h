@@ -0,0 +1,30 @@
+/* Frame Capture Header */
+
+#ifndef HEADER_CAPTURE_H
+#define HEADER_CAPTURE_H
+
+#include "ubee512.h"
+
+enum
+{
+ CAPTURE_PNG,
+ CAPTURE_RAW,
+ CAPTURE_TEXT
+};
+
+typedef struct capture_t
+{
+ char file[SSIZE1];             // capture file name
+ int format;                    // CAPTURE_PNG, CAPTURE_RAW or CAPTURE_TEXT
+ int every;                     // capture every n frames (0=off)
+ int changed;                   // capture frames where the screen changed
+ int trigger;                   // capture the next frame
+}capture_t;
+
+int capture_init (void);
+int capture_deinit (void);
+int capture_reset (void);
+
+void capture_frame (void);
+
+#endif     /* HEADER_CAPTURE_H */
@@ -9,11 +9,13 @@
 
 #include "ubee512.h"
 #include "audio.h"
+#include "blep.h"
 #include "sn76489an_core.h"
 #include "parint.h"
 #include "compumuse.h"
 #include "z80api.h"
 #include "pio.h"
+#include "snapshot.h"
 
 //==============================================================================
 // constants
@@ -36,6 +38,7 @@ void compumuse_ready (void);
 void compumuse_strobe (void);
 void compumuse_w (uint8_t data);
 void compumuse_clock (int cpuclock);
+void compumuse_snapshot (void);
 
 //==============================================================================
 // structures and variables
@@ -55,6 +58,7 @@ parint_ops_t compumuse_ops = {
  .strobe = &pio_porta_strobe,
  .read = NULL,                  // output-only peripheral
  .write = &compumuse_w,
+ .snapshot = &compumuse_snapshot,
 };
 
 extern modio_t modio;
@@ -207,3 +211,19 @@ void compumuse_strobe (void)
  compumuse.busy = 0;
  (*compumuse_ops.strobe)();
 }
+
+//==============================================================================
+// Save or load the Compumuse state for a machine snapshot.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void compumuse_snapshot (void)
+{
+ if (snapshot_chunk("CMUS"))
+    return;
+
+ snapshot_int(&compumuse.busy);
+ snapshot_u64(&compumuse.strobe_due);
+ sn76489an_core_snapshot(&compumuse.sn76489);
+}
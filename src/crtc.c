@@ -12,11 +12,16 @@
 #include "keystd.h"
 #include "vdu.h"
 #include "video.h"
+#include "snapshot.h"
+#include "replay.h"
+#include "render.h"
+#include "sched.h"
 
 //==============================================================================
 // structures and variables
 //==============================================================================
 static void crtc_calc_vsync_freq (void);
+static void crtc_raster_row (void);
 int crtc_update_cursor (void);
 
 crtc_t crtc =
@@ -43,7 +48,6 @@ static int cur_blink;
 static int cur_mode;
 static int cur_pos;
 
-static int flashvideo_last;
 
 static int crtc_regs_data[32];
 static int vblank_divval;
@@ -60,6 +64,13 @@ static int reg;
 static int mem_addr;
 static int redraw;
 
+static sched_event_t raster_event = {0, crtc_raster_row, "crtc_raster", 0};
+static uint64_t raster_frame;           // tstate count the VSYNC period began
+static int raster_next;                 // next row to be latched
+static int raster_latch[CRTC_ROWS_MAX]; // rows latched this frame
+static int raster_rows;                 // rows of the last frame, 0 if not split
+static int raster_start[CRTC_ROWS_MAX]; // row start addresses of the last frame
+
 #ifdef MINGW
 #else
 struct timeval tod_x;
@@ -118,7 +129,11 @@ static int crtc_videochange (void)
  /*
   * For programs running in 40 column mode (such as Videotex),
   * the aspect ratio is forced to 1 as it looks better.
+  *
+  * vdu_configure() replaces the character data and flushes the glyph
+  * cache so the render thread is locked out first.
   */
+ render_lock();
  video_configure((crtc.hdisp < 50) ? 1 : video.aspect);
  vdu_configure(video.yscale);
  video_create_surface(crt_w, crt_h * video.yscale);
@@ -126,6 +141,7 @@ static int crtc_videochange (void)
  crtc_set_redraw();
  crtc_redraw();
  video_render();
+ render_unlock();
 
  crtc.resized = 0;          // clear the resized flag
 
@@ -164,9 +180,115 @@ int crtc_reset (void)
 {
  reg = 0;
 
+ raster_next = 0;
+ raster_rows = 0;
+ memset(raster_start, 0, sizeof(raster_start));
+ if (crtc.raster)
+    sched_add(&raster_event, z80api_get_tstates());
+
  return 0;
 }
 
+//==============================================================================
+// Latch the display start address for character rows.
+//
+// Rows from the next one due up to and including the one passed are given
+// the current display start address.  When the last displayed row has been
+// latched the frame's rows are kept for crtc_frame(), only if any row has a
+// different start address to the first is the frame noted as split.
+//
+//   pass: int row                      last row to latch
+// return: void
+//==============================================================================
+static void crtc_raster_latch (int row)
+{
+ int i;
+
+ if (row >= crtc.vdisp)
+    row = crtc.vdisp - 1;
+ for (; raster_next <= row; raster_next++)
+    raster_latch[raster_next] = crtc.disp_start;
+
+ if (raster_next < crtc.vdisp)
+    return;
+
+ raster_rows = 0;
+ for (i = 1; i < crtc.vdisp; i++)
+    {
+     if (raster_latch[i] != raster_latch[0])
+        {
+         raster_rows = crtc.vdisp;
+         break;
+        }
+    }
+ if (raster_rows)
+    memcpy(raster_start, raster_latch, sizeof(raster_start));
+ else
+    memset(raster_start, 0, sizeof(raster_start));
+ raster_next = 0;
+}
+
+//==============================================================================
+// Raster event, called from the event scheduler at the start of each
+// displayed character row when the raster renderer is in use (--raster).
+//
+// The displayed rows are spread evenly over the part of each VSYNC period
+// that is not vertical blanking as reported by crtc_vblank(), so a program
+// timing display start address changes from the blanking status sees them
+// take effect from the row being displayed.  Rows the Z80 has run past are
+// latched with the current start address.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void crtc_raster_row (void)
+{
+ uint64_t now;
+ uint64_t frame;
+ int phase;
+ int row_tstates;
+
+ if (! crtc.raster)
+    {
+     raster_next = 0;
+     raster_rows = 0;
+     memset(raster_start, 0, sizeof(raster_start));
+     return;
+    }
+
+ now = z80api_get_tstates();
+ if ((vblank_divval == 0) || (crtc.vdisp == 0))
+    {
+     sched_add(&raster_event, now + 10000);
+     return;
+    }
+
+ phase = now % vblank_divval;
+ frame = now - phase;
+ row_tstates = (vblank_divval - vblank_cmpval) / crtc.vdisp;
+ if (row_tstates < 1)
+    row_tstates = 1;
+
+ // finish a frame that has been run past
+ if ((frame != raster_frame) && raster_next)
+    crtc_raster_latch(crtc.vdisp - 1);
+ raster_frame = frame;
+
+ if (phase >= vblank_cmpval)
+    {
+     crtc_raster_latch((phase - vblank_cmpval) / row_tstates);
+     if (raster_next == 0)
+        {
+         // all rows latched, wait for the next frame
+         sched_add(&raster_event, frame + vblank_divval + vblank_cmpval);
+         return;
+        }
+    }
+
+ sched_add(&raster_event, frame + vblank_cmpval +
+           (uint64_t)raster_next * row_tstates);
+}
+
 //==============================================================================
 // CRTC vblank status
 //
@@ -188,7 +310,7 @@ int crtc_vblank (void)
     }
  else
     {
-     if ((time_get_ms() / 10) & 1)      // div 10mS (100Hz)
+     if ((replay_time_ms() / 10) & 1)   // div 10mS (100Hz)
         return B8(10000000);            // return true at a 50Hz rate
     }
 
@@ -329,8 +451,6 @@ uint16_t crtc_data_r (uint16_t port, struct z80_port_read *port_s)
 //==============================================================================
 void crtc_data_w (uint16_t port, uint8_t data, struct z80_port_write *port_s)
 {
- int old_curpos;
-
  if (modio.crtc)
     log_port_1("crtc_data_w", "data", port, data);
 
@@ -392,37 +512,27 @@ void crtc_data_w (uint16_t port, uint8_t data, struct z80_port_write *port_s)
         cur_start = data & 0x1F;
         cur_mode = (data >> 5) & 0x03;
         crtc_update_cursor();
-        crtc_redraw_char(cur_pos, 0);
         break;
      case CRTC_CUR_END:         // R11
         cur_end = data & 0x1F;
-        crtc_redraw_char(cur_pos, 0);
         break;
 
      case CRTC_DISP_START_H:    // R12
         crtc.disp_start &= 0xFF;
         crtc.disp_start |= (data & 0x3F) << 8;
-        crtc_set_redraw();
         break;
      case CRTC_DISP_START_L:    // R13
         crtc.disp_start &= 0x3F00;
         crtc.disp_start |= data & 0xFF;
-        crtc_set_redraw();
         break;
 
      case CRTC_CUR_POS_H:       // R14
-        old_curpos = cur_pos;
         cur_pos &= 0xFF;
         cur_pos |= (data & 0x3F) << 8;
-        crtc_redraw_char(old_curpos, 0);
-        crtc_redraw_char(cur_pos, 0);
         break;
      case CRTC_CUR_POS_L:       // R15
-        old_curpos = cur_pos;
         cur_pos &= 0x3F00;
         cur_pos |= data & 0xFF;
-        crtc_redraw_char(old_curpos, 0);
-        crtc_redraw_char(cur_pos, 0);
         break;
 
      // R16 - Is a read only register
@@ -443,6 +553,45 @@ void crtc_data_w (uint16_t port, uint8_t data, struct z80_port_write *port_s)
    }
 }
 
+//==============================================================================
+// Save or load the CRTC state for a machine snapshot.
+//
+// When loading the registers are written again so that all the values
+// derived from them are set up the same way as a port write.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void crtc_snapshot (void)
+{
+ int i;
+
+ if (snapshot_chunk("CRTC"))
+    return;
+
+ for (i = 0; i < 32; i++)
+    snapshot_int(&crtc_regs_data[i]);
+ snapshot_int(&reg);
+ snapshot_int(&mem_addr);
+ snapshot_int(&lpen);
+ snapshot_int(&crtc.latchrom);
+ snapshot_int(&crtc.update_strobe);
+ snapshot_int(&crtc.lpen_valid);
+
+ if (! snapshot_loading())
+    return;
+
+ if (crtc.raster)
+    sched_add(&raster_event, z80api_get_tstates());
+
+ i = reg;
+ for (reg = CRTC_HTOT; reg <= CRTC_SETADDR_L; reg++)
+    crtc_data_w(0, crtc_regs_data[reg], NULL);
+ reg = i;
+
+ crtc_set_redraw();
+}
+
 //==============================================================================
 // redraw one screen address character position.
 //
@@ -454,7 +603,9 @@ void crtc_redraw_char (int maddr, int dostdout)
 {
  if ((crtc.hdisp == 0) || (! crtc.video))
     return;
+ render_lock();
  vdu_redraw_char(maddr);
+ render_unlock();
 }
 
 //==============================================================================
@@ -466,47 +617,251 @@ void crtc_redraw_char (int maddr, int dostdout)
 //==============================================================================
 void crtc_set_redraw (void)
 {
- redraw = 1;
+ redraw++;
 }
 
 //==============================================================================
-// Update the whole screen area if the global redraw flag is set, otherwise
-// only those character positions that have changed.
+// Describe the display for drawing.
 //
-//   pass: void
+// Takes the CRTC values the display is drawn from.  A full redraw is
+// requested by changing the redraw count so one can't be lost if a frame
+// description published to the render thread is never drawn.
+//
+// When the raster renderer is in use and the last frame had rows with
+// different display start addresses the start address latched for each row
+// is included.
+//
+//   pass: crtc_frame_t *f              returns the frame description
 // return: void
 //==============================================================================
-void crtc_redraw (void)
+void crtc_frame (crtc_frame_t *f)
+{
+ f->video = crtc.video;
+ f->disp_start = crtc.disp_start;
+ f->hdisp = crtc.hdisp;
+ f->vdisp = crtc.vdisp;
+ f->scans_per_row = crtc.scans_per_row;
+ f->flashvideo = crtc.flashvideo;
+ f->cur_pos = cur_pos;
+ f->cur_blink = cur_blink;
+ f->cur_start = cur_start;
+ f->cur_end = cur_end;
+ f->redraw = redraw;
+ f->rows = raster_rows;
+ memcpy(f->row_start, raster_start, sizeof(f->row_start));
+}
+
+//==============================================================================
+// Draw a frame description with a display start address for each row.
+//
+// Each row is drawn from the address latched for it.  A row whose start
+// address differs from the last frame drawn is drawn whole, the other rows
+// only where cells have changed.  As rows may show the same cells the cells
+// are only noted as drawn once all rows have been drawn.
+//
+//   pass: crtc_frame_t *f              frame description
+//         crtc_frame_t *last           last frame drawn
+//         int full                     draw all rows
+// return: int                          non-zero if anything was drawn
+//==============================================================================
+static int crtc_draw_rows (crtc_frame_t *f, crtc_frame_t *last, int full)
 {
  int i, j, x, y, l;
  int maddr;
+ int whole;
+ int changed;
+ int drawn = 0;
 
- if (!crtc.video)
-    return;                     /* redraws disabled */
+ if (! full)
+    {
+     if ((f->cur_pos != last->cur_pos) || (f->cur_blink != last->cur_blink) ||
+         (f->cur_start != last->cur_start) || (f->cur_end != last->cur_end))
+        {
+         vdu_redraw_char(last->cur_pos);
+         vdu_redraw_char(f->cur_pos);
+        }
+     if (f->flashvideo != last->flashvideo)
+        {
+         for (i = 0; i < f->vdisp; i++)
+            vdu_propagate_flashing_attr(f->row_start[i] + i * f->hdisp,
+                                        f->hdisp);
+        }
+    }
 
- vdu_propagate_pcg_updates(crtc.disp_start, crtc.vdisp * crtc.hdisp);
+ // rows may be taken from anywhere in the screen RAM
+ changed = vdu_shadow_update(0, SCR_RAM_SIZE);
 
- maddr = crtc.disp_start;
- l = video.yscale * crtc.scans_per_row;
- for (y = 0, i = 0; i < crtc.vdisp; i++, y += l)
-    for (x = 0, j = 0; j < crtc.hdisp; j++, x += 8)
-       {
-        maddr &= 0x3fff;
-        if (redraw || vdu_char_is_redrawn(maddr))
-           {
-           vdu_draw_char(screen, 
-                         x, y,
-                         maddr,
-                         crtc.scans_per_row,
-                         crtc.flashvideo,
-                         (maddr == cur_pos) ? cur_blink : 0x00, cur_start, cur_end);
-           vdu_char_clear_redraw(maddr);
-           /* Signal to the video module that the screen needs to be redrawn */
-           crtc.update = 1;
-           }
-        maddr++;
-       }
- redraw = 0;
+ l = video.yscale * f->scans_per_row;
+ for (y = 0, i = 0; i < f->vdisp; i++, y += l)
+    {
+     maddr = f->row_start[i] + i * f->hdisp;
+     whole = full || (f->row_start[i] != last->row_start[i]);
+     if ((! whole) && ((! changed) || (! vdu_row_is_redrawn(maddr, f->hdisp))))
+        continue;
+
+     if (whole && (vdu_draw_row(screen, 0, y, maddr, f->hdisp,
+                                f->scans_per_row, f->flashvideo,
+                                f->cur_pos, f->cur_blink, f->cur_start,
+                                f->cur_end) == 0))
+        {
+         drawn = 1;
+         continue;
+        }
+
+     for (x = 0, j = 0; j < f->hdisp; j++, x += 8)
+        {
+         maddr &= 0x3fff;
+         if (whole || vdu_char_is_redrawn(maddr))
+            {
+             vdu_draw_char(screen,
+                           x, y,
+                           maddr,
+                           f->scans_per_row,
+                           f->flashvideo,
+                           (maddr == f->cur_pos) ? f->cur_blink : 0x00,
+                           f->cur_start, f->cur_end);
+             drawn = 1;
+            }
+         maddr++;
+        }
+    }
+
+ for (i = 0; changed && (i < f->vdisp); i++)
+    {
+     maddr = f->row_start[i] + i * f->hdisp;
+     for (j = 0; j < f->hdisp; j++)
+        vdu_char_clear_redraw(maddr++);
+    }
+
+ if (full)
+    vdu_shadow_sync(0, SCR_RAM_SIZE);
+
+ return drawn;
+}
+
+//==============================================================================
+// Draw a frame description.
+//
+// Updates the whole screen area if a redraw was requested or the display
+// layout changed since the last frame drawn, otherwise only those character
+// positions that have changed.  The cursor and flashing characters are
+// redrawn when their state differs from the last frame drawn.  The display
+// RAM is read through vdu_source().
+//
+// A frame with a start address for each row is drawn by crtc_draw_rows(),
+// frames where the start address was the same for all rows take the usual
+// path.
+//
+//   pass: crtc_frame_t *f              frame description
+// return: int                          non-zero if anything was drawn
+//==============================================================================
+int crtc_draw (crtc_frame_t *f)
+{
+ static crtc_frame_t last;
+ int i, j, x, y, l;
+ int maddr;
+ int size;
+ int full;
+ int drawn = 0;
+
+ if (! f->video)
+    return 0;                   /* redraws disabled */
+
+ size = f->vdisp * f->hdisp;
+ full = (f->redraw != last.redraw) || (f->disp_start != last.disp_start) ||
+        (f->hdisp != last.hdisp) || (f->vdisp != last.vdisp) ||
+        (f->scans_per_row != last.scans_per_row) || (f->rows != last.rows);
+
+ if (f->rows)
+    {
+     drawn = crtc_draw_rows(f, &last, full);
+     last = *f;
+     return drawn;
+    }
+
+ if (! full)
+    {
+     if ((f->cur_pos != last.cur_pos) || (f->cur_blink != last.cur_blink) ||
+         (f->cur_start != last.cur_start) || (f->cur_end != last.cur_end))
+        {
+         vdu_redraw_char(last.cur_pos);
+         vdu_redraw_char(f->cur_pos);
+        }
+     if (f->flashvideo != last.flashvideo)
+        vdu_propagate_flashing_attr(f->disp_start, size);
+    }
+ last = *f;
+
+ if (! full && ! vdu_shadow_update(f->disp_start, size))
+    return 0;                   /* nothing has changed */
+
+ maddr = f->disp_start;
+ l = video.yscale * f->scans_per_row;
+ for (y = 0, i = 0; i < f->vdisp; i++, y += l)
+    {
+     // a fully dirty screen is drawn a whole row at a time
+     if (full && (vdu_draw_row(screen, 0, y, maddr, f->hdisp,
+                               f->scans_per_row, f->flashvideo,
+                               f->cur_pos, f->cur_blink, f->cur_start,
+                               f->cur_end) == 0))
+        {
+         for (j = 0; j < f->hdisp; j++)
+            vdu_char_clear_redraw(maddr++);
+         drawn = 1;
+         continue;
+        }
+
+     if (! full && ! vdu_row_is_redrawn(maddr, f->hdisp))
+        {
+         maddr += f->hdisp;
+         continue;
+        }
+
+     for (x = 0, j = 0; j < f->hdisp; j++, x += 8)
+        {
+         maddr &= 0x3fff;
+         if (full || vdu_char_is_redrawn(maddr))
+            {
+            vdu_draw_char(screen, 
+                          x, y,
+                          maddr,
+                          f->scans_per_row,
+                          f->flashvideo,
+                          (maddr == f->cur_pos) ? f->cur_blink : 0x00,
+                          f->cur_start, f->cur_end);
+            vdu_char_clear_redraw(maddr);
+            drawn = 1;
+            }
+         maddr++;
+        }
+    }
+
+ if (full)
+    vdu_shadow_sync(f->disp_start, size);
+
+ return drawn;
+}
+
+//==============================================================================
+// Update the whole screen area if the global redraw flag is set, otherwise
+// only those character positions that have changed.
+//
+// The display is drawn straight from the emulated machine's state.  This
+// is used for all drawing unless the render thread is in use, and then
+// still when the OSD or a window change needs the display drawn at once.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void crtc_redraw (void)
+{
+ crtc_frame_t f;
+
+ crtc_frame(&f);
+ render_lock();
+ if (crtc_draw(&f))
+    crtc.update = 1;    /* Signal to the video module that the screen needs to be redrawn */
+ render_unlock();
 }
 
 //==============================================================================
@@ -572,10 +927,14 @@ void crtc_update (void)
   if (crtc.resized)
      crtc_videochange();        // resets crtc.resized value
 
- if (crtc_update_cursor())
-    crtc_redraw_char(cur_pos, 0);
- // Determine the current state of the alpha+ flashing video and refresh it
- // if this has changed.
+ // start the raster events if the raster renderer has been turned on
+ if (crtc.raster && (! raster_event.queued))
+    sched_add(&raster_event, z80api_get_tstates());
+
+ // The cursor and flashing characters are redrawn by crtc_draw() when their
+ // state changes.
+ crtc_update_cursor();
+ // Determine the current state of the alpha+ flashing video.
  if (vdu.extendram)                    // only if extended RAM selected
     {
      if (emu.turbo)
@@ -592,13 +951,10 @@ void crtc_update (void)
          else
             crtc.flashvideo = 0;
         }
-     if (crtc.flashvideo != flashvideo_last)
-        {
-         flashvideo_last = crtc.flashvideo;
-         vdu_propagate_flashing_attr(crtc.disp_start, crtc.vdisp * crtc.hdisp);
-        }
     }
- crtc_redraw();
+
+ // the display is drawn by video_update() once it has decided that the
+ // frame is not skipped.
 }
 
 //==============================================================================
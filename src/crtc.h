@@ -28,12 +28,33 @@
 
 #define CRTC_DOSETADDR      31
 
+#define CRTC_ROWS_MAX       128
+
 extern int disp_start;
 
 int crtc_init (void);
 int crtc_deinit (void);
 int crtc_reset (void);
 
+typedef struct crtc_frame_t
+{
+ int video;
+ int disp_start;
+ int hdisp;
+ int vdisp;
+ int scans_per_row;
+ int flashvideo;
+ int cur_pos;
+ int cur_blink;
+ int cur_start;
+ int cur_end;
+ int redraw;                    // full redraw request count
+ int rows;                      // rows with their own start address, or 0
+ int row_start[CRTC_ROWS_MAX];  // display start address latched for each row
+}crtc_frame_t;
+
+void crtc_frame (crtc_frame_t *f);
+int crtc_draw (crtc_frame_t *f);
 void crtc_redraw (void);
 void crtc_set_redraw (void);
 void crtc_redraw_char (int addr, int dostdout);
@@ -50,6 +71,7 @@ void crtc_update (void);
 void crtc_regdump (void);
 int crtc_set_flash_rate (int n);
 void crtc_clock (int cpuclock);
+void crtc_snapshot (void);
 
 typedef struct crtc_t
 {
@@ -70,6 +92,7 @@ typedef struct crtc_t
  int lpen_valid;
  int update_strobe;
  int update;
+ int raster;
 }crtc_t;
 
 #endif     /* HEADER_CRTC_H */
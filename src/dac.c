@@ -32,6 +32,11 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added dac_snapshot() function for machine snapshots.
+// - DAC writes are now passed as level changes to the band limited step
+//   synthesizer (blep.c) and rendered once per block of Z80 instructions.
+//
 // v5.0.0 - 6 August 2010, uBee
 // - Start with the latest sound.c module and modify the speaker_* code for
 //   DAC usage.  Code here uses the sound buffer management functions
@@ -56,9 +61,11 @@
 #include "dac.h"
 #include "ubee512.h"
 #include "audio.h"
+#include "blep.h"
 #include "z80api.h"
 #include "support.h"
 #include "gui.h"
+#include "snapshot.h"
 
 //==============================================================================
 // constants
@@ -74,6 +81,7 @@ int dac_tick (audio_scratch_t *buf, const void *data,
               uint64_t start, uint64_t cycles);
 void dac_clock (int cpuclock);
 void dac_w (uint8_t data);
+void dac_snapshot (void);
 
 parint_ops_t dac_ops =
 {
@@ -84,7 +92,8 @@ parint_ops_t dac_ops =
  .ready = NULL,    // &dac_ready,
  .strobe = NULL,   // &pio_porta_strobe,
  .read = NULL,
- .write = &dac_w
+ .write = &dac_w,
+ .snapshot = &dac_snapshot
 };
 
 extern audio_t audio;
@@ -95,53 +104,21 @@ extern emu_t emu;
 #define DAC_IDLE_TIME 1000      /* ms */
 #define DAC_DECAY_CONSTANT 50   /* ms */
 
-#define DAC_AMPLITUDE (AUDIO_MAXVAL / 3)
-
 typedef struct dac_t {
    audio_scratch_t snd_buf;
-   int samples_since_write;     // counts samples since the dac
-                                // port was last written to
+   blep_t blep;                 // dac level changes to be rendered
    uint8_t state;               // current state of the dac
                                 // output
    int idle;                    // set if the dac hasn't changed state
                                 // during the last video frame
    uint64_t change_tstates;
-   int samplenumber;
-   int fraction;                // position of dac transition
-                                // within a sample, used to
-                                // interpolate the final value
-   int last_sample;             // partial sample under construction
-   int div_num, div_denom;      // numerator and denominator of the
-                                // tstates -> samples conversion factor
    int idle_count;              // number of idle frames before this source
                                 // stops generating samples
    int count;                   // counter
-   int tau, decay;
 } dac_t;
 
 dac_t dac;
 
-
-// this macro, given a time in CPU clocks, returns the number of clocks after
-// the start of the current sample.  The numerator and denominator of the
-// cpu clock -> sample clock conversion fraction are in S (a dac_t
-// structure)
-#define SAMPLE_TIME_FRACTION(S, TSTATES)                        \
-   ((TSTATES) * (S)->div_denom % (S)->div_num / (S)->div_denom)
-
-#define SAMPLE_TIME_FRACTION_REMAINING(S, TSTATES)                      \
-   (((S)->div_num - (TSTATES) * (S)->div_denom % (S)->div_num) /        \
-    (S)->div_denom)
-
-// computes the value of a partial sample given the full sample value
-// and a sample fraction
-#define PARTIAL_SAMPLE(S, TSTATE_FRACTION, SAMPLE)                      \
-   ((SAMPLE) * (TSTATE_FRACTION) * (S)->div_denom / (S)->div_num)
-
-// computes the number of complete samples in a number of CPU clocks
-#define SAMPLE_COUNT(S, TSTATES)                \
-   ((TSTATES) * (S)->div_denom / (S)->div_num)
-
 //==============================================================================
 // DAC Initialise
 //
@@ -150,6 +127,16 @@ dac_t dac;
 //==============================================================================
 int dac_init (void)
 {
+ if (blep_init(&dac.blep))
+    return -1;
+ /* Make the audio output decay with a time constant of about
+  * 50ms. Actual hardware doesn't do this; but on actual hardware
+  * the sound output also never goes negative :) */
+ blep_set_decay_constant(&dac.blep, DAC_DECAY_CONSTANT);
+ // the dac is silent until first written to.
+ dac.idle = 1;
+ dac.count = 0;
+
  // register a sound source for the Microbee dac
  audio_register(&dac.snd_buf, "dac",
                 &dac_tick, (void *)&dac,
@@ -160,11 +147,6 @@ int dac_init (void)
  // framerate is in frames/s, so one frame is 1/framerate seconds.
  dac.idle_count = DAC_IDLE_TIME * emu.framerate / 1000;
 
- /* Make the audio output decay with a time constant of about
-  * 50ms. Actual hardware doesn't do this; but on actual hardware
-  * the sound output also never goes negative :) */
- dac.tau = audio.frequency * DAC_DECAY_CONSTANT / 1000;
-
  return 0;
 }
 
@@ -177,6 +159,7 @@ int dac_init (void)
 int dac_deinit (void)
 {
  audio_deregister(&dac.snd_buf);
+ blep_deinit(&dac.blep);
  return 0;
 }
 
@@ -189,38 +172,13 @@ int dac_deinit (void)
 void dac_clock (int cpuclock)
 {
  dac_t *s = &dac;
- uint64_t cycles_now = z80api_get_tstates();
 
  if (audio.mode != AUDIO_PROPORTIONAL)
     cpuclock = 3375000;
 
- dac.div_denom = audio.frequency;
- dac.div_num = cpuclock;
-
- {
-  int a = dac.div_denom, b = dac.div_num, t;
-
-  /* A should be > B */
-  if (a < b)
-     {
-      t = a;
-      a = b;
-      b = t;
-     }
-  while (b != 0)                /* compute GCD */
-     {
-      t = b;
-      b = a % b;
-      a = t;
-     }
-  dac.div_num /= a;
-  dac.div_denom /= a;
- }
-
- // The current sample number and partial sample counts also
- // need to be updated here
- s->samplenumber = SAMPLE_COUNT(s, cycles_now);
- s->fraction = SAMPLE_TIME_FRACTION(s, cycles_now);
+ // the time so far was at the old clock rate
+ blep_end_frame(&s->blep, z80api_get_tstates());
+ blep_set_rate(&s->blep, cpuclock);
 }
 
 //==============================================================================
@@ -234,19 +192,6 @@ inline int dac_sample (uint8_t data)
  return data - 128;
 }
 
-//==============================================================================
-// DAC sample fixup.  Integer rounding errors can accrue to the point
-// where an accumulated sample doesn't quite add up to DAC_AMPLITUDE
-// which leads to an annoying buzz in the output.
-//
-//   pass: int                          sample
-// return: int
-//==============================================================================
-inline int dac_fixup_sample (int sample)
-{
- return sample;
-}
-
 //==============================================================================
 // DAC reset.
 //
@@ -260,12 +205,12 @@ int dac_reset (void)
 
  s->state = 0;
  s->change_tstates = z80api_get_tstates();
- s->decay = 0;
- s->fraction = 0;
- s->last_sample = 0;
+ s->idle = 1;
+ s->count = 0;
+ blep_clear(&s->blep, s->change_tstates);
 
  // If there is an audio buffer under construction - dump it, the
- // next call to dac_fill will get a fresh one.
+ // next call to dac_tick will get a fresh one.
  if (audio_has_work_buffer(sb))
     audio_put_work_buffer(sb);
 
@@ -273,187 +218,65 @@ int dac_reset (void)
 }
 
 //==============================================================================
-// DAC fill.
-//
-//   pass: dac_t *s
-//         int sample
-//         int count
-// return: void
-//==============================================================================
-void dac_fill (dac_t *s, int sample, int count)
-{
- audio_scratch_t *sb = &s->snd_buf;
-#if DEBUG_DAC
-    xprintf("dac_fill: writing %d of %d\n", count, sample);
-#endif /* DEBUG_DAC */
- // fill the buffer with the dac value.
- while (count)
-    {
-     int n;
-     /* flush the current work buffer if it is full */
-     if (audio_space_remaining(sb) == 0)
-         audio_put_work_buffer(sb);
-     /* get a fresh sound buffer if necessary */
-     if (!audio_has_work_buffer(sb))
-        audio_get_work_buffer(sb);
-     /* work out how many samples will fit in the current buffer */
-     n = audio_space_remaining(sb);
-     if (n > count)
-        n = count;
-     count -= n;
-     while (n--)
-        {
-         s->decay -= ((sample * (1 << 16)) + s->decay) / s->tau;
-         // delay applying the decay value until after it becomes
-         // significant...  FIXME: necessary?
-         if (s->decay > 2 * (1 << 16) || s->decay < -2 * (1 << 16))
-            audio_put_sample(sb, audio_limit(sample + (s->decay / (1 << 16))));
-         else
-            audio_put_sample(sb, audio_limit(sample));
-        }
-    }
-}
-
-//==============================================================================
-// DAC update.
+// DAC write.
 //
-// dac_update generates audio samples since the last dac bit change.
+// Only the time of the change is recorded, the samples are rendered in
+// dac_tick().
 //
-//   pass: dac_t *
-//         uint_8
+//   pass: uint8_t data                 upto 8 DAC bits
 // return: void
 //==============================================================================
-
-void dac_update (dac_t *s, uint8_t data)
+void dac_w (uint8_t data)
 {
+ dac_t *s = &dac;
  uint64_t cycles_now;
- int samplenumber_now;
- int fraction_now;
- int fraction_diff;
- unsigned int n;
- int sample = dac_sample(s->state);
- int fractional_sample;
 
- cycles_now = z80api_get_tstates();
-
-#if DEBUG_DAC
- xprintf("dac_update: cycles_now %llu, cycles_then %llu\n",
-         cycles_now, s->change_tstates);
-#endif /* DEBUG_DAC */
+ // only do something if the dac state changes.
+ if (audio.mute)
+    return;
+ if (data == s->state)
+    return;
 
- /* if there is no current buffer, obtain one.  In this case the
-  * audio source has been idle for some time, so we assume the
-  * last sample to be zero and the last state change to be now */
- if (!audio_has_work_buffer(&s->snd_buf))
-    {
-     audio_get_work_buffer(&s->snd_buf);
-     s->change_tstates = cycles_now;
-     s->last_sample = 0;
-     s->samplenumber = SAMPLE_COUNT(s, s->change_tstates);
-     s->fraction = SAMPLE_TIME_FRACTION(s, s->change_tstates);
 #if DEBUG_DAC
-     xprintf("dac_update: "
-             "initial partial sample: %d * %d/%d of %d = %d\n",
-             s->fraction, s->div_denom, s->div_num,
-             dac_sample(s->state), s->last_sample);
+ xprintf("dac_w: writing %02x\n", data);
 #endif /* DEBUG_DAC */
-    }
+ cycles_now = z80api_get_tstates();
 
- samplenumber_now = SAMPLE_COUNT(s, cycles_now);
- fraction_now = SAMPLE_TIME_FRACTION(s, cycles_now);
+ // if this is the first update since the dac source was marked idle
+ // and stopped generating samples start again from silence.
+ if (s->idle && s->count == 0)
+    blep_clear(&s->blep, cycles_now);
+ blep_level(&s->blep, cycles_now, dac_sample(data));
 
- if (samplenumber_now == s->samplenumber)
-    {
-     /* Only the partial sample needs to be updated, we don't need
-      * to emit it yet */
-#if DEBUG_DAC
-     xprintf("dac_update: "
-             "updated partial sample %d ", s->last_sample);
-#endif /* DEBUG_DAC */
-     fraction_diff = fraction_now - s->fraction;
-     fractional_sample = PARTIAL_SAMPLE(s, fraction_diff, sample);
-     s->last_sample += fractional_sample;
-#if DEBUG_DAC
-     xprintf("with %d * %d/%d of %d = %d ",
-             fraction_diff, s->div_denom, s->div_num,
-             sample, fractional_sample);
-     xprintf("result %d\n", s->last_sample);
-#endif /* DEBUG_DAC */
-     /* the sample number remains unchanged */
-    }
- else
-    {
-     // need to finish off the partial sample from the last call
-     // to dac_update();
-     fraction_diff = SAMPLE_TIME_FRACTION_REMAINING(s, s->change_tstates);
-     fractional_sample = PARTIAL_SAMPLE(s, fraction_diff, sample);
-     s->last_sample += fractional_sample;
-     s->last_sample = dac_fixup_sample(s->last_sample);
-#if DEBUG_DAC
-     xprintf("dac_update: "
-             "updated partial sample: %d * %d/%d of %d = %d\n",
-             fraction_diff, s->div_denom, s->div_num,
-             sample, fractional_sample);
-#endif /* DEBUG_DAC */
-#if DEBUG_DAC
-     xprintf("dac_update: value %d\n", s->last_sample);
-#endif /* DEBUG_DAC */
-     assert(s->last_sample >= -(AUDIO_MAXVAL + 1) &&
-            s->last_sample <= AUDIO_MAXVAL);
-     dac_fill(s, s->last_sample, 1);
-     s->samples_since_write++;
-     // write out complete samples
-     n = samplenumber_now - s->samplenumber - 1;
-     dac_fill(s, sample, n);
-     s->samples_since_write += n;
-     // and record the final partial sample.
-     s->last_sample = PARTIAL_SAMPLE(s, fraction_now, sample);
-#if DEBUG_DAC
-     xprintf("dac_update: "
-             "created partial sample: %d * %d/%d of %d = %d\n",
-             fraction_now, s->div_denom, s->div_num,
-             sample, s->last_sample);
-#endif /* DEBUG_DAC */
-    }
- s->fraction = fraction_now;
- s->samplenumber = samplenumber_now;
  s->state = data;
  s->change_tstates = cycles_now;
+ s->idle = 0;
+ s->count = s->idle_count;
 }
 
 //==============================================================================
-// DAC write.
+// Save or load the DAC state for a machine snapshot.
 //
-//   pass: uint8_t data                 upto 8 DAC bits
+// Only the DAC level is kept, on loading it is written again at the current
+// tstate count and any sound under construction is discarded.
+//
+//   pass: void
 // return: void
 //==============================================================================
-void dac_w (uint8_t data)
+void dac_snapshot (void)
 {
- dac_t *s = &dac;
+ uint8_t state = dac.state;
 
- // only do something if the dac state changes.
- if (audio.mute)
-    return;
- if (data == s->state)
+ if (snapshot_chunk("DAC "))
     return;
 
-#if DEBUG_DAC
- xprintf("dac_w: writing %02x\n", data);
-#endif /* DEBUG_DAC */
- // if this is the first update since the dac source was marked idle
- // and stopped generating samples, just update the last update time, don't
- // actually write anything into the buffer yet.
- if (s->idle && s->count == 0)
+ snapshot_u8(&state);
+
+ if (snapshot_loading())
     {
-     s->last_sample = 0;
-     s->state = data;
-     s->change_tstates = z80api_get_tstates();
+     dac_reset();
+     dac_w(state);
     }
- else
-    dac_update(s, data);
- s->idle = 0;
- s->count = s->idle_count;
- s->samples_since_write = 0;
 }
 
 //==============================================================================
@@ -470,18 +293,13 @@ int dac_tick (audio_scratch_t *buf, const void *data,
 {
  dac_t *s = (dac_t *)data;
 
- if (!audio_has_work_buffer(&s->snd_buf))
+ if (s->idle && s->count == 0)
     goto idle;
 
- if (s->change_tstates == start)
+ if (s->change_tstates < start)
     {
      if (s->idle)
-        {
-         if (s->count > 0)
-            s->count--;
-         else
-            goto idle;
-        }
+        s->count--;
      else
         {
          s->idle = 1;
@@ -490,21 +308,16 @@ int dac_tick (audio_scratch_t *buf, const void *data,
     }
 
 #if DEBUG_DAC
-// insert a very marked click into the audio stream
-// dac_fill(s, 128, 1);
-// dac_fill(s, -128, 1);
  xprintf("dac_tick:\n");
 #endif /* DEBUG_DAC */
- dac_update(s, s->state);
+ blep_end_frame(&s->blep, start + cycles);
+ blep_read(&s->blep, &s->snd_buf);
 
- if (s->idle && s->count == 0)
- {
-  audio_put_work_buffer(&s->snd_buf); // flush current buffer.
-  s->decay = 0;                       // reset decay constant
- }
+ if (s->idle && s->count == 0 && audio_has_work_buffer(&s->snd_buf))
+    audio_put_work_buffer(&s->snd_buf); // flush current buffer.
  return 1;
 
 idle:
- s->change_tstates = start + cycles;
+ blep_clear(&s->blep, start + cycles);
  return 0;
 }
@@ -31,6 +31,12 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added disk_unshare() function to give a farm instance a private copy
+//   of an open image.
+// - disk_write() and disk_format_track() do not write to the image while
+//   rewind_step_back() is re-executing instructions.
+//
 // v5.8.0 - 15 November 2016, uBee
 // - Added detection for LibDsk's 'rcpmfs' type in disk_open() for use by
 //   modified disk_read() and disk_write() functions.  If detected and a
@@ -232,6 +238,7 @@
 #include "ubee512.h"
 #include "support.h"
 #include "disk.h"
+#include "rewind.h"
 
 //==============================================================================
 // structures and variables
@@ -254,6 +261,7 @@ extern char userhome_diskpath[];
 extern emu_t emu;
 extern model_t modelx;
 extern modio_t modio;
+extern rewind_t rewindx;
 
 // these formats are for the built in RAW and DSK driver (not LibDsk)
 // The order must match the enumeration for the labels. FIXME
@@ -1515,6 +1523,73 @@ int disk_open (disk_t *disk)
  return 0;
 }
 
+//==============================================================================
+// Disk unshare.
+//
+// Replace an open image with a private copy.  Used by an instance forked
+// from --farm-snapshot, the image file inherited from the supervisor
+// shares its file offset with the other instances and writes to it would
+// be seen by them.  The copy is an unnamed temporary file that is removed
+// when it's closed, the image itself is not changed by the instance.
+//
+//   pass: disk_t *disk
+// return: int                          0 if no errors, else -1
+//==============================================================================
+int disk_unshare (disk_t *disk)
+{
+ char buf[4096];
+ FILE *fp;
+ FILE *copy;
+ size_t n;
+
+ if (! disk->itype)
+    return 0;
+
+#ifdef USE_LIBDSK
+ if (disk->itype == DISK_LIBDSK)
+    {
+     xprintf("disk_unshare: Drive %c: LibDsk drives can't be used by farm "
+             "instances: %s\n", disk->drive+'A', disk->filepath);
+     return -1;
+    }
+#endif
+
+ // the image is opened again so its offset is not shared
+ fp = fopen(disk->filepath, "rb");
+ if (fp == NULL)
+    {
+     xprintf("disk_unshare: Unable to open image: %s\n", disk->filepath);
+     return -1;
+    }
+
+ copy = tmpfile();
+ if (copy == NULL)
+    {
+     xprintf("disk_unshare: Unable to create a copy of image: %s\n",
+             disk->filepath);
+     fclose(fp);
+     return -1;
+    }
+
+ while ((n = fread(buf, 1, sizeof(buf), fp)) != 0)
+    {
+     if (fwrite(buf, 1, n, copy) != n)
+        {
+         xprintf("disk_unshare: Unable to copy image: %s\n", disk->filepath);
+         fclose(copy);
+         fclose(fp);
+         return -1;
+        }
+    }
+ fclose(fp);
+ fflush(copy);
+
+ fclose(disk->fdisk);
+ disk->fdisk = copy;
+
+ return 0;
+}
+
 //==============================================================================
 // Disk close.
 //
@@ -1798,6 +1873,10 @@ int disk_write (disk_t *disk, char *buf, int side, int idside, int track,
  int sectuse;
  int dskofs;
 
+ // the sector was written when the instruction was first executed.
+ if (rewindx.replaying)
+    return 0;
+
  // reset the exit seconds counter to a new minimum value every time we write
  // to disk and emu.secs_exit is not zero.
  if ((emu.secs_exit) && ((emu.secs_run + 3) >= emu.secs_exit))
@@ -2193,6 +2272,10 @@ int disk_format_track (disk_t *disk, char *buf, int ddense, int track,
  int s;
 #endif
 
+ // the track was formatted when the instruction was first executed.
+ if (rewindx.replaying)
+    return 0;
+
  // reset the exit seconds counter to a new minimum value every time we write
  // to disk and emu.secs_exit is not zero.
  if ((emu.secs_exit) && ((emu.secs_run + 3) >= emu.secs_exit))
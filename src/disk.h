@@ -186,6 +186,7 @@ typedef struct rcpmfs_args_t
 int disk_init (void);
 int disk_open (disk_t *disk);
 void disk_close (disk_t *disk);
+int disk_unshare (disk_t *disk);
 int disk_create (disk_t *disk, int temp_only);
 int disk_read (disk_t *disk, char *buf, int side, int idside, int track,
                int sect, char rtype);
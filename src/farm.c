@@ -0,0 +1,438 @@
+//******************************************************************************
+//*                                  uBee512                                   *
+//*       An emulator for the Microbee Z80 ROM, FDD and HDD based models       *
+//*                                                                            *
+//*                            Instance farm module                            *
+//*                                                                            *
+//*                          Copyright (C) 2026 agent                          *
+//******************************************************************************
+//
+// Runs many headless Microbee instances from one ubee512 invocation.
+//
+// The --farm=file option names an instance list file.  Each non blank line
+// of the file that does not start with '#' describes one instance and holds
+// the options for that instance (disk images, --bench-* limits, etc).  The
+// options are added after those given on the command line so an instance
+// may override any of them.
+//
+// The process that reads the list becomes a supervisor.  It starts up to
+// --farm-jobs instances at once as worker processes forked from itself.
+// Each instance processes the options again, the configuration file and
+// command line followed by its own line, as the options must be applied in
+// order on a machine that has not yet been set up.  Such an instance is an
+// independent emulator, it loads its own ROMs and disk images and carries
+// out the full start up, the fork only saves loading the program and
+// reading the list.  Use --farm-snapshot to share one start up between the
+// instances.  Each instance's console output is written to
+// its own file (--farm-log) and the supervisor reports the exit status and
+// run time of each instance as it finishes.
+//
+// The instances are processes rather than threads of one process because
+// the machine state is held in file scope variables in every module (emu,
+// crtc, vdu, the memmap tables, the z80ex context, the sound chips and so
+// on).  Running instances on a thread pool would need all of it moved into
+// a per instance context passed through every module, the Z80 port and
+// memory callbacks included.  A forked process gives each instance the
+// same isolation with no change to the modules, memory is shared copy on
+// write and a crashing instance can not take the others down.
+//
+// When --farm-snapshot is used the supervisor is instead started up
+// headless as a normal emulator, loads the snapshot once and only then
+// forks the instances.  Each instance shares the supervisor's memory (DRAM
+// banks, video RAM, etc) with copy on write semantics so it starts from the
+// loaded state in milliseconds and only pages it writes to are copied.
+// Such an instance only processes the options on its own line, in run
+// mode, as everything else is already set up.  The open disk image files
+// are inherited from the supervisor and would share one file offset and
+// each instance's writes, so every instance first copies its images to
+// private temporary files (see disk_unshare()) and the images themselves
+// are left unchanged.
+//
+// This is not supported on Windows as there is no fork().
+//
+//==============================================================================
+/*
+ *  uBee512 - An emulator for the Microbee Z80 ROM, FDD and HDD based models.
+ *  Copyright (C) 2026 agent
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+//==============================================================================
+// ChangeLog (most recent entries are at top)
+//==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Farm snapshot instances use private copies of the open disk images.
+// - Fixed the instance argument list being allocated one entry short.
+// - Added --farm-snapshot to fork the instances from a loaded snapshot.
+// - Created a new file to run many headless instances from one invocation.
+//==============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#ifndef MINGW
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#include "farm.h"
+#include "ubee512.h"
+#include "options.h"
+#include "support.h"
+#include "snapshot.h"
+#include "fdc.h"
+#include "hdd.h"
+#include "ide.h"
+
+//==============================================================================
+// structures and variables
+//==============================================================================
+farm_t farm =
+{
+ .log = FARM_LOG_DEFAULT,
+};
+
+#ifndef MINGW
+typedef struct farm_job_t
+{
+ pid_t pid;
+ int instance;
+ uint64_t start;
+}farm_job_t;
+
+static char **lines;
+static int lines_count;
+
+//==============================================================================
+// Load the instance list file.
+//
+// Each line is kept as it is read, blank lines and lines starting with '#'
+// are ignored.
+//
+//   pass: void
+// return: int                          0 if no error, -1 if error
+//==============================================================================
+static int farm_load (void)
+{
+ FILE *fp;
+ char s[OPTIONS_SIZE];
+ char **p;
+ int i;
+
+ fp = fopen(farm.file, "r");
+ if (! fp)
+    {
+     xprintf("farm_load: Unable to open instance list: %s\n", farm.file);
+     return -1;
+    }
+
+ while (fgets(s, sizeof(s), fp))
+    {
+     i = strlen(s);
+     while (i && (s[i-1] <= ' '))
+        s[--i] = 0;
+     i = 0;
+     while (s[i] && (s[i] <= ' '))
+        i++;
+     if ((s[i] == 0) || (s[i] == '#'))
+        continue;
+
+     p = realloc(lines, sizeof(char *) * (lines_count + 1));
+     if (p)
+        {
+         lines = p;
+         lines[lines_count] = malloc(strlen(&s[i]) + 1);
+        }
+     if ((! p) || (! lines[lines_count]))
+        {
+         xprintf("farm_load: Unable to allocate memory\n");
+         fclose(fp);
+         return -1;
+        }
+     strcpy(lines[lines_count++], &s[i]);
+    }
+
+ fclose(fp);
+
+ if (! lines_count)
+    {
+     xprintf("farm_load: No instances found in: %s\n", farm.file);
+     return -1;
+    }
+
+ return 0;
+}
+
+//==============================================================================
+// Split an instance line into arguments.
+//
+// Arguments are separated by white space, a double quoted section may
+// contain white space.  The line is modified in place.
+//
+//   pass: char *s                      instance line
+//         char *args[]                 arguments found
+//         int max                      maximum number of arguments
+// return: int                          number of arguments
+//==============================================================================
+static int farm_split (char *s, char *args[], int max)
+{
+ char *d;
+ int n = 0;
+
+ while (*s && (n < max))
+    {
+     while (*s && (*s <= ' '))
+        s++;
+     if (*s == 0)
+        break;
+
+     args[n++] = d = s;
+     while (*s && (*s > ' '))
+        {
+         if (*s == '"')
+            {
+             s++;
+             while (*s && (*s != '"'))
+                *d++ = *s++;
+             if (*s)
+                s++;
+            }
+         else
+            *d++ = *s++;
+        }
+     if (*s)
+        s++;
+     *d = 0;
+    }
+
+ return n;
+}
+
+//==============================================================================
+// Set up the forked process for an instance.
+//
+// The instance arguments are the command line arguments followed by
+// --headless and the arguments from the instance's line.  If the instances
+// are forked from a snapshot only the program name and the arguments from
+// the instance's line are used and the open disk images are replaced with
+// private copies.  Standard output and error are redirected to the
+// instance's console output file.
+//
+//   pass: int n                        instance number (1..n)
+//         int argc                     command line argument count
+//         char *argv[]                 command line arguments
+// return: int                          0 if no error, -1 if error
+//==============================================================================
+static int farm_instance (int n, int argc, char *argv[])
+{
+ char path[SSIZE1];
+ char *p;
+ int fd;
+ int i;
+
+ farm.instance = n;
+
+ // the arguments, --headless, the line's arguments and the NULL
+ farm.argv = malloc(sizeof(char *) * (argc + OPTIONS_SIZE / 2 + 2));
+ if (! farm.argv)
+    return -1;
+
+ i = 0;
+ farm.argv[i++] = argv[0];
+ if (! farm.snapshot[0])
+    {
+     while (i < argc)
+        {
+         farm.argv[i] = argv[i];
+         i++;
+        }
+     farm.argv[i++] = "--headless";
+    }
+ i += farm_split(lines[n-1], &farm.argv[i], OPTIONS_SIZE / 2);
+ farm.argv[i] = NULL;
+ farm.argc = i;
+
+ // the instance number replaces a '%d' in the log path, otherwise it's
+ // appended.
+ p = strstr(farm.log, "%d");
+ if (p)
+    snprintf(path, sizeof(path), "%.*s%d%s", (int)(p - farm.log), farm.log,
+             n, p + 2);
+ else
+    snprintf(path, sizeof(path), "%s%d", farm.log, n);
+
+ fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+ if (fd == -1)
+    {
+     xprintf("farm_instance: Unable to create console output file: %s\n", path);
+     return -1;
+    }
+ dup2(fd, STDOUT_FILENO);
+ dup2(fd, STDERR_FILENO);
+ close(fd);
+
+ fd = open("/dev/null", O_RDONLY);
+ if (fd != -1)
+    {
+     dup2(fd, STDIN_FILENO);
+     close(fd);
+    }
+
+ if (farm.snapshot[0])
+    {
+     if (fdc_unshare() || hdd_unshare() || ide_unshare())
+        return -1;
+    }
+
+ return 0;
+}
+
+//==============================================================================
+// Wait for an instance to finish and report it.
+//
+//   pass: farm_job_t *jobs             running jobs
+//         int *running                 number of running jobs
+// return: int                          0 if instance exited with 0, else 1
+//==============================================================================
+static int farm_wait (farm_job_t *jobs, int *running)
+{
+ pid_t pid;
+ int status;
+ int i;
+
+ do
+    pid = wait(&status);
+ while (pid == -1 && errno == EINTR);
+
+ if (pid == -1)
+    {
+     *running = 0;
+     return 1;
+    }
+
+ for (i = 0; (i < *running) && (jobs[i].pid != pid); i++)
+    {}
+ if (i == *running)
+    return 0;
+
+ if (WIFEXITED(status))
+    xprintf("farm: instance %d exit %d, %.3f s\n", jobs[i].instance,
+            WEXITSTATUS(status), (time_get_ns() - jobs[i].start) / 1E9);
+ else
+    xprintf("farm: instance %d terminated by signal %d, %.3f s\n",
+            jobs[i].instance, WTERMSIG(status),
+            (time_get_ns() - jobs[i].start) / 1E9);
+
+ jobs[i] = jobs[--(*running)];
+
+ return ! (WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+}
+#endif
+
+//==============================================================================
+// Run the instance farm.
+//
+// Called after the options have been processed when --farm is used, or
+// once the emulator is up and running if --farm-snapshot is also used.  The
+// supervisor returns from here once all instances have finished.  Each
+// instance also returns from here with farm.instance, farm.argc and
+// farm.argv set and must process the options again using farm.argv before
+// carrying on with a normal start up, or with running the emulation.
+//
+//   pass: int argc                     command line argument count
+//         char *argv[]                 command line arguments
+// return: int                          supervisor: 0 if all instances
+//                                      exited with 0, else 1
+//                                      instance: 0 if no error, else 1
+//==============================================================================
+int farm_run (int argc, char *argv[])
+{
+#ifdef MINGW
+ xprintf("farm_run: --farm is not supported on this system\n");
+ return 1;
+#else
+ farm_job_t *jobs;
+ uint64_t start;
+ pid_t pid;
+ int running = 0;
+ int failed = 0;
+ int n;
+
+ if (farm_load())
+    return 1;
+
+ // load the snapshot once, the instances share it after forking
+ if (farm.snapshot[0])
+    {
+     start = time_get_ns();
+     if (snapshot_load(farm.snapshot))
+        return 1;
+     xprintf("farm: snapshot %s loaded, %.3f s\n", farm.snapshot,
+             (time_get_ns() - start) / 1E9);
+    }
+
+ if (farm.jobs <= 0)
+    farm.jobs = sysconf(_SC_NPROCESSORS_ONLN);
+ if (farm.jobs <= 0)
+    farm.jobs = 1;
+
+ jobs = malloc(sizeof(farm_job_t) * farm.jobs);
+ if (! jobs)
+    return 1;
+
+ xprintf("farm: %d instances, %d jobs\n", lines_count, farm.jobs);
+
+ start = time_get_ns();
+ for (n = 1; n <= lines_count; n++)
+    {
+     if (running == farm.jobs)
+        failed += farm_wait(jobs, &running);
+
+     fflush(NULL);
+     pid = fork();
+     if (pid == 0)
+        {
+         free(jobs);
+         return (farm_instance(n, argc, argv) != 0);
+        }
+     if (pid == -1)
+        {
+         xprintf("farm: instance %d unable to start\n", n);
+         failed++;
+         continue;
+        }
+
+     jobs[running].pid = pid;
+     jobs[running].instance = n;
+     jobs[running].start = time_get_ns();
+     running++;
+    }
+
+ while (running)
+    failed += farm_wait(jobs, &running);
+
+ xprintf("farm: %d instances, %d failed, %.3f s\n", lines_count, failed,
+         (time_get_ns() - start) / 1E9);
+
+ free(jobs);
+
+ return (failed != 0);
+#endif
+}
@@ -0,0 +1,23 @@
+/* Instance Farm Header */
+
+#ifndef HEADER_FARM_H
+#define HEADER_FARM_H
+
+#include "ubee512.h"
+
+#define FARM_LOG_DEFAULT "farm-%d.log"
+
+int farm_run (int argc, char *argv[]);
+
+typedef struct farm_t
+{
+ char file[SSIZE1];             // instance list file
+ char log[SSIZE1];              // per instance console output path
+ char snapshot[SSIZE1];         // snapshot all instances start from
+ int jobs;                      // maximum instances running at once
+ int instance;                  // instance number (1..n), 0 if supervisor
+ int argc;                      // instance argument count
+ char **argv;                   // instance arguments
+}farm_t;
+
+#endif     /* HEADER_FARM_H */
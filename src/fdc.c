@@ -31,6 +31,10 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added fdc_unshare() function for farm instances.
+// - Added fdc_snapshot() function for machine snapshots.
+//
 // v5.7.0 - 1 February 2014, uBee
 // - Fixed a major bug that prevents correct operation of 128 and 1024 byte
 //   size sectors in FDC_READSECT and FDC_WRITESECT.  The idfield->seclen
@@ -183,6 +187,7 @@
 #include "gui.h"
 #include "options.h"
 #include "z80.h"
+#include "snapshot.h"
 
 static int fdc_loaddisk (int drive, int report);
 static int fdc_bootimage (void);
@@ -504,6 +509,25 @@ void fdc_unloaddisk (int drive)
     }
 }
 
+//==============================================================================
+// Give a farm instance private copies of the open disk images.
+//
+//   pass: void
+// return: int                  0 if no errors, else -1
+//==============================================================================
+int fdc_unshare (void)
+{
+ int i;
+
+ for (i = 0; i < FDC_NUMDRIVES; i++)
+    {
+     if (disk_unshare(&fdc_drive[i].disk) != 0)
+        return -1;
+    }
+
+ return 0;
+}
+
 //==============================================================================
 // Load boot image.
 //
@@ -2090,3 +2114,54 @@ uint16_t fdc_ext_r (uint16_t port, struct z80_port_read *port_s)
 
  return status;
 }
+
+//==============================================================================
+// Save or load the FDC state for a machine snapshot.
+//
+// The disk images are not saved, the same images must be in use when the
+// snapshot is loaded.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void fdc_snapshot (void)
+{
+ int i;
+
+ if (! modelx.fdc)
+    return;
+
+ if (snapshot_chunk("FDC "))
+    return;
+
+ for (i = 0; i < FDC_NUMDRIVES; i++)
+    snapshot_int(&fdc_drive[i].track);
+
+ snapshot_int(&ctrl_side);
+ snapshot_int(&ctrl_drive);
+ snapshot_int(&ctrl_ddense);
+ snapshot_int(&ctrl_rate);
+ snapshot_int(&ctrl_motoron);
+ snapshot_u64(&ctrl_motoroff_time);
+ snapshot_u64(&ctrl_motoron_time);
+ snapshot_int(&ctrl_rdata);
+ snapshot_int(&ctrl_rtrack);
+ snapshot_int(&ctrl_rsect);
+ snapshot_int(&ctrl_status);
+ snapshot_int(&ctrl_stepdir);
+ snapshot_int(&fdc_error);
+ snapshot_int(&sidex);
+ snapshot_int(&cmdx);
+ snapshot_int(&lastcmd);
+ snapshot_u64(&cycles_last);
+ snapshot_int(&bytes_left);
+ snapshot_int(&buf_index);
+ snapshot_int(&buf_len);
+ snapshot_u64(&starting_cycles);
+ snapshot_u64(&every_cycles);
+ snapshot_u64(&window_start);
+ snapshot_u64(&window_end);
+ snapshot_int(&sector_header_pos);
+ snapshot_int(&sector_count);
+ snapshot_packed(buf, sizeof(buf));
+}
@@ -94,6 +94,8 @@ int fdc_deinit (void);
 int fdc_reset (void);
 int fdc_set_drive (int drive, fdc_drive_t *fdc_d);
 void fdc_unloaddisk (int drive);
+int fdc_unshare (void);
+void fdc_snapshot (void);
 
 uint16_t fdc_status_r (uint16_t port, struct z80_port_read *port_s);
 void fdc_cmd_w (uint16_t port, uint8_t data, struct z80_port_write *port_s);
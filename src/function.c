@@ -31,6 +31,10 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Changes to function_files() fgets and fread functions to call
+//   z80api_code_flush() as Z80 memory is written to directly.
+//
 // v6.0.0 - 1 January 2017, K Duckmanton
 // - Microbee memory is now an array of uint8_t rather than char, all
 //   pointers to it must also be uint8_t*.
@@ -189,6 +193,7 @@
 #include "z80debug.h"
 #include "crtc.h"
 #include "joystick.h"
+#include "z80api.h"
 #include "tapfile.h"
 
 //==============================================================================
@@ -586,6 +591,7 @@ static void function_files (int addr)
             z80mem_x3 = get_z80mem_ptr_and_addr(&addr3);
             ptrres = fgets((char*)(z80mem_x3+addr3), leu16_to_host(f->file.num), f->file.fp.p);
             f->file.res = host_to_leu16(ptrres != NULL);
+            z80api_code_flush();
             break;
          case 0x08 : // fputc
             f->file.res = host_to_le16(fputc(leu16_to_host(f->file.val1), f->file.fp.p));
@@ -630,6 +636,7 @@ static void function_files (int addr)
                         memcpy(z80mem_x3+addr3, buffer, amount_h);
                        }
                    }
+                z80api_code_flush();
                 if (modio.func)
                    {
                     log_data_5("function_files", "function", "Z80 addr", "read", "amount(LB)", "amount(HB)",
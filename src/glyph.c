@@ -0,0 +1,780 @@
+//******************************************************************************
+//*                                  uBee512                                   *
+//*       An emulator for the Microbee Z80 ROM, FDD and HDD based models       *
+//*                                                                            *
+//*                          Glyph expansion module                            *
+//*                                                                            *
+//*                          Copyright (C) 2026 agent                          *
+//******************************************************************************
+//
+// Expands 1 bit per pixel glyph rows into screen pixels.
+//
+// A kernel expands a run of glyph bytes (one per character cell, each with
+// its own foreground and background pixel values) into 8 pixels per cell.
+// It is used for a single cell by vdu_draw_char() and for a whole scan line
+// of cells when the screen is completely redrawn (vdu_draw_row()).
+//
+// A scalar kernel using a byte to 8 pixel mask table is always available.
+// SSE2 and AVX2 kernels are built for x86 hosts using GCC function target
+// attributes so the rest of the program needs no special compiler flags,
+// and are only used if the host CPU supports them.  A NEON kernel is built
+// for ARM hosts with NEON.  The best kernel is chosen at start up unless
+// one is named with --glyph-kernel.
+//
+// The glyph cache holds character cells already expanded into screen
+// pixels so a cell drawn again with the same colours is copied instead of
+// expanded.  Entries are found through a list for each character so the
+// entries for a PCG character that is written to can be dropped, and the
+// least recently used entry is reused when the cache is full.  The size is
+// set with --glyph-cache.
+//
+// --bench-glyph runs each available kernel over a full 80x25 screen of 16
+// line characters and reports the number of cells per second.
+//
+//==============================================================================
+/*
+ *  uBee512 - An emulator for the Microbee Z80 ROM, FDD and HDD based models.
+ *  Copyright (C) 2026 agent
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+//==============================================================================
+// ChangeLog (most recent entries are at top)
+//==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added a glyph cache of expanded character cells with least recently
+//   used replacement (--glyph-cache).
+// - Created a new file for scalar, SSE2, AVX2 and NEON glyph row expansion
+//   kernels with run time selection and a microbenchmark.
+//==============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GLYPH_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define GLYPH_NEON
+#include <arm_neon.h>
+#endif
+
+#include "glyph.h"
+#include "ubee512.h"
+#include "support.h"
+
+//==============================================================================
+// structures and variables
+//==============================================================================
+#define GLYPH_BENCH_COLS   80
+#define GLYPH_BENCH_ROWS   25
+#define GLYPH_BENCH_LINES  16
+#define GLYPH_BENCH_NS     250000000
+
+glyph_t glyph =
+{
+ .kernel = "auto",
+ .cache = GLYPH_CACHE_DEFAULT,
+};
+
+typedef struct glyph_entry_t
+{
+ uint32_t key;                  // cell key, only unique for a character
+ int c;                         // character, -1 if not in use
+ int char_next;                 // entries for the same character
+ int char_prev;
+ int lru_next;                  // towards the least recently used
+ int lru_prev;
+}glyph_entry_t;
+
+static glyph_entry_t *cache;    // the last entry is the LRU list head
+static uint8_t *cache_pixels;
+static int *cache_chars;        // first entry for each character
+static int cache_entries;
+static int cache_char_count;
+static int cache_size;          // bytes for each entry
+
+typedef struct glyph_kernel_t
+{
+ char *name;
+ int (*supported)(void);
+ glyph_row_t row16;
+ glyph_row_t row32;
+}glyph_kernel_t;
+
+static uint32_t expand_mask[256][8];
+static int expand_ready;
+
+//==============================================================================
+// Scalar kernels.
+//
+// Each glyph byte selects 8 pixel masks from a table, a pixel is the
+// background value with the bits that differ in the foreground value
+// switched where the mask is set.
+//==============================================================================
+static void glyph_expand_table (void)
+{
+ int i;
+ int j;
+
+ if (expand_ready)
+    return;
+
+ for (i = 0; i < 256; i++)
+    for (j = 0; j < 8; j++)
+       expand_mask[i][j] = (i & (0x80 >> j)) ? 0xffffffff : 0;
+ expand_ready = 1;
+}
+
+static int glyph_scalar_supported (void)
+{
+ return 1;
+}
+
+static void glyph_row8_scalar (void *dst, const uint8_t *bits,
+                               const uint32_t *fg, const uint32_t *bg,
+                               int cells)
+{
+ uint8_t *d = dst;
+ uint32_t *m;
+ uint32_t diff;
+ int i;
+
+ while (cells--)
+    {
+     m = expand_mask[*bits++];
+     diff = *fg++ ^ *bg;
+     for (i = 0; i < 8; i++)
+        *d++ = *bg ^ (diff & m[i]);
+     bg++;
+    }
+}
+
+static void glyph_row16_scalar (void *dst, const uint8_t *bits,
+                                const uint32_t *fg, const uint32_t *bg,
+                                int cells)
+{
+ uint16_t *d = dst;
+ uint32_t *m;
+ uint32_t diff;
+ int i;
+
+ while (cells--)
+    {
+     m = expand_mask[*bits++];
+     diff = *fg++ ^ *bg;
+     for (i = 0; i < 8; i++)
+        *d++ = *bg ^ (diff & m[i]);
+     bg++;
+    }
+}
+
+static void glyph_row32_scalar (void *dst, const uint8_t *bits,
+                                const uint32_t *fg, const uint32_t *bg,
+                                int cells)
+{
+ uint32_t *d = dst;
+ uint32_t *m;
+ uint32_t diff;
+ int i;
+
+ while (cells--)
+    {
+     m = expand_mask[*bits++];
+     diff = *fg++ ^ *bg;
+     for (i = 0; i < 8; i++)
+        *d++ = *bg ^ (diff & m[i]);
+     bg++;
+    }
+}
+
+#ifdef GLYPH_X86
+//==============================================================================
+// SSE2 kernels.
+//
+// The glyph byte is copied to every lane and each lane tests its own bit,
+// the resulting lane masks select between the foreground and background
+// values.
+//==============================================================================
+static int glyph_sse2_supported (void)
+{
+ __builtin_cpu_init();
+ return __builtin_cpu_supports("sse2");
+}
+
+__attribute__((target("sse2")))
+static void glyph_row16_sse2 (void *dst, const uint8_t *bits,
+                              const uint32_t *fg, const uint32_t *bg,
+                              int cells)
+{
+ const __m128i sel = _mm_setr_epi16(0x80, 0x40, 0x20, 0x10, 0x08, 0x04,
+                                    0x02, 0x01);
+ __m128i *d = dst;
+ __m128i m;
+ __m128i b;
+
+ while (cells--)
+    {
+     m = _mm_and_si128(_mm_set1_epi16(*bits++), sel);
+     m = _mm_cmpeq_epi16(m, sel);
+     b = _mm_set1_epi16(*bg);
+     m = _mm_and_si128(m, _mm_set1_epi16(*fg++ ^ *bg++));
+     _mm_storeu_si128(d++, _mm_xor_si128(b, m));
+    }
+}
+
+__attribute__((target("sse2")))
+static void glyph_row32_sse2 (void *dst, const uint8_t *bits,
+                              const uint32_t *fg, const uint32_t *bg,
+                              int cells)
+{
+ const __m128i sel_hi = _mm_setr_epi32(0x80, 0x40, 0x20, 0x10);
+ const __m128i sel_lo = _mm_setr_epi32(0x08, 0x04, 0x02, 0x01);
+ __m128i *d = dst;
+ __m128i v;
+ __m128i b;
+ __m128i x;
+
+ while (cells--)
+    {
+     v = _mm_set1_epi32(*bits++);
+     b = _mm_set1_epi32(*bg);
+     x = _mm_set1_epi32(*fg++ ^ *bg++);
+     _mm_storeu_si128(d++, _mm_xor_si128(b, _mm_and_si128(x,
+                      _mm_cmpeq_epi32(_mm_and_si128(v, sel_hi), sel_hi))));
+     _mm_storeu_si128(d++, _mm_xor_si128(b, _mm_and_si128(x,
+                      _mm_cmpeq_epi32(_mm_and_si128(v, sel_lo), sel_lo))));
+    }
+}
+
+//==============================================================================
+// AVX2 kernels.
+//
+// 32 bpp expands a whole cell in one 256 bit register, 16 bpp expands two
+// cells at a time.
+//==============================================================================
+static int glyph_avx2_supported (void)
+{
+ __builtin_cpu_init();
+ return __builtin_cpu_supports("avx2");
+}
+
+__attribute__((target("avx2")))
+static void glyph_row16_avx2 (void *dst, const uint8_t *bits,
+                              const uint32_t *fg, const uint32_t *bg,
+                              int cells)
+{
+ const __m256i sel = _mm256_setr_epi16(0x80, 0x40, 0x20, 0x10, 0x08, 0x04,
+                                       0x02, 0x01, 0x80, 0x40, 0x20, 0x10,
+                                       0x08, 0x04, 0x02, 0x01);
+ __m256i *d = dst;
+ __m256i m;
+ __m256i b;
+ __m256i x;
+
+ for (; cells >= 2; cells -= 2, bits += 2, fg += 2, bg += 2)
+    {
+     m = _mm256_setr_m128i(_mm_set1_epi16(bits[0]), _mm_set1_epi16(bits[1]));
+     m = _mm256_cmpeq_epi16(_mm256_and_si256(m, sel), sel);
+     b = _mm256_setr_m128i(_mm_set1_epi16(bg[0]), _mm_set1_epi16(bg[1]));
+     x = _mm256_setr_m128i(_mm_set1_epi16(fg[0] ^ bg[0]),
+                           _mm_set1_epi16(fg[1] ^ bg[1]));
+     _mm256_storeu_si256(d++, _mm256_xor_si256(b, _mm256_and_si256(x, m)));
+    }
+
+ if (cells)
+    glyph_row16_sse2(d, bits, fg, bg, cells);
+}
+
+__attribute__((target("avx2")))
+static void glyph_row32_avx2 (void *dst, const uint8_t *bits,
+                              const uint32_t *fg, const uint32_t *bg,
+                              int cells)
+{
+ const __m256i sel = _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04,
+                                       0x02, 0x01);
+ __m256i *d = dst;
+ __m256i m;
+
+ while (cells--)
+    {
+     m = _mm256_and_si256(_mm256_set1_epi32(*bits++), sel);
+     m = _mm256_cmpeq_epi32(m, sel);
+     m = _mm256_and_si256(m, _mm256_set1_epi32(*fg++ ^ *bg));
+     _mm256_storeu_si256(d++, _mm256_xor_si256(_mm256_set1_epi32(*bg++), m));
+    }
+}
+#endif
+
+#ifdef GLYPH_NEON
+//==============================================================================
+// NEON kernels.
+//
+// Each lane tests its own bit of the glyph byte and the lane masks select
+// between the foreground and background values.
+//==============================================================================
+static int glyph_neon_supported (void)
+{
+ return 1;
+}
+
+static void glyph_row16_neon (void *dst, const uint8_t *bits,
+                              const uint32_t *fg, const uint32_t *bg,
+                              int cells)
+{
+ static const uint16_t sel_bits[8] = {0x80, 0x40, 0x20, 0x10, 0x08, 0x04,
+                                      0x02, 0x01};
+ const uint16x8_t sel = vld1q_u16(sel_bits);
+ uint16_t *d = dst;
+ uint16x8_t m;
+
+ while (cells--)
+    {
+     m = vtstq_u16(vdupq_n_u16(*bits++), sel);
+     vst1q_u16(d, vbslq_u16(m, vdupq_n_u16(*fg++), vdupq_n_u16(*bg++)));
+     d += 8;
+    }
+}
+
+static void glyph_row32_neon (void *dst, const uint8_t *bits,
+                              const uint32_t *fg, const uint32_t *bg,
+                              int cells)
+{
+ static const uint32_t sel_bits[8] = {0x80, 0x40, 0x20, 0x10, 0x08, 0x04,
+                                      0x02, 0x01};
+ const uint32x4_t sel_hi = vld1q_u32(&sel_bits[0]);
+ const uint32x4_t sel_lo = vld1q_u32(&sel_bits[4]);
+ uint32_t *d = dst;
+ uint32x4_t v;
+ uint32x4_t f;
+ uint32x4_t b;
+
+ while (cells--)
+    {
+     v = vdupq_n_u32(*bits++);
+     f = vdupq_n_u32(*fg++);
+     b = vdupq_n_u32(*bg++);
+     vst1q_u32(d, vbslq_u32(vtstq_u32(v, sel_hi), f, b));
+     vst1q_u32(d + 4, vbslq_u32(vtstq_u32(v, sel_lo), f, b));
+     d += 8;
+    }
+}
+#endif
+
+//==============================================================================
+// Kernels in order of preference, the scalar kernel must be last.
+//==============================================================================
+static glyph_kernel_t kernels[] =
+{
+#ifdef GLYPH_X86
+ {"avx2",   glyph_avx2_supported,   glyph_row16_avx2,   glyph_row32_avx2},
+ {"sse2",   glyph_sse2_supported,   glyph_row16_sse2,   glyph_row32_sse2},
+#endif
+#ifdef GLYPH_NEON
+ {"neon",   glyph_neon_supported,   glyph_row16_neon,   glyph_row32_neon},
+#endif
+ {"scalar", glyph_scalar_supported, glyph_row16_scalar, glyph_row32_scalar},
+ {NULL,     NULL,                   NULL,               NULL}
+};
+
+//==============================================================================
+// Glyph initialise.
+//
+//   pass: void
+// return: int                          0 if success, -1 if error
+//==============================================================================
+int glyph_init (void)
+{
+ return glyph_select(glyph.kernel);
+}
+
+//==============================================================================
+// Glyph de-initialise.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int glyph_deinit (void)
+{
+ free(cache);
+ free(cache_pixels);
+ free(cache_chars);
+ cache = NULL;
+ cache_pixels = NULL;
+ cache_chars = NULL;
+ cache_entries = 0;
+ cache_char_count = 0;
+
+ return 0;
+}
+
+//==============================================================================
+// Glyph reset.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int glyph_reset (void)
+{
+ return 0;
+}
+
+//==============================================================================
+// Select the glyph expansion kernel.
+//
+// "auto" selects the first kernel supported by the host CPU.
+//
+//   pass: char *name                   kernel name or "auto"
+// return: int                          0 if success, -1 if unknown or not
+//                                      supported by the host CPU
+//==============================================================================
+int glyph_select (char *name)
+{
+ int auto_select = (strcmp(name, "auto") == 0);
+ int i;
+
+ glyph_expand_table();
+
+ for (i = 0; kernels[i].name; i++)
+    {
+     if ((! auto_select) && (strcmp(name, kernels[i].name) != 0))
+        continue;
+     if (! kernels[i].supported())
+        {
+         if (auto_select)
+            continue;
+         xprintf("glyph_select: %s is not supported by this CPU\n", name);
+         return -1;
+        }
+     glyph.name = kernels[i].name;
+     glyph.row8 = glyph_row8_scalar;
+     glyph.row16 = kernels[i].row16;
+     glyph.row32 = kernels[i].row32;
+     return 0;
+    }
+
+ xprintf("glyph_select: unknown kernel: %s\n", name);
+ return -1;
+}
+
+//==============================================================================
+// Get the row expansion kernel for a screen pixel size.
+//
+//   pass: int bytes_per_pixel          1, 2 or 4
+// return: glyph_row_t                  kernel, NULL if not supported
+//==============================================================================
+glyph_row_t glyph_row (int bytes_per_pixel)
+{
+ if (! glyph.name)
+    glyph_select(glyph.kernel);
+
+ switch (bytes_per_pixel)
+    {
+     case 1 :
+        return glyph.row8;
+     case 2 :
+        return glyph.row16;
+     case 4 :
+        return glyph.row32;
+    }
+
+ return NULL;
+}
+
+//==============================================================================
+// Glyph cache LRU list handling.
+//
+// The list is circular through the head entry at cache[cache_entries], the
+// most recently used entry follows the head.
+//==============================================================================
+static void glyph_cache_lru_unlink (int i)
+{
+ cache[cache[i].lru_prev].lru_next = cache[i].lru_next;
+ cache[cache[i].lru_next].lru_prev = cache[i].lru_prev;
+}
+
+static void glyph_cache_lru_insert (int i, int after)
+{
+ cache[i].lru_prev = after;
+ cache[i].lru_next = cache[after].lru_next;
+ cache[cache[after].lru_next].lru_prev = i;
+ cache[after].lru_next = i;
+}
+
+//==============================================================================
+// Remove a glyph cache entry from its character list and make it the next
+// to be reused.
+//
+//   pass: int i                        entry
+// return: void
+//==============================================================================
+static void glyph_cache_drop (int i)
+{
+ if (cache[i].char_prev != -1)
+    cache[cache[i].char_prev].char_next = cache[i].char_next;
+ else
+    cache_chars[cache[i].c] = cache[i].char_next;
+ if (cache[i].char_next != -1)
+    cache[cache[i].char_next].char_prev = cache[i].char_prev;
+ cache[i].c = -1;
+
+ glyph_cache_lru_unlink(i);
+ glyph_cache_lru_insert(i, cache[cache_entries].lru_prev);
+}
+
+//==============================================================================
+// Empty the glyph cache.
+//
+// This must be called before the cache is used and whenever the pixel
+// values or size of the cells change.  The cache memory is allocated here
+// if the number of characters, entry size or --glyph-cache has changed.
+//
+//   pass: int chars                    number of characters
+//         int size                     bytes for each entry
+// return: void
+//==============================================================================
+void glyph_cache_flush (int chars, int size)
+{
+ int i;
+
+ if ((chars != cache_char_count) || (size != cache_size) ||
+    (glyph.cache != cache_entries))
+    {
+     glyph_deinit();
+     if (glyph.cache <= 0)
+        return;
+     cache = malloc(sizeof(glyph_entry_t) * (glyph.cache + 1));
+     cache_pixels = malloc((size_t)size * glyph.cache);
+     cache_chars = malloc(sizeof(int) * chars);
+     if ((! cache) || (! cache_pixels) || (! cache_chars))
+        {
+         xprintf("glyph_cache_flush: Unable to allocate memory\n");
+         glyph_deinit();
+         glyph.cache = 0;
+         return;
+        }
+     cache_entries = glyph.cache;
+     cache_char_count = chars;
+     cache_size = size;
+    }
+
+ if (! cache)
+    return;
+
+ for (i = 0; i < cache_char_count; i++)
+    cache_chars[i] = -1;
+
+ cache[cache_entries].lru_next = cache[cache_entries].lru_prev = cache_entries;
+ for (i = 0; i < cache_entries; i++)
+    {
+     cache[i].c = -1;
+     glyph_cache_lru_insert(i, cache[cache_entries].lru_prev);
+    }
+}
+
+//==============================================================================
+// Get the glyph cache entry for a cell.
+//
+// If the cell is not in the cache the least recently used entry is given
+// to it and the caller must fill in the pixels.
+//
+//   pass: int c                        character
+//         uint32_t key                 cell key (colours, attributes, etc)
+//         int *hit                     set to 1 if the cell was in the cache
+// return: uint8_t *                    entry pixels, NULL if no cache
+//==============================================================================
+uint8_t *glyph_cache_get (int c, uint32_t key, int *hit)
+{
+ int i;
+
+ if ((! cache) || (c < 0) || (c >= cache_char_count))
+    return NULL;
+
+ for (i = cache_chars[c]; i != -1; i = cache[i].char_next)
+    if (cache[i].key == key)
+       break;
+
+ *hit = (i != -1);
+ if (i == -1)
+    {
+     i = cache[cache_entries].lru_prev;
+     if (cache[i].c != -1)
+        glyph_cache_drop(i);
+     cache[i].key = key;
+     cache[i].c = c;
+     cache[i].char_prev = -1;
+     cache[i].char_next = cache_chars[c];
+     if (cache_chars[c] != -1)
+        cache[cache_chars[c]].char_prev = i;
+     cache_chars[c] = i;
+    }
+
+ glyph_cache_lru_unlink(i);
+ glyph_cache_lru_insert(i, cache_entries);
+
+ return cache_pixels + (size_t)i * cache_size;
+}
+
+//==============================================================================
+// Drop the glyph cache entries for characters whose glyphs have changed.
+//
+//   pass: int c                        first character
+//         int count                    number of characters
+// return: void
+//==============================================================================
+void glyph_cache_invalidate (int c, int count)
+{
+ if (! cache)
+    return;
+
+ for (; count > 0; c++, count--)
+    {
+     if ((c < 0) || (c >= cache_char_count))
+        continue;
+     while (cache_chars[c] != -1)
+        glyph_cache_drop(cache_chars[c]);
+    }
+}
+
+//==============================================================================
+// Run one kernel over a full screen of character cells until the time
+// limit is reached.
+//
+//   pass: glyph_row_t row              kernel
+//         int bpp                      bytes per pixel
+//         uint8_t *pixels              screen buffer
+//         uint8_t *bits                glyph bytes for every cell line
+//         uint32_t *fg                 foreground pixel for each column
+//         uint32_t *bg                 background pixel for each column
+// return: double                       cells per second
+//==============================================================================
+static double glyph_bench_kernel (glyph_row_t row, int bpp, uint8_t *pixels,
+                                  uint8_t *bits, uint32_t *fg, uint32_t *bg)
+{
+ uint64_t start;
+ uint64_t elapsed;
+ uint64_t cells = 0;
+ int pitch = GLYPH_BENCH_COLS * 8 * bpp;
+ int lines = GLYPH_BENCH_ROWS * GLYPH_BENCH_LINES;
+ int l;
+
+ start = time_get_ns();
+ do
+    {
+     for (l = 0; l < lines; l++)
+        row(pixels + l * pitch, bits + l * GLYPH_BENCH_COLS, fg, bg,
+            GLYPH_BENCH_COLS);
+     cells += GLYPH_BENCH_COLS * GLYPH_BENCH_ROWS;
+     elapsed = time_get_ns() - start;
+    }
+ while (elapsed < GLYPH_BENCH_NS);
+
+ return cells / (elapsed / 1E9);
+}
+
+//==============================================================================
+// Glyph kernel microbenchmark (--bench-glyph).
+//
+// Each kernel supported by the host CPU expands a full 80x25 screen of 16
+// line characters with varying glyph data and colours at 16 and 32 bpp.
+// The scalar kernel's result is checked against each of the others.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void glyph_bench (void)
+{
+ uint32_t fg[GLYPH_BENCH_COLS];
+ uint32_t bg[GLYPH_BENCH_COLS];
+ uint8_t *bits;
+ uint8_t *pixels;
+ uint8_t *check;
+ double scalar[2] = {0, 0};
+ double rate;
+ int match;
+ glyph_row_t row;
+ int size;
+ int bpp;
+ int i;
+ int j;
+
+ size = GLYPH_BENCH_COLS * 8 * 4 * GLYPH_BENCH_ROWS * GLYPH_BENCH_LINES;
+ bits = malloc(GLYPH_BENCH_COLS * GLYPH_BENCH_ROWS * GLYPH_BENCH_LINES);
+ pixels = malloc(size);
+ check = malloc(size);
+ if ((! bits) || (! pixels) || (! check))
+    {
+     xprintf("glyph_bench: Unable to allocate memory\n");
+     free(bits);
+     free(pixels);
+     free(check);
+     return;
+    }
+
+ glyph_expand_table();
+ if (! glyph.name)
+    glyph_select(glyph.kernel);
+
+ for (i = 0; i < GLYPH_BENCH_COLS * GLYPH_BENCH_ROWS * GLYPH_BENCH_LINES; i++)
+    bits[i] = (i * 37) ^ (i >> 3);
+ for (i = 0; i < GLYPH_BENCH_COLS; i++)
+    {
+     fg[i] = 0x00c0ffeeu * (uint32_t)(i + 1);
+     bg[i] = 0x0badf00du * (uint32_t)(i + 3);
+    }
+
+ xprintf("glyph: auto selects '%s'\n", glyph.name);
+ xprintf("kernel  bpp  Mcells/s  speed up\n");
+
+ for (j = (sizeof(kernels) / sizeof(kernels[0])) - 2; j >= 0; j--)
+    {
+     if (! kernels[j].supported())
+        continue;
+     for (bpp = 2; bpp <= 4; bpp += 2)
+        {
+         row = (bpp == 2) ? kernels[j].row16 : kernels[j].row32;
+
+         // check against the scalar kernel output
+         memset(pixels, 0, size);
+         memset(check, 0, size);
+         for (i = 0; i < GLYPH_BENCH_ROWS * GLYPH_BENCH_LINES; i++)
+            {
+             row(pixels + i * GLYPH_BENCH_COLS * 8 * bpp,
+                 bits + i * GLYPH_BENCH_COLS, fg, bg, GLYPH_BENCH_COLS);
+             ((bpp == 2) ? glyph_row16_scalar : glyph_row32_scalar)
+                (check + i * GLYPH_BENCH_COLS * 8 * bpp,
+                 bits + i * GLYPH_BENCH_COLS, fg, bg, GLYPH_BENCH_COLS);
+            }
+
+         match = (memcmp(pixels, check, size) == 0);
+
+         rate = glyph_bench_kernel(row, bpp, pixels, bits, fg, bg);
+         if (! scalar[bpp / 4])
+            scalar[bpp / 4] = rate;
+
+         xprintf("%-6s  %3d  %8.2f  %7.2fx%s\n", kernels[j].name, bpp * 8,
+                 rate / 1E6, rate / scalar[bpp / 4],
+                 match ? "" : "  (MISMATCH)");
+        }
+    }
+
+ free(bits);
+ free(pixels);
+ free(check);
+}
@@ -0,0 +1,39 @@
+/* Glyph Expansion Header */
+
+#ifndef HEADER_GLYPH_H
+#define HEADER_GLYPH_H
+
+#include <stdint.h>
+
+#include "ubee512.h"
+
+#define GLYPH_CACHE_DEFAULT 1024 // default glyph cache entries
+
+// expands 'cells' glyph bytes, each with its own foreground and background
+// pixel value, into cells * 8 pixels
+typedef void (*glyph_row_t)(void *dst, const uint8_t *bits,
+                            const uint32_t *fg, const uint32_t *bg, int cells);
+
+typedef struct glyph_t
+{
+ char kernel[16];               // requested kernel ("auto" to detect)
+ char *name;                    // name of the kernel in use
+ glyph_row_t row8;              // 8 bpp row expansion
+ glyph_row_t row16;             // 16 bpp row expansion
+ glyph_row_t row32;             // 32 bpp row expansion
+ int cache;                     // glyph cache entries (0=off)
+}glyph_t;
+
+int glyph_init (void);
+int glyph_deinit (void);
+int glyph_reset (void);
+
+int glyph_select (char *name);
+glyph_row_t glyph_row (int bytes_per_pixel);
+void glyph_bench (void);
+
+void glyph_cache_flush (int chars, int size);
+uint8_t *glyph_cache_get (int c, uint32_t key, int *hit);
+void glyph_cache_invalidate (int c, int count);
+
+#endif     /* HEADER_GLYPH_H */
@@ -51,7 +51,8 @@ gui_status_t gui_status =
  .tape=1,
  .joy=1,
  .longdrive=0,
- .shortdrive=1
+ .shortdrive=1,
+ .skip=1
 };
 
 static int mouse_motion_ignore;
@@ -333,6 +334,15 @@ void gui_status_update (void)
          strcat(status, convert);
         }
 
+     if (gui_status.skip && video_skip_rate())
+        {
+         if (displayed)
+            strcat(status, padding);
+         displayed++;
+         snprintf(convert, sizeof(convert)-1, "[skip %d%%]", video_skip_rate());
+         strcat(status, convert);
+        }
+
      if (gui_status.mute && audio.mute)
         {
          strcat(vstates, "[M");
@@ -663,6 +673,8 @@ void gui_mousemotion_event (void)
 //==============================================================================
 void gui_update (void)
 {
+ static uint64_t skip_ticks;
+ static int skip_shown;
  uint64_t ticks = time_get_ms();
 
  if ((! mouse.host_in_use) && (video.flags & SDL_FULLSCREEN) &&
@@ -690,6 +702,17 @@ void gui_update (void)
          gui_status_update();
         }
     }
+
+ // the frame skip rate is measured each second
+ if (gui_status.skip && (ticks >= skip_ticks))
+    {
+     skip_ticks = ticks + 1000;
+     if (video_skip_rate() != skip_shown)
+        {
+         skip_shown = video_skip_rate();
+         gui_status_update();
+        }
+    }
 }
 
 //==============================================================================
@@ -737,6 +760,7 @@ void gui_proc_status_args (int arg, int pf)
   &gui_status.ram,
   &gui_status.speed,
   &gui_status.serial,
+  &gui_status.skip,
   &gui_status.sys,
   &gui_status.tape,
   &gui_status.title,
@@ -80,6 +80,7 @@ typedef struct gui_status_t
     int speed;
     int serial;
     int shortdrive;
+    int skip;
     int sys;
     int tape;
     int title;
@@ -44,6 +44,10 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added hdd_unshare() function for farm instances.
+// - Added hdd_snapshot() function for machine snapshots.
+//
 // v5.5.0 - 8 July 2013, uBee
 // - Changes required to disable port 0x58 by default as this was a 3rd
 //   party modification and to boot a standard Microbee HDD ROM it must be
@@ -71,6 +75,7 @@
 #include "options.h"
 #include "z80.h"
 #include "support.h"
+#include "snapshot.h"
 
 #include "macros.h"
 
@@ -280,6 +285,25 @@ void hdd_unloaddisk (int d)
     }
 }
 
+//==============================================================================
+// Give a farm instance private copies of the open disk images.
+//
+//   pass: void
+// return: int                  0 if no errors, else -1
+//==============================================================================
+int hdd_unshare (void)
+{
+ int i;
+
+ for (i = 0; i < HDD_NUMDRIVES; i++)
+    {
+     if (disk_unshare(&hdd_drive[i].disk) != 0)
+        return -1;
+    }
+
+ return 0;
+}
+
 //==============================================================================
 // Get use-head value.
 //
@@ -864,3 +888,51 @@ void hdd_fdc_select_w (uint16_t port, uint8_t data,
  emu.port58h = data;
  z80_hdd_ports();
 }
+
+//==============================================================================
+// Save or load the WD1002-5 state for a machine snapshot.
+//
+// The buffer pointer is saved as an offset into the sector buffer.  The
+// disk images are not saved.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void hdd_snapshot (void)
+{
+ int ofs;
+
+ if (! modelx.hdd)
+    return;
+
+ if (snapshot_chunk("HDD "))
+    return;
+
+ ofs = bufptr ? (char *)bufptr - buffer : 0;
+
+ snapshot_int(&drive);
+ snapshot_int(&error);
+ snapshot_int(&byte_count);
+ snapshot_int(&sector_count);
+ snapshot_int(&head);
+ snapshot_int(&use_head);
+ snapshot_int(&sector_size);
+ snapshot_data(buffer, sizeof(buffer));
+ snapshot_int(&ofs);
+ snapshot_data(regs, sizeof(regs));
+ snapshot_int(&port48h);
+ snapshot_int(&cmd);
+ snapshot_int(&cmd_readintr);
+ snapshot_int(&cmd_longbit);
+ snapshot_int(&cmd_multisect);
+
+ if (! snapshot_loading())
+    return;
+
+ if ((ofs < 0) || (ofs > (int)sizeof(buffer)))
+    ofs = 0;
+ bufptr = buffer + ofs;
+
+ // port 0x58 was restored by memmap_snapshot()
+ z80_hdd_ports();
+}
@@ -72,6 +72,8 @@ int hdd_deinit (void);
 int hdd_reset (void);
 int hdd_set_drive (int drive, hdd_drive_t *hdd_d);
 void hdd_unloaddisk (int d);
+int hdd_unshare (void);
+void hdd_snapshot (void);
 
 uint16_t hdd_data_r (uint16_t port, struct z80_port_read *port_s);
 uint16_t hdd_error_r (uint16_t port, struct z80_port_read *port_s);
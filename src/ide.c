@@ -41,6 +41,10 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added ide_unshare() function for farm instances.
+// - Added ide_snapshot() function for machine snapshots.
+//
 // v5.7.0 - 13 December 2015, uBee
 // - Added member 'cf8' to ide_x_t structure to enable 8 bit data transfer
 //   mode for CF cards.  This is set when calling ide_error_w() with data = 1.
@@ -74,6 +78,7 @@
 #include "options.h"
 #include "z80.h"
 #include "support.h"
+#include "snapshot.h"
 
 static int ide_loaddisk (int drive, int report);
 static void ide_unloaddisk (int d);
@@ -248,6 +253,25 @@ static void ide_unloaddisk (int d)
     }
 }
 
+//==============================================================================
+// Give a farm instance private copies of the open disk images.
+//
+//   pass: void
+// return: int                  0 if no errors, else -1
+//==============================================================================
+int ide_unshare (void)
+{
+ int i;
+
+ for (i = 0; i < IDE_NUMDRIVES; i++)
+    {
+     if (disk_unshare(&ide_drive[i].disk) != 0)
+        return -1;
+    }
+
+ return 0;
+}
+
 //==============================================================================
 // Get data.
 //
@@ -662,3 +686,72 @@ void ide_dsr_w (uint16_t port, uint8_t data, struct z80_port_write *port_s)
         }
     }
 }
+
+//==============================================================================
+// Save or load the IDE state for a machine snapshot.
+//
+// Each interface's buffer pointer points into its sector buffer or into the
+// identify information of a drive, it's saved as the drive number (-1 for
+// the sector buffer) and an offset.  The disk images are not saved.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void ide_snapshot (void)
+{
+ char *p;
+ int where;
+ int ofs;
+ int i;
+
+ if (! modelx.ide)
+    return;
+
+ if (snapshot_chunk("IDE "))
+    return;
+
+ snapshot_data(regs, sizeof(regs));
+ snapshot_u8(&dsr_port);
+ snapshot_int(&drive);
+ snapshot_int(&iface);
+ snapshot_int(&swap_bytes);
+
+ for (i = 0; i < 2; i++)
+    {
+     p = ide_x[i].bufptr;
+     if ((p >= (char *)&ide_drive[0]) &&
+        (p < (char *)&ide_drive[IDE_NUMDRIVES]))
+        {
+         where = (p - (char *)&ide_drive[0]) / sizeof(ide_drive_t);
+         ofs = p - (char *)&ide_drive[where].id;
+        }
+     else
+        {
+         where = -1;
+         ofs = p ? p - ide_x[i].buffer : 0;
+        }
+
+     snapshot_int(&ide_x[i].poweron);
+     snapshot_int(&ide_x[i].poweron_last);
+     snapshot_int(&ide_x[i].reset);
+     snapshot_int(&ide_x[i].reset_last);
+     snapshot_int(&ide_x[i].byte_count);
+     snapshot_int(&ide_x[i].error);
+     snapshot_int(&ide_x[i].cf8);
+     snapshot_data(ide_x[i].buffer, sizeof(ide_x[i].buffer));
+     snapshot_int(&where);
+     snapshot_int(&ofs);
+
+     if (! snapshot_loading())
+        continue;
+
+     if ((where >= 0) && (where < IDE_NUMDRIVES) &&
+        (ofs >= 0) && (ofs <= (int)sizeof(ide_id_t)))
+        ide_x[i].bufptr = (char *)&ide_drive[where].id + ofs;
+     else
+     if ((where == -1) && (ofs >= 0) && (ofs <= (int)sizeof(ide_x[i].buffer)))
+        ide_x[i].bufptr = ide_x[i].buffer + ofs;
+     else
+        ide_x[i].bufptr = ide_x[i].buffer;
+    }
+}
@@ -96,6 +96,8 @@ int ide_init (void);
 int ide_deinit (void);
 int ide_reset (void);
 int ide_set_drive (int drive, ide_drive_t *ide_d);
+int ide_unshare (void);
+void ide_snapshot (void);
 
 uint16_t ide_data_r (uint16_t port, struct z80_port_read *port_s);
 uint16_t ide_error_r (uint16_t port, struct z80_port_read *port_s);
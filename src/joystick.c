@@ -123,6 +123,7 @@ parint_ops_t joystick_ops =
  .strobe = NULL,  // never called
  .read = &joystick_r,
  .write = NULL,
+ .snapshot = NULL,
 };
 
 static const button_states_t hat_values[] =
@@ -98,6 +98,24 @@ int keyb_reset (void)
     return keystd_reset();
 }
 
+//==============================================================================
+// Save or load the keyboard state for a machine snapshot.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void keyb_snapshot (void)
+{
+ if (modelx.tckeys)
+    {
+     keytc_snapshot();
+     if (modelx.lpen)
+        keystd_snapshot();
+    }
+ else
+    keystd_snapshot();
+}
+
 //==============================================================================
 // Set unicode on or off.
 //
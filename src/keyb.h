@@ -6,6 +6,7 @@
 int keyb_init(void);
 int keyb_deinit(void);
 int keyb_reset(void);
+void keyb_snapshot (void);
 
 void keyb_set_unicode (int enable);
 void keyb_emu_command (int cmd, int p);
@@ -8,6 +8,7 @@
 #include "vdu.h"
 #include "ubee512.h"
 #include "support.h"
+#include "snapshot.h"
 
 //==============================================================================
 // structures and variables
@@ -293,6 +294,33 @@ int keystd_reset (void)
  return 0;
 }
 
+//==============================================================================
+// Save or load the keyboard matrix state for a machine snapshot.
+//
+// The PC key states are not included as they follow the host keyboard.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void keystd_snapshot (void)
+{
+ if (snapshot_chunk("KSTD"))
+    return;
+
+ snapshot_data(mb_keystate, sizeof(mb_keystate));
+ snapshot_data(mb_invert, sizeof(mb_invert));
+ snapshot_int(&scan_check);
+ snapshot_int(&forcescans);
+ snapshot_int(&forcenone);
+ snapshot_int(&havekeys);
+
+ if (snapshot_loading())
+    {
+     emu.keyesc = mb_keystate[mb_scan_pclower[PCK_ESCAPE]];
+     emu.keym = mb_keystate[mb_scan_pclower[PCK_m]];
+    }
+}
+
 //==============================================================================
 // Get the down status of a Microbee key.
 //
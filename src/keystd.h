@@ -9,6 +9,7 @@
 int keystd_init(void);
 int keystd_deinit(void);
 int keystd_reset(void);
+void keystd_snapshot (void);
 
 void keystd_keydown_event (void);
 void keystd_keyup_event (void);
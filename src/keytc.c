@@ -10,6 +10,7 @@
 #include "z80.h"
 #include "pio.h"
 #include "support.h"
+#include "snapshot.h"
 
 #include "macros.h"
 
@@ -343,6 +344,27 @@ int keytc_reset (void)
  return 0;
 }
 
+//==============================================================================
+// Save or load the key buffer state for a machine snapshot.
+//
+// The PC key states are not included as they follow the host keyboard.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void keytc_snapshot (void)
+{
+ if (snapshot_chunk("KTC "))
+    return;
+
+ snapshot_int(&key_256tc);
+ snapshot_data(key_buffer, sizeof(key_buffer));
+ snapshot_int(&key_count);
+ snapshot_int(&key_get);
+ snapshot_int(&key_put);
+ snapshot_u16(&port_18h);
+}
+
 //==============================================================================
 // Key event handler.
 //
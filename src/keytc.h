@@ -8,6 +8,7 @@
 int keytc_init(void);
 int keytc_deinit(void);
 int keytc_reset(void);
+void keytc_snapshot (void);
 
 void keytc_keydown_event (void);
 void keytc_keyup_event (void);
@@ -31,6 +31,24 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added memmap_snapshot() function for machine snapshots.
+// - Added RAM page write tracking for the rewind module.  When enabled the
+//   first write to each RAM page after memmap_track_clear() goes through
+//   memmap_write_lo() or memmap_write_hi() which call rewind_page_write()
+//   with the page contents before the write and then restore the page's
+//   direct write pointer.  Later writes to the page are not slowed down.
+// - Added z80_mem_rp[] and z80_mem_wp[] direct page pointer tables.  These
+//   are maintained by set_read_handler() and set_write_handler() and hold a
+//   host pointer to each 1K page when it is plain RAM or ROM, allowing the
+//   Z80 memory call backs to access the page without calling a handler.
+//   Pages using video, PCG, banked Net/alpha+ ROM or unhandled handlers are
+//   NULL and still use the handler call.
+// - memmap_configure() now calls z80api_memmap_update() after the memory
+//   map has been set up so the Z80 block engine can update its page tables.
+// - Added memmap_write_host() to get the host page written to by a Z80 page
+//   even when its direct write pointer has been removed by write tracking.
+//
 // v6.0.0 - 5 February 2017, uBee
 // - Comment out the printf("file=...") line in sram_load().
 // - Changed sram_save() to ignore an open new file error, now it only warns
@@ -186,6 +204,9 @@
 #include "support.h"
 #include "vdu.h"
 #include "z80.h"
+#include "z80api.h"
+#include "snapshot.h"
+#include "rewind.h"
 
 #include "macros.h"
 
@@ -230,6 +251,17 @@ struct z80_memory_write_byte z80_mem_w[MAXMEMHANDLERS] =
 struct z80_memory_read_byte z80_mem_r[MAXMEMHANDLERS] =
 { { -1, -1, NULL, NULL } };
 
+#ifdef MEMMAP_HANDLER_1
+// direct host pointers to the start of each page or NULL if the page must
+// use the z80_mem_r[]/z80_mem_w[] handler call.
+uint8_t *z80_mem_rp[MEMMAP_BLOCKS];
+uint8_t *z80_mem_wp[MEMMAP_BLOCKS];
+
+static uint8_t page_zero[MEMMAP_OFFSET + 1];
+static uint8_t page_ff[MEMMAP_OFFSET + 1];
+static uint8_t page_sink[MEMMAP_OFFSET + 1];
+#endif
+
 static uint8_t
    block00[BLOCK_SIZE], block01[BLOCK_SIZE], block02[BLOCK_SIZE], block03[BLOCK_SIZE],
    block04[BLOCK_SIZE], block05[BLOCK_SIZE], block06[BLOCK_SIZE], block07[BLOCK_SIZE],
@@ -283,6 +315,9 @@ memmap_t memmap =
 
 static int blocksel_x;
 
+static int track;                               // RAM page write tracking
+static uint8_t page_dirty[MEMMAP_RAM_PAGES];    // written since last clear
+
 static char name[512];
 extern char userhome_srampath[];
 extern char *model_args[];
@@ -471,6 +506,10 @@ int memmap_init (void)
 {
  int i;
 
+#ifdef MEMMAP_HANDLER_1
+ memset(page_ff, 0xFF, sizeof(page_ff));
+#endif
+
  if ((emu.model == MOD_SCF) || (emu.model == MOD_PCF))
     {
      if (emu.cfmode)
@@ -750,6 +789,243 @@ void memmap_mode2_w (uint16_t port, uint8_t data, struct z80_port_write *port_s)
     }
 }
 
+//==============================================================================
+// Save or load the memory state for a machine snapshot.
+//
+// All memory blocks are included, unused blocks compress to almost nothing.
+// The blocks are left out of the in memory snapshots used for rewinding.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void memmap_snapshot (void)
+{
+ int i;
+
+ if (snapshot_chunk("MEM "))
+    return;
+
+ snapshot_int(&emu.port50h);
+ snapshot_int(&emu.port51h);
+ snapshot_int(&emu.port58h);
+
+ if (snapshot_memory())
+    for (i = 0; i < BLOCK_TOTAL; i++)
+       snapshot_packed(block_ptrs[i], BLOCK_SIZE);
+
+ if (snapshot_loading())
+    memmap_configure();
+}
+
+#ifdef MEMMAP_HANDLER_1
+//==============================================================================
+// Get a direct host pointer for a memory read handler page.
+//
+// Returns a pointer to the first byte of the page if the handler simply
+// reads from a RAM or ROM array at a location that can not change without
+// memmap_configure() being called again.  The pak ROM offset qualifies as
+// roms_switch_pak() reconfigures the map, the Net and alpha+ BASIC ROM
+// offsets are changed by port accesses alone so these must use the handler.
+//
+//   pass: void *f                      read handler
+//         int page                     page number
+// return: uint8_t *                    page pointer, NULL if not plain memory
+//==============================================================================
+static uint8_t *memmap_read_page_ptr (void *f, int page)
+{
+ uint32_t addr = page << MEMMAP_SHIFT;
+
+ if (f == memmap_read_lo)
+    return block_ptrs[blocksel_x] + addr;
+ if (f == memmap_read_hi)
+    return block00 + (addr & 0x7FFF);
+ if (f == memmap_read_lo_z)
+    return page_zero;
+ if (f == memmap_rom1_dram_read)
+    return (uint8_t *)rom1 + (addr & 0x3FFF);
+ if (f == memmap_rom2_dram_read)
+    return (uint8_t *)rom2 + (addr & 0x3FFF);
+ if (f == memmap_rom3_dram_read)
+    return (uint8_t *)rom3 + (addr & 0x1FFF);
+ if (f == memmap_rom3x_dram_read)
+    return page_ff;
+ if (f == memmap_rom_56k_read)
+    return (uint8_t *)rom1 + (addr & 0x0FFF);
+ if (f == memmap_rom_basic_read)
+    return (uint8_t *)basic + (addr & 0x3FFF);
+ if (f == memmap_rom_pak_read)
+    return (uint8_t *)paks + pakofs + (addr & 0x1FFF);
+
+ return NULL;
+}
+
+//==============================================================================
+// Get a direct host pointer for a memory write handler page.
+//
+// Writes to ROM and disabled RAM pages are directed to a sink page that is
+// never read.
+//
+//   pass: void *f                      write handler
+//         int page                     page number
+// return: uint8_t *                    page pointer, NULL if not plain memory
+//==============================================================================
+static uint8_t *memmap_write_page_ptr (void *f, int page)
+{
+ uint32_t addr = page << MEMMAP_SHIFT;
+
+ if (f == memmap_write_lo)
+    return block_ptrs[blocksel_x] + addr;
+ if (f == memmap_write_hi)
+    return block00 + (addr & 0x7FFF);
+ if ((f == memmap_write_lo_z) || (f == memmap_romxwrite))
+    return page_sink;
+ if (f == memmap_rom_basic_write)
+    return (uint8_t *)basic + (addr & 0x3FFF);
+ if (f == memmap_rom_pak_write)
+    return (uint8_t *)paks + pakofs + (addr & 0x1FFF);
+
+ return NULL;
+}
+#endif
+
+//==============================================================================
+// Get the RAM page written to by a Z80 page.
+//
+//   pass: int i                        Z80 page number
+// return: int                          RAM page number, -1 if not main RAM
+//==============================================================================
+#ifdef MEMMAP_HANDLER_1
+static int memmap_track_page (int i)
+{
+ if (z80_mem_w[i].memory_call == memmap_write_lo)
+    return blocksel_x * (BLOCK_SIZE / MEMMAP_PAGE_SIZE) + i;
+ if (z80_mem_w[i].memory_call == memmap_write_hi)
+    return i - (0x8000 >> MEMMAP_SHIFT);
+
+ return -1;
+}
+#endif
+
+//==============================================================================
+// Remove the direct write pointers of Z80 pages mapped to RAM pages that
+// have not been written to since tracking was last cleared so that the next
+// write to each of them calls the write handler.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void memmap_track_protect (void)
+{
+#ifdef MEMMAP_HANDLER_1
+ int i;
+ int n;
+
+ if (! track)
+    return;
+
+ for (i = 0; i < MEMMAP_BLOCKS; i++)
+    {
+     n = memmap_track_page(i);
+     if ((n != -1) && (! page_dirty[n]))
+        z80_mem_wp[i] = NULL;
+    }
+#endif
+}
+
+//==============================================================================
+// First write to a RAM page since tracking was last cleared.
+//
+// The page contents are passed to the rewind module before the write takes
+// place and the direct write pointers for the page are restored.
+//
+//   pass: int n                        RAM page number
+// return: void
+//==============================================================================
+static void memmap_track_write (int n)
+{
+#ifdef MEMMAP_HANDLER_1
+ int i;
+#endif
+
+ rewind_page_write(n, memmap_ram_page(n));
+ page_dirty[n] = 1;
+
+#ifdef MEMMAP_HANDLER_1
+ for (i = 0; i < MEMMAP_BLOCKS; i++)
+    if (memmap_track_page(i) == n)
+       z80_mem_wp[i] = memmap_write_page_ptr(z80_mem_w[i].memory_call, i);
+#endif
+}
+
+//==============================================================================
+// Enable or disable RAM page write tracking.
+//
+//   pass: int enable                   1 to enable, 0 to disable
+// return: void
+//==============================================================================
+void memmap_track (int enable)
+{
+#ifdef MEMMAP_HANDLER_1
+ int i;
+#endif
+
+ track = enable;
+ memset(page_dirty, 0, sizeof(page_dirty));
+
+ if (track)
+    memmap_track_protect();
+#ifdef MEMMAP_HANDLER_1
+ else
+    for (i = 0; i < MEMMAP_BLOCKS; i++)
+       if (memmap_track_page(i) != -1)
+          z80_mem_wp[i] = memmap_write_page_ptr(z80_mem_w[i].memory_call, i);
+#endif
+}
+
+//==============================================================================
+// Clear the RAM page write tracking.
+//
+// All RAM pages are marked as not written to.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void memmap_track_clear (void)
+{
+ memset(page_dirty, 0, sizeof(page_dirty));
+ memmap_track_protect();
+}
+
+//==============================================================================
+// Get the host page written to by a Z80 page.
+//
+// Unlike z80_mem_wp[] the page is also returned for RAM pages that the
+// write tracking has removed the direct write pointer from.
+//
+//   pass: int i                        Z80 page number
+// return: uint8_t *                    page pointer, NULL if not plain memory
+//==============================================================================
+uint8_t *memmap_write_host (int i)
+{
+#ifdef MEMMAP_HANDLER_1
+ if ((z80_mem_wp[i] == NULL) && (memmap_track_page(i) != -1))
+    return memmap_write_page_ptr(z80_mem_w[i].memory_call, i);
+#endif
+ return z80_mem_wp[i];
+}
+
+//==============================================================================
+// Get a pointer to a RAM page.
+//
+//   pass: int n                        RAM page number
+// return: uint8_t *                    pointer to the start of the page
+//==============================================================================
+uint8_t *memmap_ram_page (int n)
+{
+ return block_ptrs[n / (BLOCK_SIZE / MEMMAP_PAGE_SIZE)] +
+        (n % (BLOCK_SIZE / MEMMAP_PAGE_SIZE)) * MEMMAP_PAGE_SIZE;
+}
+
 //==============================================================================
 // Insert a memory read handler.
 //
@@ -767,7 +1043,10 @@ static void set_read_handler (int addr_l, int addr_h, void *f)
  while (i <= h)
     {
      if ((z80_mem_r[i].memory_call == memmap_unhandled_read) || (f == memmap_unhandled_read))
-        z80_mem_r[i].memory_call = f;
+        {
+         z80_mem_r[i].memory_call = f;
+         z80_mem_rp[i] = memmap_read_page_ptr(f, i);
+        }
      i++;
     }
 #else
@@ -798,7 +1077,10 @@ static void set_write_handler (int addr_l, int addr_h, void *f)
  while (i <= h)
     {
      if ((z80_mem_w[i].memory_call == memmap_unhandled_write) || (f == memmap_unhandled_write))
-        z80_mem_w[i].memory_call = f;
+        {
+         z80_mem_w[i].memory_call = f;
+         z80_mem_wp[i] = memmap_write_page_ptr(f, i);
+        }
      i++;
     }
 #else
@@ -1422,6 +1704,12 @@ static void memmap_rom_net_write (uint32_t addr, uint8_t data, struct z80_memory
 //==============================================================================
 static void memmap_write_lo (uint32_t addr, uint8_t data, struct z80_memory_write_byte *mem_s)
 {
+ int n = blocksel_x * (BLOCK_SIZE / MEMMAP_PAGE_SIZE) +
+         ((addr & 0x7FFF) >> MEMMAP_SHIFT);
+
+ if (track && (! page_dirty[n]))
+    memmap_track_write(n);
+
  *(block_ptrs[blocksel_x] + addr) = data;
 }
 
@@ -1449,6 +1737,11 @@ static void memmap_write_lo_z (uint32_t addr, uint8_t data, struct z80_memory_wr
 //==============================================================================
 static void memmap_write_hi (uint32_t addr, uint8_t data, struct z80_memory_write_byte *mem_s)
 {
+ int n = (addr & 0x7FFF) >> MEMMAP_SHIFT;
+
+ if (track && (! page_dirty[n]))
+    memmap_track_write(n);
+
  block00[addr & 0x7FFF] = data;
 }
 
@@ -1497,13 +1790,15 @@ uint8_t *memmap_get_z80_ptr (int addr)
 void memmap_configure (void)
 {
  if ((emu.model == MOD_SCF) || (emu.model == MOD_PCF))
-    {
-     cf_map_configure();
-     return;
-    }
-
- if (modelx.ram >= 64)
-    dram_map_configure();
+    cf_map_configure();
  else
-    sram_map_configure();
+    if (modelx.ram >= 64)
+       dram_map_configure();
+    else
+       sram_map_configure();
+
+ z80api_memmap_update();
+
+ // done after the Z80 block engine has seen the direct write pointers
+ memmap_track_protect();
 }
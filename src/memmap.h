@@ -22,13 +22,18 @@
 #define MEMMAP_BLOCKS 16
 #define MEMMAP_MASK  0xF000
 #define MEMMAP_SHIFT 12
+#define MEMMAP_OFFSET 0x0FFF
 #else
 #define MAXMEMHANDLERS 64+4
 #define MEMMAP_BLOCKS 64
 #define MEMMAP_MASK   0xFC00
 #define MEMMAP_SHIFT  10
+#define MEMMAP_OFFSET 0x03FF
 #endif
 
+#define MEMMAP_PAGE_SIZE (MEMMAP_OFFSET + 1)
+#define MEMMAP_RAM_PAGES (BLOCK_TOTAL * (BLOCK_SIZE / MEMMAP_PAGE_SIZE))
+
 typedef struct memmap_t
 {
  int backup;
@@ -47,5 +52,10 @@ void memmap_mode1_w (uint16_t port, uint8_t data, struct z80_port_write *port_s)
 void memmap_mode2_w (uint16_t port, uint8_t data, struct z80_port_write *port_s);
 uint8_t *memmap_get_z80_ptr (int addr);
 void memmap_configure (void);
+void memmap_snapshot (void);
+void memmap_track (int enable);
+void memmap_track_clear (void);
+uint8_t *memmap_ram_page (int n);
+uint8_t *memmap_write_host (int i);
 
 #endif  /* HEADER_MEMMAP_H */
@@ -32,6 +32,10 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added --headless, --bench-frames, --bench-halt and --bench-tstates
+//   options for unthrottled benchmark runs without a window or audio.
+//
 // v6.0.0 - 1 January 2017, K Duckmanton
 // - Moved functions relating to pixels and pixel colours to the vdu module.
 //
@@ -443,6 +447,8 @@
 #include "getopt.h"
 #include "ubee512.h"
 #include "audio.h"
+#include "audiofile.h"
+#include "blep.h"
 #include "options.h"
 #include "z80.h"
 #include "z80api.h"
@@ -477,6 +483,13 @@
 #include "quickload.h"
 #include "sn76489an_core.h"
 #include "compumuse.h"
+#include "farm.h"
+#include "snapshot.h"
+#include "replay.h"
+#include "rewind.h"
+#include "glyph.h"
+#include "render.h"
+#include "capture.h"
 
 #include "macros.h"
 
@@ -490,6 +503,10 @@ static struct option long_options[] =
  {"alias-disks",    required_argument, 0, OPT_ALIAS_DISKS      + OPT_RUN},
  {"alias-roms",     required_argument, 0, OPT_ALIAS_ROMS       + OPT_RUN},
  {"args-error",     required_argument, 0, OPT_ARGS_ERROR       + OPT_RUN},
+ {"bench-frames",   required_argument, 0, OPT_BENCH_FRAMES     + OPT_RUN},
+ {"bench-glyph",    no_argument,       0, OPT_BENCH_GLYPH      + OPT_Z  },
+ {"bench-halt",     required_argument, 0, OPT_BENCH_HALT       + OPT_Z  },
+ {"bench-tstates",  required_argument, 0, OPT_BENCH_TSTATES    + OPT_RUN},
  {"bootkey",        required_argument, 0, OPT_BOOTKEY          + OPT_RUN},
  {"cfmode",         required_argument, 0, OPT_CFMODE           + OPT_Z  },
  {"config",         required_argument, 0, OPT_CONFIG           + OPT_RUN},
@@ -499,7 +516,12 @@ static struct option long_options[] =
  {"dclick",         required_argument, 0, OPT_DCLICK           + OPT_RUN},
  {"exit",           required_argument, 0, OPT_EXIT             + OPT_RUN},
  {"exit-check",     required_argument, 0, OPT_EXIT_CHECK       + OPT_RUN},
+ {"farm",           required_argument, 0, OPT_FARM             + OPT_Z  },
+ {"farm-jobs",      required_argument, 0, OPT_FARM_JOBS        + OPT_Z  },
+ {"farm-log",       required_argument, 0, OPT_FARM_LOG         + OPT_Z  },
+ {"farm-snapshot",  required_argument, 0, OPT_FARM_SNAPSHOT    + OPT_Z  },
  {"gui-persist",    required_argument, 0, OPT_GUI_PERSIST      + OPT_RUN},
+ {"headless",       no_argument,       0, OPT_HEADLESS         + OPT_Z  },
  {"keystd-mod",     required_argument, 0, OPT_KEYSTD_MOD       + OPT_RUN},
  {"lockfix-win32",  required_argument, 0, OPT_LOCKFIX_WIN32    + OPT_RUN},
  {"lockfix-x11",    required_argument, 0, OPT_LOCKFIX_X11      + OPT_RUN},
@@ -509,12 +531,21 @@ static struct option long_options[] =
  {"nodisk",         no_argument,       0, OPT_NODISK           + OPT_RUN},
  {"options-warn",   required_argument, 0, OPT_OPTIONS_WARN     + OPT_RUN},
  {"output",         required_argument, 0, OPT_OUTPUT           + OPT_RUN},
+ {"pace-spin",      required_argument, 0, OPT_PACE_SPIN        + OPT_RUN},
+ {"pace-stats",     required_argument, 0, OPT_PACE_STATS       + OPT_RUN},
  {"powercyc",       no_argument,       0, OPT_POWERCYC         + OPT_RTO},
  {"prefix",         required_argument, 0, OPT_PREFIX           + OPT_Z  },
+ {"record",         required_argument, 0, OPT_RECORD           + OPT_Z  },
+ {"replay",         required_argument, 0, OPT_REPLAY           + OPT_Z  },
  {"reset",          no_argument,       0, OPT_RESET            + OPT_RTO},
+ {"rewind",         required_argument, 0, OPT_REWIND           + OPT_RTO},
+ {"rewind-frames",  required_argument, 0, OPT_REWIND_FRAMES    + OPT_RUN},
+ {"rewind-size",    required_argument, 0, OPT_REWIND_SIZE      + OPT_RUN},
  {"runsecs",        required_argument, 0, OPT_RUNSECS          + OPT_RUN},
  {"sdl-putenv",     required_argument, 0, OPT_SDL_PUTENV       + OPT_RUN},
  {"slashes",        required_argument, 0, OPT_SLASHES          + OPT_RUN},
+ {"snapshot-load",  required_argument, 0, OPT_SNAPSHOT_LOAD    + OPT_RUN},
+ {"snapshot-save",  required_argument, 0, OPT_SNAPSHOT_SAVE    + OPT_RUN},
  {"spad",           required_argument, 0, OPT_SPAD             + OPT_RUN},
  {"status",         required_argument, 0, OPT_STATUS           + OPT_RUN},
  {"title",          required_argument, 0, OPT_TITLE            + OPT_RUN},
@@ -593,6 +624,7 @@ static struct option long_options[] =
  {"db-portw",       required_argument, 0, OPT_DB_PORTW         + OPT_RTO},
  {"db-pushm",       required_argument, 0, OPT_DB_PUSHM         + OPT_RTO},
  {"db-pushr",       no_argument,       0, OPT_DB_PUSHR         + OPT_RTO},
+ {"db-rstep",       required_argument, 0, OPT_DB_RSTEP         + OPT_RTO},
  {"db-saveb",       required_argument, 0, OPT_DB_SAVEB         + OPT_RTO},
  {"db-savem",       required_argument, 0, OPT_DB_SAVEM         + OPT_RTO},
  {"db-setb",        required_argument, 0, OPT_DB_SETB          + OPT_RTO},
@@ -660,7 +692,17 @@ static struct option long_options[] =
 
  // Display related
  {"aspect",         required_argument, 0, OPT_ASPECT           + OPT_Z  },
+ {"capture",        required_argument, 0, OPT_CAPTURE          + OPT_RUN},
+ {"capture-changed",required_argument, 0, OPT_CAPTURE_CHANGED  + OPT_RUN},
+ {"capture-every",  required_argument, 0, OPT_CAPTURE_EVERY    + OPT_RUN},
+ {"capture-format", required_argument, 0, OPT_CAPTURE_FORMAT   + OPT_RUN},
+ {"capture-frame",  no_argument,       0, OPT_CAPTURE_FRAME    + OPT_RUN},
+ {"frame-changed",  required_argument, 0, OPT_FRAME_CHANGED    + OPT_RUN},
+ {"frame-rate",     required_argument, 0, OPT_FRAME_RATE       + OPT_RUN},
+ {"frame-skip",     required_argument, 0, OPT_FRAME_SKIP       + OPT_RUN},
  {"fullscreen",     optional_argument, 0, OPT_FULLSCREEN       + OPT_Z  }, // option (-f)
+ {"glyph-cache",    required_argument, 0, OPT_GLYPH_CACHE      + OPT_Z  },
+ {"glyph-kernel",   required_argument, 0, OPT_GLYPH_KERNEL     + OPT_RUN},
  {"monitor",        required_argument, 0, OPT_MONITOR          + OPT_RUN}, // option (-m)
 
  {"mon-bg-b",       required_argument, 0, OPT_MON_BG_B         + OPT_RUN},
@@ -680,6 +722,9 @@ static struct option long_options[] =
  {"mon-fgl-g",      required_argument, 0, OPT_MON_FGL_G        + OPT_RUN},
  {"mon-fgl-r",      required_argument, 0, OPT_MON_FGL_R        + OPT_RUN},
 
+ {"raster",         required_argument, 0, OPT_RASTER           + OPT_RUN},
+ {"render-thread",  required_argument, 0, OPT_RENDER_THREAD    + OPT_Z  },
+
  {"rgb-00-r",       required_argument, 0, OPT_RGB_00_R         + OPT_RUN},
  {"rgb-00-g",       required_argument, 0, OPT_RGB_00_G         + OPT_RUN},
  {"rgb-00-b",       required_argument, 0, OPT_RGB_00_B         + OPT_RUN},
@@ -741,6 +786,8 @@ static struct option long_options[] =
  {"gl-filter-max",  required_argument, 0, OPT_GL_FILTER_MAX    + OPT_RUN},
  {"gl-filter-win",  required_argument, 0, OPT_GL_FILTER_WIN    + OPT_RUN},
  {"gl-max",         required_argument, 0, OPT_GL_MAX           + OPT_Z  },
+ {"gl-present",     required_argument, 0, OPT_GL_PRESENT       + OPT_RUN},
+ {"gl-stream",      required_argument, 0, OPT_GL_STREAM        + OPT_Z  },
  {"gl-vsync",       required_argument, 0, OPT_GL_VSYNC         + OPT_Z  },
  {"gl-winpct",      required_argument, 0, OPT_GL_WINPCT        + OPT_Z  },
  {"gl-winpix",      required_argument, 0, OPT_GL_WINPIX        + OPT_Z  },
@@ -851,10 +898,14 @@ static struct option long_options[] =
 
  // Sound emulation
  {"sound",          required_argument, 0, OPT_SOUND            + OPT_Z  },
+ {"snd-adapt",      required_argument, 0, OPT_SND_ADAPT        + OPT_Z  },
  {"snd-alg1",       required_argument, 0, OPT_SND_ALG1         + OPT_RUN}, // deprecated
+ {"snd-file",       required_argument, 0, OPT_SND_FILE         + OPT_Z  },
+ {"snd-format",     required_argument, 0, OPT_SND_FORMAT       + OPT_Z  },
  {"snd-freq",       required_argument, 0, OPT_SND_FREQ         + OPT_Z  },
  {"snd-freqadj",    required_argument, 0, OPT_SND_FREQADJ      + OPT_Z  }, // deprecated
  {"snd-freqlow",    required_argument, 0, OPT_SND_FREQLOW      + OPT_Z  }, // deprecated
+ {"snd-gain",       required_argument, 0, OPT_SND_GAIN         + OPT_RUN},
  {"snd-holdoff",    required_argument, 0, OPT_SND_HOLDOFF      + OPT_RUN}, // deprecated
  {"snd-hq",         no_argument,       0, OPT_SND_HQ           + OPT_Z  },
  {"snd-mute",       required_argument, 0, OPT_SND_MUTE         + OPT_RUN},
@@ -872,6 +923,7 @@ static struct option long_options[] =
  {"speedsel",       required_argument, 0, OPT_SPEEDSEL         + OPT_RUN},
  {"turbo",          optional_argument, 0, OPT_TURBO            + OPT_RUN}, // option (-t)
  {"z80div",         required_argument, 0, OPT_Z80DIV           + OPT_RUN},
+ {"z80-engine",     required_argument, 0, OPT_Z80_ENGINE       + OPT_Z  },
 
  // Tape port emulation
  {"tapei",          required_argument, 0, OPT_TAPEI            + OPT_RUN},
@@ -1067,6 +1119,14 @@ extern fdc_drive_t fdc_drive[];
 extern ide_drive_t ide_drive[];
 
 extern emu_t emu;
+extern farm_t farm;
+extern snapshot_t snapshot;
+extern replay_t replay;
+extern rewind_t rewindx;
+extern glyph_t glyph;
+extern render_t render;
+extern capture_t capture;
+extern audiofile_t audiofile;
 extern memmap_t memmap;
 extern model_t model_data[];
 extern model_t modelx;
@@ -1386,6 +1446,21 @@ TITLESTRING"\n"
 "                          The arguments supported are:\n"
 "                          unknown (-+) non-recognised argument error.\n"
 "\n"
+"  --bench-frames=n        Exit after n frames have been emulated and show a\n"
+"                          benchmark report. Default is 0 (no limit).\n"
+"\n"
+"  --bench-glyph           Run a microbenchmark of the glyph expansion kernels\n"
+"                          supported by this CPU and exit. The number of\n"
+"                          character cells drawn per second at 16 and 32 bpp\n"
+"                          is shown for each kernel.\n"
+"\n"
+"  --bench-halt=x          Exit when the Z80 executes a HALT instruction with\n"
+"                          interrupts disabled and show a benchmark report.\n"
+"                          x=on to enable, x=off to disable. Default is off.\n"
+"\n"
+"  --bench-tstates=n       Exit after n Z80 tstates have been emulated and show\n"
+"                          a benchmark report. Default is 0 (no limit).\n"
+"\n"
 "  --bootkey=key           Forces a light-pen key scan code on start-up. This\n"
 "                          is needed by some ROMs to enter certain operating\n"
 "                          modes. The ASCII key value is converted to a scan\n"
@@ -1419,6 +1494,9 @@ TITLESTRING"\n"
 "                          1 : delays do not give up processor time.\n"
 "                          2 : if data is in the sound buffer then use method 1\n"
 "                              otherwise method 0 applies.\n"
+"                          3 : nS pacing. Sleeps until an absolute deadline\n"
+"                              for each frame then busy waits for the last\n"
+"                              part. See --pace-spin and --pace-stats.\n"
 "\n"
 "  --dclick=n              Set the double click speed for mouse button events.\n"
 "                          n may be 100-3000 milliseconds, default is 300mS.\n"
@@ -1431,9 +1509,52 @@ TITLESTRING"\n"
 "                          must confirm before exiting the emulator. x=on to\n"
 "                          enable, x=off to disable. Default is enabled.\n"
 "\n"
+"  --farm=file             Run many headless instances from one invocation.\n"
+"                          Each line of the instance list file holds the\n"
+"                          options for one instance, these are added after\n"
+"                          the command line options and --headless. Blank\n"
+"                          lines and lines starting with '#' are ignored.\n"
+"                          Instances run as separate worker processes started\n"
+"                          once all other options have been processed. The\n"
+"                          exit status and run time of each instance is\n"
+"                          reported as it finishes. Each instance is an\n"
+"                          independent emulator with its own start up, ROMs\n"
+"                          and memory, use --farm-snapshot to share one start\n"
+"                          up between the instances. Not supported on Windows.\n"
+"\n"
+"  --farm-jobs=n           Set the maximum number of --farm instances running\n"
+"                          at once. Default is the number of host processors.\n"
+"\n"
+"  --farm-log=path         Set the console output file used by each --farm\n"
+"                          instance. A '%d' in the path is replaced by the\n"
+"                          instance number, otherwise the number is appended.\n"
+"                          Default is 'farm-%d.log'.\n"
+"\n"
+"  --farm-snapshot=file    Start every --farm instance from the machine state\n"
+"                          in a snapshot file made with --snapshot-save. The\n"
+"                          emulator is started headless and the snapshot is\n"
+"                          loaded once, each instance is then forked from it\n"
+"                          and shares its memory until written to (copy on\n"
+"                          write) so it starts in milliseconds. Only the\n"
+"                          options on the instance's line are processed by an\n"
+"                          instance and only those allowed in run mode are\n"
+"                          used, --bench-frames and --bench-tstates may be\n"
+"                          used to limit each instance. Each instance works\n"
+"                          on private copies of the open disk images, its\n"
+"                          disk writes are not saved to the images. LibDsk\n"
+"                          drives can't be used. Not supported on Windows.\n"
+"\n"
 "  --gui-persist=n         Set the persist time in milliseconds for values that\n"
 "                          appear on the status line, default is 3000mS.\n"
 "\n"
+"  --headless              Run without a window or audio device and without\n"
+"                          any speed regulation. The display is rendered to an\n"
+"                          off screen surface. On exit a benchmark report is\n"
+"                          shown with the emulated clock rate, host nS per Z80\n"
+"                          tstate and the host time spent in the CPU, sound,\n"
+"                          CRTC, video and event handling code. Use with the\n"
+"                          --bench-* options to limit the run time.\n"
+"\n"
 "  --keystd-mod=args       Set a standard keyboard behaviour modifier flag.\n"
 "                          These flags provide workarounds when emulating the\n"
 "                          6545 light pen keys.\n"
@@ -1506,6 +1627,17 @@ TITLESTRING"\n"
 "                          stdout (+-) output to STDOUT or stdout.txt on win32.\n"
 "                                      default is (-+) on win32 systems.\n"
 "\n"
+"  --pace-spin=n           Set the busy wait time in microseconds used at the\n"
+"                          end of each frame by the nS pacing method\n"
+"                          (--cpu-delay=3). Larger values give less jitter at\n"
+"                          the cost of host CPU time. Default is 200uS.\n"
+"\n"
+"  --pace-stats=n          Report nS pacing statistics every n seconds. The\n"
+"                          report shows the frame start jitter percentiles,\n"
+"                          the number of missed frame deadlines and the host\n"
+"                          CPU usage of this process. 0 disables reporting\n"
+"                          which is the default.\n"
+"\n"
 "  --powercyc              Microbee 'Power Cycle'. (no confirmation checking)\n"
 "\n"
 "  --prefix=path           Specify an alternative installation location to be\n"
@@ -1513,8 +1645,35 @@ TITLESTRING"\n"
 "                          Installed files are normally located in /usr/local/\n"
 "                          but may be prefixed with 'path'.\n"
 "\n"
+"  --record=file           Record all keyboard, joystick and serial port input\n"
+"                          to a file, each stamped with the emulated time, so\n"
+"                          that the run can be reproduced with --replay. While\n"
+"                          recording the RTC and other host time sources seen\n"
+"                          by the Microbee use the emulated time.\n"
+"\n"
+"  --replay=file           Replay a recording made with --record. Host\n"
+"                          keyboard, joystick and serial input is ignored and\n"
+"                          the recorded input is used at the same emulated\n"
+"                          times. The replay runs in turbo mode and exits at\n"
+"                          the end of the recording. The same options, ROMs\n"
+"                          and disk images (in their original state) as used\n"
+"                          for the recording must be used.\n"
+"\n"
 "  --reset                 Reset z80. (no confirmation checking)\n"
 "\n"
+"  --rewind=secs           Wind the emulation back by 'secs' seconds of emulated\n"
+"                          time (fractions allowed) to the nearest state kept.\n"
+"                          States are kept while --rewind-frames is not 0. The\n"
+"                          history is cleared by a reset and when memory is\n"
+"                          changed directly, such as by loading a file.\n"
+"\n"
+"  --rewind-frames=n       Keep a state for rewinding every n frames. 0\n"
+"                          disables rewinding. Only the RAM pages written to\n"
+"                          between states are kept. The default is 25.\n"
+"\n"
+"  --rewind-size=n         Limit the rewind history to n MB, the oldest states\n"
+"                          are dropped. The default is 32 MB.\n"
+"\n"
 "  --runsecs=n             Run the emulator for n seconds then exit. A minimum\n"
 "                          value of 5 seconds is allowed. Any disk write\n"
 "                          activity will increase the run value until several\n"
@@ -1531,6 +1690,20 @@ TITLESTRING"\n"
 "  --slashes=x             Conversion of path slashes to host format. x=on to\n"
 "                          enable, x=off to disable. Default is enabled.\n"
 "\n"
+"  --snapshot-load=file    Load the machine state from a snapshot file made\n"
+"                          with --snapshot-save.  The snapshot must be for the\n"
+"                          same model, RAM size and parallel port device and\n"
+"                          the same disk images should be in use as disk\n"
+"                          contents are not saved.\n"
+"                          The current state is kept if the file can not be\n"
+"                          loaded.  The load takes place at the end of the\n"
+"                          current frame.\n"
+"\n"
+"  --snapshot-save=file    Save the machine state to a snapshot file.  The\n"
+"                          file holds the CPU, memory and device states and\n"
+"                          can be loaded with --snapshot-load.  The save takes\n"
+"                          place at the end of the current frame.\n"
+"\n"
 "  --spad=n                Sets the number of spaces to be placed between each\n"
 "                          status entry on the title bar. The actual spacing\n"
 "                          achieved will be dependent on the title font used.\n"
@@ -1556,6 +1729,7 @@ TITLESTRING"\n"
 "                          print  (+-) show parallel printer enable.\n"
 "                          ram    (-+) show amount of RAM emulated.\n"
 "                          serial (+-) show serial port set up if enabled.\n"
+"                          skip   (+-) show percentage of frames not drawn.\n"
 "                          speed  (+-) show CPU clock speed.\n"
 "                          sys    (-+) show system name.\n"
 "                          tape   (+-) show tape input/output state.\n"
@@ -1828,6 +2002,16 @@ TITLESTRING"\n"
 "                          af, bc, de, hl, ix, iy, pc, sp, a, f, b, c, d, e, h,\n"
 "                          l, i, r and alternate registers rr_p and r_p.\n"
 "\n"
+"  --db-rstep=n            Step back n instructions, or pass 'bp' to step back\n"
+"                          to the last break point reached.  The Z80 must be\n"
+"                          stopped in the debugger and rewinding must be\n"
+"                          enabled (--rewind-frames).  The Z80 is wound back to\n"
+"                          a kept state and run forward to the wanted\n"
+"                          instruction using the current host input.  Disk,\n"
+"                          printer and serial output is not repeated while\n"
+"                          running forward.  Disk images are not wound back so\n"
+"                          disk reads return the current image contents.\n"
+"\n"
 "  --db-step=lines         Step lines of instructions.  For continuous operation\n"
 "                          pass 'c' or 'cont' and to stop pass 's', 'stop' or\n"
 "                          '0' for lines.  To step over a CALL instruction, pass\n"
@@ -2065,11 +2249,64 @@ TITLESTRING"\n"
 "                          n may be set to 1 or 2. 1:1 scaling may be enforced\n"
 "                          for some CRTC6545 display sizes'.\n"
 "\n"
+"  --capture=file          Capture displayed frames to 'file'. Frames are\n"
+"                          captured when selected by --capture-every,\n"
+"                          --capture-changed or --capture-frame. For PNG\n"
+"                          captures a '%d' in the file name is replaced by the\n"
+"                          frame number, otherwise the frame number is added\n"
+"                          before the extension. This is most useful with\n"
+"                          --video-type=offscreen.\n"
+"\n"
+"  --capture-changed=x     Capture each frame where the screen, colour,\n"
+"                          attribute or PCG RAM or the CRTC display start has\n"
+"                          changed. x=on to enable, x=off to disable. Default\n"
+"                          is disabled.\n"
+"\n"
+"  --capture-every=n       Capture every n'th frame. 0 disables this and is\n"
+"                          the default.\n"
+"\n"
+"  --capture-format=type   Capture file format. <type> may be one of the\n"
+"                          following:\n"
+"\n"
+"                          png  : a PNG file for each frame (default).\n"
+"                          raw  : 24 bit RGB frames appended to the file with\n"
+"                                 no header, for piping to a video encoder.\n"
+"                                 The frame size is reported on the console.\n"
+"                          text : the displayed characters taken from the\n"
+"                                 screen RAM appended to the file.\n"
+"\n"
+"  --capture-frame         Capture the next frame.\n"
+"  --frame-changed=x       Only draw a frame when video memory or the CRTC\n"
+"                          display state has changed since the last frame\n"
+"                          drawn. Writes made to video memory by the debugger\n"
+"                          are not noted. 'x' may be 'on' or 'off'. Default is\n"
+"                          off.\n"
+"  --frame-rate=n          The most frames drawn each second, frames that come\n"
+"                          sooner are not drawn and their changes appear in\n"
+"                          the next frame drawn. This stops the display being\n"
+"                          drawn more often than the host can show it when\n"
+"                          the emulation runs faster than real time. 0 removes\n"
+"                          the limit. Default is 60.\n"
+"  --frame-skip=n          The most frames in a row not drawn when the\n"
+"                          emulation has fallen behind real time. 0 draws\n"
+"                          every frame. Default is 4. Frames are never skipped\n"
+"                          when capturing frames.\n"
 "  -f, --fullscreen[=x]    Toggle state of full screen mode, the display\n"
 "                          defaults to a window (use EMUKEY+ENTER to toggle).\n"
 "                          If 'x' is specified then full screen mode can be set\n"
 "                          with x=on or window mode set with x=off.\n"
 "\n"
+"  --glyph-cache=n         Number of character cells kept in the glyph cache.\n"
+"                          Cells already expanded into screen pixels with the\n"
+"                          same character, colours and attributes are copied\n"
+"                          from the cache instead of being expanded again. 0\n"
+"                          disables the cache. Default is 1024.\n"
+"  --glyph-kernel=name     Select the kernel used to expand character glyphs\n"
+"                          into screen pixels. 'name' may be 'auto', 'scalar',\n"
+"                          'sse2', 'avx2' (x86) or 'neon' (ARM). The default\n"
+"                          is 'auto' which uses the fastest kernel the CPU\n"
+"                          supports.\n"
+"\n"
 "  -m, --monitor=type      Monitor type, if this option is not specified a\n"
 "                          colour monitor is the default when emulating colour\n"
 "                          and green if a monochrome model. <type> may be one\n"
@@ -2106,6 +2343,21 @@ TITLESTRING"\n"
 "                          option is only for the Premium (alpha+) models for\n"
 "                          dual intensity monochrome (see --dint).\n"
 "\n"
+"  --raster=x              Raster renderer. The display start address is\n"
+"                          latched at the start of each character row as the\n"
+"                          frame is displayed so programs that change it part\n"
+"                          way through a frame, such as split screens and\n"
+"                          smooth scrolling, are shown as they would be on a\n"
+"                          real display. Frames where all rows have the same\n"
+"                          start address are drawn as usual. The other CRTC\n"
+"                          registers take effect for the whole frame. x=on to\n"
+"                          enable, x=off to disable. Default is disabled.\n"
+"\n"
+"  --render-thread=x       Draw and present the display on a separate thread so\n"
+"                          a slow display does not slow down the emulation.\n"
+"                          x=on to enable, x=off to disable. Not used with\n"
+"                          OpenGL rendering. Default is disabled.\n"
+"\n"
 "  --rgb-nn-x=level        48 options to customise the Premium (alpha+) colours.\n"
 "                          nn is the colour value (00-15), x is the gun colour\n"
 "                          ('r', 'g', 'b'). The level value is 0-255.\n"
@@ -2129,6 +2381,9 @@ TITLESTRING"\n"
 "\n"
 "                          gl : OpenGL (textured) hardware rendering.\n"
 "                          hw : SDL hardware rendering.\n"
+"                          offscreen : Draw into memory only, no display is\n"
+"                                      needed. Used by --headless and for\n"
+"                                      --capture.\n"
 "                          sw : SDL software rendering.\n"
 "\n"
 // +++++++++++++++++++++++++ On Screen Display (OSD) +++++++++++++++++++++++++++
@@ -2256,6 +2511,18 @@ TITLESTRING"\n"
 "                          --fullscreen option. Default is off. This option is\n"
 "                          currently not supported on Windows machines.\n"
 "\n"
+"  --gl-present=x          Presentation of OpenGL frames. x=frame draws and\n"
+"                          presents every frame, x=changed only draws and\n"
+"                          presents a frame when the display has changed so\n"
+"                          an idle display does not wait for the vertical\n"
+"                          retrace. Default is frame.\n"
+"\n"
+"  --gl-stream=x           Texture streaming: update the texture through a\n"
+"                          ring of pixel buffer objects and draw from a\n"
+"                          vertex buffer object if the OpenGL driver supports\n"
+"                          them. x=off to disable, x=on to enable. Default is\n"
+"                          enabled.\n"
+"\n"
 "  --gl-vsync=x            Vsync: swap buffers every n'th retrace. x=off to\n"
 "                          disable, x=on to enable. Default is enabled.\n"
 "\n"
@@ -2754,8 +3021,29 @@ TITLESTRING"\n"
 "                          prop   : sound is proportional to CPU clock frequency\n"
 "                          normal : sound rate forced as if 3.375 MHz CPU clock\n"
 "\n"
+"  --snd-adapt=x           Adaptive low latency sound. The sound is held at the\n"
+"                          smallest queue that covers the measured timing\n"
+"                          jitter and is played up to 0.5\% faster or slower to\n"
+"                          keep it there. The SDL callback size is limited to\n"
+"                          512 samples. x=on to enable, x=off to disable.\n"
+"                          Default is off.\n"
+"  --snd-file=file         Write the sound to 'file' as well as the sound\n"
+"                          device. The samples are timed by the emulated Z80,\n"
+"                          so the file is the same in turbo and headless runs\n"
+"                          as at normal speed. A name ending in '.flac' writes\n"
+"                          a 16 bit FLAC file, other names a WAV file in the\n"
+"                          --snd-format sample format. --snd-adapt is not\n"
+"                          used with this option.\n"
+"  --snd-format=x          Set the sound output format. x may be 's16' for\n"
+"                          signed 16 bit or 'f32' for 32 bit float samples.\n"
+"                          Default is 's16'.\n"
 "  --snd-freq=f            Set the sound sampling rate, f may be a value from\n"
 "                          5512 to 176400 Hz. Default frequency is 44100 Hz.\n"
+"  --snd-gain=s,l          Set the gain of a sound source before it is mixed\n"
+"                          with the others. 's' is the source, one of\n"
+"                          'beetalker', 'beethoven', 'compumuse', 'dac',\n"
+"                          'sn76489an' or 'speaker'. A level of 0 to 200\% is\n"
+"                          allowed. Default is 100\%.\n"
 "  --snd-hq                Sets high quality sound. How well this works will be\n"
 "                          dependent on the host platform. This option has the\n"
 "                          same effect as setting all these values:\n"
@@ -2838,6 +3126,15 @@ TITLESTRING"\n"
 "                          versions prior to 2.7.0 this value was 1. Default\n"
 "                          value is 25.\n"
 "\n"
+"  --z80-engine=type       Select the Z80 CPU engine. The 'block' engine\n"
+"                          decodes Z80 code once into basic blocks that are\n"
+"                          cached and run directly, giving higher emulation\n"
+"                          speeds. Blocks are discarded when the code is\n"
+"                          written to. The default is 'z80ex'.\n"
+"\n"
+"                          z80ex : z80ex library engine\n"
+"                          block : basic block engine\n"
+"\n"
 // +++++++++++++++++++++++++ Tape port emulation +++++++++++++++++++++++++++++++
 " Tape port emulation:\n\n"
 "                          See 'File path searching' further on for detailed\n"
@@ -3608,6 +3905,7 @@ static void options_control (int c)
   "ram",
   "speed",
   "serial",
+  "skip",
   "sys",
   "tape",
   "title",
@@ -3651,6 +3949,21 @@ static void options_control (int c)
                }
            }
         break;
+     case OPT_BENCH_FRAMES :
+        set_int_from_arg(&emu.bench_frames, 0, MAXINT);
+        break;
+     case OPT_BENCH_GLYPH :
+        glyph_bench();
+        exitstatus = -1;
+        break;
+     case OPT_BENCH_HALT :
+        set_int_from_list(&emu.bench_halt, offon_args);
+        break;
+     case OPT_BENCH_TSTATES :
+        emu.bench_tstates = strtoull(e_optarg, &ptr, 0);
+        if ((! e_optarg[0]) || (*ptr != 0))
+           param_error_mesg();
+        break;
      case OPT_BOOTKEY :
         if (! e_optarg[0] || e_optarg[1])
            param_error_mesg();
@@ -3676,7 +3989,7 @@ static void options_control (int c)
         set_int_from_arg(&emu.cmd_repeat2, 1, MAXINT);
         break;
      case OPT_CPU_DELAY :
-        set_int_from_arg(&emu.proc_delay_type, 0, 2);
+        set_int_from_arg(&emu.proc_delay_type, 0, 3);
         break;
      case OPT_DCLICK :
         set_int_from_arg(&gui.dclick_time, 100, 3000);
@@ -3687,9 +4000,31 @@ static void options_control (int c)
      case OPT_EXIT_CHECK :
         set_int_from_list(&emu.exit_check, offon_args);
         break;
+     case OPT_FARM :
+        // an instance processes the options again and must ignore this
+        if (! farm.instance)
+           {
+            strncpy(farm.file, e_optarg, sizeof(farm.file));
+            farm.file[sizeof(farm.file)-1] = 0;
+           }
+        break;
+     case OPT_FARM_JOBS :
+        set_int_from_arg(&farm.jobs, 1, 1024);
+        break;
+     case OPT_FARM_LOG :
+        strncpy(farm.log, e_optarg, sizeof(farm.log));
+        farm.log[sizeof(farm.log)-1] = 0;
+        break;
+     case OPT_FARM_SNAPSHOT :
+        strncpy(farm.snapshot, e_optarg, sizeof(farm.snapshot));
+        farm.snapshot[sizeof(farm.snapshot)-1] = 0;
+        break;
      case OPT_GUI_PERSIST :
         set_int_from_arg(&gui.persist_time, 1, MAXINT);
         break;
+     case OPT_HEADLESS :
+        emu.headless = 1;
+        break;
      case OPT_KEYSTD_MOD :
         while (1)
            {
@@ -3729,6 +4064,12 @@ static void options_control (int c)
             console_proc_output_args(res, pf);
            }
         break;
+     case OPT_PACE_SPIN :
+        set_int_from_arg(&emu.pace_spin, 0, 100000);
+        break;
+     case OPT_PACE_STATS :
+        set_int_from_arg(&emu.pace_stats, 0, 3600);
+        break;
      case OPT_POWERCYC :
         emu.reset = EMU_RST_POWERCYC_NOW;
         emu.keyesc = 0;
@@ -3737,6 +4078,16 @@ static void options_control (int c)
      case OPT_PREFIX :
         strcpy(emu.prefix_path, e_optarg);
         break;
+     case OPT_RECORD :
+        strncpy(replay.file, e_optarg, sizeof(replay.file));
+        replay.file[sizeof(replay.file)-1] = 0;
+        replay.mode = REPLAY_RECORD;
+        break;
+     case OPT_REPLAY :
+        strncpy(replay.file, e_optarg, sizeof(replay.file));
+        replay.file[sizeof(replay.file)-1] = 0;
+        replay.mode = REPLAY_PLAY;
+        break;
      case OPT_SDL_PUTENV :
         // we have to keep the variables ourselves! SDL_putenv(e_optarg)
         // won't work as the value gets changed on each option!
@@ -3754,6 +4105,18 @@ static void options_control (int c)
         emu.keyesc = 0;
         emu.keym = 0;
         break;
+     case OPT_REWIND :
+        if (float_arg <= 0)
+           param_error_mesg();
+        else
+           rewindx.secs = float_arg;
+        break;
+     case OPT_REWIND_FRAMES :
+        set_int_from_arg(&rewindx.frames, 0, MAXINT);
+        break;
+     case OPT_REWIND_SIZE :
+        set_int_from_arg(&rewindx.size, 1, 4096);
+        break;
      case OPT_RUNSECS :
         if ((int_arg != 0) && (int_arg < 5))  // can't use 'set_int_from_arg()' on this
            param_error_mesg();
@@ -3763,6 +4126,14 @@ static void options_control (int c)
      case OPT_SLASHES :
         set_int_from_list(&emu.slashconv, offon_args);
         break;
+     case OPT_SNAPSHOT_LOAD :
+        strncpy(snapshot.load, e_optarg, sizeof(snapshot.load));
+        snapshot.load[sizeof(snapshot.load)-1] = 0;
+        break;
+     case OPT_SNAPSHOT_SAVE :
+        strncpy(snapshot.save, e_optarg, sizeof(snapshot.save));
+        snapshot.save[sizeof(snapshot.save)-1] = 0;
+        break;
      case OPT_SPAD :
         if (gui_status_padding(int_arg))
            param_error_mesg();
@@ -4187,6 +4558,11 @@ static void options_debugging (int c)
            param_error_mesg();
         break;
 
+     case OPT_DB_RSTEP :
+        if (z80debug_rstep(e_optarg) == -1)
+           param_error_mesg();
+        break;
+
      case OPT_DB_SAVEB :
         if (z80debug_save_bank(e_optarg) == -1)
            param_error_mesg();
@@ -4453,6 +4829,15 @@ static void options_display (int c)
   "sw",
   "hw",
   "gl",
+  "offscreen",
+  ""
+ };
+
+ char *capture_format_args[] =
+ {
+  "png",
+  "raw",
+  "text",
   ""
  };
 
@@ -4472,6 +4857,13 @@ static void options_display (int c)
   "sharp",
   ""
  };
+
+ char *gl_present_args[] =
+ {
+  "frame",
+  "changed",
+  ""
+ };
 #endif
 
  int x = 0;
@@ -4481,12 +4873,49 @@ static void options_display (int c)
      case OPT_ASPECT :
         set_int_from_arg(&video.aspect, 1, 2);
         break;
+     case OPT_CAPTURE :
+        strncpy(capture.file, e_optarg, sizeof(capture.file));
+        capture.file[sizeof(capture.file)-1] = 0;
+        break;
+     case OPT_CAPTURE_CHANGED :
+        set_int_from_list(&capture.changed, offon_args);
+        break;
+     case OPT_CAPTURE_EVERY :
+        set_int_from_arg(&capture.every, 0, MAXINT);
+        break;
+     case OPT_CAPTURE_FORMAT :
+        set_int_from_list(&capture.format, capture_format_args);
+        break;
+     case OPT_CAPTURE_FRAME :
+        capture.trigger = 1;
+        break;
+     case OPT_FRAME_CHANGED :
+        set_int_from_list(&video.frame_changed, offon_args);
+        break;
+     case OPT_FRAME_RATE :
+        set_int_from_arg(&video.frame_rate, 0, 1000);
+        break;
+     case OPT_FRAME_SKIP :
+        set_int_from_arg(&video.frame_skip, 0, 1000);
+        break;
      case OPT_FULLSCREEN :
         if (! e_optarg[0])
            video.fullscreen = ! video.fullscreen;
         else
            set_int_from_list(&video.fullscreen, offon_args);
         break;
+     case OPT_GLYPH_CACHE :
+        set_int_from_arg(&glyph.cache, 0, 65536);
+        break;
+     case OPT_GLYPH_KERNEL :
+        if (glyph_select(e_optarg) == -1)
+           param_error_mesg();
+        else
+           {
+            strncpy(glyph.kernel, e_optarg, sizeof(glyph.kernel));
+            glyph.kernel[sizeof(glyph.kernel)-1] = 0;
+           }
+        break;
      case OPT_MONITOR :
         if (set_int_from_list(&x, monitor_args) == -1)
            break;
@@ -4526,6 +4955,13 @@ static void options_display (int c)
         xprintf("ubee512: See the ubee512rc.sample and README files.\n");
         break;
 
+     case OPT_RASTER :
+        set_int_from_list(&crtc.raster, offon_args);
+        break;
+     case OPT_RENDER_THREAD :
+        set_int_from_list(&render.thread, offon_args);
+        break;
+
      case OPT_RGB_00_R :
      case OPT_RGB_00_G :
      case OPT_RGB_00_B :
@@ -4625,6 +5061,12 @@ static void options_display (int c)
         set_int_from_list(&video.max, offon_args);
 #endif
         break;
+     case OPT_GL_PRESENT :
+        set_int_from_list(&video.gl_present, gl_present_args);
+        break;
+     case OPT_GL_STREAM :
+        set_int_from_list(&video.gl_stream, offon_args);
+        break;
      case OPT_GL_VSYNC :
         set_int_from_list(&video.vsync, offon_args);
         break;
@@ -5149,6 +5591,9 @@ static void options_serial_port (int c)
 static void options_sound (int c)
 {
  int x;
+ char name[16];
+ char level[16];
+ char *s;
  
  char *sound_args[] =
  {
@@ -5158,6 +5603,24 @@ static void options_sound (int c)
   ""
  };
 
+ char *snd_format_args[] =
+ {
+  "s16",
+  "f32",
+  ""
+ };
+
+ char *snd_gain_args[] =
+ {
+  "beetalker",
+  "beethoven",
+  "compumuse",
+  "dac",
+  "sn76489an",
+  "speaker",
+  ""
+ };
+
  switch (c)
     {
      case OPT_SOUND :           // deprecated --sound=off
@@ -5172,8 +5635,19 @@ static void options_sound (int c)
         audio.mute = 1;
         xprintf("ubee512: Option `--sound=off' now sets --snd-mute=on.\n");
         break;
+     case OPT_SND_ADAPT :
+        set_int_from_list(&audio.adapt, offon_args);
+        break;
      case OPT_SND_ALG1 :	/* deprecated */
         break;
+     case OPT_SND_FILE :
+        strncpy(audiofile.file, e_optarg, sizeof(audiofile.file));
+        audiofile.file[sizeof(audiofile.file)-1] = 0;
+        break;
+     case OPT_SND_FORMAT :
+        if (set_int_from_list(&x, snd_format_args) != -1)
+           audio.format = x ? AUDIO_F32SYS : AUDIO_S16SYS;
+        break;
      case OPT_SND_FREQ :
         set_int_from_arg(&audio.frequency, 5512, 176400);
         break;
@@ -5181,6 +5655,19 @@ static void options_sound (int c)
         break;
      case OPT_SND_FREQLOW :	/* deprecated */
         break;
+     case OPT_SND_GAIN :
+        s = get_next_parameter(e_optarg, ',', name, &x, sizeof(name)-1);
+        if ((s == NULL) || (string_search(snd_gain_args, name) == -1))
+           {
+            param_error_mesg();
+            break;
+           }
+        get_next_parameter(s, ',', level, &x, sizeof(level)-1);
+        if ((x < 0) || (x > 200))
+           param_error_mesg();
+        else
+           audio_set_gain(name, x);
+        break;
      case OPT_SND_HOLDOFF :	/* deprecated */
         break;
      case OPT_SND_HQ :
@@ -5213,6 +5700,13 @@ static void options_sound (int c)
 //==============================================================================
 static void options_speed (int c)
 {
+ char *z80engine_args[] =
+ {
+  "z80ex",
+  "block",
+  ""
+ };
+
  switch (c)
     {
      case OPT_CLOCK :
@@ -5254,6 +5748,9 @@ static void options_speed (int c)
         if (emu.runmode)
            set_clock_speed(modelx.cpuclock, emu.z80_divider, 0);
         break;
+     case OPT_Z80_ENGINE :
+        set_int_from_list(&emu.z80engine, z80engine_args);
+        break;
     }
 }
 
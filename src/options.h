@@ -44,6 +44,10 @@ enum
  OPT_ALIAS_DISKS,
  OPT_ALIAS_ROMS,
  OPT_ARGS_ERROR,
+ OPT_BENCH_FRAMES,
+ OPT_BENCH_GLYPH,
+ OPT_BENCH_HALT,
+ OPT_BENCH_TSTATES,
  OPT_BOOTKEY,
  OPT_CFMODE,
  OPT_CONFIG,
@@ -53,7 +57,12 @@ enum
  OPT_DCLICK,
  OPT_EXIT,
  OPT_EXIT_CHECK,
+ OPT_FARM,
+ OPT_FARM_JOBS,
+ OPT_FARM_LOG,
+ OPT_FARM_SNAPSHOT,
  OPT_GUI_PERSIST,
+ OPT_HEADLESS,
  OPT_KEYSTD_MOD,
  OPT_LOCKFIX_WIN32,
  OPT_LOCKFIX_X11,
@@ -63,12 +72,21 @@ enum
  OPT_NODISK,
  OPT_OPTIONS_WARN,
  OPT_OUTPUT,
+ OPT_PACE_SPIN,
+ OPT_PACE_STATS,
  OPT_POWERCYC,
  OPT_PREFIX,
+ OPT_RECORD,
+ OPT_REPLAY,
  OPT_RESET,
+ OPT_REWIND,
+ OPT_REWIND_FRAMES,
+ OPT_REWIND_SIZE,
  OPT_RUNSECS,
  OPT_SDL_PUTENV,
  OPT_SLASHES,
+ OPT_SNAPSHOT_LOAD,
+ OPT_SNAPSHOT_SAVE,
  OPT_SPAD,
  OPT_STATUS,
  OPT_TITLE,
@@ -147,6 +165,7 @@ enum
  OPT_DB_PORTW,
  OPT_DB_PUSHM,
  OPT_DB_PUSHR,
+ OPT_DB_RSTEP,
  OPT_DB_SAVEB,
  OPT_DB_SAVEM,
  OPT_DB_SETB,
@@ -220,7 +239,17 @@ enum
 enum
 {
  OPT_ASPECT=OPT_GROUP_DISPLAY,
+ OPT_CAPTURE,
+ OPT_CAPTURE_CHANGED,
+ OPT_CAPTURE_EVERY,
+ OPT_CAPTURE_FORMAT,
+ OPT_CAPTURE_FRAME,
+ OPT_FRAME_CHANGED,
+ OPT_FRAME_RATE,
+ OPT_FRAME_SKIP,
  OPT_FULLSCREEN,
+ OPT_GLYPH_CACHE,
+ OPT_GLYPH_KERNEL,
  OPT_MONITOR,
 
  OPT_MON_BG_B,
@@ -240,6 +269,9 @@ enum
  OPT_MON_FGL_G,
  OPT_MON_FGL_R,
 
+ OPT_RASTER,
+ OPT_RENDER_THREAD,
+
  OPT_RGB_00_R,
  OPT_RGB_00_G,
  OPT_RGB_00_B,
@@ -300,6 +332,8 @@ enum
  OPT_GL_FILTER_MAX,
  OPT_GL_FILTER_WIN,
  OPT_GL_MAX,
+ OPT_GL_PRESENT,
+ OPT_GL_STREAM,
  OPT_GL_VSYNC,
  OPT_GL_WINPCT,
  OPT_GL_WINPIX
@@ -425,10 +459,14 @@ enum
 enum
 {
  OPT_SOUND=OPT_GROUP_SOUND,
+ OPT_SND_ADAPT,
  OPT_SND_ALG1,
+ OPT_SND_FILE,
+ OPT_SND_FORMAT,
  OPT_SND_FREQ,
  OPT_SND_FREQADJ,
  OPT_SND_FREQLOW,
+ OPT_SND_GAIN,
  OPT_SND_HOLDOFF,
  OPT_SND_HQ,
  OPT_SND_MUTE,
@@ -448,7 +486,8 @@ enum
  OPT_XTAL,
  OPT_SPEEDSEL,
  OPT_TURBO,
- OPT_Z80DIV
+ OPT_Z80DIV,
+ OPT_Z80_ENGINE
 };
 
 // Tape port emulation and TAP file support
@@ -24,6 +24,9 @@
 // the poll() function is called when the PIO is polled for an interrupt
 // condition, but before the interrupt flag is tested.
 
+// the snapshot() function saves or loads the peripheral state for a
+// machine snapshot, it is called as part of the PIO snapshot.
+
 typedef struct {
     int (*init)(void);          /* initialisation */
     int (*deinit)(void);        /* de-initialisation */
@@ -33,6 +36,7 @@ typedef struct {
     void (*strobe)(void);
     uint8_t (*read)(void);
     void (*write)(uint8_t);
+    void (*snapshot)(void);
 } parint_ops_t;
 
 #endif /* HEADER_PARINT_H */
@@ -47,6 +47,10 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added pio_snapshot() function for machine snapshots, this includes the
+//   state of the parallel port peripheral.
+//
 // v5.0.0 - 13 July 2010, K Duckmanton
 // - Removed all references to the 'sound' global variable and replaced them
 //   with references to the 'audio' global instead.
@@ -179,6 +183,7 @@
 #include "z80api.h"
 #include "support.h"
 #include "parint.h"
+#include "snapshot.h"
 
 #include "macros.h"
 
@@ -516,6 +521,58 @@ void pio_configure (int cpuclock)
 {
 }
 
+//==============================================================================
+// Save or load the state of one PIO port for a machine snapshot.
+//
+//   pass: pio_t *p
+// return: void
+//==============================================================================
+static void pio_snapshot_port (pio_t *p)
+{
+ SDL_LockMutex(p->pending_mutex);
+
+ snapshot_u8(&p->data);
+ snapshot_u8(&p->cont);
+ snapshot_u8(&p->mode);
+ snapshot_u8(&p->vector);
+ snapshot_u8(&p->maskword);
+ snapshot_u8(&p->direction);
+ snapshot_u8(&p->data_in);
+ snapshot_u8(&p->data_out);
+ snapshot_int(&p->action);
+ snapshot_int(&p->ienable);
+ snapshot_int(&p->andor);
+ snapshot_int(&p->hilo);
+ snapshot_int(&p->ienableff);
+ snapshot_int(&p->pending);
+ snapshot_int(&p->change);
+ snapshot_int(&p->last);
+
+ SDL_UnlockMutex(p->pending_mutex);
+}
+
+//==============================================================================
+// Save or load the PIO state for a machine snapshot.
+//
+// The peripheral connected to port A saves its own state in a chunk
+// following the PIO chunk.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void pio_snapshot (void)
+{
+ if (snapshot_chunk("PIO "))
+    return;
+
+ pio_snapshot_port(&pio_a);
+ pio_snapshot_port(&pio_b);
+ snapshot_int(&polling);
+
+ if (pio_a_peripheral && pio_a_peripheral->snapshot)
+    (*pio_a_peripheral->snapshot)();
+}
+
 //==============================================================================
 // PIO register dump
 //
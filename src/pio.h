@@ -15,6 +15,7 @@ void pio_polling (void);
 void pio_porta_strobe(void);
 void pio_configure (int cpuclock);
 void pio_regdump (void);
+void pio_snapshot (void);
 uint16_t pio_r (uint16_t port, struct z80_port_read *port_s);
 void pio_w (uint16_t port, uint8_t data, struct z80_port_write *port_s);
 int pio_porta_connect(parint_ops_t *device);
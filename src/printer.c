@@ -32,6 +32,10 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - printer_ready() does not write to the printer files while
+//   rewind_step_back() is re-executing instructions.
+//
 // v4.7.0 - 17 June 2010, K Duckmanton
 // - Changes to allow several different devices to be connected to the
 //   emulated parallel port
@@ -76,6 +80,7 @@
 #include "z80api.h"
 #include "parint.h"
 #include "pio.h"
+#include "rewind.h"
 
 
 //==============================================================================
@@ -106,6 +111,7 @@ void printer_poll(void);
 printer_t printer;
 
 extern char userhome_prntpath[];
+extern rewind_t rewindx;
 
 parint_ops_t printer_ops = {
     .init = &printer_init,
@@ -116,6 +122,7 @@ parint_ops_t printer_ops = {
     .strobe = &pio_porta_strobe,
     .read = NULL,
     .write = &printer_w,
+    .snapshot = NULL,
 };
 
 //==============================================================================
@@ -314,7 +321,9 @@ void printer_ready(void)
     return;                     /* new data has been written before
                                  * the previous data was
                                  * acknowledged */
- if (printer.print_a_file != NULL)
+ // the data was printed when the instruction was first executed but the
+ // busy timing is kept the same.
+ if (printer.print_a_file != NULL && ! rewindx.replaying)
     {
      fprintf(printer.print_a_file, "%3d ", printer.data);
      if (++printer.count == 16)
@@ -324,7 +333,7 @@ void printer_ready(void)
         }
     }
 
- if (printer.print_b_file != NULL)
+ if (printer.print_b_file != NULL && ! rewindx.replaying)
     fwrite(&printer.data, sizeof(printer.data), 1, printer.print_b_file);
 
  if ((printer.print_a_file != NULL) || (printer.print_b_file != NULL))
@@ -0,0 +1,268 @@
+//******************************************************************************
+//*                                  uBee512                                   *
+//*       An emulator for the Microbee Z80 ROM, FDD and HDD based models       *
+//*                                                                            *
+//*                            Render thread module                            *
+//*                                                                            *
+//*                          Copyright (C) 2026 agent                          *
+//******************************************************************************
+//
+// Draws and presents the display on its own thread so a slow present does
+// not take time from the Z80 emulation.
+//
+// When --render-thread=on is used video_update() publishes a frame
+// description after each Z80 code frame instead of drawing the display.
+// The description holds copies of the character ROM, screen, attribute,
+// colour and PCG RAM and the CRTC values the display is drawn from
+// (crtc_frame()).  Frames are passed through a lock free triple buffer, the
+// emulation thread always has a frame to write to and never waits for the
+// render thread, which draws the newest frame published with crtc_draw()
+// and presents it.  Frames published while the render thread is busy are
+// replaced by newer ones.
+//
+// Everything the render thread changes is found by comparing frames so no
+// state is shared with the emulation thread while it runs.  Drawing that is
+// still done on the emulation thread (the OSD, window changes) holds the
+// render lock, which the render thread also holds while it draws and
+// presents a frame.
+//
+// The render thread is not used with OpenGL rendering as the OpenGL
+// context belongs to the thread that created it.
+//
+//==============================================================================
+/*
+ *  uBee512 - An emulator for the Microbee Z80 ROM, FDD and HDD based models.
+ *  Copyright (C) 2026 agent
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+//==============================================================================
+// ChangeLog (most recent entries are at top)
+//==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Created a new file to draw and present the display on a render thread
+//   fed through a triple buffer of frame descriptions.
+//==============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "render.h"
+#include "ubee512.h"
+#include "support.h"
+#include "crtc.h"
+#include "vdu.h"
+#include "video.h"
+
+//==============================================================================
+// constants
+//==============================================================================
+#define RENDER_SLOT  0x03       // frame slot number
+#define RENDER_FRESH 0x04       // slot holds a frame not yet drawn
+
+//==============================================================================
+// structures and variables
+//==============================================================================
+render_t render;
+
+typedef struct render_frame_t
+{
+ vdu_t vdu;
+ crtc_frame_t crtc;
+}render_frame_t;
+
+static render_frame_t frames[3];
+static int slot_write = 0;      // owned by the emulation thread
+static int slot_read = 1;       // owned by the render thread
+static int slot_ready = 2;      // exchanged between them
+
+static SDL_Thread *thread;
+static SDL_mutex *lock;
+static SDL_sem *frame_sem;
+static volatile int done;
+
+extern emu_t emu;
+extern model_t modelx;
+extern vdu_t vdu;
+extern video_t video;
+
+//==============================================================================
+// Render thread.
+//
+// Waits for a frame to be published then draws and presents the newest one.
+//
+//   pass: void *data                   not used
+// return: int                          0
+//==============================================================================
+static int render_worker (void *data)
+{
+ render_frame_t *f;
+
+ for (;;)
+    {
+     SDL_SemWait(frame_sem);
+     if (done)
+        break;
+
+     slot_read = __atomic_exchange_n(&slot_ready, slot_read, __ATOMIC_ACQ_REL);
+     if (! (slot_read & RENDER_FRESH))
+        continue;
+     slot_read &= RENDER_SLOT;
+     f = &frames[slot_read];
+
+     render_lock();
+     vdu_source(&f->vdu);
+     if (crtc_draw(&f->crtc))
+        video_render();
+     vdu_source(NULL);
+     render_unlock();
+    }
+
+ return 0;
+}
+
+//==============================================================================
+// Render initialise.
+//
+//   pass: void
+// return: int                          0 if success, -1 if error
+//==============================================================================
+int render_init (void)
+{
+ if (! render.thread)
+    return 0;
+
+ if (video.type == VIDEO_GL)
+    {
+     xprintf("render_init: The render thread is not used with OpenGL rendering\n");
+     render.thread = 0;
+     return 0;
+    }
+
+ done = 0;
+ lock = SDL_CreateMutex();
+ frame_sem = SDL_CreateSemaphore(0);
+ if (lock && frame_sem)
+    thread = SDL_CreateThread(render_worker, NULL);
+ if (! thread)
+    {
+     xprintf("render_init: Unable to start the render thread\n");
+     render_deinit();
+     return -1;
+    }
+
+ return 0;
+}
+
+//==============================================================================
+// Render de-initialise.
+//
+// Stops the render thread, the display is drawn on the emulation thread
+// after this.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int render_deinit (void)
+{
+ if (thread)
+    {
+     done = 1;
+     SDL_SemPost(frame_sem);
+     SDL_WaitThread(thread, NULL);
+     thread = NULL;
+    }
+ if (frame_sem)
+    SDL_DestroySemaphore(frame_sem);
+ if (lock)
+    SDL_DestroyMutex(lock);
+ frame_sem = NULL;
+ lock = NULL;
+ render.thread = 0;
+
+ return 0;
+}
+
+//==============================================================================
+// Render reset.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int render_reset (void)
+{
+ return 0;
+}
+
+//==============================================================================
+// Publish a frame description to the render thread.
+//
+// The frame is written to the emulation thread's slot which is then
+// exchanged with the ready slot.  The render thread is only woken if the
+// ready slot did not already hold a frame it hasn't drawn.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void render_publish (void)
+{
+ render_frame_t *f = &frames[slot_write];
+ int old;
+
+ memcpy(f->vdu.chr_rom, vdu.chr_rom, sizeof(vdu.chr_rom));
+ memcpy(f->vdu.scr_ram, vdu.scr_ram, sizeof(vdu.scr_ram));
+ memcpy(f->vdu.att_ram, vdu.att_ram, sizeof(vdu.att_ram));
+ memcpy(f->vdu.col_ram, vdu.col_ram, sizeof(vdu.col_ram));
+ memcpy(f->vdu.pcg_ram, vdu.pcg_ram, modelx.pcg * 0x0800);
+ f->vdu.scr_mask = vdu.scr_mask;
+ f->vdu.extendram = vdu.extendram;
+ f->vdu.colour_cont = vdu.colour_cont;
+ crtc_frame(&f->crtc);
+
+ old = __atomic_exchange_n(&slot_ready, slot_write | RENDER_FRESH,
+                           __ATOMIC_ACQ_REL);
+ slot_write = old & RENDER_SLOT;
+ if (! (old & RENDER_FRESH))
+    SDL_SemPost(frame_sem);
+}
+
+//==============================================================================
+// Take the render lock.
+//
+// Held while drawing to or presenting the screen surface if the render
+// thread is in use.  The lock may be taken again by the thread holding it.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void render_lock (void)
+{
+ if (lock)
+    SDL_LockMutex(lock);
+}
+
+//==============================================================================
+// Release the render lock.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void render_unlock (void)
+{
+ if (lock)
+    SDL_UnlockMutex(lock);
+}
@@ -0,0 +1,21 @@
+/* Render Thread Header */
+
+#ifndef HEADER_RENDER_H
+#define HEADER_RENDER_H
+
+#include "ubee512.h"
+
+typedef struct render_t
+{
+ int thread;                    // draw and present the display on a thread
+}render_t;
+
+int render_init (void);
+int render_deinit (void);
+int render_reset (void);
+
+void render_publish (void);
+void render_lock (void);
+void render_unlock (void);
+
+#endif     /* HEADER_RENDER_H */
@@ -0,0 +1,484 @@
+//******************************************************************************
+//*                                  uBee512                                   *
+//*       An emulator for the Microbee Z80 ROM, FDD and HDD based models       *
+//*                                                                            *
+//*                           Record/Replay module                             *
+//*                                                                            *
+//*                          Copyright (C) 2026 agent                          *
+//******************************************************************************
+//
+// Records every externally sourced input to a file so that a run can be
+// reproduced exactly later on.
+//
+// With --record=file the host keyboard and joystick events and the bytes
+// read from the serial port are written to the file, each stamped with the
+// emulated clock (Z80 tstates since start up, carried across resets).  The
+// host date and time used to seed the RTC is also kept in the file.
+//
+// With --replay=file the host keyboard, joystick and serial input is
+// ignored and the recorded input is injected instead at the same emulated
+// clock values.  The emulator is run in turbo mode and exits when the end
+// of the recording is reached.
+//
+// While recording or replaying host time sources that can be seen by the
+// emulated machine (the RTC and the CRTC vertical blanking by host time
+// method) are replaced with time derived from the emulated clock so that
+// both runs see exactly the same values.
+//
+// The file is plain text, one event per line:
+//
+//   ubee512-replay version seed
+//   clock type a b c
+//   ...
+//
+// where type is 'K' key down, 'k' key up, 'J' joystick button down, 'j'
+// joystick button up, 'H' joystick hat, 'A' joystick axis, 'S' serial byte
+// and 'E' end of recording.
+//
+// A replay must be started with the same options, ROMs and disk images as
+// the recording.  Disk images written to during the recording need to be
+// restored to their original state first.
+//
+//==============================================================================
+/*
+ *  uBee512 - An emulator for the Microbee Z80 ROM, FDD and HDD based models.
+ *  Copyright (C) 2026 agent
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+//==============================================================================
+// ChangeLog (most recent entries are at top)
+//==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Created a new file to implement deterministic record and replay.
+//==============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <SDL2/SDL.h>
+
+#include "replay.h"
+#include "ubee512.h"
+#include "z80api.h"
+#include "keyb.h"
+#include "joystick.h"
+#include "support.h"
+
+//==============================================================================
+// structures and variables
+//==============================================================================
+typedef struct replay_event_t
+{
+ uint64_t clock;                // emulated clock the event is due
+ int type;                      // event type character
+ int a;
+ int b;
+ int c;
+}replay_event_t;
+
+replay_t replay;
+
+static FILE *fp;
+static time_t seed;
+static uint64_t base;
+
+static replay_event_t *events;
+static int events_count;
+static int input_pos;
+static int serial_pos;
+
+extern emu_t emu;
+
+//==============================================================================
+// Write an event to the recording.
+//
+// Each event is flushed as it is written so the recording is complete up
+// to the point of a crash.
+//
+//   pass: int type                     event type character
+//         int a, b, c                  event values
+// return: void
+//==============================================================================
+static void replay_write (int type, int a, int b, int c)
+{
+ if (! fp)
+    return;
+
+ fprintf(fp, "%llu %c %d %d %d\n", (unsigned long long)replay_clock(), type,
+         a, b, c);
+ fflush(fp);
+}
+
+//==============================================================================
+// Load all the events from a recording.
+//
+//   pass: void
+// return: int                          0 if no error, -1 if error
+//==============================================================================
+static int replay_load (void)
+{
+ char s[512];
+ char magic[32];
+ unsigned long long clock;
+ long long t;
+ replay_event_t *p;
+ replay_event_t e;
+ int version;
+ int line = 1;
+ char type;
+
+ if ((! fgets(s, sizeof(s), fp)) ||
+    (sscanf(s, "%31s %d %lld", magic, &version, &t) != 3) ||
+    (strcmp(magic, REPLAY_MAGIC) != 0))
+    {
+     xprintf("replay_load: Not a recording: %s\n", replay.file);
+     return -1;
+    }
+
+ if (version != REPLAY_VERSION)
+    {
+     xprintf("replay_load: Recording version %d is not supported: %s\n",
+             version, replay.file);
+     return -1;
+    }
+
+ seed = (time_t)t;
+
+ while (fgets(s, sizeof(s), fp))
+    {
+     line++;
+     if (sscanf(s, "%llu %c %d %d %d", &clock, &type, &e.a, &e.b, &e.c) != 5)
+        {
+         xprintf("replay_load: Error in line %d: %s\n", line, replay.file);
+         return -1;
+        }
+     e.clock = clock;
+     e.type = type;
+
+     p = realloc(events, sizeof(replay_event_t) * (events_count + 1));
+     if (! p)
+        {
+         xprintf("replay_load: Unable to allocate memory\n");
+         return -1;
+        }
+     events = p;
+     events[events_count++] = e;
+    }
+
+ return 0;
+}
+
+//==============================================================================
+// Record/Replay initialise.
+//
+// Opens the recording file, this must be done before the RTC is initialised
+// as it is seeded from the host time kept in the recording.
+//
+//   pass: void
+// return: int                          0 if success, -1 if error
+//==============================================================================
+int replay_init (void)
+{
+ base = 0;
+
+ switch (replay.mode)
+    {
+     case REPLAY_RECORD :
+        fp = fopen(replay.file, "w");
+        if (! fp)
+           {
+            xprintf("replay_init: Unable to create file: %s\n", replay.file);
+            return -1;
+           }
+        seed = time(NULL);
+        fprintf(fp, "%s %d %lld\n", REPLAY_MAGIC, REPLAY_VERSION,
+                (long long)seed);
+        fflush(fp);
+        break;
+     case REPLAY_PLAY :
+        fp = fopen(replay.file, "r");
+        if (! fp)
+           {
+            xprintf("replay_init: Unable to open file: %s\n", replay.file);
+            return -1;
+           }
+        if (replay_load())
+           return -1;
+        fclose(fp);
+        fp = NULL;
+        input_pos = 0;
+        serial_pos = 0;
+        emu.turbo = 1;
+        if (emu.verbose)
+           xprintf("replay_init: %d events loaded from %s\n", events_count,
+                   replay.file);
+        break;
+    }
+
+ return 0;
+}
+
+//==============================================================================
+// Record/Replay de-initialise.
+//
+// The end of a recording is marked so that a replay stops at the same
+// point.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int replay_deinit (void)
+{
+ if (fp)
+    {
+     replay_write('E', 0, 0, 0);
+     fclose(fp);
+     fp = NULL;
+    }
+
+ if (events)
+    {
+     free(events);
+     events = NULL;
+     events_count = 0;
+    }
+
+ return 0;
+}
+
+//==============================================================================
+// Record/Replay reset.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int replay_reset (void)
+{
+ return 0;
+}
+
+//==============================================================================
+// Carry the emulated clock across a reset.
+//
+// Must be called before the Z80 tstate count is cleared by a reset.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void replay_rebase (void)
+{
+ base += z80api_get_tstates();
+}
+
+//==============================================================================
+// Return the emulated clock.
+//
+//   pass: void
+// return: uint64_t                     Z80 tstates since start up
+//==============================================================================
+uint64_t replay_clock (void)
+{
+ return base + z80api_get_tstates();
+}
+
+//==============================================================================
+// Return a time in milliseconds for time sources seen by the emulated
+// machine.
+//
+//   pass: void
+// return: uint64_t                     emulated time if recording or
+//                                      replaying, else host time
+//==============================================================================
+uint64_t replay_time_ms (void)
+{
+ if (replay.mode == REPLAY_OFF)
+    return time_get_ms();
+
+ return replay_clock() / (emu.cpuclock / 1000);
+}
+
+//==============================================================================
+// Return the host date and time for the emulated machine.
+//
+//   pass: void
+// return: time_t                       recorded time plus emulated time if
+//                                      recording or replaying, else host time
+//==============================================================================
+time_t replay_host_time (void)
+{
+ if (replay.mode == REPLAY_OFF)
+    return time(NULL);
+
+ return seed + (time_t)(replay_time_ms() / 1000);
+}
+
+//==============================================================================
+// Check an event polled from the host.
+//
+// Input events are written to the recording when recording, when replaying
+// input events from the host are ignored.
+//
+//   pass: void
+// return: int                          1 if the event is to be ignored, else 0
+//==============================================================================
+int replay_event (void)
+{
+ int type;
+ int a;
+ int b = 0;
+ int c = 0;
+
+ if (replay.mode == REPLAY_OFF)
+    return 0;
+
+ switch (emu.event.type)
+    {
+     case SDL_KEYDOWN :
+     case SDL_KEYUP :
+        type = (emu.event.type == SDL_KEYDOWN) ? 'K' : 'k';
+        a = emu.event.key.keysym.sym;
+        b = emu.event.key.keysym.mod;
+        c = emu.event.key.keysym.unicode;
+        break;
+     case SDL_JOYBUTTONDOWN :
+     case SDL_JOYBUTTONUP :
+        type = (emu.event.type == SDL_JOYBUTTONDOWN) ? 'J' : 'j';
+        a = emu.event.jbutton.button;
+        break;
+     case SDL_JOYHATMOTION :
+        type = 'H';
+        a = emu.event.jhat.hat;
+        b = emu.event.jhat.value;
+        break;
+     case SDL_JOYAXISMOTION :
+        type = 'A';
+        a = emu.event.jaxis.axis;
+        b = emu.event.jaxis.value;
+        break;
+     default :
+        return 0;
+    }
+
+ if (replay.mode == REPLAY_PLAY)
+    return 1;
+
+ replay_write(type, a, b, c);
+ return 0;
+}
+
+//==============================================================================
+// Inject all recorded input events that are now due.
+//
+// Called from the event handler after the host events have been polled.
+// The end of replay is reached when the end of recording event is due.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void replay_pending (void)
+{
+ replay_event_t *e;
+ uint64_t now;
+
+ if (replay.mode != REPLAY_PLAY)
+    return;
+
+ now = replay_clock();
+
+ while ((input_pos < events_count) && (events[input_pos].clock <= now))
+    {
+     e = &events[input_pos++];
+
+     memset(&emu.event, 0, sizeof(emu.event));
+     switch (e->type)
+        {
+         case 'K' :
+         case 'k' :
+            emu.event.type = (e->type == 'K') ? SDL_KEYDOWN : SDL_KEYUP;
+            emu.event.key.keysym.sym = e->a;
+            emu.event.key.keysym.mod = e->b;
+            emu.event.key.keysym.unicode = e->c;
+            if (e->type == 'K')
+               keyb_keydown_event();
+            else
+               keyb_keyup_event();
+            break;
+         case 'J' :
+         case 'j' :
+            emu.event.type = (e->type == 'J') ?
+                             SDL_JOYBUTTONDOWN : SDL_JOYBUTTONUP;
+            emu.event.jbutton.button = e->a;
+            if (e->type == 'J')
+               joystick_buttondown_event();
+            else
+               joystick_buttonup_event();
+            break;
+         case 'H' :
+            emu.event.type = SDL_JOYHATMOTION;
+            emu.event.jhat.hat = e->a;
+            emu.event.jhat.value = e->b;
+            joystick_hatmotion_event();
+            break;
+         case 'A' :
+            emu.event.type = SDL_JOYAXISMOTION;
+            emu.event.jaxis.axis = e->a;
+            emu.event.jaxis.value = e->b;
+            joystick_axismotion_event();
+            break;
+         case 'E' :
+            xprintf("replay: end of recording reached at %llu tstates\n",
+                    (unsigned long long)now);
+            emu.done = 1;
+            break;
+         default :
+            break;
+        }
+    }
+}
+
+//==============================================================================
+// Read a byte from the serial port.
+//
+// When recording the byte read from the host is written to the recording,
+// when replaying the host is not read and the recorded byte is returned
+// once it is due.
+//
+//   pass: deschand_t fd                serial port descriptor/handle
+// return: int                          serial byte or -1 if none ready
+//==============================================================================
+int replay_serial_read (deschand_t fd)
+{
+ int c;
+
+ if (replay.mode == REPLAY_PLAY)
+    {
+     while ((serial_pos < events_count) && (events[serial_pos].type != 'S'))
+        serial_pos++;
+     if ((serial_pos < events_count) &&
+        (events[serial_pos].clock <= replay_clock()))
+        return events[serial_pos++].a;
+     return -1;
+    }
+
+ c = async_read(fd);
+
+ if ((replay.mode == REPLAY_RECORD) && (c != -1))
+    replay_write('S', c, 0, 0);
+
+ return c;
+}
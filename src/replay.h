@@ -0,0 +1,41 @@
+/* Record/Replay Header */
+
+#ifndef HEADER_REPLAY_H
+#define HEADER_REPLAY_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "ubee512.h"
+#include "async.h"
+
+#define REPLAY_MAGIC     "ubee512-replay"
+#define REPLAY_VERSION   1
+
+enum
+{
+ REPLAY_OFF,
+ REPLAY_RECORD,
+ REPLAY_PLAY
+};
+
+int replay_init (void);
+int replay_deinit (void);
+int replay_reset (void);
+
+void replay_rebase (void);
+uint64_t replay_clock (void);
+uint64_t replay_time_ms (void);
+time_t replay_host_time (void);
+
+int replay_event (void);
+void replay_pending (void);
+int replay_serial_read (deschand_t fd);
+
+typedef struct replay_t
+{
+ char file[SSIZE1];             // recording file
+ int mode;                      // REPLAY_OFF, REPLAY_RECORD or REPLAY_PLAY
+}replay_t;
+
+#endif     /* HEADER_REPLAY_H */
@@ -0,0 +1,536 @@
+//******************************************************************************
+//*                                  uBee512                                   *
+//*       An emulator for the Microbee Z80 ROM, FDD and HDD based models       *
+//*                                                                            *
+//*                               Rewind module                                *
+//*                                                                            *
+//*                          Copyright (C) 2026 agent                          *
+//******************************************************************************
+//
+// Keeps a ring of recent machine states so that emulation can be wound
+// back in time (--rewind) and the debugger can step backwards
+// (--db-rstep).
+//
+// Every --rewind-frames frames a ring entry is captured.  An entry holds
+// the machine state without the main memory blocks (snapshot_capture())
+// and an undo log of the RAM pages written to while the entry is the
+// newest one.  Page writes are trapped by memmap.c, the first write to each
+// 1K RAM page after a capture passes a copy of the page as it was to
+// rewind_page_write() and later writes to the page run at full speed.  An
+// entry is restored by copying back the undo logs of it and all newer
+// entries, newest first, and then restoring the rest of the state.
+//
+// The ring is limited to --rewind-size MB, the oldest entries are dropped
+// to stay within it.
+//
+// The ring is cleared by a reset and when memory is changed directly (file
+// loads, debugger memory commands, snapshot loads) as these changes are not
+// seen by the page write trap.  Host input is not part of the state so
+// running forward again after a rewind uses the current input.
+//
+// Disk images are not wound back.  The instructions re-executed by
+// rewind_step_back() have already written their disk sectors, printer and
+// serial output so rewindx.replaying is set while they run and these
+// modules drop the output.  Disk reads see the current image contents.
+//
+//==============================================================================
+/*
+ *  uBee512 - An emulator for the Microbee Z80 ROM, FDD and HDD based models.
+ *  Copyright (C) 2026 agent
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+//==============================================================================
+//==============================================================================
+// ChangeLog (most recent entries are at top)
+//==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - rewind_capture() finishes a partly executed instruction before the
+//   machine state is captured.
+// - rewind_step_back() sets rewindx.replaying while re-executing so that
+//   disk, printer and serial output is not repeated.
+// - Created a new file to rewind the emulation and reverse step the
+//   debugger.
+//==============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "rewind.h"
+#include "ubee512.h"
+#include "z80api.h"
+#include "z80debug.h"
+#include "memmap.h"
+#include "snapshot.h"
+#include "support.h"
+
+//==============================================================================
+// structures and variables
+//==============================================================================
+rewind_t rewindx =
+{
+ .frames = REWIND_FRAMES_DEF,
+ .size = REWIND_SIZE_DEF,
+};
+
+typedef struct rewind_page_t
+{
+ int n;                         // RAM page number
+ uint8_t data[MEMMAP_PAGE_SIZE];        // page contents before the write
+}rewind_page_t;
+
+typedef struct rewind_entry_t
+{
+ uint64_t tstates;              // Z80 tstate count when captured
+ uint8_t *state;                // machine state without main memory
+ uint32_t state_len;
+ rewind_page_t *pages;          // undo log
+ int pages_count;
+ int pages_size;                // allocated undo log entries
+}rewind_entry_t;
+
+extern emu_t emu;
+extern debug_t debug;
+
+static rewind_entry_t entries[REWIND_ENTRIES];
+static int head;                // oldest entry
+static int count;               // number of entries
+static uint64_t used;           // bytes used by all entries
+static int tracking;
+static int restoring;
+static int frame_count;
+
+//==============================================================================
+// Get a ring entry.
+//
+//   pass: int k                        entry number, 0 is the oldest
+// return: rewind_entry_t *
+//==============================================================================
+static rewind_entry_t *rewind_entry (int k)
+{
+ return &entries[(head + k) % REWIND_ENTRIES];
+}
+
+//==============================================================================
+// Free an entry's undo log.
+//
+//   pass: rewind_entry_t *e
+// return: void
+//==============================================================================
+static void rewind_free_pages (rewind_entry_t *e)
+{
+ used -= (uint64_t)e->pages_size * sizeof(rewind_page_t);
+ free(e->pages);
+ e->pages = NULL;
+ e->pages_count = 0;
+ e->pages_size = 0;
+}
+
+//==============================================================================
+// Free an entry.
+//
+//   pass: rewind_entry_t *e
+// return: void
+//==============================================================================
+static void rewind_free_entry (rewind_entry_t *e)
+{
+ rewind_free_pages(e);
+ used -= e->state_len;
+ free(e->state);
+ e->state = NULL;
+ e->state_len = 0;
+}
+
+//==============================================================================
+// Drop the oldest entry.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void rewind_drop_oldest (void)
+{
+ rewind_free_entry(rewind_entry(0));
+ head = (head + 1) % REWIND_ENTRIES;
+ count--;
+}
+
+//==============================================================================
+// Clear all entries.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void rewind_clear (void)
+{
+ while (count)
+    rewind_drop_oldest();
+ head = 0;
+ frame_count = 0;
+}
+
+//==============================================================================
+// Rewind initialise.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int rewind_init (void)
+{
+ rewind_clear();
+ return 0;
+}
+
+//==============================================================================
+// Rewind de-initialise.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int rewind_deinit (void)
+{
+ rewind_clear();
+ if (tracking)
+    {
+     memmap_track(0);
+     tracking = 0;
+    }
+ return 0;
+}
+
+//==============================================================================
+// Rewind reset.
+//
+// The tstate count starts again from 0 after a reset so the ring entries
+// can no longer be used.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int rewind_reset (void)
+{
+ rewind_clear();
+ return 0;
+}
+
+//==============================================================================
+// Memory has been changed directly.
+//
+// Called from z80api_code_flush().  The change is not in any undo log so
+// the ring entries can no longer be used.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void rewind_invalidate (void)
+{
+ if (! restoring)
+    rewind_clear();
+}
+
+//==============================================================================
+// First write to a RAM page since the last capture.
+//
+// Called from memmap.c before the write takes place, the page contents are
+// added to the newest entry's undo log.
+//
+//   pass: int n                        RAM page number
+//         uint8_t *p                   page contents
+// return: void
+//==============================================================================
+void rewind_page_write (int n, uint8_t *p)
+{
+ rewind_entry_t *e;
+ rewind_page_t *pages;
+ int size;
+
+ if (! count)
+    return;
+
+ e = rewind_entry(count - 1);
+
+ if (e->pages_count == e->pages_size)
+    {
+     size = e->pages_size ? e->pages_size * 2 : 16;
+     pages = realloc(e->pages, size * sizeof(rewind_page_t));
+     if (! pages)
+        {
+         xprintf("rewind: Unable to allocate memory, history cleared\n");
+         rewind_clear();
+         return;
+        }
+     used += (uint64_t)(size - e->pages_size) * sizeof(rewind_page_t);
+     e->pages = pages;
+     e->pages_size = size;
+    }
+
+ e->pages[e->pages_count].n = n;
+ memcpy(e->pages[e->pages_count].data, p, MEMMAP_PAGE_SIZE);
+ e->pages_count++;
+}
+
+//==============================================================================
+// Capture a new ring entry.
+//
+// Nothing is captured if the Z80 has not run since the last capture.  The
+// oldest entries are dropped to stay within the memory limit, the newest
+// entry is always kept.  An instruction left part way through a prefix is
+// finished first so the entry's tstate count and registers are at an
+// instruction boundary.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void rewind_capture (void)
+{
+ rewind_entry_t *e;
+ uint64_t tstates;
+
+ z80api_finish_instruction();
+ tstates = z80api_get_tstates();
+ if (count && (rewind_entry(count - 1)->tstates == tstates))
+    return;
+
+ if (count == REWIND_ENTRIES)
+    rewind_drop_oldest();
+
+ e = rewind_entry(count);
+ if (snapshot_capture(&e->state, &e->state_len))
+    {
+     xprintf("rewind: Unable to capture the machine state\n");
+     e->state = NULL;
+     e->state_len = 0;
+     return;
+    }
+
+ e->tstates = tstates;
+ used += e->state_len;
+ count++;
+
+ while ((count > 1) && (used > (uint64_t)rewindx.size * 1024 * 1024))
+    rewind_drop_oldest();
+
+ memmap_track_clear();
+}
+
+//==============================================================================
+// Restore a ring entry.
+//
+// The undo logs are copied back from the newest entry down to the entry
+// being restored, the newer entries are dropped and the restored entry
+// becomes the newest with an empty undo log.
+//
+//   pass: int k                        entry number, 0 is the oldest
+// return: int                          0 if success, -1 if error
+//==============================================================================
+static int rewind_restore (int k)
+{
+ rewind_entry_t *e;
+ int res;
+ int i;
+ int j;
+
+ restoring = 1;
+
+ for (i = count - 1; i >= k; i--)
+    {
+     e = rewind_entry(i);
+     for (j = e->pages_count - 1; j >= 0; j--)
+        memcpy(memmap_ram_page(e->pages[j].n), e->pages[j].data,
+               MEMMAP_PAGE_SIZE);
+     if (i > k)
+        rewind_free_entry(e);
+    }
+ count = k + 1;
+
+ e = rewind_entry(k);
+ rewind_free_pages(e);
+ res = snapshot_restore(e->state, e->state_len);
+
+ restoring = 0;
+
+ if (res)
+    {
+     xprintf("rewind: Unable to restore the machine state\n");
+     rewind_clear();
+    }
+
+ memmap_track_clear();
+ frame_count = 0;
+
+ return res;
+}
+
+//==============================================================================
+// Wind back the emulation.
+//
+// Restores the newest entry captured at least 'secs' seconds of emulated
+// time ago, or the oldest entry if there is none that old.
+//
+//   pass: float secs                   seconds of emulated time
+// return: int                          0 if success, -1 if error
+//==============================================================================
+int rewind_back_secs (float secs)
+{
+ uint64_t now;
+ uint64_t tstates;
+ uint64_t back;
+ int k;
+
+ if (! count)
+    {
+     xprintf("rewind: No history available\n");
+     return -1;
+    }
+
+ now = z80api_get_tstates();
+ back = (uint64_t)(secs * emu.cpuclock);
+ tstates = (back < now) ? now - back : 0;
+
+ for (k = count - 1; (k > 0) && (rewind_entry(k)->tstates > tstates); k--)
+    {}
+
+ if (rewind_restore(k))
+    return -1;
+
+ if (emu.verbose)
+    xprintf("rewind: Back %.3f seconds\n",
+            (now - z80api_get_tstates()) / (double)emu.cpuclock);
+
+ return 0;
+}
+
+//==============================================================================
+// Step the Z80 back by instructions or to the last break point.
+//
+// The newest entry captured before now is restored and the Z80 is run
+// forward to now counting the instructions executed and noting break point
+// addresses reached.  If the target is not found in that range the next
+// older entry is tried.  The entry is then restored again and the Z80 run
+// forward to the target instruction.  If the target can not be reached
+// with the history available the Z80 is left where it was.
+//
+// rewindx.replaying is set while running forward as the output of these
+// instructions has already been made.
+//
+//   pass: int steps                    number of instructions
+//         int to_bp                    step back to the last break point
+//                                      reached instead
+// return: int                          0 if success, -1 if error
+//==============================================================================
+int rewind_step_back (int steps, int to_bp)
+{
+ z80regs_t z80regs;
+ uint64_t now;
+ int target = -1;
+ int n;
+ int k;
+
+ now = z80api_get_tstates();
+
+ k = count - 1;
+ if ((k >= 0) && (rewind_entry(k)->tstates >= now))
+    k--;
+
+ rewindx.replaying = 1;
+
+ while ((k >= 0) && (target == -1))
+    {
+     if (rewind_restore(k))
+        {
+         rewindx.replaying = 0;
+         return -1;
+        }
+
+     n = 0;
+     while (z80api_get_tstates() < now)
+        {
+         z80api_get_regs(&z80regs);
+         if (to_bp && (debug.break_point[z80regs.pc] &
+             (Z80DEBUG_BP_FLAG | Z80DEBUG_BPR_FLAG)))
+            target = n;
+         z80api_execute_complete();
+         n++;
+        }
+
+     if ((! to_bp) && (n >= steps))
+        target = n - steps;
+
+     if (target == -1)
+        k--;
+    }
+
+ if (target == -1)
+    {
+     rewindx.replaying = 0;
+     xprintf("rewind: Not enough history available\n");
+     return -1;
+    }
+
+ if (rewind_restore(k))
+    {
+     rewindx.replaying = 0;
+     return -1;
+    }
+
+ for (n = 0; n < target; n++)
+    z80api_execute_complete();
+
+ rewindx.replaying = 0;
+ return 0;
+}
+
+//==============================================================================
+// Rewind update.
+//
+// Called at the start of each frame.  Carries out a pending --rewind and
+// captures a ring entry every --rewind-frames frames.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void rewind_update (void)
+{
+ if (rewindx.frames <= 0)
+    {
+     if (tracking)
+        {
+         rewind_clear();
+         memmap_track(0);
+         tracking = 0;
+        }
+     rewindx.secs = 0;
+     return;
+    }
+
+ if (! tracking)
+    {
+     memmap_track(1);
+     tracking = 1;
+    }
+
+ if (rewindx.secs > 0)
+    {
+     rewind_back_secs(rewindx.secs);
+     rewindx.secs = 0;
+    }
+
+ if (++frame_count >= rewindx.frames)
+    {
+     frame_count = 0;
+     rewind_capture();
+    }
+}
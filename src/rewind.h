@@ -0,0 +1,32 @@
+/* Rewind Header */
+
+#ifndef HEADER_REWIND_H
+#define HEADER_REWIND_H
+
+#include <stdint.h>
+
+#include "ubee512.h"
+
+#define REWIND_ENTRIES      1024
+#define REWIND_FRAMES_DEF   25
+#define REWIND_SIZE_DEF     32
+
+typedef struct rewind_t
+{
+ int frames;                    // frames between captures (0=off)
+ int size;                      // memory limit in MB
+ float secs;                    // pending --rewind seconds (0=none)
+ int replaying;                 // set while instructions are re-executed
+}rewind_t;
+
+int rewind_init (void);
+int rewind_deinit (void);
+int rewind_reset (void);
+
+void rewind_update (void);
+void rewind_invalidate (void);
+void rewind_page_write (int n, uint8_t *p);
+int rewind_back_secs (float secs);
+int rewind_step_back (int steps, int to_bp);
+
+#endif     /* HEADER_REWIND_H */
@@ -32,6 +32,11 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added roms_snapshot() function for machine snapshots.
+// - Changes to roms_load_config_paks() and roms_load_config_net() to call
+//   z80api_code_flush() after loading new images.
+//
 // v6.0.0 - 1 January 2017, K Duckmanton
 // - Microbee memory is now an array of uint8_t rather than char.
 //
@@ -146,6 +151,7 @@
 #include "z80.h"
 #include "memmap.h"
 #include "support.h"
+#include "snapshot.h"
 
 #include "macros.h"
 
@@ -971,6 +977,42 @@ uint16_t roms_nsel_r (uint16_t port, struct z80_port_read *port_s)
  return 0;
 }
 
+//==============================================================================
+// Save or load the ROM banking state for a machine snapshot.
+//
+// ROM contents are not saved but the BASIC, Pak and Net locations that have
+// been set to use SRAM are.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void roms_snapshot (void)
+{
+ int i;
+
+ if (snapshot_chunk("ROMS"))
+    return;
+
+ snapshot_int(&pakdata);
+ snapshot_int(&netbank);
+ snapshot_int(&netofs);
+ snapshot_int(&basofs);
+
+ if (modelx.rom)
+    {
+     if ((modelc.basram) || (emu.model == MOD_TTERM))
+        snapshot_packed(basic, sizeof(basic));
+     for (i = 0; i < 8; i++)
+        if (modelc.pakram[i])
+           snapshot_packed(&paks[i * 0x4000], 0x4000);
+     if (modelc.netram)
+        snapshot_packed(netx, sizeof(netx));
+
+     if (snapshot_loading())
+        roms_switch_pak(pakdata);
+    }
+}
+
 //==============================================================================
 // Pak write - Port function.
 //
@@ -1508,6 +1550,7 @@ static int roms_load_config_paks (void)
      // load all the Pak locations with ROM images or initialised SRAM
      if (roms_load_paks(1) == -1)
         return -1;
+     z80api_code_flush();
 
      // configure map
      memmap_configure();
@@ -1529,6 +1572,7 @@ static int roms_load_config_net (void)
      // load Net ROM
      if (roms_load_net(1) == -1)
         return -1;
+     z80api_code_flush();
 
      // configure map
      memmap_configure();
@@ -39,6 +39,7 @@ uint16_t roms_nsel_r (uint16_t port, struct z80_port_read *port_s);
 void roms_psel_w (uint16_t port, uint8_t data, struct z80_port_write *port_s);
 void roms_create_md5 (void);
 int roms_proc_pak_argument (int pak, char *p);
+void roms_snapshot (void);
 
 int roms_loadrom (char *name, uint8_t *dest, int size, char *filepath);
 
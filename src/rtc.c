@@ -31,6 +31,11 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added rtc_snapshot() function for machine snapshots.
+// - Host time is now obtained with replay_time_ms() and replay_host_time()
+//   so that it can be virtualised when recording or replaying.
+//
 // v4.7.0 - 29 June 2010, uBee
 // - Changes made to fread() function to use the result as some compilers
 //   report warning: declared with attribute warn_unused_result.
@@ -98,6 +103,8 @@
 #include "z80api.h"
 #include "ubee512.h"
 #include "support.h"
+#include "snapshot.h"
+#include "replay.h"
 
 #include "macros.h"
 
@@ -198,7 +205,7 @@ static void rtc_setclockfromhost (void)
  time_t result;
  tm_t resultp;
 
- time(&result);
+ result = replay_host_time();
 #ifdef MINGW
  memcpy(&resultp, localtime(&result), sizeof(resultp));
 #else
@@ -232,7 +239,7 @@ static int rtc_timer_update_cycle (void)
  int secs_behind;
  int secs_now;
 
- secs_now = (time_get_ms() - rtc_time_ref) / 1000;
+ secs_now = (replay_time_ms() - rtc_time_ref) / 1000;
 
  if (secs_now == rtc_secs_before)
     return 0;
@@ -432,7 +439,7 @@ int rtc_init (void)
 
      addr = 0;
      rtc_setclockfromhost();
-     rtc_time_ref = time_get_ms();
+     rtc_time_ref = replay_time_ms();
      rtc_secs_before = 0;
     }
  return 0;
@@ -611,7 +618,7 @@ void rtc_w (uint16_t port, uint8_t data, struct z80_port_write *port_s)
                    clocks_pf = (int)(periodic_interrupt_rate[data & B8(00001111)] * clocks_sec);
                    rtcx.ram[addr] &= RTC_A_UIP;
                    rtcx.ram[addr] |= (data & (0xff ^ RTC_A_UIP));
-                   rtc_time_ref = time_get_ms();
+                   rtc_time_ref = replay_time_ms();
                    rtc_secs_before = 0;
                   }
                else
@@ -746,3 +753,25 @@ void rtc_clock (int cpuclock)
  clocks_sec = cpuclock;
  clocks_uip = cpuclock - (int)((float)cpuclock * 0.001984);
 }
+
+//==============================================================================
+// Save or load the RTC state for a machine snapshot.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void rtc_snapshot (void)
+{
+ if (! modelx.rtc)
+    return;
+
+ if (snapshot_chunk("RTC "))
+    return;
+
+ snapshot_u8(&addr);
+ snapshot_data(rtc.ram, sizeof(rtc.ram));
+ snapshot_data(rtcx.ram, sizeof(rtcx.ram));
+ snapshot_int(&rtcpf_before);
+ snapshot_u64(&rtc_time_ref);
+ snapshot_int(&rtc_secs_before);
+}
@@ -88,5 +88,6 @@ void rtc_w (uint16_t port, uint8_t data, struct z80_port_write *port_s);
 int rtc_poll (void);
 void rtc_regdump (void);
 void rtc_clock (int cpuclock);
+void rtc_snapshot (void);
 
 #endif     /* HEADER_RTC_H */
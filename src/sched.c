@@ -0,0 +1,204 @@
+//******************************************************************************
+//*                                  uBee512                                   *
+//*       An emulator for the Microbee Z80 ROM, FDD and HDD based models       *
+//*                                                                            *
+//*                       T-state event scheduler module                       *
+//*                                                                            *
+//*                          Copyright (C) 2026 agent                          *
+//******************************************************************************
+//
+// A central queue of events ordered by the Z80 tstate count they are due.
+//
+// Devices needing to be woken at a future time add a sched_event_t to the
+// queue using sched_add().  z80api_execute() runs the Z80 straight through
+// to the earliest deadline (sched_deadline) and then calls sched_run() to
+// call the functions of all events that are due.  An event is removed from
+// the queue before its function is called, periodic events add themselves
+// again from within the function.
+//
+// The number of events is small so the queue is kept as an array of event
+// pointers sorted by due time, the earliest event is always at the front.
+//
+//==============================================================================
+/*
+ *  uBee512 - An emulator for the Microbee Z80 ROM, FDD and HDD based models.
+ *  Copyright (C) 2026 agent
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+//==============================================================================
+// ChangeLog (most recent entries are at top)
+//==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Created a new file to implement a T-state ordered event queue.
+//==============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "sched.h"
+#include "z80api.h"
+#include "ubee512.h"
+#include "support.h"
+
+//==============================================================================
+// structures and variables
+//==============================================================================
+uint64_t sched_deadline = SCHED_NEVER;
+
+static sched_event_t *queue[SCHED_EVENTS_MAX];
+static int queued;
+
+//==============================================================================
+// Remove an event from the queue.
+//
+//   pass: sched_event_t *ev
+// return: void
+//==============================================================================
+static void sched_remove (sched_event_t *ev)
+{
+ int i;
+
+ for (i = 0; i < queued; i++)
+    {
+     if (queue[i] == ev)
+        {
+         memmove(&queue[i], &queue[i + 1], sizeof(queue[0]) * (queued - i - 1));
+         queued--;
+         break;
+        }
+    }
+
+ ev->queued = 0;
+ sched_deadline = queued ? queue[0]->when : SCHED_NEVER;
+}
+
+//==============================================================================
+// Scheduler initialise.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int sched_init (void)
+{
+ return sched_reset();
+}
+
+//==============================================================================
+// Scheduler de-initialise.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int sched_deinit (void)
+{
+ return sched_reset();
+}
+
+//==============================================================================
+// Scheduler reset.
+//
+// Empties the queue, this is called before any other module is reset so
+// that modules may add their events during their reset.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int sched_reset (void)
+{
+ while (queued)
+    queue[--queued]->queued = 0;
+
+ sched_deadline = SCHED_NEVER;
+
+ return 0;
+}
+
+//==============================================================================
+// Add an event to the queue.
+//
+// If the event is already queued it is moved to the new due time.  Events
+// due at the same time are called in the order they were added.  If the new
+// event is now the earliest the Z80 engine is asked to return so that the
+// new deadline is used.
+//
+//   pass: sched_event_t *ev
+//         uint64_t when                Z80 tstate count the event is due
+// return: void
+//==============================================================================
+void sched_add (sched_event_t *ev, uint64_t when)
+{
+ int i;
+
+ if (ev->queued)
+    sched_remove(ev);
+
+ if (queued == SCHED_EVENTS_MAX)
+    {
+     xprintf("sched_add: event queue is full, '%s' not added\n", ev->name);
+     return;
+    }
+
+ for (i = queued; (i > 0) && (queue[i - 1]->when > when); i--)
+    queue[i] = queue[i - 1];
+
+ queue[i] = ev;
+ queued++;
+ ev->when = when;
+ ev->queued = 1;
+
+ if (when < sched_deadline)
+    {
+     sched_deadline = when;
+     z80api_break();
+    }
+}
+
+//==============================================================================
+// Cancel an event.
+//
+//   pass: sched_event_t *ev
+// return: void
+//==============================================================================
+void sched_cancel (sched_event_t *ev)
+{
+ if (ev->queued)
+    sched_remove(ev);
+}
+
+//==============================================================================
+// Call all events that are due.
+//
+// Each event is removed from the queue before its function is called.  The
+// number of events called is limited to the queue size so that an event
+// adding itself again with a due time in the past can not loop forever.
+//
+//   pass: uint64_t now                 current Z80 tstate count
+// return: void
+//==============================================================================
+void sched_run (uint64_t now)
+{
+ sched_event_t *ev;
+ int count = SCHED_EVENTS_MAX;
+
+ while (queued && (queue[0]->when <= now) && count--)
+    {
+     ev = queue[0];
+     sched_remove(ev);
+     (*ev->fn)();
+    }
+}
@@ -0,0 +1,30 @@
+/* T-state Event Scheduler Header */
+
+#ifndef HEADER_SCHED_H
+#define HEADER_SCHED_H
+
+#include <stdint.h>
+
+#define SCHED_EVENTS_MAX 32
+#define SCHED_NEVER      UINT64_MAX
+
+typedef void (*sched_fn_t)(void);
+
+typedef struct sched_event_t
+{
+ uint64_t when;                 // Z80 tstate count the event is due
+ sched_fn_t fn;                 // function called when the event is due
+ char *name;                    // name used for debug reporting
+ int queued;                    // non zero if in the event queue
+}sched_event_t;
+
+extern uint64_t sched_deadline;
+
+int sched_init (void);
+int sched_deinit (void);
+int sched_reset (void);
+void sched_add (sched_event_t *ev, uint64_t when);
+void sched_cancel (sched_event_t *ev);
+void sched_run (uint64_t now);
+
+#endif     /* HEADER_SCHED_H */
@@ -33,6 +33,12 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - serial_write() does not send while rewind_step_back() is re-executing
+//   instructions.
+// - Changed serial_readpoll() to read through replay_serial_read() so that
+//   serial input can be recorded and replayed.
+//
 // v5.7.0 - 9 March 2015, uBee
 // - Changes to serial_config() to allow 4 and 6.750 MHz clock in calculation.
 //
@@ -84,6 +90,8 @@
 #include "z80api.h"
 #include "pio.h"
 #include "async.h"
+#include "replay.h"
+#include "rewind.h"
 
 #include "macros.h"
 
@@ -117,6 +125,7 @@ static int serial_divval_tx;
 
 extern emu_t emu;
 extern pio_t pio_b;
+extern rewind_t rewindx;
 
 //==============================================================================
 // Serial Initialise.
@@ -236,7 +245,7 @@ static int serial_readpoll (void)
          return c;
         }
 
-     serial_saved_rx = async_read(coms1);
+     serial_saved_rx = replay_serial_read(coms1);
      return serial_saved_rx;
     }
 
@@ -251,6 +260,10 @@ static int serial_readpoll (void)
 //==============================================================================
 static void serial_write (void)
 {
+ // the byte was sent when the instruction was first executed.
+ if (rewindx.replaying)
+    return;
+
  // send out our emulated TX byte (time shifted by 1 byte time)
  if (serial_bitcount_tx == serial.databits)
     async_write(coms1, serial_byte_tx);
@@ -30,6 +30,9 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added sn76489an_snapshot() function for machine snapshots.
+//
 // v5.2.0 - 19 February 2011, K Duckmanton
 // - Initial implementation
 //==============================================================================
@@ -47,9 +50,11 @@ static const char
 #include "ubee512.h"
 #include "z80api.h"
 #include "audio.h"
+#include "blep.h"
 #include "function.h"
 #include "sn76489an.h"
 #include "sn76489an_core.h"
+#include "snapshot.h"
 
 #define SN76489AN_CLOCK         emu.cpuclock
 
@@ -176,3 +181,22 @@ void sn76489an_w (uint16_t port, uint8_t data, struct z80_port_write *port_s)
 
  sn76489an_core_w(s, port, data);
 }
+
+//==============================================================================
+// Save or load the sn76489an state for a machine snapshot.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void sn76489an_snapshot (void)
+{
+ sn76489an_t *s = &snd;
+
+ if (! modelx.sn76489an)
+    return;
+
+ if (snapshot_chunk("SN  "))
+    return;
+
+ sn76489an_core_snapshot(s);
+}
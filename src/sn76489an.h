@@ -5,6 +5,7 @@
 int sn76489an_init (void);
 int sn76489an_deinit (void);
 int sn76489an_reset (void);
+void sn76489an_snapshot (void);
 uint16_t sn76489an_r (uint16_t port, struct z80_port_read *port_s);
 void sn76489an_w (uint16_t port, uint8_t data, struct z80_port_write *port_s);
 
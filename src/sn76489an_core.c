@@ -49,6 +49,13 @@
  */
 //==============================================================================
 // ChangeLog (most recent entries are at top)
+// v6.0.0 - 16 October 2026, agent
+// - Added sn76489an_core_snapshot() function for machine snapshots.
+// - The tone and noise generators are now advanced from one counter
+//   running out to the next and the output level changes are rendered
+//   by the band limited step synthesizer (blep.c) in place of the
+//   per sample circular buffer and linear interpolation.
+//
 // v5.2.0 - 06 August 2010, K Duckmanton
 // - Initial implementation
 //==============================================================================
@@ -66,8 +73,10 @@ static const char
 #include "ubee512.h"
 #include "z80api.h"
 #include "audio.h"
+#include "blep.h"
 #include "function.h"
 #include "sn76489an_core.h"
+#include "snapshot.h"
 
 //==============================================================================
 // constants
@@ -132,7 +141,7 @@ extern emu_t emu;
 //==============================================================================
 // function prototypes
 //==============================================================================
-int sn76489an_core_iterate (sn76489an_t *snd, int samples);
+void sn76489an_core_iterate (sn76489an_t *snd, int samples);
 int sn76489an_core_tick (audio_scratch_t *buf, const void *data,
                          uint64_t frame_start, uint64_t cycles);
 
@@ -173,7 +182,8 @@ int sn76489an_core_init (sn76489an_t *s, char *name,
 
  s->noise = SN_NOISE_INITIAL;   /* the noise shift register must be
                                  * initialised to a non-zero value */
- audio_circularbuf_init(&s->scratch);
+ if (blep_init(&s->blep))
+    return -1;
  /* -------------------------------------------------------------------- */
  /*  Register this as a sound peripheral with the SND driver.            */
  /* -------------------------------------------------------------------- */
@@ -186,12 +196,8 @@ int sn76489an_core_init (sn76489an_t *s, char *name,
                     ))
     return -1;
  s->clock_frequency = clock_frequency;
- audio_circularbuf_set_rate_conversion(&s->scratch,
-                                       audio.frequency,
-                                       clock_frequency /
-                                       SN76489AN_CLOCK_DIVISOR);
- audio_circularbuf_set_decay_constant(&s->scratch,
-                                      SN76489AN_DECAY_CONSTANT);
+ blep_set_rate(&s->blep, clock_frequency / SN76489AN_CLOCK_DIVISOR);
+ blep_set_decay_constant(&s->blep, SN76489AN_DECAY_CONSTANT);
  return 0;
 }
 
@@ -204,7 +210,7 @@ int sn76489an_core_init (sn76489an_t *s, char *name,
 int sn76489an_core_deinit (sn76489an_t *s)
 {
  audio_deregister(&s->snd_buf);
- audio_circularbuf_deinit(&s->scratch);
+ blep_deinit(&s->blep);
  return 0;
 }
 
@@ -221,21 +227,87 @@ int sn76489an_core_reset (sn76489an_t *s)
 
 //==============================================================================
 // Set the sample rate conversion factor based on the current CPU
-// clock and the current output sample frequency.
+// clock and the current output sample frequency.  Samples already
+// generated at the old rate are rendered first.
 //
 //   pass: int clock_frequency          New Sn76489 clock frequency
 // return: void
 //==============================================================================
 void sn76489an_core_clock (sn76489an_t *s, int clock_frequency)
 {
- audio_drain_samples(&s->snd_buf, &s->scratch);
- audio_circularbuf_set_rate_conversion(&s->scratch,
-                                       audio.frequency,
-                                       clock_frequency /
-                                       SN76489AN_CLOCK_DIVISOR);
+ blep_end_frame(&s->blep, s->ticks);
+ blep_read(&s->blep, &s->snd_buf);
+ blep_set_rate(&s->blep, clock_frequency / SN76489AN_CLOCK_DIVISOR);
  s->clock_frequency = clock_frequency;
 }
 
+//==============================================================================
+// sn76489an core snapshot.
+//
+// Saves or loads the registers, generator state and the register writes not
+// yet applied by sn76489an_core_tick() as part of the caller's chunk.
+// Output level changes not yet rendered are discarded on loading.
+//
+//   pass: sn76489an_t *s
+// return: void
+//==============================================================================
+void sn76489an_core_snapshot (sn76489an_t *s)
+{
+ sn_update_le_t *p;
+ uint32_t count = 0;
+ int i;
+
+ for (i = 0; i < 8; i++)
+    snapshot_u16(&s->regs[i]);
+ snapshot_int(&s->current_register);
+ for (i = 0; i < 4; i++)
+    snapshot_u16(&s->period_current[i]);
+ snapshot_u32(&s->noise);
+ snapshot_int(&s->state);
+ snapshot_u64(&s->ticks);
+ snapshot_u64(&s->cycles_remainder);
+
+ for (p = s->update_head; p; p = p->next)
+    count++;
+ snapshot_u32(&count);
+
+ if (! snapshot_loading())
+    {
+     for (p = s->update_head; p; p = p->next)
+        {
+         snapshot_u64(&p->when);
+         snapshot_u8(&p->address);
+         snapshot_u8(&p->data);
+        }
+     return;
+    }
+
+ while (s->update_head)
+    {
+     p = s->update_head->next;
+     free(s->update_head);
+     s->update_head = p;
+    }
+ s->update_tail = NULL;
+
+ while (count-- && ! snapshot_failed())
+    {
+     p = malloc(sizeof(*p));
+     snapshot_u64(&p->when);
+     snapshot_u8(&p->address);
+     snapshot_u8(&p->data);
+     p->next = NULL;
+
+     if (!s->update_head)
+        s->update_head = p;
+     else
+        s->update_tail->next = p;
+     s->update_tail = p;
+    }
+
+ blep_clear(&s->blep, s->ticks);
+}
+
 //==============================================================================
 // sn76489an core read.
 //
@@ -286,137 +358,115 @@ void sn76489an_core_w (sn76489an_t *s, uint16_t port, uint8_t data)
 }
 
 //==============================================================================
-// sn76489an generate sample.
+// sn76489an output level.
 //
 //   pass: sn76489an_t *s
-// return: int
+// return: int                          sum of the tone and noise channels
 //==============================================================================
-int sn76489an_gen_sample (sn76489an_t *s)
+static int sn76489an_level (sn76489an_t *s)
 {
  int i;
- int smask;
- int sample = 0;
- uint16_t *periodp, *attenp;
- uint16_t *currperiodp;
  int v;
+ int sample = 0;
 
- smask = (1 << 0);
- periodp = &s->regs[0];
- attenp = &s->regs[1];
- currperiodp = &s->period_current[0];
-
- i = 0;
- while (i < 3)
+ for (i = 0; i < 3; i++)
     {
-     if (--(*currperiodp) == 0)
-        {
-         s->state ^= smask;
-         if ((*currperiodp = *periodp) == 0)
-            // A period value of 0 is special - this ends up being a
-            // division by 1024.
-            *currperiodp = (1 << (SN_LO_BITS + SN_HI_BITS));;
-        }
-     v = sn76489an_amplitude[*attenp & SN_ATTEN_VALUE_MASK];
-     if (s->state & smask)
+     v = sn76489an_amplitude[s->regs[i * 2 + 1] & SN_ATTEN_VALUE_MASK];
+     if (s->state & (1 << i))
         sample += v;
      else
         sample -= v;
-     periodp += 2;
-     attenp += 2;
-     currperiodp += 1;
-     smask <<= 1;
-     ++i;
-    }
-
- /* Update the noise channel. */
- if (--(*currperiodp) == 0)
-    {
-     /* The noise register's shift rate is controlled by the low two
-      * bits of the "period" register */
-     switch (*periodp & ((1 << 2) - 1))
-        {
-         case 0:
-            *currperiodp = 0x20;
-            break;
-         case 1:
-            *currperiodp = 0x40;
-            break;
-         case 2:
-            *currperiodp = 0x80;
-            break;
-         case 3:
-            *currperiodp = s->regs[2 * 2]; /* the divisor used is the
-                                            * divisor for tone
-                                            * generator 2 */
-            break;
-        }
-     /* Bit 2 of the noise generator's period register controls the
-      * noise mode - either "white" (1) or "periodic" (0) */
-     if (*periodp & (1 << 2))
-        {
-         /* white noise.  In this mode the SN76489AN outputs a maximal
-          * length PRNG sequence.  The LSFR reference[3] documents 2
-          * ways of implementing an LSFR: a Fibonacci implementation,
-          * where a modulo 2 sum of the binary weighted taps is fed
-          * back to the input (this realisation is also the one
-          * described in [2]), and a Galois implementation, where the
-          * bits at each stage of the shift register are modified by
-          * the weighted value of the output stage.
-          *
-          * [3] also notes that the sequence of weights for the
-          * Fibonacci implementation is precisely the reverse of the
-          * sequence for the Galois implementation, which makes it
-          * easy to convert from one to the other.
-          *
-          * The Galois implementation is easier for a computer to
-          * realise.
-          *
-          * [2] suggests several possibilities for the taps, depending
-          * on the revision and manufacturer, though the description
-          * is a little unclear.  [1] gives the length of shift
-          * register as 15 bits for the TI chips, while [2] and [4]
-          * also mention that clones of this chip (such as those made
-          * by Sega) had a 16 stage shift register.
-          *
-          * [2] and [4] give different taps for the feedback network.
-          * For this implementation we assume that the LFSR is to
-          * produce a maximal length sequence; [3] gives 3
-          * possibilities for generating a maximal length sequence
-          * from a 15 stage shift register with 2 taps:
-          *
-          * (15, 14), (15, 11) and {15, 8) (with implied bit 0, the
-          * output)
-          *
-          * A-B tests with a real SN76489A reveal that the sequence
-          * produced by the first pair sounds very similar to the real
-          * output.
-          */
-         if (s->noise & 1)
-             s->noise ^= ((1 << 14) | (1 << 13)) << 1;
-        }
-     else
-        {
-         /* periodic noise.  In this mode the chip outputs a series of
-          * single bit impulses from the 15 bit shift register. */
-         if (s->noise & 1)
-             s->noise = SN_NOISE_INITIAL << 1;
-        }
-     s->noise >>= 1;
     }
- v = sn76489an_amplitude[*attenp & SN_ATTEN_VALUE_MASK];
 
+ v = sn76489an_amplitude[s->regs[3 * 2 + 1] & SN_ATTEN_VALUE_MASK];
  if (s->noise & 1)
     sample += v;
  else
     sample -= v;
 
-#if 0
- if (sample != 0)
-    xprintf("sn76489an_gen_sample: sample %4d\n", sample);
-#endif
  return sample;
 }
 
+//==============================================================================
+// sn76489an noise shift.  Called when the noise channel's counter runs out.
+//
+//   pass: sn76489an_t *s
+// return: void
+//==============================================================================
+static void sn76489an_noise (sn76489an_t *s)
+{
+ /* The noise register's shift rate is controlled by the low two
+  * bits of the "period" register */
+ switch (s->regs[3 * 2] & ((1 << 2) - 1))
+    {
+     case 0:
+        s->period_current[3] = 0x20;
+        break;
+     case 1:
+        s->period_current[3] = 0x40;
+        break;
+     case 2:
+        s->period_current[3] = 0x80;
+        break;
+     case 3:
+        /* the divisor used is the divisor for tone generator 2 */
+        s->period_current[3] = s->regs[2 * 2];
+        break;
+    }
+ /* Bit 2 of the noise generator's period register controls the
+  * noise mode - either "white" (1) or "periodic" (0) */
+ if (s->regs[3 * 2] & (1 << 2))
+    {
+     /* white noise.  In this mode the SN76489AN outputs a maximal
+      * length PRNG sequence.  The LSFR reference[3] documents 2
+      * ways of implementing an LSFR: a Fibonacci implementation,
+      * where a modulo 2 sum of the binary weighted taps is fed
+      * back to the input (this realisation is also the one
+      * described in [2]), and a Galois implementation, where the
+      * bits at each stage of the shift register are modified by
+      * the weighted value of the output stage.
+      *
+      * [3] also notes that the sequence of weights for the
+      * Fibonacci implementation is precisely the reverse of the
+      * sequence for the Galois implementation, which makes it
+      * easy to convert from one to the other.
+      *
+      * The Galois implementation is easier for a computer to
+      * realise.
+      *
+      * [2] suggests several possibilities for the taps, depending
+      * on the revision and manufacturer, though the description
+      * is a little unclear.  [1] gives the length of shift
+      * register as 15 bits for the TI chips, while [2] and [4]
+      * also mention that clones of this chip (such as those made
+      * by Sega) had a 16 stage shift register.
+      *
+      * [2] and [4] give different taps for the feedback network.
+      * For this implementation we assume that the LFSR is to
+      * produce a maximal length sequence; [3] gives 3
+      * possibilities for generating a maximal length sequence
+      * from a 15 stage shift register with 2 taps:
+      *
+      * (15, 14), (15, 11) and {15, 8) (with implied bit 0, the
+      * output)
+      *
+      * A-B tests with a real SN76489A reveal that the sequence
+      * produced by the first pair sounds very similar to the real
+      * output.
+      */
+     if (s->noise & 1)
+         s->noise ^= ((1 << 14) | (1 << 13)) << 1;
+    }
+ else
+    {
+     /* periodic noise.  In this mode the chip outputs a series of
+      * single bit impulses from the 15 bit shift register. */
+     if (s->noise & 1)
+         s->noise = SN_NOISE_INITIAL << 1;
+    }
+ s->noise >>= 1;
+}
+
 //==============================================================================
 // Register update.
 //
@@ -508,87 +558,102 @@ int sn76489an_core_tick (audio_scratch_t *buf, const void *data,
  // now generate samples
  while (num_samples)
     {
-     int samples_generated;
      int n;
      sn_update_le_t *up, *uq;
 
-     audio_drain_samples(&s->snd_buf, &s->scratch);
-     do {
-      /* apply all register updates that are due. */
-      for (up = s->update_head;
-           up && up->when <= frame_start;)
-         {
-          if (modio.sn76489an)
-             {
-              xprintf("Sn76489an: register update (z80 tstates %llu) r%02o = %02x\n",
-                      up->when, up->address, up->data);
-             }
-          register_update(s, up->address, up->data);
-          uq = up->next;
-          free(up);
-          up = uq;
-         }
-      s->update_head = up;
-      if (up == NULL)         /* list now empty */
-         s->update_tail = up;
-      if (up == NULL)
-         n = num_samples;       /* generate the requested number of
-                                 * samples */
-      else
-         {
-          /* ceil((when - frame_start) / ticks_per_sample) */
-          n = (up->when - frame_start +
-               ticks_per_sample - 1) / ticks_per_sample;
-          if (n > num_samples)
-             n = num_samples;   /* generate no more than the number of
-                                 * samples originally requested */
-         }
-      samples_generated = sn76489an_core_iterate(s, n);
-      if (samples_generated <= 0)
-         ;                      /* the buffer needs draining */
-      else
-         {
-          frame_start += samples_generated * ticks_per_sample;
-          num_samples -= samples_generated;
-         }
-     } while (samples_generated > 0);
+     /* apply all register updates that are due. */
+     for (up = s->update_head;
+          up && up->when <= frame_start;)
+        {
+         if (modio.sn76489an)
+            {
+             xprintf("Sn76489an: register update (z80 tstates %llu) r%02o = %02x\n",
+                     up->when, up->address, up->data);
+            }
+         register_update(s, up->address, up->data);
+         uq = up->next;
+         free(up);
+         up = uq;
+        }
+     s->update_head = up;
+     if (up == NULL)         /* list now empty */
+        s->update_tail = up;
+     /* an attenuation change is a change of level too */
+     blep_level(&s->blep, s->ticks, sn76489an_level(s));
+     if (up == NULL)
+        n = num_samples;       /* generate the requested number of
+                                * samples */
+     else
+        {
+         /* ceil((when - frame_start) / ticks_per_sample) */
+         n = (up->when - frame_start +
+              ticks_per_sample - 1) / ticks_per_sample;
+         if (n > num_samples)
+            n = num_samples;   /* generate no more than the number of
+                                * samples originally requested */
+        }
+     sn76489an_core_iterate(s, n);
+     frame_start += n * ticks_per_sample;
+     num_samples -= n;
     }
+
+ // render this block's samples
+ blep_end_frame(&s->blep, s->ticks);
+ blep_read(&s->blep, &s->snd_buf);
  return 1;                      /* output is always generated */
 }
 
 //==============================================================================
 // sn76489an core iterate.
 //
-// Generate the requested number of samples into the sample buffer.
+// Run the tone and noise generators for the requested number of sample
+// periods.  Rather than stepping every sample period the generators are
+// advanced straight to the next counter to run out and only the changes
+// of the output level are passed to the band limited step synthesizer.
 //
 //   pass: sn76489an_t *s
 //         int samples
-// return: int         Number of samples actually generated, or -1 if the
-//                     sample buffer is full and needs to be drained.
+// return: void
 //==============================================================================
-int sn76489an_core_iterate (sn76489an_t *s, int samples)
+void sn76489an_core_iterate (sn76489an_t *s, int samples)
 {
- int do_samp;
-
- if (samples <= 0)
-    return 0;           /* no samples to generate! */
- audio_circularbuf_normalise(&s->scratch, AUDIO_CIRCULARBUF_MASK);
- do_samp = audio_circularbuf_samples_remaining(&s->scratch,
-                                               AUDIO_CIRCULARBUF_SIZE);
- // the circular buffer is deemed to be full when only 1 sample is
- // left - i.e. head is just behind tail
- if (do_samp <= 1)
-    return -1;          /* sample buffer is full */
- if (do_samp > samples)
-    do_samp = samples;  /* generate no more samples than
-                         * requested (but can generate
-                         * fewer!) */
- assert(do_samp > 0 && do_samp <= samples &&
-        do_samp < AUDIO_CIRCULARBUF_SIZE);
- samples = do_samp;
- while (do_samp--)
-    audio_circularbuf_put_sample(&s->scratch,
-                                 AUDIO_CIRCULARBUF_MASK,
-                                 sn76489an_gen_sample(s));
- return samples;
+ int i;
+ int n;
+ int p;
+
+ while (samples > 0)
+    {
+     // A counter of 0 has just been loaded with a period of 0 and runs
+     // through all 16 bits before it next runs out.
+     n = samples;
+     for (i = 0; i < 4; i++)
+        {
+         p = s->period_current[i] ? s->period_current[i] : 0x10000;
+         if (p < n)
+            n = p;
+        }
+
+     for (i = 0; i < 4; i++)
+        s->period_current[i] -= n;
+     s->ticks += n;
+     samples -= n;
+
+     for (i = 0; i < 3; i++)
+        {
+         if (s->period_current[i] == 0)
+            {
+             s->state ^= (1 << i);
+             if ((s->period_current[i] = s->regs[i * 2]) == 0)
+                // A period value of 0 is special - this ends up being a
+                // division by 1024.
+                s->period_current[i] = (1 << (SN_LO_BITS + SN_HI_BITS));
+            }
+        }
+
+     /* Update the noise channel. */
+     if (s->period_current[3] == 0)
+        sn76489an_noise(s);
+
+     blep_level(&s->blep, s->ticks, sn76489an_level(s));
+    }
 }
@@ -27,8 +27,9 @@ struct sn76489an_t {
    // output state
    int state;
 
-   // buffer for samples
-   audio_circularbuf_t scratch;
+   // output level changes and the sample period count they are at
+   blep_t blep;
+   uint64_t ticks;
    uint64_t cycles_remainder;
    sn_update_list_t update_head, update_tail;
 
@@ -56,5 +57,9 @@ void sn76489an_core_w (sn76489an_t *s, uint16_t port, uint8_t data);
  * change (e.g. when clocked from the CPU clock).
  */
 void sn76489an_core_clock (sn76489an_t *s, int clock_frequency);
+/*
+ * Save or load the state for a machine snapshot
+ */
+void sn76489an_core_snapshot (sn76489an_t *s);
 
 #endif /* _sn76489an_core_h */
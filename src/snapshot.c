@@ -0,0 +1,811 @@
+//******************************************************************************
+//*                                  uBee512                                   *
+//*       An emulator for the Microbee Z80 ROM, FDD and HDD based models       *
+//*                                                                            *
+//*                          Machine snapshot module                           *
+//*                                                                            *
+//*                          Copyright (C) 2026 agent                          *
+//******************************************************************************
+//
+// Saves and restores the complete state of the emulated machine.
+//
+// A snapshot file starts with a header holding the magic string, the format
+// version and the model and RAM size it was taken from, followed by a
+// sequence of chunks.  Each chunk has a 4 character tag and a 32 bit length
+// followed by the data.  All values are little endian.  The last chunk has
+// the tag 'END '.
+//
+// Each module with state to be saved has a <module>_snapshot() function.
+// The same function is used for saving and loading, it calls
+// snapshot_chunk() with its tag and then snapshot_u8(), snapshot_int(),
+// etc. for each item of state.  When saving the values are appended to the
+// snapshot and when loading they are replaced by the values read back, a
+// module can check snapshot_loading() for any work needed after its state
+// has been restored.  Large memory areas use snapshot_packed() which stores
+// them using PackBits run length encoding.
+//
+// A snapshot can only be loaded into the same model with the same RAM size
+// and the same ROM and disk images.  The disk image contents are not part
+// of the snapshot.
+//
+// The current state is saved to memory before a snapshot is loaded, if the
+// snapshot turns out to be damaged or incomplete the saved state is loaded
+// back again.
+//
+// Saving and loading is requested with the --snapshot-save and
+// --snapshot-load options and carried out by snapshot_pending() between
+// frames.
+//
+//==============================================================================
+/*
+ *  uBee512 - An emulator for the Microbee Z80 ROM, FDD and HDD based models.
+ *  Copyright (C) 2026 agent
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+//==============================================================================
+// ChangeLog (most recent entries are at top)
+//==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added the keyboard and parallel port peripheral states, the format
+//   version is now 2.
+// - Added snapshot_failed() for modules that load a variable number of
+//   items.
+// - Added snapshot_capture() and snapshot_restore() to keep the machine state
+//   without the main memory blocks in memory for the rewind module.
+// - Created a new file to save and restore machine snapshots.
+//==============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "snapshot.h"
+#include "ubee512.h"
+#include "z80api.h"
+#include "memmap.h"
+#include "roms.h"
+#include "vdu.h"
+#include "crtc.h"
+#include "pio.h"
+#include "fdc.h"
+#include "hdd.h"
+#include "ide.h"
+#include "rtc.h"
+#include "sound.h"
+#include "sn76489an.h"
+#include "keyb.h"
+#include "audio.h"
+#include "support.h"
+
+//==============================================================================
+// structures and variables
+//==============================================================================
+#define SNAPSHOT_HEADER_SIZE (8 + 4 + 4 + 4)
+#define SNAPSHOT_CHUNK_SIZE  (4 + 4)
+
+snapshot_t snapshot;
+
+typedef struct snapshot_buf_t
+{
+ uint8_t *data;
+ uint32_t size;                 // allocated size
+ uint32_t len;                  // used length
+}snapshot_buf_t;
+
+static int mode = SNAPSHOT_IDLE;
+static int error;
+static snapshot_buf_t *buf;
+static uint32_t chunk_start;    // save: chunk length field, load: data start
+static uint32_t chunk_end;      // load: end of chunk data
+static uint32_t pos;            // load: read position
+static char chunk_tag[5];
+static int memory_included = 1;
+
+extern emu_t emu;
+extern model_t modelx;
+
+//==============================================================================
+// Report a snapshot error.  Only the first error is reported.
+//
+//   pass: char *mesg
+// return: void
+//==============================================================================
+static void snapshot_error (char *mesg)
+{
+ if (! error)
+    xprintf("snapshot: %s (chunk '%s')\n", mesg, chunk_tag);
+ error = 1;
+}
+
+//==============================================================================
+// Append data to the save buffer.
+//
+//   pass: void *data
+//         uint32_t size
+// return: void
+//==============================================================================
+static void snapshot_put (const void *data, uint32_t size)
+{
+ uint8_t *p;
+ uint32_t n;
+
+ if (error)
+    return;
+
+ if (buf->len + size > buf->size)
+    {
+     n = buf->size ? buf->size : 0x10000;
+     while (buf->len + size > n)
+        n *= 2;
+     p = realloc(buf->data, n);
+     if (! p)
+        {
+         snapshot_error("unable to allocate memory");
+         return;
+        }
+     buf->data = p;
+     buf->size = n;
+    }
+
+ memcpy(buf->data + buf->len, data, size);
+ buf->len += size;
+}
+
+//==============================================================================
+// Get data from the current chunk of the load buffer.
+//
+//   pass: void *data
+//         uint32_t size
+// return: int                          0 if success, -1 if past chunk end
+//==============================================================================
+static int snapshot_get (void *data, uint32_t size)
+{
+ if (error)
+    return -1;
+
+ if (size > chunk_end - pos)
+    {
+     snapshot_error("chunk is too short");
+     return -1;
+    }
+
+ memcpy(data, buf->data + pos, size);
+ pos += size;
+
+ return 0;
+}
+
+//==============================================================================
+// Little endian conversions.
+//==============================================================================
+static void put_le32 (uint8_t *p, uint32_t v)
+{
+ p[0] = v;
+ p[1] = v >> 8;
+ p[2] = v >> 16;
+ p[3] = v >> 24;
+}
+
+static uint32_t get_le32 (const uint8_t *p)
+{
+ return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+//==============================================================================
+// Finish the current chunk.
+//
+// When saving the chunk length is filled in.  When loading all the data in
+// the chunk must have been used otherwise the chunk does not match what
+// the module expects.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void snapshot_chunk_end (void)
+{
+ if (! chunk_tag[0])
+    return;
+
+ if (mode == SNAPSHOT_SAVE)
+    {
+     if (! error)
+        put_le32(buf->data + chunk_start,
+                 buf->len - chunk_start - 4);
+    }
+ else
+    {
+     if (pos != chunk_end)
+        snapshot_error("chunk size does not match");
+    }
+
+ chunk_tag[0] = 0;
+}
+
+//==============================================================================
+// Start a chunk.
+//
+// When saving a new chunk header is added.  When loading the chunk with the
+// tag is found and becomes the current chunk.
+//
+//   pass: char *tag                    4 character chunk tag
+// return: int                          0 if success, -1 if error
+//==============================================================================
+int snapshot_chunk (char *tag)
+{
+ uint8_t len[4] = {0, 0, 0, 0};
+ uint32_t p;
+
+ snapshot_chunk_end();
+ memcpy(chunk_tag, tag, 4);
+ chunk_tag[4] = 0;
+
+ if (error)
+    return -1;
+
+ if (mode == SNAPSHOT_SAVE)
+    {
+     snapshot_put(tag, 4);
+     chunk_start = buf->len;
+     snapshot_put(len, 4);
+     return -error;
+    }
+
+ // the chunk lengths were checked by snapshot_check()
+ p = SNAPSHOT_HEADER_SIZE;
+ while (p < buf->len)
+    {
+     if (memcmp(buf->data + p, tag, 4) == 0)
+        {
+         chunk_start = pos = p + SNAPSHOT_CHUNK_SIZE;
+         chunk_end = pos + get_le32(buf->data + p + 4);
+         return 0;
+        }
+     p += SNAPSHOT_CHUNK_SIZE + get_le32(buf->data + p + 4);
+    }
+
+ snapshot_error("chunk not found");
+ return -1;
+}
+
+//==============================================================================
+// Return non zero if a snapshot is being loaded.
+//
+//   pass: void
+// return: int                          1 if loading, else 0
+//==============================================================================
+int snapshot_loading (void)
+{
+ return (mode == SNAPSHOT_LOAD);
+}
+
+//==============================================================================
+// Return non zero if an error has occurred.
+//
+// Used by modules to stop loading a variable number of items once the
+// chunk data has run out.
+//
+//   pass: void
+// return: int                          1 if an error occurred, else 0
+//==============================================================================
+int snapshot_failed (void)
+{
+ return (error != 0);
+}
+
+//==============================================================================
+// Save or load values of various sizes.
+//
+//   pass: type *v                      pointer to value
+// return: void
+//==============================================================================
+void snapshot_u8 (uint8_t *v)
+{
+ if (mode == SNAPSHOT_SAVE)
+    snapshot_put(v, 1);
+ else
+    snapshot_get(v, 1);
+}
+
+void snapshot_u16 (uint16_t *v)
+{
+ uint8_t b[2];
+
+ if (mode == SNAPSHOT_SAVE)
+    {
+     b[0] = *v;
+     b[1] = *v >> 8;
+     snapshot_put(b, 2);
+    }
+ else
+    if (snapshot_get(b, 2) == 0)
+       *v = b[0] | (b[1] << 8);
+}
+
+void snapshot_u32 (uint32_t *v)
+{
+ uint8_t b[4];
+
+ if (mode == SNAPSHOT_SAVE)
+    {
+     put_le32(b, *v);
+     snapshot_put(b, 4);
+    }
+ else
+    if (snapshot_get(b, 4) == 0)
+       *v = get_le32(b);
+}
+
+void snapshot_u64 (uint64_t *v)
+{
+ uint32_t lo;
+ uint32_t hi;
+
+ lo = *v;
+ hi = *v >> 32;
+ snapshot_u32(&lo);
+ snapshot_u32(&hi);
+ *v = ((uint64_t)hi << 32) | lo;
+}
+
+void snapshot_int (int *v)
+{
+ uint32_t x = *v;
+
+ snapshot_u32(&x);
+ *v = (int32_t)x;
+}
+
+//==============================================================================
+// Save or load a block of data as is.
+//
+//   pass: void *data
+//         int size
+// return: void
+//==============================================================================
+void snapshot_data (void *data, int size)
+{
+ if (mode == SNAPSHOT_SAVE)
+    snapshot_put(data, size);
+ else
+    snapshot_get(data, size);
+}
+
+//==============================================================================
+// Save or load a block of data using PackBits run length encoding.
+//
+// A control byte n of 0-127 is followed by n+1 literal bytes, 129-255 is
+// followed by one byte to be repeated 257-n times.  The size is stored
+// ahead of the encoded data and must match when loading.
+//
+//   pass: void *data
+//         int size
+// return: void
+//==============================================================================
+void snapshot_packed (void *data, int size)
+{
+ uint8_t *d = data;
+ uint32_t x = size;
+ uint8_t c;
+ int lit;
+ int run;
+ int i = 0;
+
+ snapshot_u32(&x);
+ if (error)
+    return;
+
+ if ((int)x != size)
+    {
+     snapshot_error("memory size does not match");
+     return;
+    }
+
+ if (mode == SNAPSHOT_SAVE)
+    {
+     while (i < size)
+        {
+         run = 1;
+         while ((i + run < size) && (run < 128) && (d[i + run] == d[i]))
+            run++;
+         if (run > 1)
+            {
+             c = 257 - run;
+             snapshot_put(&c, 1);
+             snapshot_put(&d[i], 1);
+             i += run;
+             continue;
+            }
+         lit = 1;
+         while ((i + lit < size) && (lit < 128) &&
+                ! ((i + lit + 1 < size) && (d[i + lit] == d[i + lit + 1])))
+            lit++;
+         c = lit - 1;
+         snapshot_put(&c, 1);
+         snapshot_put(&d[i], lit);
+         i += lit;
+        }
+     return;
+    }
+
+ while ((i < size) && (snapshot_get(&c, 1) == 0))
+    {
+     if (c < 128)
+        {
+         if (i + c + 1 > size)
+            break;
+         if (snapshot_get(&d[i], c + 1))
+            return;
+         i += c + 1;
+        }
+     else
+        if (c > 128)
+           {
+            if (i + 257 - c > size)
+               break;
+            if (snapshot_get(&d[i], 1))
+               return;
+            memset(&d[i + 1], d[i], 256 - c);
+            i += 257 - c;
+           }
+        else
+           break;
+    }
+
+ if (i != size)
+    snapshot_error("packed data is damaged");
+}
+
+//==============================================================================
+// Return whether the main memory blocks are part of the snapshot.
+//
+// The memory blocks are left out of in memory snapshots taken by the rewind
+// module as it keeps track of memory changes itself.
+//
+//   pass: void
+// return: int                          1 if included, else 0
+//==============================================================================
+int snapshot_memory (void)
+{
+ return memory_included;
+}
+
+//==============================================================================
+// Save or load the state of all modules.
+//
+// The CPU is first as it restores the tstate count that other modules use
+// to set up their timing.
+//
+//   pass: void
+// return: int                          0 if success, -1 if error
+//==============================================================================
+static int snapshot_modules (void)
+{
+ chunk_tag[0] = 0;
+
+ z80api_snapshot();
+ memmap_snapshot();
+ roms_snapshot();
+ vdu_snapshot();
+ crtc_snapshot();
+ pio_snapshot();
+ fdc_snapshot();
+ hdd_snapshot();
+ ide_snapshot();
+ rtc_snapshot();
+ speaker_snapshot();
+ sn76489an_snapshot();
+ keyb_snapshot();
+
+ snapshot_chunk("END ");
+ snapshot_chunk_end();
+
+ if (mode == SNAPSHOT_LOAD)
+    {
+     memmap_configure();
+     audio_reset();
+     z80api_code_flush();
+     crtc_set_redraw();
+    }
+
+ return -error;
+}
+
+//==============================================================================
+// Save the machine state to a buffer.
+//
+//   pass: snapshot_buf_t *b
+// return: int                          0 if success, -1 if error
+//==============================================================================
+static int snapshot_to_buf (snapshot_buf_t *b)
+{
+ uint8_t header[SNAPSHOT_HEADER_SIZE];
+ int res;
+
+ memcpy(header, SNAPSHOT_MAGIC, 8);
+ put_le32(&header[8], SNAPSHOT_VERSION);
+ put_le32(&header[12], emu.model);
+ put_le32(&header[16], modelx.ram);
+
+ buf = b;
+ buf->len = 0;
+ mode = SNAPSHOT_SAVE;
+ error = 0;
+
+ snapshot_put(header, sizeof(header));
+ res = snapshot_modules();
+
+ mode = SNAPSHOT_IDLE;
+
+ return res;
+}
+
+//==============================================================================
+// Check a loaded snapshot's header and chunk structure.
+//
+//   pass: snapshot_buf_t *b
+// return: int                          0 if valid, -1 if error
+//==============================================================================
+static int snapshot_check (snapshot_buf_t *b)
+{
+ uint32_t p;
+ uint32_t len;
+
+ if ((b->len < SNAPSHOT_HEADER_SIZE) ||
+     (memcmp(b->data, SNAPSHOT_MAGIC, 8) != 0))
+    {
+     xprintf("snapshot: not a snapshot file\n");
+     return -1;
+    }
+
+ if (get_le32(&b->data[8]) != SNAPSHOT_VERSION)
+    {
+     xprintf("snapshot: unsupported version %u\n", get_le32(&b->data[8]));
+     return -1;
+    }
+
+ if ((get_le32(&b->data[12]) != (uint32_t)emu.model) ||
+     (get_le32(&b->data[16]) != (uint32_t)modelx.ram))
+    {
+     xprintf("snapshot: taken from a different model or RAM size\n");
+     return -1;
+    }
+
+ p = SNAPSHOT_HEADER_SIZE;
+ while (p < b->len)
+    {
+     if (b->len - p < SNAPSHOT_CHUNK_SIZE)
+        break;
+     len = get_le32(b->data + p + 4);
+     if (len > b->len - p - SNAPSHOT_CHUNK_SIZE)
+        break;
+     if (memcmp(b->data + p, "END ", 4) == 0)
+        return 0;
+     p += SNAPSHOT_CHUNK_SIZE + len;
+    }
+
+ xprintf("snapshot: file is truncated or damaged\n");
+ return -1;
+}
+
+//==============================================================================
+// Load the machine state from a buffer.
+//
+//   pass: snapshot_buf_t *b
+// return: int                          0 if success, -1 if error
+//==============================================================================
+static int snapshot_from_buf (snapshot_buf_t *b)
+{
+ int res;
+
+ buf = b;
+ mode = SNAPSHOT_LOAD;
+ error = 0;
+
+ res = snapshot_modules();
+
+ mode = SNAPSHOT_IDLE;
+
+ return res;
+}
+
+//==============================================================================
+// Save a snapshot file.
+//
+//   pass: char *filename
+// return: int                          0 if success, -1 if error
+//==============================================================================
+int snapshot_save (char *filename)
+{
+ snapshot_buf_t b = {NULL, 0, 0};
+ FILE *fp;
+ int res;
+
+ res = snapshot_to_buf(&b);
+
+ if (res == 0)
+    {
+     fp = fopen(filename, "wb");
+     if (! fp)
+        {
+         xprintf("snapshot_save: Unable to create file: %s\n", filename);
+         res = -1;
+        }
+     else
+        {
+         if (fwrite(b.data, 1, b.len, fp) != b.len)
+            res = -1;
+         if (fclose(fp) != 0)
+            res = -1;
+         if (res)
+            xprintf("snapshot_save: Error writing file: %s\n", filename);
+        }
+    }
+
+ if ((res == 0) && (emu.verbose))
+    xprintf("snapshot_save: %s (%u bytes)\n", filename, b.len);
+
+ free(b.data);
+
+ return res;
+}
+
+//==============================================================================
+// Load a snapshot file.
+//
+// The current state is kept in memory and restored if the snapshot can not
+// be loaded completely.
+//
+//   pass: char *filename
+// return: int                          0 if success, -1 if error
+//==============================================================================
+int snapshot_load (char *filename)
+{
+ snapshot_buf_t b = {NULL, 0, 0};
+ snapshot_buf_t backup = {NULL, 0, 0};
+ FILE *fp;
+ long size;
+ int res = -1;
+
+ fp = fopen(filename, "rb");
+ if (! fp)
+    {
+     xprintf("snapshot_load: Unable to open file: %s\n", filename);
+     return -1;
+    }
+
+ if ((fseek(fp, 0, SEEK_END) == 0) && ((size = ftell(fp)) > 0) &&
+     (fseek(fp, 0, SEEK_SET) == 0))
+    {
+     b.data = malloc(size);
+     if (b.data && (fread(b.data, 1, size, fp) == (size_t)size))
+        {
+         b.len = b.size = size;
+         res = 0;
+        }
+    }
+ fclose(fp);
+
+ if (res)
+    xprintf("snapshot_load: Error reading file: %s\n", filename);
+ else
+    res = snapshot_check(&b);
+
+ if (res == 0)
+    res = snapshot_to_buf(&backup);
+
+ if (res == 0)
+    {
+     res = snapshot_from_buf(&b);
+     if (res)
+        {
+         xprintf("snapshot_load: Restoring the previous state\n");
+         snapshot_from_buf(&backup);
+        }
+     else
+        if (emu.verbose)
+           xprintf("snapshot_load: %s\n", filename);
+    }
+
+ free(b.data);
+ free(backup.data);
+
+ return res;
+}
+
+//==============================================================================
+// Capture the machine state, without the main memory blocks, to memory.
+//
+// The returned buffer is allocated and must be freed by the caller.
+//
+//   pass: uint8_t **data               returns the state data
+//         uint32_t *len                returns the state length
+// return: int                          0 if success, -1 if error
+//==============================================================================
+int snapshot_capture (uint8_t **data, uint32_t *len)
+{
+ snapshot_buf_t b = {NULL, 0, 0};
+ uint8_t *p;
+ int res;
+
+ memory_included = 0;
+ res = snapshot_to_buf(&b);
+ memory_included = 1;
+
+ if (res)
+    {
+     free(b.data);
+     return -1;
+    }
+
+ // give back the unused part of the buffer as many of these may be kept
+ p = realloc(b.data, b.len);
+ if (p)
+    b.data = p;
+
+ *data = b.data;
+ *len = b.len;
+
+ return 0;
+}
+
+//==============================================================================
+// Restore the machine state from a snapshot_capture() buffer.
+//
+// The main memory blocks are not changed.
+//
+//   pass: uint8_t *data                state data
+//         uint32_t len                 state length
+// return: int                          0 if success, -1 if error
+//==============================================================================
+int snapshot_restore (uint8_t *data, uint32_t len)
+{
+ snapshot_buf_t b;
+ int res;
+
+ b.data = data;
+ b.size = b.len = len;
+
+ memory_included = 0;
+ res = snapshot_from_buf(&b);
+ memory_included = 1;
+
+ return res;
+}
+
+//==============================================================================
+// Carry out any pending snapshot save or load requests.
+//
+// Called between frames so that the Z80 and the devices are not part way
+// through an operation.  A save is done before a load if both are pending.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void snapshot_pending (void)
+{
+ if (snapshot.save[0])
+    {
+     snapshot_save(snapshot.save);
+     snapshot.save[0] = 0;
+    }
+
+ if (snapshot.load[0])
+    {
+     snapshot_load(snapshot.load);
+     snapshot.load[0] = 0;
+    }
+}
@@ -0,0 +1,44 @@
+/* Machine Snapshot Header */
+
+#ifndef HEADER_SNAPSHOT_H
+#define HEADER_SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "ubee512.h"
+
+#define SNAPSHOT_MAGIC   "uBeeSNAP"
+#define SNAPSHOT_VERSION 2
+
+enum
+{
+ SNAPSHOT_IDLE,
+ SNAPSHOT_SAVE,
+ SNAPSHOT_LOAD
+};
+
+typedef struct snapshot_t
+{
+ char save[SSIZE1];             // pending save file name
+ char load[SSIZE1];             // pending load file name
+}snapshot_t;
+
+void snapshot_pending (void);
+int snapshot_save (char *filename);
+int snapshot_load (char *filename);
+int snapshot_capture (uint8_t **data, uint32_t *len);
+int snapshot_restore (uint8_t *data, uint32_t len);
+int snapshot_memory (void);
+
+int snapshot_loading (void);
+int snapshot_failed (void);
+int snapshot_chunk (char *tag);
+void snapshot_u8 (uint8_t *v);
+void snapshot_u16 (uint16_t *v);
+void snapshot_u32 (uint32_t *v);
+void snapshot_u64 (uint64_t *v);
+void snapshot_int (int *v);
+void snapshot_data (void *data, int size);
+void snapshot_packed (void *data, int size);
+
+#endif     /* HEADER_SNAPSHOT_H */
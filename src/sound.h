@@ -7,5 +7,6 @@ int speaker_init (void);
 int speaker_deinit (void);
 int speaker_reset (void);
 void speaker_w (uint8_t data);
+void speaker_snapshot (void);
 
 #endif     /* HEADER_SOUND_H */
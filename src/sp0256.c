@@ -33,6 +33,11 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added sp0256_snapshot() function for machine snapshots.
+// - Samples are now passed on as 16 bit values scaled by AUDIO_SHIFT
+//   instead of being reduced to 8 bits.
+//
 // v4.7.0 - 17 June 2010, K Duckmanton
 // - Initial implementation, based on work by Joseph Zbiciak
 //==============================================================================
@@ -71,6 +76,7 @@ static const char rcs_id[]="$Id: sp0256.c,v 1.1.1.4 2011/03/27 06:04:42 krd Exp
 #include "audio.h"
 #include "support.h"
 #include "sp0256.h"
+#include "snapshot.h"
 
 extern modio_t modio;
 
@@ -223,11 +229,13 @@ int lpc12_update(lpc12_t *f, int num_samp, audio_circularbuf_t *cb)
      audio_circularbuf_put_sample(sc, AUDIO_CIRCULARBUF_MASK, limit(samp) << 2);
 #else
      // NOTE! The maximum value of the sample needs to be kept in
-     // mind here.  Maximum and minimum values are +/- 0xf80, this
-     // needs to be scaled back by 4 or 5 bits in order to fit into
-     // a char (esp. when offset by 128).  Division is used rather
-     // than a bit shift in order to to preserve the sign
-     audio_circularbuf_put_sample(cb, AUDIO_CIRCULARBUF_MASK, samp / (1<<4));
+     // mind here.  Maximum and minimum values are +/- 0xf80, this is
+     // scaled back by 4 bits to the source level range and the 16 bit
+     // sample keeps AUDIO_SHIFT bits of fraction below that.
+     // Division is used rather than a bit shift in order to to
+     // preserve the sign
+     audio_circularbuf_put_sample(cb, AUDIO_CIRCULARBUF_MASK,
+                                  samp * (1 << AUDIO_SHIFT) / (1<<4));
 #endif
     }
 
@@ -1322,6 +1330,44 @@ int sp0256_deinit(sp0256_t *sp)
  return audio_circularbuf_deinit(&sp->scratch);
 }
 
+/* ======================================================================== */
+/*  SP0256_SNAPSHOT -- Save or load the microcontroller and filter state.   */
+/*                     The ROM pages are not included and samples waiting   */
+/*                     in the circular buffer are discarded on loading.     */
+/* ======================================================================== */
+void sp0256_snapshot(sp0256_t *sp)
+{
+ lpc12_t *f = &sp->filt;
+ int i;
+
+ snapshot_int(&f->rpt);
+ snapshot_int(&f->cnt);
+ snapshot_u32(&f->per);
+ snapshot_u32(&f->rng);
+ snapshot_int(&f->amp);
+ for (i = 0; i < 6; i++)
+    {
+     snapshot_u16((uint16_t *)&f->f_coef[i]);
+     snapshot_u16((uint16_t *)&f->b_coef[i]);
+     snapshot_u16((uint16_t *)&f->z_data[i][0]);
+     snapshot_u16((uint16_t *)&f->z_data[i][1]);
+    }
+ snapshot_data(f->r, sizeof(f->r));
+ snapshot_int(&f->interp);
+
+ snapshot_int(&sp->lrq);
+ snapshot_int(&sp->ald);
+ snapshot_int(&sp->pc);
+ snapshot_int(&sp->stack);
+ snapshot_int(&sp->fifo_sel);
+ snapshot_int(&sp->halted);
+ snapshot_u32(&sp->mode);
+ snapshot_u32(&sp->page);
+
+ if (snapshot_loading())
+    sp->scratch.tail = sp->scratch.head;
+}
+
 void sp0256_ald(sp0256_t *sp, uint8_t data)
 {
  sp->lrq = 0;
@@ -75,6 +75,11 @@ int lpc12_update(lpc12_t *f, int num_samp, audio_circularbuf_t *cb);
 /* ======================================================================== */
 void sp0256_ald(sp0256_t *sp, uint8_t data);
 
+/* ======================================================================== */
+/*  SP0256_SNAPSHOT -- save or load the state for a machine snapshot.       */
+/* ======================================================================== */
+void sp0256_snapshot(sp0256_t *sp);
+
 #endif /* _SP0256_H */
 /* ======================================================================== */
 /*  This program is free software; you can redistribute it and/or modify    */
@@ -31,6 +31,13 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added time_get_ns() function returning a monotonic nanosecond clock for
+//   benchmark timing.
+// - Added time_get_cpu_ns() to return the process CPU time and
+//   time_sleep_until_ns() to sleep until an absolute monotonic deadline
+//   with a short busy wait at the end.
+//
 // v6.0.0 - 1 January 2017, K Duckmanton
 // - Microbee memory is now an array of uint8_t rather than char.
 //
@@ -80,6 +87,7 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <time.h>
+#include <errno.h>
 #include <sys/stat.h>
 
 #ifdef MINGW
@@ -162,6 +170,104 @@ uint64_t time_get_ms (void)
 #endif
 }
 
+//==============================================================================
+// Get the current monotonic clock time in nanoseconds.
+//
+// This clock is not affected by changes to the host's time of day and is
+// intended for measuring elapsed time intervals.
+//
+//   pass: void
+// return: uint64_t                     number of nanoseconds
+//==============================================================================
+uint64_t time_get_ns (void)
+{
+#ifdef MINGW
+ static LARGE_INTEGER freq;
+ LARGE_INTEGER count;
+
+ if (! freq.QuadPart)
+    QueryPerformanceFrequency(&freq);
+ QueryPerformanceCounter(&count);
+ return (uint64_t)((double)count.QuadPart * 1E9 / (double)freq.QuadPart);
+#else
+ struct timespec ts;
+
+ clock_gettime(CLOCK_MONOTONIC, &ts);
+ return ((uint64_t)ts.tv_sec * 1000000000) + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+//==============================================================================
+// Get the CPU time used by this process in nanoseconds.
+//
+//   pass: void
+// return: uint64_t                     number of nanoseconds
+//==============================================================================
+uint64_t time_get_cpu_ns (void)
+{
+#ifdef MINGW
+ FILETIME create, leave, kernel, user;
+ ULARGE_INTEGER k, u;
+
+ if (! GetProcessTimes(GetCurrentProcess(), &create, &leave, &kernel, &user))
+    return 0;
+ k.LowPart = kernel.dwLowDateTime;
+ k.HighPart = kernel.dwHighDateTime;
+ u.LowPart = user.dwLowDateTime;
+ u.HighPart = user.dwHighDateTime;
+ return (k.QuadPart + u.QuadPart) * 100;  // 100nS units
+#else
+ struct timespec ts;
+
+ clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+ return ((uint64_t)ts.tv_sec * 1000000000) + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+//==============================================================================
+// Sleep until an absolute time_get_ns() deadline.
+//
+// The process sleeps until 'spin' nanoseconds before the deadline and then
+// busy waits for the remaining time.  The sleep gives up host CPU time while
+// the short busy wait removes most of the host's wake up latency.
+//
+//   pass: uint64_t deadline            time_get_ns() value to wake at
+//         uint64_t spin                busy wait time in nanoseconds
+// return: void
+//==============================================================================
+void time_sleep_until_ns (uint64_t deadline, uint64_t spin)
+{
+ uint64_t now = time_get_ns();
+
+ if (deadline > now + spin)
+    {
+#ifdef MINGW
+     Sleep((DWORD)((deadline - spin - now) / 1000000));
+#else
+#ifdef DARWIN
+     struct timespec ts;
+     uint64_t t = deadline - spin - now;
+
+     ts.tv_sec = t / 1000000000;
+     ts.tv_nsec = t % 1000000000;
+     while ((nanosleep(&ts, &ts) == -1) && (errno == EINTR))
+        ;
+#else
+     struct timespec ts;
+     uint64_t t = deadline - spin;
+
+     ts.tv_sec = t / 1000000000;
+     ts.tv_nsec = t % 1000000000;
+     while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+#endif
+#endif
+    }
+
+ while (time_get_ns() < deadline)
+    ;
+}
+
 //==============================================================================
 // Time delay in milliseconds. Gives up host CPU time to other applications.
 //
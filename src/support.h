@@ -57,6 +57,9 @@ typedef struct basicver_t
 char *sup_strncpy (char *d, const char *s, int size);
 int time_get_secs (void);
 uint64_t time_get_ms (void);
+uint64_t time_get_ns (void);
+uint64_t time_get_cpu_ns (void);
+void time_sleep_until_ns (uint64_t deadline, uint64_t spin);
 void time_delay_ms (int ms);
 void time_wait_ms (int ms);
 void get_date_and_time (char *s);
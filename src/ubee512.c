@@ -31,6 +31,46 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added a capture_* entry to init_func[] for frame capture, see
+//   capture.c.  Headless mode now uses the off screen video type and SDL's
+//   dummy video driver is also used when --video-type=offscreen is given.
+// - Added a glyph_* entry to init_func[] to select the glyph expansion
+//   kernel used to draw characters, see glyph.c.
+// - Added rewinding (--rewind, --rewind-frames and --db-rstep).  A rewind_*
+//   entry was added to init_func[] and application_loop() calls
+//   rewind_update() at the start of each frame, see rewind.c.
+// - Added record and replay of input (--record and --replay).  A replay_*
+//   entry was added to init_func[], event_handler() passes host events to
+//   replay_event() and injects due recorded events with replay_pending()
+//   and reset() calls replay_rebase() before clearing the tstate count.
+// - Added --farm-snapshot to main().  The supervisor starts up headless,
+//   loads the snapshot and forks the instances once the emulator is
+//   running so they share its memory copy on write.
+// - Added a snapshot_pending() call at the start of each frame in
+//   application_loop() to save and load machine snapshots (--snapshot-save
+//   and --snapshot-load), see snapshot.c.
+// - Added an instance farm (--farm) to main().  The supervisor process
+//   forks worker processes for each instance after the options have been
+//   processed and each instance then processes them again with its own
+//   options added, see farm.c.
+// - Added a nS pacing method (--cpu-delay=3) to emulation_delay() using
+//   absolute monotonic deadlines with a short busy wait, see
+//   emulation_pace().  Frame jitter percentiles, missed deadlines and host
+//   CPU usage can be reported with --pace-stats.
+// - Added the sched_* functions to init_func[] table ahead of all other
+//   modules so that modules may add events during their reset.
+// - Removed the pio_polling() call after each block in
+//   normal_execution_loop() as PIO polling is now a scheduled event.
+// - Removed the audio_sources_update() call from application_loop() as
+//   the synchronous sound sources are now updated by a scheduled event.
+//   audio_reset() is called after the modules are reset in reset().
+// - Added a headless benchmark mode (--headless).  No window is shown, no
+//   audio device is opened and emulation_delay() is bypassed.  The run can
+//   be limited with --bench-tstates, --bench-frames and --bench-halt and a
+//   report of the emulated MHz, host nS per tstate and time spent in each
+//   part of the application loop is shown on exit.
+//
 // v6.0.0 - 5 February 2017, uBee
 // - Added in main() a new test for 'emu.exit_warning'.
 // v6.0.0 - 1 January 2017, K Duckmanton
@@ -454,6 +494,14 @@
 #include "keystd.h"
 #include "sn76489an.h"
 #include "console.h"
+#include "sched.h"
+#include "farm.h"
+#include "snapshot.h"
+#include "replay.h"
+#include "rewind.h"
+#include "glyph.h"
+#include "render.h"
+#include "capture.h"
 
 #include "macros.h"
 
@@ -486,6 +534,7 @@ emu_t emu =
  .cpuclock_def = CPU_CLOCK_FREQ,
  .cmd_repeat1 = EMU_REPEAT1,
  .cmd_repeat2 = EMU_REPEAT2,
+ .pace_spin = EMU_PACE_SPIN_US,
  .hardware=0xffffffff
 };
 
@@ -642,6 +691,12 @@ static char *acc_dir_paths[] =
 // first mouse click (any button) afterwards does not generate a mouse button event.
 static init_func_t init_func[] =
 {
+ {sched_init,    sched_deinit,    sched_reset,    EMU_INIT + EMU_INIT_POWERCYC + EMU_RST1 + EMU_RST2,    "sched"},
+ {replay_init,   replay_deinit,   replay_reset,   EMU_INIT,                                                 "replay"},
+ {rewind_init,   rewind_deinit,   rewind_reset,   EMU_INIT + EMU_INIT_POWERCYC + EMU_RST1 + EMU_RST2,   "rewind"},
+ {glyph_init,    glyph_deinit,    glyph_reset,    EMU_INIT,                                                 "glyph"},
+ {render_init,   render_deinit,   render_reset,   EMU_INIT,                                                 "render"},
+ {capture_init,  capture_deinit,  capture_reset,  EMU_INIT,                                                 "capture"},
  {z80_init,      z80_deinit,      z80_reset,      EMU_INIT + EMU_INIT_POWERCYC + EMU_RST1 + EMU_RST2,      "z80"},
  {vdu_init,      vdu_deinit,      vdu_reset,      EMU_INIT                     + EMU_RST1 + EMU_RST2,      "vdu"},
  {clock_init,    clock_deinit,    clock_reset,    EMU_INIT + EMU_INIT_POWERCYC + EMU_RST1 + EMU_RST2,    "clock"},
@@ -678,10 +733,30 @@ static int delay_adj;
 static uint64_t ticks1;
 static uint64_t ticks2;
 
+static int bench;               // non zero if benchmark timing is active
+static int bench_halted;
+static int bench_frame_count;
+static uint64_t bench_tstates_run;
+static uint64_t bench_ns_start;
+static uint64_t bench_ns_z80;
+static uint64_t bench_ns_audio;
+static uint64_t bench_ns_crtc;
+static uint64_t bench_ns_video;
+static uint64_t bench_ns_event;
+
+static uint64_t pace_deadline;  // next frame deadline (nS), 0 if not started
+static uint64_t pace_stats_ns;  // start of the current report period (nS)
+static uint64_t pace_stats_cpu; // process CPU time at start of period (nS)
+static int pace_frames;
+static int pace_missed;
+static int pace_samples;
+static uint32_t pace_jitter[EMU_PACE_SAMPLES];
+
 extern char *c_argv[];
 extern int c_argc;
 
 extern crtc_t crtc;
+extern farm_t farm;
 extern video_t video;
 extern mouse_t mouse;
 extern audio_t audio;
@@ -1279,6 +1354,88 @@ static int icon_init (void)
  return 0;
 }
 
+//==============================================================================
+// Benchmark timer.
+//
+// Returns the monotonic host time in nanoseconds if benchmark timing is
+// active, otherwise 0 so that the time differences accumulated are also 0.
+//
+//   pass: void
+// return: uint64_t                     nanoseconds or 0
+//==============================================================================
+static inline uint64_t bench_time (void)
+{
+ return bench ? time_get_ns() : 0;
+}
+
+//==============================================================================
+// Benchmark Z80 HALT action.
+//
+// Flags the end of a benchmark run when the Z80 halts with interrupts
+// disabled, as nothing can then resume execution other than a reset.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void bench_halt_action (void)
+{
+ if (! z80api_intr_possible())
+    bench_halted = 1;
+}
+
+//==============================================================================
+// Benchmark report.
+//
+// Reports the emulated Z80 clock rate achieved, the host time used for each
+// emulated tstate and a breakdown of where the host time was spent.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void bench_report (void)
+{
+ uint64_t total_ns;
+ uint64_t other_ns;
+ double total;
+
+ total_ns = time_get_ns() - bench_ns_start;
+ if (total_ns == 0)
+    total_ns = 1;
+ total = (double)total_ns;
+
+ other_ns = bench_ns_z80 + bench_ns_audio + bench_ns_crtc + bench_ns_video +
+ bench_ns_event;
+ other_ns = (other_ns < total_ns)? total_ns - other_ns : 0;
+
+ xprintf("\n");
+ xprintf("BENCHMARK REPORT\n");
+ xprintf("----------------\n");
+ xprintf("Frames               : %d\n", bench_frame_count);
+ xprintf("Emulated tstates     : %llu\n",
+         (unsigned long long)bench_tstates_run);
+ xprintf("Host time            : %.3f s\n", total / 1E9);
+ xprintf("Emulated speed       : %.3f MHz (%.1f%% of %.3f MHz)\n",
+         (double)bench_tstates_run * 1E3 / total,
+         (double)bench_tstates_run * 1E11 / total / (double)emu.cpuclock,
+         (double)emu.cpuclock / 1E6);
+ xprintf("Host nS per tstate   : %.3f\n",
+         bench_tstates_run ? total / (double)bench_tstates_run : 0.0);
+ xprintf("\n");
+ xprintf("z80api_execute       : %10.3f ms %5.1f%%\n",
+         bench_ns_z80 / 1E6, bench_ns_z80 * 100.0 / total);
+ xprintf("audio_sources_update : %10.3f ms %5.1f%%\n",
+         bench_ns_audio / 1E6, bench_ns_audio * 100.0 / total);
+ xprintf("crtc_update          : %10.3f ms %5.1f%%\n",
+         bench_ns_crtc / 1E6, bench_ns_crtc * 100.0 / total);
+ xprintf("video_update         : %10.3f ms %5.1f%%\n",
+         bench_ns_video / 1E6, bench_ns_video * 100.0 / total);
+ xprintf("event_handler        : %10.3f ms %5.1f%%\n",
+         bench_ns_event / 1E6, bench_ns_event * 100.0 / total);
+ xprintf("other                : %10.3f ms %5.1f%%\n",
+         other_ns / 1E6, other_ns * 100.0 / total);
+ xprintf("\n");
+}
+
 //==============================================================================
 // Initialise modules.
 //
@@ -1296,6 +1453,10 @@ static int init_modules (int flags)
            return i;
     }
 
+ // the Z80 action list is cleared when the Z80 is initialised
+ if (emu.bench_halt)
+    z80api_register_action(Z80_HALT, bench_halt_action);
+
  // only report if we are up and running or verbose reporting
  if (emu.runmode || emu.verbose)
     xprintf("ubee512: emulation power cycle\n");
@@ -1336,6 +1497,22 @@ static int init (void)
  if (joystick.used >= 0)
     sdl_init_properties |= SDL_INIT_JOYSTICK;
 
+ // in headless mode the display is drawn off screen and no audio device
+ // is opened.
+ if (emu.headless)
+    {
+     video.type = VIDEO_OFFSCREEN;
+     sdl_init_properties &= ~(SDL_INIT_AUDIO | SDL_INIT_JOYSTICK);
+    }
+
+ // the off screen video type needs no display, SDL's dummy video driver
+ // still provides the event handling.
+ if (video.type == VIDEO_OFFSCREEN)
+    {
+     SDL_putenv("SDL_VIDEODRIVER=dummy");
+     video.fullscreen = 0;
+    }
+
 #ifndef MINGW
  // set the X window class name, necessary to avoid an SDL crash on
  // Debian with SDL 1.2
@@ -1460,6 +1637,7 @@ static int reset (int flags)
  int res = 0;
  int i = 0;
 
+ replay_rebase();
  emu.z80_cycles = 0;
  emu.done = 0;
 
@@ -1467,14 +1645,15 @@ static int reset (int flags)
  if (emu.runmode || emu.verbose)
     xprintf("ubee512: emulation reset\n");
 
- audio_reset();
-
  if ((i = reset_modules(flags)))
     {
      xprintf("init: Failed %s_reset\n", init_func[i].func_name);
      res = -1;
     }
 
+ // after the scheduler reset as the audio update is a scheduled event
+ audio_reset();
+
  return res;
 }
 
@@ -1592,6 +1771,10 @@ static void application_setup (void)
  video_update();
 
  emu.secs_init = time_get_secs();
+
+ bench = emu.headless || emu.bench_tstates || emu.bench_frames ||
+ emu.bench_halt;
+ bench_ns_start = time_get_ns();
 }
 
 //==============================================================================
@@ -1602,8 +1785,14 @@ static void application_setup (void)
 //==============================================================================
 void event_handler (void)
 {
+ uint64_t t = bench_time();
+
  while (SDL_PollEvent(&emu.event))
     {
+     // host input is recorded, or ignored if replaying
+     if (replay_event())
+        continue;
+
      switch (emu.event.type)
         {
          case SDL_KEYDOWN:
@@ -1647,7 +1836,7 @@ void event_handler (void)
 
 #ifdef USE_OPENGL
          case SDL_VIDEOEXPOSE:
-            if (video.type >= VIDEO_GL)
+            if (video.type == VIDEO_GL)
                {
                 crtc_redraw();
                 if (emu.display_context == EMU_OSD_CONTEXT)
@@ -1666,6 +1855,11 @@ void event_handler (void)
             break;
         }
     }
+
+ // inject any recorded input that is now due
+ replay_pending();
+
+ bench_ns_event += bench_time() - t;
 }
 
 //==============================================================================
@@ -1749,17 +1943,26 @@ static void normal_execution_loop (void)
     {
      static int64_t block_tstates_delta = 0;
      uint64_t block_tstates_start, block_tstates_end;
+     uint64_t t;
+     uint64_t audio_ns;
      // Execute a block (Z80CYCLES) of Z80 instructions and return the result.
      // The Z80CYCLES value used has been calculated for timing purposes.
      block_tstates_start = z80api_get_tstates();
+     t = bench_time();
+     audio_ns = audio.update_ns;
      z80api_execute(z80_block_cycles + block_tstates_delta);
+     // the synchronous sound sources are updated by a scheduled event
+     // while the Z80 runs, their time is reported separately
+     audio_ns = audio.update_ns - audio_ns;
+     bench_ns_z80 += bench_time() - t - (bench ? audio_ns : 0);
+     bench_ns_audio += audio_ns;
      block_tstates_end = z80api_get_tstates();
+     bench_tstates_run += block_tstates_end - block_tstates_start;
      // compute the number of tstates that the previous block
      // of instructions went over the target
      block_tstates_delta += z80_block_cycles -
         block_tstates_end + block_tstates_start;
 
-     pio_polling();   // poll the PIO for interrupt events
      keyb_update();   // keyboard updating
      event_handler(); // check and handle any pending events
     }
@@ -1777,6 +1980,113 @@ static void normal_execution_loop (void)
     }
 }
 
+//==============================================================================
+// Compare function for sorting jitter samples.
+//==============================================================================
+static int pace_compare (const void *a, const void *b)
+{
+ uint32_t x = *(const uint32_t *)a;
+ uint32_t y = *(const uint32_t *)b;
+
+ return (x > y) - (x < y);
+}
+
+//==============================================================================
+// Report the nS pacing statistics for the last period and start a new one.
+//
+// Jitter is the time in uS between a frame deadline and the time the frame
+// actually started.  The host CPU percentage is the CPU time used by this
+// process over the wall clock time of the period.
+//
+//   pass: uint64_t now                 current time_get_ns() value
+// return: void
+//==============================================================================
+static void pace_report (uint64_t now)
+{
+ uint64_t cpu = time_get_cpu_ns();
+ uint64_t wall = now - pace_stats_ns;
+
+ if (pace_samples)
+    {
+     qsort(pace_jitter, pace_samples, sizeof(pace_jitter[0]), pace_compare);
+     xprintf("pace: %d frames, jitter uS p50 %u p95 %u p99 %u max %u, "
+             "missed %d, cpu %.1f%%\n",
+             pace_frames,
+             pace_jitter[pace_samples / 2],
+             pace_jitter[(pace_samples * 95) / 100],
+             pace_jitter[(pace_samples * 99) / 100],
+             pace_jitter[pace_samples - 1],
+             pace_missed,
+             wall ? ((double)(cpu - pace_stats_cpu) * 100.0 / wall) : 0.0);
+    }
+
+ pace_stats_ns = now;
+ pace_stats_cpu = cpu;
+ pace_frames = 0;
+ pace_missed = 0;
+ pace_samples = 0;
+}
+
+//==============================================================================
+// Emulation pacing using nS absolute deadlines.
+//
+// Each frame has a deadline calculated from the tstates in one frame and
+// the CPU clock.  Deadlines are absolute so no error accumulates from one
+// frame to the next.  The process sleeps until just before the deadline
+// and busy waits the last --pace-spin uS.  A frame that is already late is
+// counted as a missed deadline and if it is later than --maxcpulag the
+// deadlines are restarted from the current time rather than trying to
+// catch up.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void emulation_pace (void)
+{
+ uint64_t period;
+ uint64_t now;
+ uint64_t late;
+
+ period = ((uint64_t)z80_blocks_cur * z80_block_cycles_cur * 1000000000) /
+          emu.cpuclock;
+
+ now = time_get_ns();
+ if (pace_deadline == 0)
+    {
+     pace_deadline = now;
+     pace_stats_ns = now;
+     pace_stats_cpu = time_get_cpu_ns();
+    }
+
+ pace_deadline += period;
+
+ if (now >= pace_deadline)
+    {
+     pace_missed++;
+     late = now - pace_deadline;
+     if (late > (uint64_t)emu.maxcpulag * 1000000)
+        {
+         if (modio.ubee512)
+            xprintf("emulation_pace: excessive time loss detected:"
+                    " %d mS (cleared)\n", (int)(late / 1000000));
+         pace_deadline = now;
+        }
+    }
+ else
+    time_sleep_until_ns(pace_deadline, (uint64_t)emu.pace_spin * 1000);
+
+ if (emu.pace_stats)
+    {
+     now = time_get_ns();
+     late = (now > pace_deadline) ? (now - pace_deadline) / 1000 : 0;
+     if (pace_samples < EMU_PACE_SAMPLES)
+        pace_jitter[pace_samples++] = (late > UINT32_MAX) ? UINT32_MAX : late;
+     pace_frames++;
+     if ((now - pace_stats_ns) >= (uint64_t)emu.pace_stats * 1000000000)
+        pace_report(now);
+    }
+}
+
 //==============================================================================
 // Emulation delay.
 //
@@ -1788,6 +2098,13 @@ static void emulation_delay (void)
  if (emu.turbo)
     {
      time_delay_ms(0);
+     pace_deadline = 0;
+     return;
+    }
+
+ if (emu.proc_delay_type == 3)
+    {
+     emulation_pace();
      return;
     }
 
@@ -1859,6 +2176,7 @@ static void emulation_delay (void)
 //==============================================================================
 static void application_loop (void)
 {
+ uint64_t t;
  int i;
  
 #if DEBUG_DELAY
@@ -1871,6 +2189,7 @@ static void application_loop (void)
  delay = 0;
  delay_adj = 0;
  ticks1 = time_get_ms();
+ pace_deadline = 0;
 
  while (! emu.done)
     {
@@ -1878,6 +2197,12 @@ static void application_loop (void)
      ticks1 = time_get_ms();
      delay_adj += z80ms - (ticks1 - ticks2);
 
+     // snapshots are saved and loaded between frames
+     snapshot_pending();
+
+     // rewind states are kept and restored between frames
+     rewind_update();
+
 #if DEBUG_DELAY
      Tstart = ticks1;
 #endif
@@ -1915,21 +2240,35 @@ static void application_loop (void)
      }
 #endif
 
-     // update synchronous sound sources
-     audio_sources_update();
-
 #if DEBUG_DELAY
      Tsound = time_get_ms();
 #endif
 
+     t = bench_time();
      crtc_update();   // CRTC updating for cursor and flashing atrributes
+     bench_ns_crtc += bench_time() - t;
+     t = bench_time();
      gui_update();    // GUI updating of the status line values
      video_update();  // video updating of the display
+     bench_ns_video += bench_time() - t;
 
 #if DEBUG_DELAY
      Tvideo = time_get_ms();
 #endif
 
+     // check if a benchmark run has completed
+     if (bench)
+        {
+         bench_frame_count++;
+         if (bench_halted ||
+            (emu.bench_frames && (bench_frame_count >= emu.bench_frames)) ||
+            (emu.bench_tstates && (bench_tstates_run >= emu.bench_tstates)))
+            {
+             emu.done = 1;
+             return;
+            }
+        }
+
      // handle external GUI signals
      if (gui_signal)
         {
@@ -1991,8 +2330,10 @@ static void application_loop (void)
             }
         }
 
-     // insert a delay to get the emulation speed correct
-     emulation_delay();
+     // insert a delay to get the emulation speed correct, headless mode
+     // runs unthrottled.
+     if (! emu.headless)
+        emulation_delay();
 
 #if DEBUG_DELAY
      Tend = time_get_ms();
@@ -2038,6 +2379,7 @@ int main (int argc, char *argv[])
  const char *env;
 
  int exitstatus = 0;
+ int farmstatus = 0;
 
  // get a copy of the default model data to work with
  memcpy(&modelx, &model_data[emu.model], sizeof(model_t));
@@ -2117,6 +2459,27 @@ int main (int argc, char *argv[])
     exitstatus = options_process(argc, argv);
 #endif
 
+ // if an instance farm is requested this process supervises the instances
+ // and returns here when they have all finished.  Each instance carries on
+ // from here and processes the options again with its own options added.
+ if ((! exitstatus) && (farm.file[0]) && (! farm.instance) &&
+    (! farm.snapshot[0]))
+    {
+#ifdef MINGW
+     exitstatus = farm_run(c_argc, c_argv);
+#else
+     exitstatus = farm_run(argc, argv);
+#endif
+     if (! farm.instance)
+        return exitstatus;
+     if (! exitstatus)
+        exitstatus = options_process(farm.argc, farm.argv);
+    }
+
+ // instances forked from a snapshot are forked from a running emulator
+ if (farm.snapshot[0])
+    emu.headless = 1;
+
  // if SDL-1.2.14 or later in use get back the SDL_DISABLE_LOCK_KEYS value
  // to see if the user disabled the LOCK key fix with an option.
  if (emu.sdl_version >= 1020014)
@@ -2142,14 +2505,16 @@ int main (int argc, char *argv[])
         }
     }
 
- // set some initial dialogues to show or set as pending
+ // set some initial dialogues to show or set as pending, not when drawing
+ // off screen as they would appear in captured frames.
  if (! exitstatus)
     {
 #if 1
-     if (strstr(APPVER, "dev"))
+     if (strstr(APPVER, "dev") && (video.type != VIDEO_OFFSCREEN))
         osd_set_dialogue(DIALOGUE_DEVMESG);
 #endif
-     if ((video.type != VIDEO_GL) && (messages.opengl_no == 0))
+     if ((video.type != VIDEO_GL) && (messages.opengl_no == 0) &&
+        (video.type != VIDEO_OFFSCREEN))
         osd_set_dialogue(DIALOGUE_OPENGL);
     }
 
@@ -2158,8 +2523,26 @@ int main (int argc, char *argv[])
     {
      application_setup();
 
+     // if the instance farm is started from a snapshot this process loads
+     // it, forks the instances and supervises them.  Each instance carries
+     // on from here and processes its own options in run mode.
+     if (farm.file[0] && farm.snapshot[0])
+        {
+         farmstatus = farm_run(argc, argv);
+         if (farm.instance && (! farmstatus))
+            {
+             farmstatus = options_process(farm.argc, farm.argv);
+             emu.secs_init = time_get_secs();
+             bench_ns_start = time_get_ns();
+            }
+         emu.done = (! farm.instance) || farmstatus;
+        }
+
      while (! emu.done)
         application_loop();
+
+     if (bench && (! farm.file[0] || farm.instance))
+        bench_report();
     }
 
  // if no errors then de-initialise the emulator
@@ -2175,6 +2558,9 @@ int main (int argc, char *argv[])
 
  // if running on Windows then get a confirmation before the console
  // output window is closed.
+ if (farmstatus && (! exitstatus))
+    exitstatus = farmstatus;
+
  if ((exitstatus && (exitstatus != -2)) || emu.exit_warning)
     {
 #ifdef MINGW
@@ -98,6 +98,10 @@
 // default host conversion of path slash characters
 #define EMU_SLASHCONV 1
 
+// nS pacing (--cpu-delay=3)
+#define EMU_PACE_SPIN_US 200    // busy wait time (in uS) before each deadline
+#define EMU_PACE_SAMPLES 4096   // maximum jitter samples kept for reporting
+
 // paths to shared directories.
 #define PATH_SHARED_IMAGES "/usr/local/share/ubee512/images/"
 #define PATH_SHARED_DOCS "/usr/local/share/ubee512/doc/"
@@ -257,6 +261,13 @@ typedef struct emu_t
  int port58h;
  int port58h_use;
  int proc_delay_type;
+ int pace_spin;                 // nS pacing busy wait time in uS
+ int pace_stats;                // nS pacing report interval in secs (0=off)
+ int headless;                  // no window or audio device, unthrottled
+ int bench_frames;              // exit after this many frames (0=no limit)
+ int bench_halt;                // exit on HALT with interrupts disabled
+ uint64_t bench_tstates;        // exit after this many tstates (0=no limit)
+ int z80engine;                 // Z80 CPU engine (Z80API_ENGINE_*)
  int sdl_version;
  int system;
  float cpuclock_def;
@@ -37,6 +37,35 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added vdu_changed() to report if video memory or the video ports have
+//   changed the display since it was last called (--frame-changed).
+// - vdu_draw_char() copies cells without the cursor from the glyph cache,
+//   keyed by character, colours, inversion and height.  The cache is
+//   emptied when the pixel values are mapped again and the entries for a
+//   character are dropped when its glyph is written.
+// - Added vdu_source() so the render thread can draw from a published copy
+//   of the video RAM, PCG changes are then found by comparing with a PCG
+//   shadow copy instead of in vdu_vidmem_w().
+// - Screen, attribute and colour RAM changes are now found once a frame by
+//   comparing the displayed cells with a shadow copy (vdu_shadow_update()),
+//   16 cells at a time using SSE2 or NEON where available, instead of
+//   flagging each cell from vdu_vidmem_w().  Cells showing a PCG character
+//   are linked to that character so a PCG write only marks those cells,
+//   this replaces the vdu_propagate_pcg_updates() display scan.
+// - Added vdu_draw_row() to draw a whole row of characters one scan line
+//   at a time with the glyph kernels (glyph.c) when the screen is fully
+//   redrawn.  The cell set up was moved out of vdu_draw_char() into
+//   vdu_cell() and the glyph lines are expanded by the glyph kernels.
+// - vdu_draw_char() now expands the glyph rows straight from the character
+//   ROM and PCG RAM into 8, 16 and 32 bpp screen surfaces using cached
+//   pixel values and a byte to 8 pixel mask table.  The cursor, inversion
+//   and video.yscale are handled in the same pass.  The SDL_BlitSurface()
+//   method is still used for other surface depths.
+// - Added vdu_snapshot() function for machine snapshots.
+// - Moved the video bank pointer set up in vdu_lvdat_w() to a new
+//   vdu_set_bank_ptrs() function.
+//
 // v6.0.0 - 1 January 2017, K Duckmanton
 // - Microbee memory is now an array of uint8_t rather than char.
 // - Refactored this module to only redraw those parts of the screen that
@@ -183,6 +212,12 @@
 #include <string.h>
 #include <SDL2/SDL.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 #include "vdu.h"
 #include "crtc.h"
 #include "video.h"
@@ -191,6 +226,9 @@
 #include "memmap.h"
 #include "roms.h"
 #include "support.h"
+#include "snapshot.h"
+#include "glyph.h"
+#include "render.h"
 
 #include "macros.h"
 
@@ -207,6 +245,8 @@
 #define CHAR_SURFACE_HEIGHT_PIXELS           (CHAR_SURFACE_HEIGHT_CHARS * 16)
 #define CHAR_SURFACE_ROM_BANK(x)             (x)
 #define CHAR_SURFACE_PCG_BANK(x)             ((x) + CHAR_SURFACE_ROM_BANKS)
+#define VDU_SHADOW_CHUNK                     16
+#define VDU_CACHE_LINES_MAX                  32
 
 
 //==============================================================================
@@ -220,12 +260,48 @@ extern model_custom_t modelc;
 extern modio_t modio;
 extern crtc_t crtc;
 extern video_t video;
+extern render_t render;
 
 extern int basofs;              /* offset into alpha+ BASIC ROM */
 
 
 SDL_Surface *char_data;
 
+// direct rasterizer pixel values for each col_table[] entry
+static uint32_t col_pixel[64];
+static SDL_PixelFormat *col_pixel_fmt;
+static int col_pixel_valid;
+
+// display RAM the screen is drawn from
+static vdu_t *src = &vdu;
+
+// screen RAM change tracking
+static uint8_t scr_shadow[SCR_RAM_SIZE];
+static uint8_t att_shadow[ATT_RAM_SIZE];
+static uint8_t col_shadow[COL_RAM_SIZE];
+static uint8_t pcg_shadow[PCG_RAM_SIZE];
+static int16_t pcg_cells[PCG_RAM_SIZE / 16];    // first cell showing each PCG character
+static int16_t cell_pcg[SCR_RAM_SIZE];          // PCG character shown by each cell
+static int16_t cell_next[SCR_RAM_SIZE];
+static int16_t cell_prev[SCR_RAM_SIZE];
+static int16_t pcg_dirty[PCG_RAM_SIZE / 16];    // PCG characters written to
+static int pcg_dirty_count;
+static int flash_cells;
+static int redraw_pending;
+static int changed = 1;         // display changed since vdu_changed()
+
+typedef struct vdu_cell_t
+{
+ uint8_t *glyph;                // 16 glyph lines
+ int bank;                      // character surface bank
+ int ch;                        // character in the bank
+ int inverse;                   // non zero if the cell is inverted
+ int cur_top;                   // first cursor line
+ int cur_bottom;                // line after the last cursor line
+ int fgc;                       // foreground col_table[] entry
+ int bgc;                       // background col_table[] entry
+}vdu_cell_t;
+
 //==============================================================================
 //
 // Available colours for each colour model
@@ -711,12 +787,13 @@ int vdu_init (void)
     }
 
  memset(vdu.redraw, 0, sizeof(vdu.redraw));
+ memset(vdu.pcg_redraw, 0, sizeof(vdu.pcg_redraw));
+ pcg_dirty_count = 0;
 
  vdu.scr_ptr = vdu.scr_ram;
  vdu.atr_ptr = vdu.att_ram;
  vdu.col_ptr = vdu.col_ram;
  vdu.pcg_ptr = vdu.pcg_ram;
- vdu.redraw_ptr = vdu.redraw;
  vdu.scr_mask = ~(~0 << 11);
 
  vdu_setcolourtable();
@@ -765,6 +842,7 @@ int vdu_reset (void)
     }
 
  vdu.scr_mask = ~(~0 << 11);
+ changed = 1;
 
  return 0;
 }
@@ -819,7 +897,8 @@ uint8_t vdu_vidmem_r (uint32_t addr, struct z80_memory_read_byte *mem_s)
 //
 // All writes to VDU memory are first checked to see if the location will
 // change. If the location is the same nothing is done, this prevents
-// unnecessary time consuming video rendering taking place.
+// unnecessary time consuming video rendering taking place.  Changes to the
+// screen, attribute and colour RAM are found later by vdu_shadow_update().
 //
 //   pass: uint32_t addr
 //         uint8_t data
@@ -830,6 +909,7 @@ void vdu_vidmem_w (uint32_t addr, uint8_t data,
                    struct z80_memory_write_byte *mem_s)
 {
  uint8_t *vidmem_ptr;
+ int c;
 
 #if 0
  if (modio.vdumem)
@@ -860,20 +940,23 @@ void vdu_vidmem_w (uint32_t addr, uint8_t data,
  if (*vidmem_ptr == data)
     return;                     /* Avoid drawing anything if the
                                  * screen location doesn't change. */
- if (!vdu.colourram && (addr & 0x0800))
+ if (!vdu.colourram && (addr & 0x0800) && ! render.thread)
     {
-     // PCG write
+     // PCG write, note the character so the cells showing it get redrawn.
+     // The render thread finds PCG changes itself.
      vdu_write_pcg_data(vdu.videobank, addr & 0x07FF, &data, 1);
-     vdu.pcg_redraw[vdu.videobank * 128 + (addr & 0x07ff) / 16] = 1;
-    }
- else
-    {
-     vdu.redraw_ptr[addr & 0x07FF] = 1; /* note that this screen location needs to be redrawn */
+     c = vdu.videobank * 128 + (addr & 0x07ff) / 16;
+     if (! vdu.pcg_redraw[c])
+        {
+         vdu.pcg_redraw[c] = 1;
+         pcg_dirty[pcg_dirty_count++] = c;
+        }
     }
  *vidmem_ptr = data;
+ changed = 1;
  /*
-  * Rendering of the changed character is deferred to the "update
-  * interval"
+  * Finding and rendering the changed characters is deferred to the
+  * "update interval"
   */
 }
 
@@ -933,6 +1016,7 @@ void vdu_colcont_w (uint16_t port, uint8_t data, struct z80_port_write *port_s)
       * motherboard
       */
      vdu.colour_cont = data;
+     changed = 1;
      if (modelx.colour == 1)    /* FIXME: this should be an ENUM */
         {
          // If any of the RGB background intensity bits have changed,
@@ -1000,6 +1084,25 @@ uint16_t vdu_lvdat_r (uint16_t port, struct z80_port_read *port_s)
     return 0;
 }
 
+//==============================================================================
+// Set the video bank pointers from the current alpha+ bank selection.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void vdu_set_bank_ptrs (void)
+{
+ vdu.scr_mask = ~(~0 << 11);
+ if (vdu.extendram)
+    vdu.scr_mask |= modelx.vdu << 11;
+ else
+    vdu.videobank = 0;
+ vdu.scr_ptr = vdu.scr_ram + (vdu.videobank & modelx.vdu) * 0x0800;
+ vdu.atr_ptr = vdu.att_ram + (vdu.videobank & modelx.vdu) * 0x0800;
+ vdu.col_ptr = vdu.col_ram + (vdu.videobank & modelx.vdu) * 0x0800;
+ vdu.pcg_ptr = (vdu.videobank >= modelx.pcg) ? NULL : vdu.pcg_ram + vdu.videobank * 0x800;
+}
+
 //==============================================================================
 // Write Port 0x1C - LV DATA
 //
@@ -1033,17 +1136,9 @@ void vdu_lvdat_w (uint16_t port, uint8_t data, struct z80_port_write *port_s)
      vdu.attribram = vdu.lv_dat & B8(00010000);         // attribute RAM select
      vdu.extendram = vdu.lv_dat & B8(10000000);    // extended graphics select
      
-     vdu.scr_mask = ~(~0 << 11);
-     if (vdu.extendram)
-        vdu.scr_mask |= modelx.vdu << 11;
-     else
-        vdu.videobank = 0;
-     vdu.scr_ptr = vdu.scr_ram + (vdu.videobank & modelx.vdu) * 0x0800;
-     vdu.atr_ptr = vdu.att_ram + (vdu.videobank & modelx.vdu) * 0x0800;
-     vdu.col_ptr = vdu.col_ram + (vdu.videobank & modelx.vdu) * 0x0800;
-     vdu.pcg_ptr = (vdu.videobank >= modelx.pcg) ? NULL : vdu.pcg_ram + vdu.videobank * 0x800;
-     vdu.redraw_ptr = vdu.redraw + (vdu.videobank & modelx.vdu) * 0x0800; 
+     vdu_set_bank_ptrs();
      crtc_set_redraw();
+     changed = 1;
     }
  vdu.x_lv_dat = vdu.lv_dat;                         // port (0x1c) value
 }
@@ -1066,29 +1161,360 @@ void vdu_latchrom_w (uint16_t port, uint8_t data, struct z80_port_write *port_s)
 
 
 //==============================================================================
+// Save or load the video state for a machine snapshot.
 //
-// Propagate updates to the PCG ram back to the screen RAM
+// The character ROM is not saved.  After loading the PCG characters are
+// rendered again and the whole screen is redrawn.
 //
+//   pass: void
+// return: void
 //==============================================================================
-void vdu_propagate_pcg_updates(int maddr, int size)
+void vdu_snapshot (void)
 {
- int pcgbank;
- uint8_t data;
+ if (snapshot_chunk("VDU "))
+    return;
 
- for (; size > 0; ++maddr, --size)
+ snapshot_u8(&vdu.colour_cont);
+ snapshot_u8(&vdu.x_colour_cont);
+ snapshot_u8(&vdu.lv_dat);
+ snapshot_u8(&vdu.x_lv_dat);
+ snapshot_int(&vdu.extendram);
+ snapshot_int(&vdu.attribram);
+ snapshot_int(&vdu.colourram);
+ snapshot_int(&vdu.videobank);
+ snapshot_packed(vdu.scr_ram, sizeof(vdu.scr_ram));
+ snapshot_packed(vdu.col_ram, sizeof(vdu.col_ram));
+ snapshot_packed(vdu.att_ram, sizeof(vdu.att_ram));
+ snapshot_packed(vdu.pcg_ram, sizeof(vdu.pcg_ram));
+
+ if (! snapshot_loading())
+    return;
+
+ if (modelx.alphap)
     {
-     data = vdu.scr_ram[maddr & vdu.scr_mask];
-     if (!(data & 0x80))
-        continue;
-     pcgbank = (vdu.extendram) ? (vdu.att_ram[maddr & vdu.scr_mask] & B8(00001111)) : 0;
-     if (pcgbank >= modelx.pcg)
-        continue;               /* The selected PCG bank isn't
+     basofs = (vdu.lv_dat & B8(00100000)) ? 0x2000 : 0;
+     vdu_set_bank_ptrs();
+    }
+ if (char_data)
+    vdu_fill_char_surface();
+ crtc_set_redraw();
+ changed = 1;
+}
+
+//==============================================================================
+// Screen RAM change tracking.
+//
+// Rather than flagging each cell as it is written the screen, attribute and
+// colour RAM are compared once a frame against a shadow copy taken when
+// they were last drawn, 16 cells at a time.  An idle frame only costs the
+// comparison of the displayed cells.
+//
+// Each displayed cell showing a PCG character is also linked into a list
+// for that character so a write to PCG RAM only marks the cells that show
+// it, and a count of the displayed flashing cells is kept so the flashing
+// attribute is only propagated when there are some.
+//==============================================================================
+#if defined(__SSE2__)
+//==============================================================================
+// Test if any of 16 cells differ from the shadow copy.
+//
+//   pass: int i                        first cell
+// return: int                          non-zero if any differ
+//==============================================================================
+static int vdu_shadow_differs (int i)
+{
+ __m128i d;
+
+ d = _mm_xor_si128(_mm_loadu_si128((__m128i *)&src->scr_ram[i]),
+                   _mm_loadu_si128((__m128i *)&scr_shadow[i]));
+ d = _mm_or_si128(d, _mm_xor_si128(_mm_loadu_si128((__m128i *)&src->att_ram[i]),
+                                   _mm_loadu_si128((__m128i *)&att_shadow[i])));
+ d = _mm_or_si128(d, _mm_xor_si128(_mm_loadu_si128((__m128i *)&src->col_ram[i]),
+                                   _mm_loadu_si128((__m128i *)&col_shadow[i])));
+ return _mm_movemask_epi8(_mm_cmpeq_epi8(d, _mm_setzero_si128())) != 0xffff;
+}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+static int vdu_shadow_differs (int i)
+{
+ uint8x16_t d;
+ uint32x2_t r;
+
+ d = veorq_u8(vld1q_u8(&src->scr_ram[i]), vld1q_u8(&scr_shadow[i]));
+ d = vorrq_u8(d, veorq_u8(vld1q_u8(&src->att_ram[i]), vld1q_u8(&att_shadow[i])));
+ d = vorrq_u8(d, veorq_u8(vld1q_u8(&src->col_ram[i]), vld1q_u8(&col_shadow[i])));
+ r = vreinterpret_u32_u8(vorr_u8(vget_low_u8(d), vget_high_u8(d)));
+ return (vget_lane_u32(r, 0) | vget_lane_u32(r, 1)) != 0;
+}
+#else
+static int vdu_shadow_differs (int i)
+{
+ return memcmp(&src->scr_ram[i], &scr_shadow[i], VDU_SHADOW_CHUNK) ||
+        memcmp(&src->att_ram[i], &att_shadow[i], VDU_SHADOW_CHUNK) ||
+        memcmp(&src->col_ram[i], &col_shadow[i], VDU_SHADOW_CHUNK);
+}
+#endif
+
+//==============================================================================
+// Return the PCG character shown by a cell.
+//
+//   pass: int i                        cell
+// return: int                          bank * 128 + character, -1 if none
+//==============================================================================
+static int vdu_cell_pcg (int i)
+{
+ int pcgbank;
+
+ if (! (src->scr_ram[i] & 0x80))
+    return -1;
+ pcgbank = (src->extendram) ? (src->att_ram[i] & B8(00001111)) : 0;
+ if (pcgbank >= modelx.pcg)
+    return -1;                  /* The selected PCG bank isn't
                                  * physically present, so it cannot be
                                  * updated. */
-     if (vdu.pcg_redraw[pcgbank * 128 + (data & 0x7f)])
-        vdu_redraw_char(maddr);
+ return pcgbank * 128 + (src->scr_ram[i] & 0x7f);
+}
+
+//==============================================================================
+// Move a cell to the list of the PCG character it now shows.
+//
+//   pass: int i                        cell
+// return: void
+//==============================================================================
+static void vdu_cell_link (int i)
+{
+ int c = vdu_cell_pcg(i);
+
+ if (c == cell_pcg[i])
+    return;
+
+ if (cell_pcg[i] != -1)
+    {
+     if (cell_prev[i] != -1)
+        cell_next[cell_prev[i]] = cell_next[i];
+     else
+        pcg_cells[cell_pcg[i]] = cell_next[i];
+     if (cell_next[i] != -1)
+        cell_prev[cell_next[i]] = cell_prev[i];
     }
- memset(vdu.pcg_redraw, 0, sizeof(vdu.pcg_redraw));
+
+ cell_pcg[i] = c;
+ if (c != -1)
+    {
+     cell_prev[i] = -1;
+     cell_next[i] = pcg_cells[c];
+     if (cell_next[i] != -1)
+        cell_prev[cell_next[i]] = i;
+     pcg_cells[c] = i;
+    }
+}
+
+//==============================================================================
+// Compare a run of cells with the shadow copy.
+//
+// Changed cells are marked for redrawing, moved to the list of any PCG
+// character they now show and copied to the shadow.
+//
+//   pass: int i                        first cell
+//         int n                        number of cells
+// return: void
+//==============================================================================
+static void vdu_shadow_diff (int i, int n)
+{
+ int end = i + n;
+ int stop;
+
+ while (i < end)
+    {
+     if ((i & (VDU_SHADOW_CHUNK - 1)) == 0 && (i + VDU_SHADOW_CHUNK <= end))
+        {
+         if (! vdu_shadow_differs(i))
+            {
+             i += VDU_SHADOW_CHUNK;
+             continue;
+            }
+         stop = i + VDU_SHADOW_CHUNK;
+        }
+     else
+        stop = i + 1;
+
+     for (; i < stop; i++)
+        {
+         if ((src->scr_ram[i] == scr_shadow[i]) &&
+             (src->att_ram[i] == att_shadow[i]) &&
+             (src->col_ram[i] == col_shadow[i]))
+            continue;
+         flash_cells += ((src->att_ram[i] >> 7) & 1) - ((att_shadow[i] >> 7) & 1);
+         scr_shadow[i] = src->scr_ram[i];
+         att_shadow[i] = src->att_ram[i];
+         col_shadow[i] = src->col_ram[i];
+         vdu_cell_link(i);
+         vdu.redraw[i] = 1;
+         redraw_pending = 1;
+        }
+    }
+}
+
+//==============================================================================
+// Call a function for each run of cells in the displayed range.
+//
+// The range wraps around at the end of the screen RAM.
+//
+//   pass: int maddr                    first displayed address
+//         int size                     number of displayed cells
+//         void (*func)(int, int)       function to call with each run
+// return: void
+//==============================================================================
+static void vdu_shadow_range (int maddr, int size, void (*func)(int, int))
+{
+ int n;
+
+ if (size > src->scr_mask + 1)
+    size = src->scr_mask + 1;
+ maddr &= src->scr_mask;
+ while (size > 0)
+    {
+     n = src->scr_mask + 1 - maddr;
+     if (n > size)
+        n = size;
+     func(maddr, n);
+     maddr = 0;
+     size -= n;
+    }
+}
+
+//==============================================================================
+// Take a new shadow copy of a run of cells and link the cells.
+//
+//   pass: int i                        first cell
+//         int n                        number of cells
+// return: void
+//==============================================================================
+static void vdu_shadow_link (int i, int n)
+{
+ for (; n > 0; i++, n--)
+    {
+     flash_cells += (src->att_ram[i] >> 7) & 1;
+     vdu_cell_link(i);
+    }
+}
+
+//==============================================================================
+// Find the PCG characters that have changed.
+//
+// Used instead of the PCG writes noted by vdu_vidmem_w() when the display
+// is drawn by the render thread.  Changed characters are also written to
+// the character surface.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void vdu_shadow_pcg (void)
+{
+ int c, ofs;
+
+ for (c = 0; c < modelx.pcg * 128; c++)
+    {
+     ofs = c * 16;
+     if (memcmp(&src->pcg_ram[ofs], &pcg_shadow[ofs], 16) == 0)
+        continue;
+     memcpy(&pcg_shadow[ofs], &src->pcg_ram[ofs], 16);
+     vdu_write_pcg_data(c / 128, ofs & 0x07ff, &pcg_shadow[ofs], 16);
+     if (! vdu.pcg_redraw[c])
+        {
+         vdu.pcg_redraw[c] = 1;
+         pcg_dirty[pcg_dirty_count++] = c;
+        }
+    }
+}
+
+//==============================================================================
+// Set the display RAM the screen is drawn from.
+//
+//   pass: vdu_t *v                     frame copy of the VDU state, NULL to
+//                                      draw from the emulated machine
+// return: void
+//==============================================================================
+void vdu_source (vdu_t *v)
+{
+ src = v ? v : &vdu;
+}
+
+//==============================================================================
+// Check if the display may have changed.
+//
+// Set by writes to video memory that change it and by the video ports, it
+// is cleared by this call.  Writes made directly to the video RAM arrays,
+// such as by the debugger, are not noted.
+//
+//   pass: void
+// return: int                          non-zero if changed
+//==============================================================================
+int vdu_changed (void)
+{
+ int c = changed;
+
+ changed = 0;
+ return c;
+}
+
+//==============================================================================
+// Take a new shadow copy after the whole display has been drawn.
+//
+//   pass: int maddr                    first displayed address
+//         int size                     number of displayed cells
+// return: void
+//==============================================================================
+void vdu_shadow_sync (int maddr, int size)
+{
+ if (render.thread)
+    vdu_shadow_pcg();
+
+ memcpy(scr_shadow, src->scr_ram, sizeof(scr_shadow));
+ memcpy(att_shadow, src->att_ram, sizeof(att_shadow));
+ memcpy(col_shadow, src->col_ram, sizeof(col_shadow));
+
+ memset(pcg_cells, 0xff, sizeof(pcg_cells));
+ memset(cell_pcg, 0xff, sizeof(cell_pcg));
+ flash_cells = 0;
+ vdu_shadow_range(maddr, size, vdu_shadow_link);
+
+ while (pcg_dirty_count)
+    vdu.pcg_redraw[pcg_dirty[--pcg_dirty_count]] = 0;
+ redraw_pending = 0;
+}
+
+//==============================================================================
+// Find the displayed cells that need redrawing.
+//
+// Cells that have changed since they were last drawn and cells showing a
+// PCG character that has been written to are marked for redrawing.
+//
+//   pass: int maddr                    first displayed address
+//         int size                     number of displayed cells
+// return: int                          non-zero if any cells were marked
+//==============================================================================
+int vdu_shadow_update (int maddr, int size)
+{
+ int c, i;
+
+ if (render.thread)
+    vdu_shadow_pcg();
+ vdu_shadow_range(maddr, size, vdu_shadow_diff);
+
+ while (pcg_dirty_count)
+    {
+     c = pcg_dirty[--pcg_dirty_count];
+     vdu.pcg_redraw[c] = 0;
+     for (i = pcg_cells[c]; i != -1; i = cell_next[i])
+        {
+         vdu.redraw[i] = 1;
+         redraw_pending = 1;
+        }
+    }
+
+ i = redraw_pending;
+ redraw_pending = 0;
+ return i;
 }
 
 //==============================================================================
@@ -1098,11 +1524,13 @@ void vdu_propagate_pcg_updates(int maddr, int size)
 //==============================================================================
 void vdu_propagate_flashing_attr(int maddr, int size)
 {
- if (!(vdu.extendram))
+ if (!(src->extendram))
     return;                     /* premium graphics not enabled */
+ if (! flash_cells)
+    return;                     /* nothing displayed is flashing */
  for (; size > 0; ++maddr, --size)
     {
-     if (vdu.att_ram[maddr & vdu.scr_mask] & B8(10000000))
+     if (src->att_ram[maddr & src->scr_mask] & B8(10000000))
         vdu_redraw_char(maddr);
     }
 }
@@ -1112,7 +1540,8 @@ void vdu_propagate_flashing_attr(int maddr, int size)
  */
 void vdu_redraw_char(int maddr)
 {
- vdu.redraw[maddr & vdu.scr_mask] = 1;
+ vdu.redraw[maddr & src->scr_mask] = 1;
+ redraw_pending = 1;
 }
 
 /*
@@ -1120,7 +1549,18 @@ void vdu_redraw_char(int maddr)
  */
 uint8_t vdu_char_is_redrawn(int maddr)
 {
- return vdu.redraw[maddr & vdu.scr_mask];
+ return vdu.redraw[maddr & src->scr_mask];
+}
+
+/*
+ * Test whether any of a run of character locations must be redrawn
+ */
+int vdu_row_is_redrawn(int maddr, int cells)
+{
+ maddr &= src->scr_mask;
+ if (maddr + cells > src->scr_mask + 1)
+    return 1;                   /* wraps, let the caller test each one */
+ return memchr(&vdu.redraw[maddr], 1, cells) != NULL;
 }
 
 /*
@@ -1128,7 +1568,7 @@ uint8_t vdu_char_is_redrawn(int maddr)
  */
 void vdu_char_clear_redraw(int maddr)
 {
- vdu.redraw[maddr & vdu.scr_mask] = 0;
+ vdu.redraw[maddr & src->scr_mask] = 0;
 }
 
 //==============================================================================
@@ -1152,6 +1592,8 @@ void vdu_write_pcg_data(int bank, int offset, uint8_t *data, int numbytes)
 void vdu_write_char_data(int bank, int offset, uint8_t *data, int numbytes)
 {
  bank *= CHAR_SURFACE_BANK_SIZE;
+ glyph_cache_invalidate(bank + offset / 16,
+                        (offset + numbytes + 15) / 16 - offset / 16);
  SDL_LockSurface(char_data);
  while (numbytes)
     {
@@ -1195,23 +1637,116 @@ void vdu_write_char_data(int bank, int offset, uint8_t *data, int numbytes)
 }
 
 //==============================================================================
+// Set up the direct rasterizer for a screen surface.
 //
-// Draw a character
+// The col_table[] colours are mapped to pixel values for the surface's
+// pixel format.  This needs to be done again whenever the colour table or
+// the surface changes.
+//
+// The glyph cache is emptied as the cached cells use the old pixel values.
 //
+//   pass: SDL_Surface *screen
+// return: void
 //==============================================================================
+static void vdu_raster_setup (SDL_Surface *screen)
+{
+ int i;
 
-void vdu_draw_char(SDL_Surface *screen, int x, int y,
-                   int maddr,     /* CRTC address of character to draw */
-                   uint8_t lines, /* number of lines to draw */
-                   uint8_t hwflash, /* whether the character is flashing */
-                   uint8_t cursor, uint8_t cur_start, uint8_t cur_end)
+ for (i = 0; i < 64; i++)
+    col_pixel[i] = SDL_MapRGB(screen->format, col_table[i].r,
+                              col_table[i].g, col_table[i].b);
+
+ col_pixel_fmt = screen->format;
+ col_pixel_valid = 1;
+
+ glyph_cache_flush(CHAR_SURFACE_NUM_BANKS * CHAR_SURFACE_BANK_SIZE,
+                   8 * screen->format->BytesPerPixel *
+                   VDU_CACHE_LINES_MAX * video.yscale);
+}
+
+//==============================================================================
+// Expand a character cell into pixels.
+//
+// Each glyph line is expanded by the glyph kernel, lines inside the cursor
+// region are inverted and each line is repeated video.yscale times.
+// Glyphs are 16 lines high and repeat for taller characters.
+//
+//   pass: uint8_t *p                   destination pixels
+//         int pitch                    destination bytes per line
+//         int bpp                      bytes per pixel
+//         vdu_cell_t *cell             cell details
+//         int lines                    number of lines to draw
+//         glyph_row_t row              glyph kernel
+// return: void
+//==============================================================================
+static void vdu_cell_expand (uint8_t *p, int pitch, int bpp, vdu_cell_t *cell,
+                             int lines, glyph_row_t row)
+{
+ uint32_t fg, bg;
+ uint8_t b;
+ int l, s;
+
+ fg = col_pixel[cell->fgc];
+ bg = col_pixel[cell->bgc];
+
+ for (l = 0; l < lines; l++)
+    {
+     b = cell->glyph[l & 0x0f];
+     if (cell->inverse ^ ((l >= cell->cur_top) && (l < cell->cur_bottom)))
+        b = ~b;
+     row(p, &b, &fg, &bg, 1);
+     for (s = 1; s < video.yscale; s++)
+        memcpy(p + s * pitch, p, 8 * bpp);
+     p += pitch * video.yscale;
+    }
+}
+
+//==============================================================================
+// Check if an area can be drawn directly into the screen surface pixels.
+//
+// The surface depth must have a glyph expansion kernel and the area must
+// fit inside the surface.
+//
+//   pass: SDL_Surface *screen
+//         int x                        X pixel position
+//         int y                        Y pixel position
+//         int cells                    number of character cells across
+//         int lines                    number of lines to draw
+// return: glyph_row_t                  kernel, NULL if not possible
+//==============================================================================
+static glyph_row_t vdu_raster_kernel (SDL_Surface *screen, int x, int y,
+                                      int cells, int lines)
+{
+ glyph_row_t row;
+
+ if ((x + cells * 8 > screen->w) || (y + lines * video.yscale > screen->h))
+    return NULL;
+
+ row = glyph_row(screen->format->BytesPerPixel);
+ if (row && ((! col_pixel_valid) || (col_pixel_fmt != screen->format)))
+    vdu_raster_setup(screen);
+
+ return row;
+}
+
+//==============================================================================
+// Work out how to draw a character cell.
+//
+// Determines the glyph, the character generator bank, the colours, whether
+// the cell is inverted and the cursor region.
+//
+//   pass: int maddr                    CRTC address of the character
+//         int lines                    number of lines to draw
+//         uint8_t hwflash              whether the character is flashing
+//         uint8_t cursor               non zero if the cursor is shown
+//         uint8_t cur_start            cursor start line
+//         uint8_t cur_end              cursor end line
+//         vdu_cell_t *cell             returns the cell details
+// return: void
+//==============================================================================
+static void vdu_cell (int maddr, int lines, uint8_t hwflash, uint8_t cursor,
+                      uint8_t cur_start, uint8_t cur_end, vdu_cell_t *cell)
 {
- SDL_Rect srcrect, dstrect;
- static SDL_Color colours[2];
- static SDL_Color inverse_colours[2];
- SDL_Color *cmap;
- SDL_Color *inv_cmap;           /* for the moment */
- int sx, sy;                    /* source X and Y */
  int bank;
  uint8_t ch;
  uint8_t attrib;
@@ -1223,11 +1758,11 @@ void vdu_draw_char(SDL_Surface *screen, int x, int y,
                                  * drawn. */
  int fgc, bgc;
 
- ch = vdu.scr_ram[maddr & vdu.scr_mask];
- attrib = vdu.extendram
-    ? vdu.att_ram[maddr & vdu.scr_mask]
+ ch = src->scr_ram[maddr & src->scr_mask];
+ attrib = src->extendram
+    ? src->att_ram[maddr & src->scr_mask]
     : 0;
- colour = vdu.col_ram[maddr & vdu.scr_mask];
+ colour = src->col_ram[maddr & src->scr_mask];
 
  if (ch & 0x80)
     {
@@ -1273,7 +1808,6 @@ void vdu_draw_char(SDL_Surface *screen, int x, int y,
       * motherboards */
      inverse = !inverse;
     }
- vdu_get_char_pos(bank, ch, &sx, &sy);
 
  if (!cursor)
     {
@@ -1308,8 +1842,7 @@ void vdu_draw_char(SDL_Surface *screen, int x, int y,
     }
 
  /*
-  * Construct the inverse and normal colour maps from the global
-  * colour map
+  * Work out the foreground and background colour table entries
   */
  if (modelx.colour == 0 || crtc.monitor)
     {
@@ -1328,7 +1861,7 @@ void vdu_draw_char(SDL_Surface *screen, int x, int y,
     {
      // 56k colour board
      fgc = ic_82s23[colour & B8(00011111)];
-     bgc = (bg_standard_colour[(vdu.colour_cont & B8(00001110)) >> 1] << 3)
+     bgc = (bg_standard_colour[(src->colour_cont & B8(00001110)) >> 1] << 3)
         | (bg_standard_colour[(colour & B8(11100000)) >> 5]);
     }
  else
@@ -1337,38 +1870,128 @@ void vdu_draw_char(SDL_Surface *screen, int x, int y,
      fgc = (colour & 0x0F);
      bgc = (colour >> 4);
     }
- colours[0] = col_table[bgc];
- colours[1] = col_table[fgc];
- inverse_colours[0] = col_table[fgc];
- inverse_colours[1] = col_table[bgc];
 
- cmap = inverse ? inverse_colours : colours;
- inv_cmap = inverse ? colours : inverse_colours;
+ if (bank < CHAR_SURFACE_ROM_BANKS)
+    cell->glyph = src->chr_rom + bank * 0x0800 + ch * 16;
+ else
+    cell->glyph = src->pcg_ram + (bank - CHAR_SURFACE_ROM_BANKS) * 0x0800 +
+                  ch * 16;
+ cell->bank = bank;
+ cell->ch = ch;
+ cell->inverse = inverse;
+ cell->cur_top = regionheights[0];
+ cell->cur_bottom = regionheights[0] + regionheights[1];
+ cell->fgc = fgc;
+ cell->bgc = bgc;
+}
+
+//==============================================================================
+//
+// Draw a character
+//
+// The character is drawn straight into the screen surface pixels if
+// possible, otherwise it is blitted from the character surface.  A cell
+// without the cursor is copied from the glyph cache, it's expanded into
+// the cache first if it's not there.
+//
+//==============================================================================
+
+void vdu_draw_char(SDL_Surface *screen, int x, int y,
+                   int maddr,     /* CRTC address of character to draw */
+                   uint8_t lines, /* number of lines to draw */
+                   uint8_t hwflash, /* whether the character is flashing */
+                   uint8_t cursor, uint8_t cur_start, uint8_t cur_end)
+{
+ SDL_Rect srcrect, dstrect;
+ static SDL_Color colours[2];
+ static SDL_Color inverse_colours[2];
+ SDL_Color *cmap;
+ SDL_Color *inv_cmap;           /* for the moment */
+ int sx, sy;                    /* source X and Y */
+ vdu_cell_t cell;
+ glyph_row_t row;
+ uint8_t *p;
+ uint8_t *c = NULL;
+ int hit;
+ int bpp;
+ int l;
+
+ vdu_cell(maddr, lines, hwflash, cursor, cur_start, cur_end, &cell);
+
+ dstrect.x = x;
+ dstrect.y = y;
+ dstrect.w = 8;
+ dstrect.h = lines * video.yscale;
+
+ row = vdu_raster_kernel(screen, x, y, 1, lines);
+ if (row)
+    {
+     bpp = screen->format->BytesPerPixel;
+     p = (uint8_t *)screen->pixels + y * screen->pitch + x * bpp;
+
+     if ((cell.cur_top == cell.cur_bottom) && (lines <= VDU_CACHE_LINES_MAX))
+        c = glyph_cache_get(cell.bank * CHAR_SURFACE_BANK_SIZE + cell.ch,
+                            cell.fgc | (cell.bgc << 6) | (cell.inverse << 12) |
+                            (lines << 13), &hit);
+
+     if (SDL_MUSTLOCK(screen))
+        SDL_LockSurface(screen);
+     if (c)
+        {
+         if (! hit)
+            vdu_cell_expand(c, 8 * bpp, bpp, &cell, lines, row);
+         for (l = lines * video.yscale; l; l--)
+            {
+             memcpy(p, c, 8 * bpp);
+             p += screen->pitch;
+             c += 8 * bpp;
+            }
+        }
+     else
+        vdu_cell_expand(p, screen->pitch, bpp, &cell, lines, row);
+     if (SDL_MUSTLOCK(screen))
+        SDL_UnlockSurface(screen);
+
+     video_update_region(dstrect);
+     return;
+    }
+
+ vdu_get_char_pos(cell.bank, cell.ch, &sx, &sy);
+
+ /*
+  * Construct the inverse and normal colour maps from the global
+  * colour map
+  */
+ colours[0] = col_table[cell.bgc];
+ colours[1] = col_table[cell.fgc];
+ inverse_colours[0] = col_table[cell.fgc];
+ inverse_colours[1] = col_table[cell.bgc];
+
+ cmap = cell.inverse ? inverse_colours : colours;
+ inv_cmap = cell.inverse ? colours : inverse_colours;
 
  srcrect.x = sx;
  srcrect.y = sy;
  srcrect.w = 8;
  srcrect.h = 0;
- dstrect.x = x;
- dstrect.y = y;
  dstrect.w = dstrect.h = 0;
 
  /* top non-cursor region */
- srcrect.h  = regionheights[0] * video.yscale;
+ srcrect.h  = cell.cur_top * video.yscale;
  SDL_SetColors(char_data, cmap, 0, 2);
  SDL_BlitSurface(char_data, &srcrect, screen, &dstrect);
  srcrect.y += srcrect.h;
  dstrect.y += srcrect.h;
 
  /* cursor region */
- srcrect.h  = regionheights[1] * video.yscale;
+ srcrect.h  = (cell.cur_bottom - cell.cur_top) * video.yscale;
  SDL_SetColors(char_data, inv_cmap, 0, 2);
  SDL_BlitSurface(char_data, &srcrect, screen, &dstrect);
  srcrect.y += srcrect.h;
  dstrect.y += srcrect.h;
 
  /* bottom non-cursor region */
- srcrect.h  = regionheights[2] * video.yscale;
+ srcrect.h  = (lines - cell.cur_bottom) * video.yscale;
  SDL_SetColors(char_data, cmap, 0, 2);
  SDL_BlitSurface(char_data, &srcrect, screen, &dstrect);
  srcrect.y += srcrect.h;
@@ -1382,6 +2005,88 @@ void vdu_draw_char(SDL_Surface *screen, int x, int y,
  video_update_region(dstrect);
 }       
 
+//==============================================================================
+// Draw a row of characters.
+//
+// Used when the whole screen is redrawn.  Each scan line of the row is
+// expanded across all the cells with one glyph kernel call and then
+// repeated video.yscale times.
+//
+//   pass: SDL_Surface *screen
+//         int x                        X pixel position
+//         int y                        Y pixel position
+//         int maddr                    CRTC address of the first character
+//         int cells                    number of characters
+//         uint8_t lines                number of lines to draw
+//         uint8_t hwflash              whether characters are flashing
+//         int cur_maddr                CRTC address of the cursor
+//         uint8_t cursor               non zero if the cursor is shown
+//         uint8_t cur_start            cursor start line
+//         uint8_t cur_end              cursor end line
+// return: int                          0 if drawn, -1 if the row must be
+//                                      drawn using vdu_draw_char()
+//==============================================================================
+int vdu_draw_row (SDL_Surface *screen, int x, int y, int maddr, int cells,
+                  uint8_t lines, uint8_t hwflash, int cur_maddr,
+                  uint8_t cursor, uint8_t cur_start, uint8_t cur_end)
+{
+ static vdu_cell_t cell[VDU_ROW_CELLS_MAX];
+ static uint32_t fg[VDU_ROW_CELLS_MAX];
+ static uint32_t bg[VDU_ROW_CELLS_MAX];
+ static uint8_t bits[VDU_ROW_CELLS_MAX];
+ SDL_Rect dstrect;
+ glyph_row_t row;
+ uint8_t *p;
+ int bpp;
+ int i, l, s;
+
+ if (cells > VDU_ROW_CELLS_MAX)
+    return -1;
+
+ row = vdu_raster_kernel(screen, x, y, cells, lines);
+ if (! row)
+    return -1;
+
+ for (i = 0; i < cells; i++, maddr++)
+    {
+     maddr &= 0x3fff;
+     vdu_cell(maddr, lines, hwflash, (maddr == cur_maddr) ? cursor : 0x00,
+              cur_start, cur_end, &cell[i]);
+     fg[i] = col_pixel[cell[i].fgc];
+     bg[i] = col_pixel[cell[i].bgc];
+    }
+
+ bpp = screen->format->BytesPerPixel;
+ p = (uint8_t *)screen->pixels + y * screen->pitch + x * bpp;
+
+ if (SDL_MUSTLOCK(screen))
+    SDL_LockSurface(screen);
+ for (l = 0; l < lines; l++)
+    {
+     for (i = 0; i < cells; i++)
+        {
+         bits[i] = cell[i].glyph[l & 0x0f];
+         if (cell[i].inverse ^
+             ((l >= cell[i].cur_top) && (l < cell[i].cur_bottom)))
+            bits[i] = ~bits[i];
+        }
+     row(p, bits, fg, bg, cells);
+     for (s = 1; s < video.yscale; s++)
+        memcpy(p + s * screen->pitch, p, cells * 8 * bpp);
+     p += screen->pitch * video.yscale;
+    }
+ if (SDL_MUSTLOCK(screen))
+    SDL_UnlockSurface(screen);
+
+ dstrect.x = x;
+ dstrect.y = y;
+ dstrect.w = cells * 8;
+ dstrect.h = lines * video.yscale;
+ video_update_region(dstrect);
+
+ return 0;
+}
+
 
 //==============================================================================
 // VDU set colour table
@@ -1396,6 +2101,9 @@ void vdu_setcolourtable()
  int i;
  const uint8_t (*coltable)[3];
 
+ // the direct rasterizer pixel values must be mapped again
+ col_pixel_valid = 0;
+
  if (modelx.colour == 0 || crtc.monitor)
     {
      /* For monochrome models we use the first 4 entries in col_table.
@@ -1508,6 +2216,7 @@ void vdu_set_mon_table (int pos, int col)
 //==============================================================================
 void vdu_configure (int aspect)
 {
+ col_pixel_valid = 0;
  if (char_data)
     vdu_destroy_char_surface();
  vdu_create_char_surface();
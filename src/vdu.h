@@ -18,6 +18,9 @@
 #define ATT_RAM_SIZE 0x0800 * ATT_RAM_BANKS
 #define PCG_RAM_SIZE 0x0800 * PCG_RAM_BANKS
 
+// most characters drawn across by vdu_draw_row()
+#define VDU_ROW_CELLS_MAX 128
+
 // #defines for the hardware flashing circuit
 #define HFNO  0
 #define HFV3  1
@@ -122,10 +125,16 @@ void vdu_draw_char(SDL_Surface *screen, int x, int y,
                    uint8_t flashvideo, /* output from the character
                                         * flashing timer */
                    uint8_t cursor, uint8_t cur_start, uint8_t cur_end);
+int vdu_draw_row (SDL_Surface *screen, int x, int y, int maddr, int cells,
+                  uint8_t lines, uint8_t hwflash, int cur_maddr,
+                  uint8_t cursor, uint8_t cur_start, uint8_t cur_end);
 void vdu_redraw_char(int addr);
 uint8_t vdu_char_is_redrawn(int addr);
+int vdu_row_is_redrawn(int maddr, int cells);
 void vdu_char_clear_redraw(int addr);
-void vdu_propagate_pcg_updates(int maddr, int size);
+void vdu_shadow_sync (int maddr, int size);
+int vdu_shadow_update (int maddr, int size);
+int vdu_changed (void);
 void vdu_propagate_flashing_attr(int maddr, int size);
 
 void vdu_write_char_data(int bank, int offset, uint8_t *data, int numbytes);
@@ -148,6 +157,7 @@ void vdu_latchrom_w (uint16_t port, uint8_t data, struct z80_port_write *port_s)
 void vdu_set_mon_table (int pos, int col);
 void vdu_setcolourtable();
 void vdu_configure (int aspect);
+void vdu_snapshot (void);
 
 
 typedef struct vdu_t
@@ -170,10 +180,6 @@ typedef struct vdu_t
  uint8_t *atr_ptr;           /* attribute RAM */
  uint8_t *pcg_ptr;           /* PCG RAM */
  uint8_t *col_ptr;           /* colour RAM */
- /*
-  * Used internally to track the character positions that need to be redrawn
-  */
- uint8_t *redraw_ptr;        /* redraw RAM */
  /*
   * The Alpha+/256TC video hardware supports up to 8k of
   * screen/attribute/colour RAM
@@ -189,7 +195,9 @@ typedef struct vdu_t
  uint8_t att_ram[ATT_RAM_SIZE];
  uint8_t pcg_ram[PCG_RAM_SIZE];  // last bank is a dummy bank
  uint8_t redraw[SCR_RAM_SIZE];
- uint8_t pcg_redraw[PCG_RAM_SIZE / 16]; /* FIXME: need a character height constant */
+ uint8_t pcg_redraw[PCG_RAM_SIZE / 16]; /* PCG characters written to, FIXME: need a character height constant */
 }vdu_t;
 
+void vdu_source (vdu_t *v);
+
 #endif /* HEADER_VDU_H */
@@ -31,6 +31,31 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Added frame pacing to video_update().  At most --frame-rate frames a
+//   second are drawn, up to --frame-skip frames in a row are skipped when
+//   the emulation is behind real time and with --frame-changed a frame is
+//   only drawn after video memory or the CRTC display state has changed.
+//   video_skip_rate() returns the percentage of frames skipped.  A skipped
+//   frame is not drawn at all, crtc_update() no longer calls crtc_redraw().
+// - Added an off screen video type (--video-type=offscreen) that draws into
+//   a memory surface, no display is needed.  video_update() passes each
+//   frame to capture_frame().
+// - video_update() publishes a frame description to the render thread
+//   instead of drawing when --render-thread is used.  Drawing and
+//   presenting on the emulation thread holds the render lock.
+// - The OpenGL texture is now updated one update rectangle at a time
+//   through a ring of pixel buffer objects and the quad is drawn from a
+//   vertex buffer object when the driver supports them (--gl-stream).
+//   Added --gl-present=changed to only present frames that have changed.
+//   Fixed the non OpenGL build of video_render().
+// - Replaced the update rectangle list with a dirty band tracker.  The
+//   screen is divided into bands one character row high, an update marks
+//   the bands it covers and widens their spans in constant time and the
+//   tracker is cleared each frame without reallocating.  video_render()
+//   passes the merged band spans to SDL_UpdateRects() and uploads only the
+//   dirty rows of the OpenGL texture.
+//
 // v6.0.0 - 1 January 2017, K Duckmanton
 // - Refactored this module to only redraw those parts of the screen that
 //   have been changed.
@@ -112,6 +137,9 @@
 #include "vdu.h"
 #include "mouse.h"
 #include "osd.h"
+#include "render.h"
+#include "capture.h"
+#include "support.h"
 
 //==============================================================================
 // #defined constants
@@ -199,12 +227,26 @@ video_t video =
  .filter_max = VIDEO_SHARP,
  .aspect_bee = VIDEO_ASPECT_BEE,
  .vsync = VIDEO_VSYNC_ON,
+ .gl_stream = 1,
+ .gl_present = VIDEO_PRESENT_FRAME,
  .initial_x_percent = 50,
 #endif
  .yscale = 1,                   // default scaling ratio
  .aspect = 2,                   // default window aspect ratio
+ .frame_rate = VIDEO_FRAME_RATE,
+ .frame_skip = VIDEO_FRAME_SKIP,
 };
 
+// frame pacing
+static uint64_t frame_due;      // host time the next emulated frame is due
+static uint64_t frame_next;     // host time the next frame may be drawn
+static int frame_skipped;       // frames skipped in a row
+static crtc_frame_t frame_crtc; // CRTC display state of the last frame drawn
+static uint64_t skip_start;     // start of the skip rate period
+static int skip_frames;
+static int skip_skipped;
+static int skip_percent;
+
 #ifdef USE_OPENGL
 typedef int RGB_Size[4];
 
@@ -232,28 +274,26 @@ extern gui_t gui;
 extern gui_status_t gui_status;
 extern modio_t modio;
 extern mouse_t mouse;
+extern render_t render;
+extern capture_t capture;
 
 
-struct _dynamic_array {
-   void *p;                     /* pointer to the array of things */
-   int entrysize;               /* size of each entry */
-   int numentries;              /* number of active entries in the
-                                 * array  */
-   int size;                    /* current size of the array */
-};
-
-struct video_update_regions {
-   union {
-      struct _dynamic_array a;
-      SDL_Rect *p;
-   } rects;
-   union {
-      struct _dynamic_array a;
-      SDL_Rect **p;
-   } free_rects;
-};
-
-struct video_update_regions *video_update_regions;
+typedef struct video_dirty_t
+{
+ int w;                         // surface width
+ int h;                         // surface height
+ int band_h;                    // pixel lines in each band
+ int bands;                     // number of bands
+ int *x0;                       // first dirty pixel of each band
+ int *x1;                       // last dirty pixel + 1 of each band
+ uint8_t *flag;                 // non zero if the band is dirty
+ int *list;                     // dirty band numbers
+ int count;                     // number of dirty bands
+ SDL_Rect *rects;               // merged update rectangles
+ int numrects;
+}video_dirty_t;
+
+static video_dirty_t dirty;
 
 
 #ifdef USE_OPENGL
@@ -272,8 +312,10 @@ void video_putpixel_fast_8bpp(int x, int y, int val);
 void video_putpixel_fast_16bpp(int x, int y, int val);
 void video_putpixel_fast_32bpp(int x, int y, int val);
 
-void video_free_update_regions();
-void video_init_update_regions();
+static void video_free_update_regions (void);
+static void video_init_update_regions (void);
+static void video_clear_update_regions (void);
+static int video_update_rects (void);
 
 
 
@@ -362,7 +404,7 @@ int video_init (void)
 #ifdef USE_OPENGL
     video_gl_values(crt_w, crt_h * video.yscale, win_w, win_h) == -1 ||
 #endif
-    win_w > video.desktop_w
+    (video.type != VIDEO_OFFSCREEN && win_w > video.desktop_w)
     )
     {
      xprintf("video_init: %d pixel wide window will not fit on screen\n", win_w);
@@ -500,7 +542,7 @@ driver_initialised =
  xprintf("Initial BPP    : %d\n", video_info.vfmt->BitsPerPixel);
 
 #ifdef USE_OPENGL
- if (video.type >= VIDEO_GL)
+ if (video.type == VIDEO_GL)
     {
      int value;
 
@@ -1145,6 +1187,235 @@ static void video_gl_probe_preferred_texture_format (void)
 }
 
 
+//==============================================================================
+// Texture streaming.
+//
+// When the OpenGL driver provides buffer objects (OpenGL 1.5 and 2.1, or
+// the ARB vertex and pixel buffer object extensions) the dirty parts of the
+// screen surface are copied into one of a ring of pixel buffer objects and
+// the texture is updated from there, one call per update rectangle.  Each
+// buffer is orphaned before it is mapped so the driver never has to wait
+// for an earlier upload to finish before the emulation can carry on, this
+// matters most with software renderers such as Mesa's llvmpipe.  The quad
+// is drawn from a vertex buffer object.
+//
+// Without buffer objects the update rectangles are uploaded straight from
+// the screen surface and the quad is drawn from a client vertex array.
+//==============================================================================
+static PFNGLGENBUFFERSPROC gl_GenBuffers;
+static PFNGLDELETEBUFFERSPROC gl_DeleteBuffers;
+static PFNGLBINDBUFFERPROC gl_BindBuffer;
+static PFNGLBUFFERDATAPROC gl_BufferData;
+static PFNGLMAPBUFFERPROC gl_MapBuffer;
+static PFNGLUNMAPBUFFERPROC gl_UnmapBuffer;
+
+//==============================================================================
+// Test if an OpenGL extension is supported.
+//
+//   pass: const char *name             extension name
+// return: int                          1 if supported, else 0
+//==============================================================================
+static int video_gl_extension (const char *name)
+{
+ const char *s = (const char *)glGetString(GL_EXTENSIONS);
+ int len = strlen(name);
+
+ while (s && (s = strstr(s, name)) != NULL)
+    {
+     if (s[len] == ' ' || s[len] == 0)
+        return 1;
+     s += len;
+    }
+ return 0;
+}
+
+//==============================================================================
+// Release the texture streaming buffer objects.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void video_gl_stream_deinit (void)
+{
+ if (video_gl.stream)
+    {
+     gl_DeleteBuffers(VIDEO_GL_PBOS, video_gl.pbo);
+     gl_DeleteBuffers(1, &video_gl.vbo);
+    }
+ video_gl.stream = 0;
+ video_gl.vbo_valid = 0;
+}
+
+//==============================================================================
+// Set up texture streaming for the current texture.
+//
+// Called each time the texture is created.  Streaming is left off if it was
+// disabled with --gl-stream=off or the driver does not provide buffer
+// objects.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void video_gl_stream_init (void)
+{
+ int glMajor = 0, glMinor = 0, glVer;
+ int i;
+
+ video_gl_stream_deinit();
+ video_gl.present = 1;
+
+ if (! video.gl_stream)
+    return;
+
+ sscanf((char *)glGetString(GL_VERSION), "%d.%d", &glMajor, &glMinor);
+ glVer = glMajor * 100 + glMinor;
+ if ((glVer < 201) &&
+    ! (video_gl_extension("GL_ARB_vertex_buffer_object") &&
+       video_gl_extension("GL_ARB_pixel_buffer_object")))
+    return;
+
+ gl_GenBuffers = (PFNGLGENBUFFERSPROC)SDL_GL_GetProcAddress("glGenBuffers");
+ gl_DeleteBuffers = (PFNGLDELETEBUFFERSPROC)SDL_GL_GetProcAddress("glDeleteBuffers");
+ gl_BindBuffer = (PFNGLBINDBUFFERPROC)SDL_GL_GetProcAddress("glBindBuffer");
+ gl_BufferData = (PFNGLBUFFERDATAPROC)SDL_GL_GetProcAddress("glBufferData");
+ gl_MapBuffer = (PFNGLMAPBUFFERPROC)SDL_GL_GetProcAddress("glMapBuffer");
+ gl_UnmapBuffer = (PFNGLUNMAPBUFFERPROC)SDL_GL_GetProcAddress("glUnmapBuffer");
+ if (! (gl_GenBuffers && gl_DeleteBuffers && gl_BindBuffer &&
+        gl_BufferData && gl_MapBuffer && gl_UnmapBuffer))
+    return;
+
+ glCLEARERROR();
+ gl_GenBuffers(VIDEO_GL_PBOS, video_gl.pbo);
+ for (i = 0; i < VIDEO_GL_PBOS; i++)
+    {
+     gl_BindBuffer(GL_PIXEL_UNPACK_BUFFER, video_gl.pbo[i]);
+     gl_BufferData(GL_PIXEL_UNPACK_BUFFER, screen->pitch * screen->h, NULL,
+                   GL_STREAM_DRAW);
+    }
+ gl_BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+ gl_GenBuffers(1, &video_gl.vbo);
+ video_gl.pbo_next = 0;
+ video_gl.stream = 1;
+
+ if (glGetError() != GL_NO_ERROR)
+    {
+     video_gl_stream_deinit();
+     glCLEARERROR();
+    }
+
+ if (modio.video)
+    xprintf("video_gl_stream_init: texture streaming %s\n",
+            video_gl.stream ? "enabled" : "not available");
+}
+
+//==============================================================================
+// Upload the update rectangles to the texture.
+//
+// The screen surface and texture rows are the same width so the rectangles
+// are taken from the surface (or the same offsets in a pixel buffer object)
+// using GL_UNPACK_ROW_LENGTH.
+//
+//   pass: int n                        number of update rectangles
+// return: GLenum                       OpenGL error
+//==============================================================================
+static GLenum video_gl_upload (int n)
+{
+ uint8_t *buf = NULL;
+ uint8_t *base;
+ SDL_Rect *r;
+ int bpp = screen->format->BytesPerPixel;
+ int ofs;
+ int i, y;
+
+ if (video_gl.stream)
+    {
+     gl_BindBuffer(GL_PIXEL_UNPACK_BUFFER, video_gl.pbo[video_gl.pbo_next]);
+     video_gl.pbo_next = (video_gl.pbo_next + 1) % VIDEO_GL_PBOS;
+     gl_BufferData(GL_PIXEL_UNPACK_BUFFER, screen->pitch * screen->h, NULL,
+                   GL_STREAM_DRAW);
+     buf = gl_MapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+     if (! buf)
+        gl_BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+ if (buf)
+    {
+     for (i = 0, r = dirty.rects; i < n; i++, r++)
+        for (y = r->y; y < r->y + r->h; y++)
+           {
+            ofs = y * screen->pitch + r->x * bpp;
+            memcpy(buf + ofs, (uint8_t *)screen->pixels + ofs, r->w * bpp);
+           }
+     gl_UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+     base = NULL;               // offsets into the pixel buffer object
+    }
+ else
+    base = screen->pixels;
+
+ glPixelStorei(GL_UNPACK_ROW_LENGTH, screen->w);
+ for (i = 0, r = dirty.rects; i < n; i++, r++)
+    glTexSubImage2D(GL_TEXTURE_2D, 0, r->x, r->y, r->w, r->h,
+                    video_gl.pixel_format, video_gl.pixel_type,
+                    base + r->y * screen->pitch + r->x * bpp);
+ glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+ if (buf)
+    gl_BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+ return glGetError();
+}
+
+//==============================================================================
+// Draw the textured quad.
+//
+// Each vertex is a texture coordinate followed by a window position, the
+// vertex buffer object is only written to when these change.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void video_gl_draw_quad (void)
+{
+ GLfloat x0 = video_gl.texture_region.x;
+ GLfloat y0 = video_gl.texture_region.y;
+ GLfloat x1 = x0 + video_gl.texture_region.w;
+ GLfloat y1 = y0 + video_gl.texture_region.h;
+ GLfloat s = video_gl.texture_region_used_w;
+ GLfloat t = video_gl.texture_region_used_h;
+ /* vertices are defined going anti-clockwise around the quadrilateral */
+ GLfloat quad[16] =
+ {
+  0.0, 0.0, x0, y0,             /* top left */
+  s,   0.0, x1, y0,             /* top right */
+  s,   t,   x1, y1,             /* bottom right */
+  0.0, t,   x0, y1,             /* bottom left */
+ };
+ GLfloat *p = quad;
+
+ if (video_gl.stream)
+    {
+     gl_BindBuffer(GL_ARRAY_BUFFER, video_gl.vbo);
+     if (! video_gl.vbo_valid || memcmp(quad, video_gl.quad, sizeof(quad)))
+        {
+         gl_BufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+         memcpy(video_gl.quad, quad, sizeof(quad));
+         video_gl.vbo_valid = 1;
+        }
+     p = NULL;                  // offsets into the vertex buffer object
+    }
+
+ glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+ glEnableClientState(GL_VERTEX_ARRAY);
+ glTexCoordPointer(2, GL_FLOAT, 4 * sizeof(GLfloat), p);
+ glVertexPointer(2, GL_FLOAT, 4 * sizeof(GLfloat), p + 2);
+ glDrawArrays(GL_QUADS, 0, 4);
+ glDisableClientState(GL_VERTEX_ARRAY);
+ glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+
+ if (video_gl.stream)
+    gl_BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 //==============================================================================
 // Create an OpenGL texture.
 //
@@ -1205,6 +1476,8 @@ static void video_gl_create_texture (void)
 
  glFlush();
  glCLEARERROR();
+
+ video_gl_stream_init();
 }
 
 //==============================================================================
@@ -1229,6 +1502,7 @@ static void video_gl_window_resize (int crt_w, int crt_h, int win_w, int win_h)
  if ((gl_screen = SDL_SetVideoMode(video.gl_window_w, video.gl_window_h, 0, video.flags)) == NULL)
     xprintf("video_create_surface: SDL_SetVideoMode failed - %s\n", SDL_GetError());
  video_gl_clear_display_borders();
+ video_gl.present = 1;
 
  if ( (emu.system & EMU_SYSTEM_UNIX) != EMU_SYSTEM_UNIX )
     {
@@ -1274,6 +1548,9 @@ void video_update_sdl_video_flags(void)
      case VIDEO_SDLHW : // SDL hardware rendering
          video.flags |= SDL_HWSURFACE | SDL_DOUBLEBUF | SDL_ASYNCBLIT;
         break;
+     case VIDEO_OFFSCREEN : // memory surface
+         video.flags |= SDL_SWSURFACE;
+        break;
 #ifdef USE_OPENGL
      case VIDEO_GL : // OpenGL texture method
         video.flags |= SDL_OPENGL | SDL_RESIZABLE;
@@ -1282,6 +1559,25 @@ void video_update_sdl_video_flags(void)
     }
 }
 
+//==============================================================================
+// Set the SDL video mode, or create a memory surface for the off screen
+// video type.
+//
+//   pass: int crt_w            CRT display width
+//         int crt_h            CRT display height
+//         int bpp              bits per pixel
+// return: SDL_Surface *        surface, NULL if error
+//==============================================================================
+static SDL_Surface *video_set_mode (int crt_w, int crt_h, int bpp)
+{
+ if (video.type != VIDEO_OFFSCREEN)
+    return SDL_SetVideoMode(crt_w, crt_h, bpp, video.flags);
+
+ if (screen)
+    SDL_FreeSurface(screen);
+ return SDL_CreateRGBSurface(SDL_SWSURFACE, crt_w, crt_h, bpp, 0, 0, 0, 0);
+}
+
 int video_create_surface (int crt_w, int crt_h)
 {
  int i;
@@ -1300,15 +1596,16 @@ int video_create_surface (int crt_w, int crt_h)
       */
      case VIDEO_SDLSW:
      case VIDEO_SDLHW:
+     case VIDEO_OFFSCREEN:
         switch (video.depth)
            {
             case VIDEO_8 :
                video.bpp = 8;
-               screen = SDL_SetVideoMode(crt_w, crt_h, 8, video.flags);
+               screen = video_set_mode(crt_w, crt_h, 8);
                break;
             case VIDEO_8GS :
                video.bpp = 8;
-               screen = SDL_SetVideoMode(crt_w, crt_h, 8, video.flags);
+               screen = video_set_mode(crt_w, crt_h, 8);
                if (screen)
                   {
                    for (i = 0; i < 256; i++) // create a grey scale
@@ -1323,16 +1620,16 @@ int video_create_surface (int crt_w, int crt_h)
                break;
             case VIDEO_16 :
                video.bpp = 16;
-               screen = SDL_SetVideoMode(crt_w, crt_h, 16, video.flags);
+               screen = video_set_mode(crt_w, crt_h, 16);
                break;
             case VIDEO_32 :
                video.bpp = 32;
-               screen = SDL_SetVideoMode(crt_w, crt_h, 32, video.flags);
+               screen = video_set_mode(crt_w, crt_h, 32);
                break;
            }
         if (screen == NULL)
            {
-            xprintf("video_create_surface: SDL_SetVideoMode failed - %s\n", SDL_GetError());
+            xprintf("video_create_surface: Unable to create the surface - %s\n", SDL_GetError());
             return -1;
            }
         switch (screen->format->BytesPerPixel)
@@ -1378,7 +1675,6 @@ int video_create_surface (int crt_w, int crt_h)
 #endif
     }
 
- video_free_update_regions();
  video_init_update_regions();
 
  video_report_information();
@@ -1394,17 +1690,34 @@ int video_create_surface (int crt_w, int crt_h)
 //     0        SDL Software rendering
 //     1        SDL Hardware rendering
 //     2        OpenGL texture rendering
+//     3        Off screen memory surface, nothing to present
+//
+// With --gl-present=changed an OpenGL frame is only drawn and presented
+// when some part of the texture has changed, so an idle screen does not
+// wait for the vertical retrace.
+//
+// This is called by the render thread when it is in use and by the
+// emulation thread, the render lock is held while presenting.
 //
 //   pass: void
 // return: void
 //==============================================================================
 void video_render (void)
 {
-
+ render_lock();
 #ifdef USE_OPENGL
  if (video.type == VIDEO_GL)
     {
      GLenum glerror = 0;
+     int n;
+
+     n = video_update_rects();
+     if (! n && ! video_gl.present && (video.gl_present == VIDEO_PRESENT_CHANGED))
+        {
+         video_clear_update_regions();
+         render_unlock();
+         return;
+        }
 
      glCLEARERROR();
      glBindTexture(GL_TEXTURE_2D, video_gl.texture);
@@ -1422,43 +1735,12 @@ void video_render (void)
         }
      /*
       * Textures which are in use can't be updated until the video
-      * card has finished rendering a frame, so the number of calls to
-      * glTexSubImage2D() should be minimised.
-      *
-      * glTexSubImage2D() expects the pixels comprising the region to
-      * be contiguous.
-      *
-      * Compute the vertical extent of the texture regions updated
+      * card has finished rendering a frame, so only the update
+      * rectangles are uploaded, through a pixel buffer object when
+      * texture streaming is available.
       */
-     {
-      int i;
-      Sint16 miny = 0, maxy = 0;
-      SDL_Rect *rp;
-      void *pixptr;
-      for (i = 0, rp = video_update_regions->rects.p;
-           i < video_update_regions->rects.a.numentries;
-           ++i, ++rp)
-         {
-          if (rp->w == 0 || rp->h == 0)
-             continue;
-          if (rp->y < miny)
-             miny = rp->y;
-          if (rp->y + rp->h > maxy)
-             maxy = rp->y + rp->h;
-         }
-      if (maxy - miny > 0)
-         {
-          pixptr = 
-             screen->pixels
-             + miny * screen->pitch;
-          glTexSubImage2D(GL_TEXTURE_2D, 0, 
-                          0, miny, screen->w, maxy - miny,
-                          video_gl.pixel_format, video_gl.pixel_type,
-                          pixptr);
-          glerror = glGetError();
-         }
-     }
-#endif
+     if (n)
+        glerror = video_gl_upload(n);
      if (glerror != GL_NO_ERROR)
         {
          // An error message is preferable to crashing
@@ -1471,42 +1753,24 @@ void video_render (void)
         }
      else
         {
-         glBegin(GL_QUADS);
-         glerror = glGetError();
-         if (glerror == GL_NO_ERROR)
-            {
-             /* vertices are defined going anti-clockwise around the quadrilateral */
-             /* top left */
-             glTexCoord2f(0.0, 0.0);
-             glVertex2i(video_gl.texture_region.x,
-                        video_gl.texture_region.y);
-             /* bottom left */
-             glTexCoord2f(video_gl.texture_region_used_w, 0.0);
-             glVertex2i(video_gl.texture_region.x + video_gl.texture_region.w, 
-                        video_gl.texture_region.y);
-             /* bottom right */
-             glTexCoord2f(video_gl.texture_region_used_w, video_gl.texture_region_used_h);
-             glVertex2i(video_gl.texture_region.x + video_gl.texture_region.w, 
-                        video_gl.texture_region.y + video_gl.texture_region.h);
-             /* top right */
-             glTexCoord2f(0.0, video_gl.texture_region_used_h);
-             glVertex2i(video_gl.texture_region.x, 
-                        video_gl.texture_region.y + video_gl.texture_region.h);
-             glEnd();
-            }
+         video_gl_draw_quad();
          glCLEARERROR();
          SDL_GL_SwapBuffers();
+         video_gl.present = 0;
         }
     }
  else
-    if (video.type == VIDEO_SDLSW ||
+#endif
+    if (video.type == VIDEO_OFFSCREEN)
+       {
+        // off screen rendering, the memory surface is the display
+       }
+    else if (video.type == VIDEO_SDLSW ||
         (screen->flags & SDL_DOUBLEBUF) != SDL_DOUBLEBUF)
        {
         // SDL software rendering, or rendering to a screen that isn't
         // double buffered
-        SDL_UpdateRects(screen, 
-                        video_update_regions->rects.a.numentries,
-                        video_update_regions->rects.p);
+        SDL_UpdateRects(screen, video_update_rects(), dirty.rects);
        }
     else if (video.type == VIDEO_SDLHW)
        {
@@ -1517,8 +1781,8 @@ void video_render (void)
        {
         // default, which shouldn't happen!
        }
- video_free_update_regions();
- video_init_update_regions();
+ video_clear_update_regions();
+ render_unlock();
 }
 
 #ifdef USE_OPENGL
@@ -1871,6 +2135,10 @@ int video_toggledisplay (void)
  int crt_w;
  int crt_h;
 
+ // there is no display to switch for the off screen video type
+ if (video.type == VIDEO_OFFSCREEN)
+    return 0;
+
  crt_w = crtc.hdisp * 8;
  crt_h = crtc.vdisp * crtc.scans_per_row;
 
@@ -1894,11 +2162,15 @@ int video_toggledisplay (void)
       * requested surface size.  If the surface won't fit, set the
       * aspect ratio to 1 and try again.
       */
+     render_lock();
      if (video_create_surface(crt_w, crt_h * video.yscale) == -1)
         {
          video_configure(1);
          if (video_create_surface(crt_w, crt_h * video.yscale) == -1)
-            return -1;
+            {
+             render_unlock();
+             return -1;
+            }
         }
      vdu_configure(video.yscale);
 
@@ -1908,6 +2180,7 @@ int video_toggledisplay (void)
      if (emu.display_context == EMU_OSD_CONTEXT)
         osd_redraw();
      video_render();
+     render_unlock();
     }
  gui_changed_videostate();
  video_convert_crtc_to_mouse_xy(x, y, &mouse_x, &mouse_y);
@@ -1915,12 +2188,116 @@ int video_toggledisplay (void)
  return 0;
 }
 
+//==============================================================================
+// Decide if the frame is to be drawn.
+//
+// At most --frame-rate frames a second are drawn, a frame that comes too
+// soon is skipped and its changes are drawn with a later frame.  One frame
+// may come early without being skipped so the jitter of frames paced to
+// real time does not cause skipping.
+//
+// When the emulation is paced to real time but has fallen more than a
+// frame behind up to --frame-skip frames in a row are skipped so it can
+// catch up.  Frames are never skipped while frames are being captured.
+//
+// With --frame-changed a frame is only drawn if video memory has been
+// written, or the CRTC display state (including the cursor, flashing and
+// redraw requests) has changed since the last frame drawn.
+//
+//   pass: void
+// return: int                  1 if the frame is to be drawn, else 0
+//==============================================================================
+static int video_frame_drawn (void)
+{
+ crtc_frame_t f;
+ uint64_t now;
+ uint64_t period;
+ int skip = 0;
+ int changed;
+
+ now = time_get_ns();
+
+ if (emu.turbo || emu.headless || emu.paused)
+    frame_due = 0;
+ else
+    {
+     period = 1000000000 / emu.framerate;
+     if ((frame_due == 0) ||
+        (now > frame_due + (uint64_t)emu.maxcpulag * 1000000))
+        frame_due = now;
+     frame_due += period;
+     if ((now > frame_due) && (frame_skipped < video.frame_skip))
+        skip = 1;
+    }
+
+ if (video.frame_rate && (! skip))
+    {
+     period = 1000000000 / video.frame_rate;
+     if (now < frame_next)
+        skip = 1;
+     else
+        {
+         if (frame_next + period < now)
+            frame_next = now - period;
+         frame_next += period;
+        }
+    }
+
+ if (capture.file[0])
+    skip = 0;
+
+ skip_frames++;
+ if (skip)
+    {
+     skip_skipped++;
+     frame_skipped++;
+    }
+ else
+    frame_skipped = 0;
+ if (now - skip_start >= 1000000000)
+    {
+     skip_percent = skip_skipped * 100 / skip_frames;
+     skip_frames = skip_skipped = 0;
+     skip_start = now;
+    }
+
+ if (skip)
+    return 0;
+
+ if ((! video.frame_changed) || crtc.update ||
+    (emu.display_context == EMU_OSD_CONTEXT))
+    return 1;
+
+ crtc_frame(&f);
+ changed = vdu_changed() || memcmp(&f, &frame_crtc, sizeof(f));
+ frame_crtc = f;
+
+ return changed;
+}
+
+//==============================================================================
+// Get the percentage of frames skipped over the last second.
+//
+//   pass: void
+// return: int                  percentage of frames skipped
+//==============================================================================
+int video_skip_rate (void)
+{
+ return skip_percent;
+}
+
 //==============================================================================
 // Video update. This is called after each Z80 code frame has completed.
 //
 // Redraws the surface then updates the display if required. The crtc.update
 // flag greatly reduces host CPU time.
 //
+// If the render thread is in use a frame description is published for it
+// to draw and present instead, unless the OSD is in use.
+//
+// Frames may be skipped, see video_frame_drawn().  The frame is then
+// passed to the frame capture.
+//
 //   pass: void
 // return: void
 //==============================================================================
@@ -1928,20 +2305,30 @@ void video_update (void)
 {
  osd_update();          // sets the crtc.update flag if OSD needs refreshing
 
- crtc_redraw();         // only redraws if corresponding flag is set.
-
 #ifdef USE_OPENGL
 // re-enable resize events after changing window size manually.
  ignore_one_resize_event = 0;
 #endif
 
- if (crtc.update)
+ if (video_frame_drawn())
     {
-     if (emu.display_context == EMU_OSD_CONTEXT)
-        osd_redraw();
-     video_render();
-     crtc.update = 0;
+     if (render.thread && (emu.display_context != EMU_OSD_CONTEXT))
+        render_publish();
+     else
+        crtc_redraw();  // only redraws if corresponding flag is set.
+
+     if (crtc.update)
+        {
+         render_lock();
+         if (emu.display_context == EMU_OSD_CONTEXT)
+            osd_redraw();
+         video_render();
+         render_unlock();
+         crtc.update = 0;
+        }
     }
+
+ capture_frame();
 }
 
 //==============================================================================
@@ -1997,148 +2384,169 @@ void video_command (int cmd, int p)
     }
 }
 
-/* ==============================================================================
- *
- * Update region management
- *
- * Rectangular regions to update are stored as an array of SDL_Rects.
- *
- * Regions added to the set of regions are coalesced where possible.
- * Two regions are coalesced when
- * a) they are vertically adjacent and their widths are equal
- * b) they are horizontally adjacent and their heights are equal
- *
- */
+//==============================================================================
+// Update region management.
+//
+// The surface is divided into horizontal bands one character row high.
+// Each band keeps the horizontal span of the pixels updated in it.  Adding
+// an update region marks the bands it covers and widens their spans, a
+// character cell covers a single band so this takes constant time.  At
+// render time the dirty bands are turned into rectangles in row order,
+// vertically adjacent bands with the same span are merged.  The bands are
+// only reallocated when the surface is created.
+//==============================================================================
 
-int video_resize_array(struct _dynamic_array *ap, int size)
+//==============================================================================
+// Free the update region tracker.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void video_free_update_regions (void)
 {
- struct _dynamic_array *p;
-
- if ((p = realloc(ap->p, size * ap->entrysize)) == NULL)
-    return 0;
- ap->p = p;
- ap->size = size;
- return !0;
+ free(dirty.x0);
+ free(dirty.x1);
+ free(dirty.flag);
+ free(dirty.list);
+ free(dirty.rects);
+ memset(&dirty, 0, sizeof(dirty));
 }
 
-void video_free_array(struct _dynamic_array *ap)
+//==============================================================================
+// Set up the update region tracker for the current surface.
+//
+// The band height is one character row of the current CRTC geometry.  Any
+// band height works, updates that are not band aligned just cover more
+// than is needed.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void video_init_update_regions (void)
 {
- if (ap->p != NULL)
-    free(ap->p);
- ap->p = NULL;
- ap->size = 0;
- ap->entrysize = 0;
- ap->numentries = 0;
+ video_free_update_regions();
+
+ if (! screen)
+    return;
+
+ dirty.w = screen->w;
+ dirty.h = screen->h;
+ dirty.band_h = crtc.scans_per_row * video.yscale;
+ if (dirty.band_h <= 0)
+    dirty.band_h = 16;
+ dirty.bands = (dirty.h + dirty.band_h - 1) / dirty.band_h;
+ if (dirty.bands <= 0)
+    return;
+
+ dirty.x0 = malloc(dirty.bands * sizeof(int));
+ dirty.x1 = malloc(dirty.bands * sizeof(int));
+ dirty.flag = calloc(dirty.bands, sizeof(uint8_t));
+ dirty.list = malloc(dirty.bands * sizeof(int));
+ dirty.rects = malloc(dirty.bands * sizeof(SDL_Rect));
+
+ if ((! dirty.x0) || (! dirty.x1) || (! dirty.flag) || (! dirty.list) ||
+     (! dirty.rects))
+    {
+     xprintf("video_init_update_regions: Unable to allocate memory\n");
+     video_free_update_regions();
+    }
 }
 
-void video_init_array(struct _dynamic_array *ap, int entrysize)
+//==============================================================================
+// Clear all update regions.
+//
+// Only the dirty bands are visited.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void video_clear_update_regions (void)
 {
- ap->p = NULL;
- ap->size = 0;
- ap->entrysize = entrysize;
- ap->numentries = 0;
+ while (dirty.count)
+    dirty.flag[dirty.list[--dirty.count]] = 0;
+ dirty.numrects = 0;
 }
 
-void video_add_update_region(SDL_Rect r)
+//==============================================================================
+// Build the update rectangles from the dirty bands.
+//
+//   pass: void
+// return: int                  number of rectangles in dirty.rects
+//==============================================================================
+static int video_update_rects (void)
 {
- int i;
- SDL_Rect *p = video_update_regions->rects.p;
- 
- for (i = 0; i < video_update_regions->rects.a.numentries; ++i)
+ SDL_Rect *r = NULL;
+ int b;
+ int y;
+
+ dirty.numrects = 0;
+ if (! dirty.count)
+    return 0;
+
+ for (b = 0; b < dirty.bands; b++)
     {
-     if (p[i].w == 0)
+     if (! dirty.flag[b])
         {
-         p[i] = r;
-         return;
+         r = NULL;
+         continue;
         }
+
+     y = b * dirty.band_h;
+
+     // merge with the band above if the spans are the same
+     if (r && (r->x == dirty.x0[b]) && (r->w == dirty.x1[b] - dirty.x0[b]))
+        {
+         r->h += (y + dirty.band_h < dirty.h) ? dirty.band_h : dirty.h - y;
+         continue;
+        }
+
+     r = &dirty.rects[dirty.numrects++];
+     r->x = dirty.x0[b];
+     r->w = dirty.x1[b] - dirty.x0[b];
+     r->y = y;
+     r->h = (y + dirty.band_h < dirty.h) ? dirty.band_h : dirty.h - y;
     }
- if (i >= video_update_regions->rects.a.size)
-    {
-     video_resize_array(&video_update_regions->rects.a,
-                        video_update_regions->rects.a.size + 20);
-     p = video_update_regions->rects.p;
-    }
- p[i] = r;
- video_update_regions->rects.a.numentries++;
+
+ return dirty.numrects;
 }
 
 //==============================================================================
 //
 // Add a rectangular region to the list of rectangular regions to redraw
 //
+// The region is clipped to the surface and marks the bands it covers.
+//
 //==============================================================================
 void video_update_region(SDL_Rect r)
 {
- /* This is a naive implementation which scans through the array of
-  * regions.  O(n^2) */
- int i;
- SDL_Rect *p = video_update_regions->rects.p;
+ int x0, x1;
+ int y0, y1;
+ int b;
+
+ x0 = (r.x < 0) ? 0 : r.x;
+ x1 = (r.x + r.w > dirty.w) ? dirty.w : r.x + r.w;
+ y0 = (r.y < 0) ? 0 : r.y;
+ y1 = (r.y + r.h > dirty.h) ? dirty.h : r.y + r.h;
+ if ((x0 >= x1) || (y0 >= y1))
+    return;
 
- for (i = 0; i < video_update_regions->rects.a.numentries; ++i)
+ for (b = y0 / dirty.band_h; b <= (y1 - 1) / dirty.band_h; b++)
     {
-     /* Wholly contained within another region? */
-     if (r.x >= p[i].x && r.x + r.w <= p[i].x + p[i].w &&
-         r.y >= p[i].y && r.y + r.h <= p[i].y + p[i].h)
-        return;                 /* this rectangle is already being
-                                 * updated */
-     /* Overlapping on top? */
-     if (r.x == p[i].x && r.w == p[i].w &&
-         r.y < p[i].y && r.y + r.h >= p[i].y)
-        {
-         r.h = p[i].y + p[i].h - r.y;
-         p[i].w = p[i].h = 0;   /* mark slot free */
-         video_update_region(r); /* coalesce the new region with
-                                  * others, if possible */
-         return;
-        }
-     /* Overlapping on the bottom? */
-     if (r.x == p[i].x && r.w == p[i].w &&
-         r.y >= p[i].y && r.y <= p[i].y + p[i].h)
+     if (! dirty.flag[b])
         {
-         r.h = r.y + r.h - p[i].y;
-         r.y = p[i].y;
-         p[i].w = p[i].h = 0;
-         video_update_region(r);
-         return;
-        }
-     /* Overlapping on the left? */
-     if (r.y == p[i].y && r.h == p[i].h &&
-         r.x < p[i].x && r.x + r.w >= p[i].x)
-        {
-         r.w = p[i].x + p[i].w - r.x;
-         p[i].w = p[i].h = 0;
-         video_update_region(r);
-         return;
+         dirty.flag[b] = 1;
+         dirty.list[dirty.count++] = b;
+         dirty.x0[b] = x0;
+         dirty.x1[b] = x1;
         }
-     /* Overlapping on the right? */
-     if (r.y == p[i].y && r.h == p[i].h &&
-         r.x >= p[i].x && r.x <= p[i].x + p[i].w)
+     else
         {
-         r.w = r.x + r.w - p[i].x;
-         r.x = p[i].x;
-         p[i].w = p[i].h = 0;
-         video_update_region(r);
-         return;
+         if (x0 < dirty.x0[b])
+            dirty.x0[b] = x0;
+         if (x1 > dirty.x1[b])
+            dirty.x1[b] = x1;
         }
     }
- /* The region couldn't be coalesced, so add it in the first free slot */
- video_add_update_region(r);
-}
-
-void video_free_update_regions()
-{
- video_free_array(&video_update_regions->rects.a);
- video_free_array(&video_update_regions->free_rects.a);
-}
-
-void video_init_update_regions()
-{
- // calloc enough space for the update_regions struct
- video_update_regions = calloc(1, sizeof(*video_update_regions));
- video_init_array(&video_update_regions->rects.a,
-                  sizeof(*video_update_regions->rects.p));
- video_init_array(&video_update_regions->free_rects.a,
-                  sizeof(*video_update_regions->free_rects.p));
 }
 
 
@@ -19,6 +19,7 @@
 #define VIDEO_SDLSW 0
 #define VIDEO_SDLHW 1
 #define VIDEO_GL 2
+#define VIDEO_OFFSCREEN 3
 
 // video depths
 #define VIDEO_8 0
@@ -48,8 +49,19 @@
 // OpenGL vsync values
 #define VIDEO_VSYNC_OFF 0
 #define VIDEO_VSYNC_ON 1
+
+// OpenGL presentation values
+#define VIDEO_PRESENT_FRAME 0
+#define VIDEO_PRESENT_CHANGED 1
+
+// number of pixel buffer objects used to stream the texture
+#define VIDEO_GL_PBOS 3
 #endif
 
+// frame pacing defaults
+#define VIDEO_FRAME_RATE 60
+#define VIDEO_FRAME_SKIP 4
+
 // Convert floating point display ratios to an integer for testing
 #define VIDEO_DISP_RATIO (int)(disp_ratio * 100)
 #define VIDEO_UBEE_RATIO (int)(video.aspect_bee * 100)
@@ -89,6 +101,7 @@ int video_toggledisplay (void);
 void video_update (void);
 void video_update_region(SDL_Rect r);
 void video_command (int cmd, int p);
+int video_skip_rate (void);
 
 #ifdef USE_OPENGL
 typedef struct video_gl_t
@@ -110,6 +123,14 @@ typedef struct video_gl_t
     GLint filter;
     int bpp;
     Uint32 Rmask, Gmask, Bmask, Amask;
+
+    int stream;      /* texture streaming with buffer objects in use */
+    GLuint pbo[VIDEO_GL_PBOS];
+    int pbo_next;
+    GLuint vbo;
+    GLfloat quad[16];
+    int vbo_valid;
+    int present;     /* present the next frame even if nothing changed */
    }video_gl_t;
 #endif
 
@@ -131,6 +152,10 @@ typedef struct video_t
     int flags;
     int bpp;
 
+    int frame_rate;
+    int frame_skip;
+    int frame_changed;
+
 #ifdef USE_OPENGL
     int gl_window_w;
     int gl_window_h;
@@ -154,6 +179,8 @@ typedef struct video_t
 
     int max;
     int vsync;
+    int gl_stream;
+    int gl_present;
 
     int initial_x_pixels;
     int initial_x_percent;
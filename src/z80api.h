@@ -21,8 +21,17 @@ typedef struct z80regs_t
  int sp;
  int i;
  int r;
+ int iff1;
+ int iff2;
+ int im;
 }z80regs_t;
 
+enum
+{
+ Z80API_ENGINE_Z80EX,
+ Z80API_ENGINE_BLOCK
+};
+
 // Action function type, for actions that can occur on Z80 state
 // changes (e.g. Z80 halt, reti callback, that sort of thing)
 typedef void (*z80api_action_fn_t)(void);
@@ -45,8 +54,10 @@ int z80api_reset (void);
 int z80api_getpc (void);
 void z80api_set_poll_tstates_def (int tstates);
 void z80api_set_poll_tstates (int tstates, int repeats);
+void z80api_break (void);
 void z80api_execute (int tstates);
 void z80api_execute_complete (void);
+void z80api_finish_instruction (void);
 void z80api_set_pc (int addr);
 uint64_t z80api_get_tstates (void);
 void z80api_register_interrupting_device (z80_device_interrupt_t *scratch,
@@ -70,5 +81,8 @@ int z80api_dasm (int addr, int lower, char *mnemonic, char *argument,
 typedef void (*z80api_memhook)(uint32_t addr, int is_write);
 
 void z80api_set_memhook (z80api_memhook hook);
+void z80api_memmap_update (void);
+void z80api_code_flush (void);
+void z80api_snapshot (void);
 
 #endif /* HEADER_Z80API_H */
@@ -0,0 +1,2433 @@
+//******************************************************************************
+//*                                  uBee512                                   *
+//*       An emulator for the Microbee Z80 ROM, FDD and HDD based models       *
+//*                                                                            *
+//*                       Z80 basic block execution engine                     *
+//*                                                                            *
+//*                          Copyright (C) 2026 agent                          *
+//******************************************************************************
+//
+// An alternative Z80 CPU engine used behind the z80api interface when the
+// --z80-engine=block option is used.
+//
+// Z80 code is decoded once into blocks of pre-decoded operations which are
+// then executed directly each time the code is run.  A block ends at any
+// instruction that may change the flow of control or at the end of a 1K
+// memory page.
+//
+// Blocks are stored per host memory page.  The host page is found from the
+// z80_mem_rp[] table maintained by memmap.c so a block is effectively keyed
+// by the Z80 PC and the current memory map bank configuration.  Banks that
+// are switched out keep their decoded blocks and these are used again when
+// switched back in.
+//
+// Each host page has a map of the bytes used by decoded instructions.  A
+// write to any of these bytes invalidates the decoded blocks for that page.
+// The page written to is found with memmap_write_host() and not from
+// z80_mem_wp[] as the rewind write tracking removes the direct write pointer
+// of RAM pages until they are first written to.
+// Pages mapped through a handler function (video, PCG, banked ROMs, etc)
+// are not cached and are decoded on each execution.
+//
+// T-states are accounted per instruction exactly as for the z80ex engine.
+// The tstate counter passed to z80bb_execute() is updated after every
+// instruction so z80api_get_tstates() is correct for any port access.
+//
+//==============================================================================
+/*
+ *  uBee512 - An emulator for the Microbee Z80 ROM, FDD and HDD based models.
+ *  Copyright (C) 2026 agent
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+//==============================================================================
+// ChangeLog (most recent entries are at top)
+//==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Created a new file to implement a basic block Z80 execution engine.
+//==============================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "z80bb.h"
+#include "z80api.h"
+#include "z80.h"
+#include "memmap.h"
+#include "ubee512.h"
+#include "support.h"
+
+//==============================================================================
+// constants
+//==============================================================================
+#define FLAG_C  0x01
+#define FLAG_N  0x02
+#define FLAG_P  0x04
+#define FLAG_3  0x08
+#define FLAG_H  0x10
+#define FLAG_5  0x20
+#define FLAG_Z  0x40
+#define FLAG_S  0x80
+
+#define CODE_PAGE_SIZE   (MEMMAP_OFFSET + 1)
+#define CODE_PAGES_MAX   512
+#define CODE_HASH_SIZE   256
+#define BLOCK_OPS_MAX    64
+#define ARENA_OPS        0x20000
+
+#define REG_A cpu.r8[Z80BB_A]
+#define REG_F cpu.r8[Z80BB_F]
+#define REG_B cpu.r8[Z80BB_B]
+#define REG_C cpu.r8[Z80BB_C]
+#define REG_L cpu.r8[Z80BB_L]
+
+//==============================================================================
+// structures and variables
+//==============================================================================
+typedef struct z80bb_op_t z80bb_op_t;
+typedef int (*z80bb_fn_t)(const z80bb_op_t *op);
+
+struct z80bb_op_t
+{
+ z80bb_fn_t fn;                 // operation handler
+ uint16_t next;                 // address of the following instruction
+ uint16_t nn;                   // 16 bit immediate value or branch target
+ int8_t d;                      // index displacement or direction
+ uint8_t n;                     // 8 bit immediate value
+ uint8_t x;                     // register index or condition code
+ uint8_t y;                     // register index, bit number or repeat
+ uint8_t idx;                   // HL, IX or IY register pair index
+ uint8_t t;                     // tstates (not taken)
+ uint8_t r;                     // R register increment (M1 cycles)
+ uint8_t end;                   // last operation in the block
+};
+
+// decoded blocks are kept per Z80 page for each host page as the operations
+// hold absolute Z80 addresses and a host page may be mapped at more than one
+// Z80 address.  The map of used bytes is kept per host page.
+typedef struct code_host_t
+{
+ uint8_t *host;
+ struct code_host_t *next;
+ struct code_page_t *pages;
+ uint8_t used[CODE_PAGE_SIZE];
+}code_host_t;
+
+typedef struct code_page_t
+{
+ code_host_t *hp;
+ int zpage;
+ struct code_page_t *next;
+ const z80bb_op_t *entry[CODE_PAGE_SIZE];
+}code_page_t;
+
+typedef struct fetch_t
+{
+ uint8_t *host;
+ int off;
+ uint16_t pc;
+ int cross;
+}fetch_t;
+
+static z80bb_cpu_t cpu;
+
+static z80bb_op_t *arena;
+static int arena_used;
+
+static code_host_t *hosts;
+static int hosts_used;
+static code_page_t *pages;
+static int pages_used;
+static code_host_t *code_hash[CODE_HASH_SIZE];
+static code_page_t *code_r[MEMMAP_BLOCKS];
+static code_host_t *code_w[MEMMAP_BLOCKS];
+
+static uint8_t *no_pages[MEMMAP_BLOCKS];
+static uint8_t **rd_pages = no_pages;
+static uint8_t **wr_pages = no_pages;
+
+static z80api_memhook memhook;
+static z80bb_reti_fn_t reti_fn;
+
+static int stop;
+static int brk;
+static int flush_pending;
+
+static uint8_t sz53[256];
+static uint8_t sz53p[256];
+
+extern uint8_t *z80_mem_rp[];
+extern uint8_t *z80_mem_wp[];
+extern struct z80_memory_read_byte z80_mem_r[];
+extern struct z80_memory_write_byte z80_mem_w[];
+
+//==============================================================================
+// Code page management.
+//==============================================================================
+static void z80bb_flush_all (void)
+{
+ memset(code_hash, 0, sizeof(code_hash));
+ memset(code_r, 0, sizeof(code_r));
+ memset(code_w, 0, sizeof(code_w));
+ hosts_used = 0;
+ pages_used = 0;
+ arena_used = 0;
+ flush_pending = 0;
+}
+
+static code_host_t *z80bb_find_host (uint8_t *host)
+{
+ code_host_t *hp;
+
+ if (host == NULL)
+    return NULL;
+
+ hp = code_hash[((uintptr_t)host / CODE_PAGE_SIZE) % CODE_HASH_SIZE];
+ while (hp && hp->host != host)
+    hp = hp->next;
+
+ return hp;
+}
+
+static code_page_t *z80bb_find_page (uint8_t *host, int zpage)
+{
+ code_host_t *hp = z80bb_find_host(host);
+ code_page_t *cp = NULL;
+
+ if (hp)
+    {
+     cp = hp->pages;
+     while (cp && cp->zpage != zpage)
+        cp = cp->next;
+    }
+
+ return cp;
+}
+
+static code_page_t *z80bb_create_page (uint8_t *host, int zpage)
+{
+ code_host_t *hp;
+ code_page_t *cp;
+ int h;
+ int i;
+
+ if ((pages_used == CODE_PAGES_MAX) || (hosts_used == CODE_PAGES_MAX))
+    z80bb_flush_all();
+
+ hp = z80bb_find_host(host);
+ if (hp == NULL)
+    {
+     hp = &hosts[hosts_used++];
+     memset(hp->used, 0, sizeof(hp->used));
+     hp->host = host;
+     hp->pages = NULL;
+
+     h = ((uintptr_t)host / CODE_PAGE_SIZE) % CODE_HASH_SIZE;
+     hp->next = code_hash[h];
+     code_hash[h] = hp;
+
+     for (i = 0; i < MEMMAP_BLOCKS; i++)
+        if (memmap_write_host(i) == host)
+           code_w[i] = hp;
+    }
+
+ cp = &pages[pages_used++];
+ memset(cp->entry, 0, sizeof(cp->entry));
+ cp->hp = hp;
+ cp->zpage = zpage;
+ cp->next = hp->pages;
+ hp->pages = cp;
+
+ code_r[zpage] = cp;
+
+ return cp;
+}
+
+static void z80bb_invalidate_host (code_host_t *hp)
+{
+ code_page_t *cp;
+
+ // the arena space is not reclaimed until the next full flush as the
+ // operation currently executing may belong to this page.
+ for (cp = hp->pages; cp; cp = cp->next)
+    memset(cp->entry, 0, sizeof(cp->entry));
+ memset(hp->used, 0, sizeof(hp->used));
+ stop = 1;
+}
+
+//==============================================================================
+// Memory and port access.
+//==============================================================================
+static uint8_t rd_slow (uint16_t addr)
+{
+ if (memhook)
+    memhook(addr, 0);
+ return z80_mem_r[addr >> MEMMAP_SHIFT].memory_call(addr, NULL);
+}
+
+static inline uint8_t rd (uint16_t addr)
+{
+ uint8_t *p = rd_pages[addr >> MEMMAP_SHIFT];
+
+ if (p)
+    return p[addr & MEMMAP_OFFSET];
+ return rd_slow(addr);
+}
+
+static void wr_slow (uint16_t addr, uint8_t data)
+{
+ z80_mem_w[addr >> MEMMAP_SHIFT].memory_call(addr, data, NULL);
+ if (memhook)
+    memhook(addr, 1);
+}
+
+static inline void wr (uint16_t addr, uint8_t data)
+{
+ int page = addr >> MEMMAP_SHIFT;
+ uint8_t *p = wr_pages[page];
+
+ if (p)
+    p[addr & MEMMAP_OFFSET] = data;
+ else
+    wr_slow(addr, data);
+
+ if (code_w[page] && code_w[page]->used[addr & MEMMAP_OFFSET])
+    z80bb_invalidate_host(code_w[page]);
+}
+
+static inline uint16_t rd16 (uint16_t addr)
+{
+ uint16_t v = rd(addr);
+ return v | (rd(addr + 1) << 8);
+}
+
+static inline void wr16 (uint16_t addr, uint16_t data)
+{
+ wr(addr, data & 0xff);
+ wr(addr + 1, data >> 8);
+}
+
+static inline uint8_t in_port (uint16_t port)
+{
+ return z80api_read_port(port);
+}
+
+static inline void out_port (uint16_t port, uint8_t data)
+{
+ z80api_write_port(port, data);
+}
+
+//==============================================================================
+// Register helpers.
+//==============================================================================
+static inline uint16_t r16 (int h)
+{
+ return (cpu.r8[h] << 8) | cpu.r8[h + 1];
+}
+
+static inline void set16 (int h, uint16_t v)
+{
+ cpu.r8[h] = v >> 8;
+ cpu.r8[h + 1] = v & 0xff;
+}
+
+static inline void push (uint16_t v)
+{
+ uint16_t sp = r16(Z80BB_SPH);
+
+ wr(--sp, v >> 8);
+ wr(--sp, v & 0xff);
+ set16(Z80BB_SPH, sp);
+}
+
+static inline uint16_t pop (void)
+{
+ uint16_t sp = r16(Z80BB_SPH);
+ uint16_t v = rd16(sp);
+
+ set16(Z80BB_SPH, sp + 2);
+ return v;
+}
+
+static inline uint16_t ea (const z80bb_op_t *op)
+{
+ uint16_t addr = r16(op->idx) + op->d;
+
+ if (op->idx != Z80BB_H)
+    cpu.memptr = addr;
+ return addr;
+}
+
+static inline int cond (int cc)
+{
+ static const uint8_t mask[8] =
+    {FLAG_Z, FLAG_Z, FLAG_C, FLAG_C, FLAG_P, FLAG_P, FLAG_S, FLAG_S};
+
+ return ((REG_F & mask[cc]) != 0) == (cc & 1);
+}
+
+//==============================================================================
+// ALU functions.
+//==============================================================================
+static inline void alu_add (uint8_t v)
+{
+ int res = REG_A + v;
+
+ REG_F = ((res >> 8) & FLAG_C) | ((REG_A ^ v ^ res) & FLAG_H) |
+         (((REG_A ^ ~v) & (REG_A ^ res) & 0x80) ? FLAG_P : 0) |
+         sz53[res & 0xff];
+ REG_A = res;
+}
+
+static inline void alu_adc (uint8_t v)
+{
+ int res = REG_A + v + (REG_F & FLAG_C);
+
+ REG_F = ((res >> 8) & FLAG_C) | ((REG_A ^ v ^ res) & FLAG_H) |
+         (((REG_A ^ ~v) & (REG_A ^ res) & 0x80) ? FLAG_P : 0) |
+         sz53[res & 0xff];
+ REG_A = res;
+}
+
+static inline void alu_sub (uint8_t v)
+{
+ int res = REG_A - v;
+
+ REG_F = ((res >> 8) & FLAG_C) | FLAG_N | ((REG_A ^ v ^ res) & FLAG_H) |
+         (((REG_A ^ v) & (REG_A ^ res) & 0x80) ? FLAG_P : 0) |
+         sz53[res & 0xff];
+ REG_A = res;
+}
+
+static inline void alu_sbc (uint8_t v)
+{
+ int res = REG_A - v - (REG_F & FLAG_C);
+
+ REG_F = ((res >> 8) & FLAG_C) | FLAG_N | ((REG_A ^ v ^ res) & FLAG_H) |
+         (((REG_A ^ v) & (REG_A ^ res) & 0x80) ? FLAG_P : 0) |
+         sz53[res & 0xff];
+ REG_A = res;
+}
+
+static inline void alu_and (uint8_t v)
+{
+ REG_A &= v;
+ REG_F = FLAG_H | sz53p[REG_A];
+}
+
+static inline void alu_xor (uint8_t v)
+{
+ REG_A ^= v;
+ REG_F = sz53p[REG_A];
+}
+
+static inline void alu_or (uint8_t v)
+{
+ REG_A |= v;
+ REG_F = sz53p[REG_A];
+}
+
+static inline void alu_cp (uint8_t v)
+{
+ int res = REG_A - v;
+
+ REG_F = ((res >> 8) & FLAG_C) | FLAG_N | ((REG_A ^ v ^ res) & FLAG_H) |
+         (((REG_A ^ v) & (REG_A ^ res) & 0x80) ? FLAG_P : 0) |
+         (sz53[res & 0xff] & (FLAG_S | FLAG_Z)) | (v & (FLAG_5 | FLAG_3));
+}
+
+static inline uint8_t alu_inc (uint8_t v)
+{
+ v++;
+ REG_F = (REG_F & FLAG_C) | (v == 0x80 ? FLAG_P : 0) |
+         ((v & 0x0f) ? 0 : FLAG_H) | sz53[v];
+ return v;
+}
+
+static inline uint8_t alu_dec (uint8_t v)
+{
+ REG_F = (REG_F & FLAG_C) | FLAG_N | ((v & 0x0f) ? 0 : FLAG_H);
+ v--;
+ REG_F |= (v == 0x7f ? FLAG_P : 0) | sz53[v];
+ return v;
+}
+
+static inline uint8_t alu_rlc (uint8_t v)
+{
+ v = (v << 1) | (v >> 7);
+ REG_F = (v & FLAG_C) | sz53p[v];
+ return v;
+}
+
+static inline uint8_t alu_rrc (uint8_t v)
+{
+ REG_F = v & FLAG_C;
+ v = (v >> 1) | (v << 7);
+ REG_F |= sz53p[v];
+ return v;
+}
+
+static inline uint8_t alu_rl (uint8_t v)
+{
+ uint8_t c = v >> 7;
+
+ v = (v << 1) | (REG_F & FLAG_C);
+ REG_F = c | sz53p[v];
+ return v;
+}
+
+static inline uint8_t alu_rr (uint8_t v)
+{
+ uint8_t c = v & FLAG_C;
+
+ v = (v >> 1) | (REG_F << 7);
+ REG_F = c | sz53p[v];
+ return v;
+}
+
+static inline uint8_t alu_sla (uint8_t v)
+{
+ REG_F = v >> 7;
+ v <<= 1;
+ REG_F |= sz53p[v];
+ return v;
+}
+
+static inline uint8_t alu_sra (uint8_t v)
+{
+ REG_F = v & FLAG_C;
+ v = (v & 0x80) | (v >> 1);
+ REG_F |= sz53p[v];
+ return v;
+}
+
+static inline uint8_t alu_sll (uint8_t v)
+{
+ REG_F = v >> 7;
+ v = (v << 1) | 0x01;
+ REG_F |= sz53p[v];
+ return v;
+}
+
+static inline uint8_t alu_srl (uint8_t v)
+{
+ REG_F = v & FLAG_C;
+ v >>= 1;
+ REG_F |= sz53p[v];
+ return v;
+}
+
+static inline void alu_bit (uint8_t v, int bit, uint8_t xy)
+{
+ uint8_t f = (REG_F & FLAG_C) | FLAG_H | (xy & (FLAG_5 | FLAG_3));
+
+ v &= (1 << bit);
+ if (! v)
+    f |= FLAG_Z | FLAG_P;
+ else
+    f |= v & FLAG_S;
+ REG_F = f;
+}
+
+//==============================================================================
+// Operation handlers.
+//
+// Each handler is called after the PC and R registers have been advanced
+// past the instruction and returns any tstates needed in addition to the
+// base tstate count for the instruction.
+//==============================================================================
+#define ALU_OPS(name)                                                       \
+static int op_##name##_r (const z80bb_op_t *op)                             \
+{                                                                           \
+ alu_##name(cpu.r8[op->x]);                                                 \
+ return 0;                                                                  \
+}                                                                           \
+static int op_##name##_n (const z80bb_op_t *op)                             \
+{                                                                           \
+ alu_##name(op->n);                                                         \
+ return 0;                                                                  \
+}                                                                           \
+static int op_##name##_m (const z80bb_op_t *op)                             \
+{                                                                           \
+ alu_##name(rd(ea(op)));                                                    \
+ return 0;                                                                  \
+}
+
+ALU_OPS(add)
+ALU_OPS(adc)
+ALU_OPS(sub)
+ALU_OPS(sbc)
+ALU_OPS(and)
+ALU_OPS(xor)
+ALU_OPS(or)
+ALU_OPS(cp)
+
+static const z80bb_fn_t alu_r_ops[8] =
+   {op_add_r, op_adc_r, op_sub_r, op_sbc_r, op_and_r, op_xor_r, op_or_r, op_cp_r};
+static const z80bb_fn_t alu_n_ops[8] =
+   {op_add_n, op_adc_n, op_sub_n, op_sbc_n, op_and_n, op_xor_n, op_or_n, op_cp_n};
+static const z80bb_fn_t alu_m_ops[8] =
+   {op_add_m, op_adc_m, op_sub_m, op_sbc_m, op_and_m, op_xor_m, op_or_m, op_cp_m};
+
+// the memory versions also store the result in register x, this is the
+// temporary register unless an undocumented DDCB/FDCB form is used.
+#define ROT_OPS(name)                                                       \
+static int op_##name##_r (const z80bb_op_t *op)                             \
+{                                                                           \
+ cpu.r8[op->x] = alu_##name(cpu.r8[op->x]);                                 \
+ return 0;                                                                  \
+}                                                                           \
+static int op_##name##_m (const z80bb_op_t *op)                             \
+{                                                                           \
+ uint16_t addr = ea(op);                                                    \
+ cpu.r8[op->x] = alu_##name(rd(addr));                                      \
+ wr(addr, cpu.r8[op->x]);                                                   \
+ return 0;                                                                  \
+}
+
+ROT_OPS(rlc)
+ROT_OPS(rrc)
+ROT_OPS(rl)
+ROT_OPS(rr)
+ROT_OPS(sla)
+ROT_OPS(sra)
+ROT_OPS(sll)
+ROT_OPS(srl)
+
+static const z80bb_fn_t rot_r_ops[8] =
+   {op_rlc_r, op_rrc_r, op_rl_r, op_rr_r, op_sla_r, op_sra_r, op_sll_r, op_srl_r};
+static const z80bb_fn_t rot_m_ops[8] =
+   {op_rlc_m, op_rrc_m, op_rl_m, op_rr_m, op_sla_m, op_sra_m, op_sll_m, op_srl_m};
+
+static int op_nop (const z80bb_op_t *op)
+{
+ return 0;
+}
+
+// 8 bit loads
+static int op_ld_r_r (const z80bb_op_t *op)
+{
+ cpu.r8[op->x] = cpu.r8[op->y];
+ return 0;
+}
+
+static int op_ld_r_n (const z80bb_op_t *op)
+{
+ cpu.r8[op->x] = op->n;
+ return 0;
+}
+
+static int op_ld_r_m (const z80bb_op_t *op)
+{
+ cpu.r8[op->x] = rd(ea(op));
+ return 0;
+}
+
+static int op_ld_m_r (const z80bb_op_t *op)
+{
+ wr(ea(op), cpu.r8[op->y]);
+ return 0;
+}
+
+static int op_ld_m_n (const z80bb_op_t *op)
+{
+ wr(ea(op), op->n);
+ return 0;
+}
+
+static int op_ld_a_rr (const z80bb_op_t *op)
+{
+ uint16_t addr = r16(op->x);
+
+ REG_A = rd(addr);
+ cpu.memptr = addr + 1;
+ return 0;
+}
+
+static int op_ld_rr_a (const z80bb_op_t *op)
+{
+ uint16_t addr = r16(op->x);
+
+ wr(addr, REG_A);
+ cpu.memptr = ((addr + 1) & 0xff) | (REG_A << 8);
+ return 0;
+}
+
+static int op_ld_a_nn (const z80bb_op_t *op)
+{
+ REG_A = rd(op->nn);
+ cpu.memptr = op->nn + 1;
+ return 0;
+}
+
+static int op_ld_nn_a (const z80bb_op_t *op)
+{
+ wr(op->nn, REG_A);
+ cpu.memptr = ((op->nn + 1) & 0xff) | (REG_A << 8);
+ return 0;
+}
+
+static int op_ld_a_i (const z80bb_op_t *op)
+{
+ REG_A = cpu.i;
+ REG_F = (REG_F & FLAG_C) | sz53[REG_A] | (cpu.iff2 ? FLAG_P : 0);
+ return 0;
+}
+
+static int op_ld_a_r (const z80bb_op_t *op)
+{
+ REG_A = (cpu.r & 0x7f) | cpu.r7;
+ REG_F = (REG_F & FLAG_C) | sz53[REG_A] | (cpu.iff2 ? FLAG_P : 0);
+ return 0;
+}
+
+static int op_ld_i_a (const z80bb_op_t *op)
+{
+ cpu.i = REG_A;
+ return 0;
+}
+
+static int op_ld_r_a (const z80bb_op_t *op)
+{
+ cpu.r = REG_A;
+ cpu.r7 = REG_A & 0x80;
+ return 0;
+}
+
+// 16 bit loads
+static int op_ld_rr_nn (const z80bb_op_t *op)
+{
+ set16(op->x, op->nn);
+ return 0;
+}
+
+static int op_ld_rr_inn (const z80bb_op_t *op)
+{
+ set16(op->x, rd16(op->nn));
+ cpu.memptr = op->nn + 1;
+ return 0;
+}
+
+static int op_ld_inn_rr (const z80bb_op_t *op)
+{
+ wr16(op->nn, r16(op->x));
+ cpu.memptr = op->nn + 1;
+ return 0;
+}
+
+static int op_ld_sp_rr (const z80bb_op_t *op)
+{
+ set16(Z80BB_SPH, r16(op->x));
+ return 0;
+}
+
+static int op_push (const z80bb_op_t *op)
+{
+ push(r16(op->x));
+ return 0;
+}
+
+static int op_pop (const z80bb_op_t *op)
+{
+ set16(op->x, pop());
+ return 0;
+}
+
+static int op_push_af (const z80bb_op_t *op)
+{
+ push((REG_A << 8) | REG_F);
+ return 0;
+}
+
+static int op_pop_af (const z80bb_op_t *op)
+{
+ uint16_t v = pop();
+
+ REG_A = v >> 8;
+ REG_F = v & 0xff;
+ return 0;
+}
+
+// exchanges
+static int op_ex_de_hl (const z80bb_op_t *op)
+{
+ uint16_t v = r16(Z80BB_D);
+
+ set16(Z80BB_D, r16(Z80BB_H));
+ set16(Z80BB_H, v);
+ return 0;
+}
+
+static int op_ex_af (const z80bb_op_t *op)
+{
+ uint16_t v = (REG_A << 8) | REG_F;
+
+ REG_A = cpu.af_p >> 8;
+ REG_F = cpu.af_p & 0xff;
+ cpu.af_p = v;
+ return 0;
+}
+
+static int op_exx (const z80bb_op_t *op)
+{
+ uint16_t v;
+
+ v = r16(Z80BB_B);
+ set16(Z80BB_B, cpu.bc_p);
+ cpu.bc_p = v;
+ v = r16(Z80BB_D);
+ set16(Z80BB_D, cpu.de_p);
+ cpu.de_p = v;
+ v = r16(Z80BB_H);
+ set16(Z80BB_H, cpu.hl_p);
+ cpu.hl_p = v;
+ return 0;
+}
+
+static int op_ex_sp_rr (const z80bb_op_t *op)
+{
+ uint16_t sp = r16(Z80BB_SPH);
+ uint16_t v = rd16(sp);
+ uint16_t h = r16(op->x);
+
+ wr(sp + 1, h >> 8);
+ wr(sp, h & 0xff);
+ set16(op->x, v);
+ cpu.memptr = v;
+ return 0;
+}
+
+// 8 bit arithmetic
+static int op_inc_r (const z80bb_op_t *op)
+{
+ cpu.r8[op->x] = alu_inc(cpu.r8[op->x]);
+ return 0;
+}
+
+static int op_dec_r (const z80bb_op_t *op)
+{
+ cpu.r8[op->x] = alu_dec(cpu.r8[op->x]);
+ return 0;
+}
+
+static int op_inc_m (const z80bb_op_t *op)
+{
+ uint16_t addr = ea(op);
+
+ wr(addr, alu_inc(rd(addr)));
+ return 0;
+}
+
+static int op_dec_m (const z80bb_op_t *op)
+{
+ uint16_t addr = ea(op);
+
+ wr(addr, alu_dec(rd(addr)));
+ return 0;
+}
+
+static int op_daa (const z80bb_op_t *op)
+{
+ uint8_t add = 0;
+ uint8_t carry = REG_F & FLAG_C;
+
+ if ((REG_F & FLAG_H) || ((REG_A & 0x0f) > 9))
+    add = 0x06;
+ if (carry || (REG_A > 0x99))
+    add |= 0x60;
+ if (REG_A > 0x99)
+    carry = FLAG_C;
+
+ if (REG_F & FLAG_N)
+    alu_sub(add);
+ else
+    alu_add(add);
+
+ REG_F = (REG_F & ~(FLAG_C | FLAG_P)) | carry | (sz53p[REG_A] & FLAG_P);
+ return 0;
+}
+
+static int op_cpl (const z80bb_op_t *op)
+{
+ REG_A ^= 0xff;
+ REG_F = (REG_F & (FLAG_C | FLAG_P | FLAG_Z | FLAG_S)) |
+         (REG_A & (FLAG_5 | FLAG_3)) | FLAG_H | FLAG_N;
+ return 0;
+}
+
+static int op_neg (const z80bb_op_t *op)
+{
+ uint8_t v = REG_A;
+
+ REG_A = 0;
+ alu_sub(v);
+ return 0;
+}
+
+static int op_scf (const z80bb_op_t *op)
+{
+ REG_F = (REG_F & (FLAG_P | FLAG_Z | FLAG_S)) |
+         (REG_A & (FLAG_5 | FLAG_3)) | FLAG_C;
+ return 0;
+}
+
+static int op_ccf (const z80bb_op_t *op)
+{
+ REG_F = (REG_F & (FLAG_P | FLAG_Z | FLAG_S)) |
+         ((REG_F & FLAG_C) ? FLAG_H : FLAG_C) | (REG_A & (FLAG_5 | FLAG_3));
+ return 0;
+}
+
+static int op_rlca (const z80bb_op_t *op)
+{
+ REG_A = (REG_A << 1) | (REG_A >> 7);
+ REG_F = (REG_F & (FLAG_P | FLAG_Z | FLAG_S)) |
+         (REG_A & (FLAG_C | FLAG_5 | FLAG_3));
+ return 0;
+}
+
+static int op_rrca (const z80bb_op_t *op)
+{
+ REG_F = (REG_F & (FLAG_P | FLAG_Z | FLAG_S)) | (REG_A & FLAG_C);
+ REG_A = (REG_A >> 1) | (REG_A << 7);
+ REG_F |= REG_A & (FLAG_5 | FLAG_3);
+ return 0;
+}
+
+static int op_rla (const z80bb_op_t *op)
+{
+ uint8_t c = REG_A >> 7;
+
+ REG_A = (REG_A << 1) | (REG_F & FLAG_C);
+ REG_F = (REG_F & (FLAG_P | FLAG_Z | FLAG_S)) |
+         (REG_A & (FLAG_5 | FLAG_3)) | c;
+ return 0;
+}
+
+static int op_rra (const z80bb_op_t *op)
+{
+ uint8_t c = REG_A & FLAG_C;
+
+ REG_A = (REG_A >> 1) | (REG_F << 7);
+ REG_F = (REG_F & (FLAG_P | FLAG_Z | FLAG_S)) |
+         (REG_A & (FLAG_5 | FLAG_3)) | c;
+ return 0;
+}
+
+static int op_rld (const z80bb_op_t *op)
+{
+ uint16_t addr = r16(Z80BB_H);
+ uint8_t v = rd(addr);
+
+ wr(addr, (v << 4) | (REG_A & 0x0f));
+ REG_A = (REG_A & 0xf0) | (v >> 4);
+ REG_F = (REG_F & FLAG_C) | sz53p[REG_A];
+ cpu.memptr = addr + 1;
+ return 0;
+}
+
+static int op_rrd (const z80bb_op_t *op)
+{
+ uint16_t addr = r16(Z80BB_H);
+ uint8_t v = rd(addr);
+
+ wr(addr, (REG_A << 4) | (v >> 4));
+ REG_A = (REG_A & 0xf0) | (v & 0x0f);
+ REG_F = (REG_F & FLAG_C) | sz53p[REG_A];
+ cpu.memptr = addr + 1;
+ return 0;
+}
+
+// 16 bit arithmetic
+static int op_inc_rr (const z80bb_op_t *op)
+{
+ set16(op->x, r16(op->x) + 1);
+ return 0;
+}
+
+static int op_dec_rr (const z80bb_op_t *op)
+{
+ set16(op->x, r16(op->x) - 1);
+ return 0;
+}
+
+static int op_add_rr (const z80bb_op_t *op)
+{
+ uint16_t a = r16(op->x);
+ uint16_t b = r16(op->y);
+ uint32_t res = a + b;
+
+ cpu.memptr = a + 1;
+ REG_F = (REG_F & (FLAG_P | FLAG_Z | FLAG_S)) | ((res >> 16) & FLAG_C) |
+         ((res >> 8) & (FLAG_5 | FLAG_3)) | (((a ^ b ^ res) >> 8) & FLAG_H);
+ set16(op->x, res);
+ return 0;
+}
+
+static int op_adc_hl (const z80bb_op_t *op)
+{
+ uint16_t a = r16(Z80BB_H);
+ uint16_t b = r16(op->y);
+ uint32_t res = a + b + (REG_F & FLAG_C);
+
+ cpu.memptr = a + 1;
+ REG_F = ((res >> 16) & FLAG_C) | ((res >> 8) & (FLAG_S | FLAG_5 | FLAG_3)) |
+         ((res & 0xffff) ? 0 : FLAG_Z) | (((a ^ b ^ res) >> 8) & FLAG_H) |
+         ((~(a ^ b) & (a ^ res) & 0x8000) ? FLAG_P : 0);
+ set16(Z80BB_H, res);
+ return 0;
+}
+
+static int op_sbc_hl (const z80bb_op_t *op)
+{
+ uint16_t a = r16(Z80BB_H);
+ uint16_t b = r16(op->y);
+ uint32_t res = a - b - (REG_F & FLAG_C);
+
+ cpu.memptr = a + 1;
+ REG_F = ((res >> 16) & FLAG_C) | FLAG_N |
+         ((res >> 8) & (FLAG_S | FLAG_5 | FLAG_3)) |
+         ((res & 0xffff) ? 0 : FLAG_Z) | (((a ^ b ^ res) >> 8) & FLAG_H) |
+         (((a ^ b) & (a ^ res) & 0x8000) ? FLAG_P : 0);
+ set16(Z80BB_H, res);
+ return 0;
+}
+
+// bit operations
+static int op_bit_r (const z80bb_op_t *op)
+{
+ alu_bit(cpu.r8[op->x], op->y, cpu.r8[op->x]);
+ return 0;
+}
+
+static int op_bit_m (const z80bb_op_t *op)
+{
+ uint8_t v = rd(ea(op));
+
+ alu_bit(v, op->y, cpu.memptr >> 8);
+ return 0;
+}
+
+static int op_res_r (const z80bb_op_t *op)
+{
+ cpu.r8[op->x] &= ~(1 << op->y);
+ return 0;
+}
+
+static int op_res_m (const z80bb_op_t *op)
+{
+ uint16_t addr = ea(op);
+
+ cpu.r8[op->x] = rd(addr) & ~(1 << op->y);
+ wr(addr, cpu.r8[op->x]);
+ return 0;
+}
+
+static int op_set_r (const z80bb_op_t *op)
+{
+ cpu.r8[op->x] |= (1 << op->y);
+ return 0;
+}
+
+static int op_set_m (const z80bb_op_t *op)
+{
+ uint16_t addr = ea(op);
+
+ cpu.r8[op->x] = rd(addr) | (1 << op->y);
+ wr(addr, cpu.r8[op->x]);
+ return 0;
+}
+
+// jumps, calls and returns
+static int op_jp (const z80bb_op_t *op)
+{
+ cpu.pc = op->nn;
+ cpu.memptr = op->nn;
+ return 0;
+}
+
+static int op_jp_cc (const z80bb_op_t *op)
+{
+ cpu.memptr = op->nn;
+ if (cond(op->x))
+    cpu.pc = op->nn;
+ return 0;
+}
+
+static int op_jp_rr (const z80bb_op_t *op)
+{
+ cpu.pc = r16(op->x);
+ return 0;
+}
+
+static int op_jr (const z80bb_op_t *op)
+{
+ cpu.pc = op->nn;
+ cpu.memptr = op->nn;
+ return 0;
+}
+
+static int op_jr_cc (const z80bb_op_t *op)
+{
+ if (! cond(op->x))
+    return 0;
+ cpu.pc = op->nn;
+ cpu.memptr = op->nn;
+ return 5;
+}
+
+static int op_djnz (const z80bb_op_t *op)
+{
+ if (--REG_B == 0)
+    return 0;
+ cpu.pc = op->nn;
+ cpu.memptr = op->nn;
+ return 5;
+}
+
+static int op_call (const z80bb_op_t *op)
+{
+ push(cpu.pc);
+ cpu.pc = op->nn;
+ cpu.memptr = op->nn;
+ return 0;
+}
+
+static int op_call_cc (const z80bb_op_t *op)
+{
+ cpu.memptr = op->nn;
+ if (! cond(op->x))
+    return 0;
+ push(cpu.pc);
+ cpu.pc = op->nn;
+ return 7;
+}
+
+static int op_ret (const z80bb_op_t *op)
+{
+ cpu.pc = pop();
+ cpu.memptr = cpu.pc;
+ return 0;
+}
+
+static int op_ret_cc (const z80bb_op_t *op)
+{
+ if (! cond(op->x))
+    return 0;
+ cpu.pc = pop();
+ cpu.memptr = cpu.pc;
+ return 6;
+}
+
+static int op_retn (const z80bb_op_t *op)
+{
+ cpu.iff1 = cpu.iff2;
+ cpu.pc = pop();
+ cpu.memptr = cpu.pc;
+ return 0;
+}
+
+static int op_reti (const z80bb_op_t *op)
+{
+ cpu.iff1 = cpu.iff2;
+ cpu.pc = pop();
+ cpu.memptr = cpu.pc;
+ if (reti_fn)
+    (*reti_fn)();
+ return 0;
+}
+
+static int op_rst (const z80bb_op_t *op)
+{
+ push(cpu.pc);
+ cpu.pc = op->nn;
+ cpu.memptr = op->nn;
+ return 0;
+}
+
+// CPU control
+static int op_halt (const z80bb_op_t *op)
+{
+ // the PC is left at the HALT instruction (as z80ex does) and is advanced
+ // when an interrupt is accepted.
+ cpu.halted = 1;
+ cpu.pc = op->next - 1;
+ return 0;
+}
+
+static int op_di (const z80bb_op_t *op)
+{
+ cpu.iff1 = 0;
+ cpu.iff2 = 0;
+ return 0;
+}
+
+static int op_ei (const z80bb_op_t *op)
+{
+ cpu.iff1 = 1;
+ cpu.iff2 = 1;
+ cpu.noint_once = 1;
+ return 0;
+}
+
+static int op_im (const z80bb_op_t *op)
+{
+ cpu.im = op->n;
+ return 0;
+}
+
+// input and output
+static int op_in_a_n (const z80bb_op_t *op)
+{
+ uint16_t port = (REG_A << 8) | op->n;
+
+ cpu.memptr = port + 1;
+ REG_A = in_port(port);
+ return 0;
+}
+
+static int op_out_n_a (const z80bb_op_t *op)
+{
+ uint16_t port = (REG_A << 8) | op->n;
+
+ out_port(port, REG_A);
+ cpu.memptr = ((op->n + 1) & 0xff) | (REG_A << 8);
+ return 0;
+}
+
+static int op_in_r_c (const z80bb_op_t *op)
+{
+ uint16_t port = r16(Z80BB_B);
+ uint8_t v;
+
+ cpu.memptr = port + 1;
+ v = in_port(port);
+ cpu.r8[op->x] = v;
+ REG_F = (REG_F & FLAG_C) | sz53p[v];
+ return 0;
+}
+
+static int op_out_c_r (const z80bb_op_t *op)
+{
+ uint16_t port = r16(Z80BB_B);
+
+ out_port(port, cpu.r8[op->x]);
+ cpu.memptr = port + 1;
+ return 0;
+}
+
+static int op_out_c_0 (const z80bb_op_t *op)
+{
+ uint16_t port = r16(Z80BB_B);
+
+ out_port(port, 0);
+ cpu.memptr = port + 1;
+ return 0;
+}
+
+// block transfer, search and I/O (d=direction, y=repeat)
+static int op_ldx (const z80bb_op_t *op)
+{
+ uint16_t hl = r16(Z80BB_H);
+ uint16_t de = r16(Z80BB_D);
+ uint16_t bc = r16(Z80BB_B) - 1;
+ uint8_t v;
+ uint8_t n;
+
+ v = rd(hl);
+ wr(de, v);
+ set16(Z80BB_H, hl + op->d);
+ set16(Z80BB_D, de + op->d);
+ set16(Z80BB_B, bc);
+
+ n = v + REG_A;
+ REG_F = (REG_F & (FLAG_S | FLAG_Z | FLAG_C)) | (bc ? FLAG_P : 0) |
+         (n & FLAG_3) | ((n & 0x02) ? FLAG_5 : 0);
+
+ if (op->y && bc)
+    {
+     cpu.pc = op->next - 2;
+     cpu.memptr = cpu.pc + 1;
+     return 5;
+    }
+ return 0;
+}
+
+static int op_cpx (const z80bb_op_t *op)
+{
+ uint16_t hl = r16(Z80BB_H);
+ uint16_t bc = r16(Z80BB_B) - 1;
+ uint8_t v;
+ uint8_t res;
+ uint8_t h;
+ uint8_t n;
+
+ v = rd(hl);
+ res = REG_A - v;
+ h = (REG_A ^ v ^ res) & FLAG_H;
+ n = res - (h ? 1 : 0);
+ set16(Z80BB_H, hl + op->d);
+ set16(Z80BB_B, bc);
+ cpu.memptr += op->d;
+
+ REG_F = (REG_F & FLAG_C) | FLAG_N | (bc ? FLAG_P : 0) | h |
+         (res ? 0 : FLAG_Z) | (res & FLAG_S) | (n & FLAG_3) |
+         ((n & 0x02) ? FLAG_5 : 0);
+
+ if (op->y && bc && res)
+    {
+     cpu.pc = op->next - 2;
+     cpu.memptr = cpu.pc + 1;
+     return 5;
+    }
+ return 0;
+}
+
+static int op_inx (const z80bb_op_t *op)
+{
+ uint16_t hl = r16(Z80BB_H);
+ uint16_t bc = r16(Z80BB_B);
+ uint8_t v;
+ int k;
+
+ v = in_port(bc);
+ cpu.memptr = bc + op->d;
+ wr(hl, v);
+ REG_B--;
+ set16(Z80BB_H, hl + op->d);
+
+ k = v + ((REG_C + op->d) & 0xff);
+ REG_F = ((v & 0x80) ? FLAG_N : 0) | ((k > 255) ? (FLAG_H | FLAG_C) : 0) |
+         (sz53p[(k & 0x07) ^ REG_B] & FLAG_P) | sz53[REG_B];
+
+ if (op->y && REG_B)
+    {
+     cpu.pc = op->next - 2;
+     return 5;
+    }
+ return 0;
+}
+
+static int op_outx (const z80bb_op_t *op)
+{
+ uint16_t hl = r16(Z80BB_H);
+ uint8_t v;
+ int k;
+
+ v = rd(hl);
+ REG_B--;
+ out_port(r16(Z80BB_B), v);
+ cpu.memptr = r16(Z80BB_B) + op->d;
+ set16(Z80BB_H, hl + op->d);
+
+ k = v + REG_L;
+ REG_F = ((v & 0x80) ? FLAG_N : 0) | ((k > 255) ? (FLAG_H | FLAG_C) : 0) |
+         (sz53p[(k & 0x07) ^ REG_B] & FLAG_P) | sz53[REG_B];
+
+ if (op->y && REG_B)
+    {
+     cpu.pc = op->next - 2;
+     return 5;
+    }
+ return 0;
+}
+
+//==============================================================================
+// Instruction decoder.
+//==============================================================================
+static uint8_t fetch_byte (fetch_t *f)
+{
+ uint8_t v;
+
+ if (f->host && f->off < CODE_PAGE_SIZE)
+    v = f->host[f->off];
+ else
+    {
+     if (f->host)
+        f->cross = 1;
+     v = rd(f->pc);
+    }
+ f->off++;
+ f->pc++;
+ return v;
+}
+
+static uint8_t peek_byte (fetch_t *f)
+{
+ if (f->host && f->off < CODE_PAGE_SIZE)
+    return f->host[f->off];
+ if (f->host)
+    f->cross = 1;
+ return z80_mem_r[f->pc >> MEMMAP_SHIFT].memory_call(f->pc, NULL);
+}
+
+static inline int reg8 (int code, int idx)
+{
+ if (code == 4)
+    return idx;
+ if (code == 5)
+    return idx + 1;
+ return code;
+}
+
+static inline int reg16 (int p, int idx)
+{
+ static const uint8_t rp[4] = {Z80BB_B, Z80BB_D, Z80BB_H, Z80BB_SPH};
+
+ if (p == 2)
+    return idx;
+ return rp[p];
+}
+
+static void decode_cb (fetch_t *f, z80bb_op_t *op, int opc)
+{
+ int x = opc >> 6;
+ int y = (opc >> 3) & 7;
+ int z = opc & 7;
+
+ op->y = y;
+ op->x = (z == 6) ? Z80BB_TMP : z;
+
+ switch (x)
+    {
+     case 0 :
+        op->fn = (z == 6) ? rot_m_ops[y] : rot_r_ops[y];
+        op->t += (z == 6) ? 15 : 8;
+        break;
+     case 1 :
+        op->fn = (z == 6) ? op_bit_m : op_bit_r;
+        op->t += (z == 6) ? 12 : 8;
+        break;
+     case 2 :
+        op->fn = (z == 6) ? op_res_m : op_res_r;
+        op->t += (z == 6) ? 15 : 8;
+        break;
+     case 3 :
+        op->fn = (z == 6) ? op_set_m : op_set_r;
+        op->t += (z == 6) ? 15 : 8;
+        break;
+    }
+}
+
+static void decode_xycb (fetch_t *f, z80bb_op_t *op, int opc)
+{
+ int x = opc >> 6;
+ int y = (opc >> 3) & 7;
+ int z = opc & 7;
+
+ // results are also copied to register z (undocumented) unless z=6
+ op->y = y;
+ op->x = (z == 6) ? Z80BB_TMP : z;
+
+ switch (x)
+    {
+     case 0 :
+        op->fn = rot_m_ops[y];
+        op->t += 19;
+        break;
+     case 1 :
+        op->fn = op_bit_m;
+        op->t += 16;
+        break;
+     case 2 :
+        op->fn = op_res_m;
+        op->t += 19;
+        break;
+     case 3 :
+        op->fn = op_set_m;
+        op->t += 19;
+        break;
+    }
+}
+
+static void decode_ed (fetch_t *f, z80bb_op_t *op, int opc)
+{
+ static const uint8_t im_mode[4] = {0, 0, 1, 2};
+ static const z80bb_fn_t block_ops[4] = {op_ldx, op_cpx, op_inx, op_outx};
+
+ int x = opc >> 6;
+ int y = (opc >> 3) & 7;
+ int z = opc & 7;
+ int p = y >> 1;
+ int q = y & 1;
+
+ op->fn = op_nop;
+ op->t += 8;
+
+ if (x == 1)
+    {
+     switch (z)
+        {
+         case 0 :
+            op->fn = op_in_r_c;
+            op->x = (y == 6) ? Z80BB_TMP : y;
+            op->t += 4;
+            break;
+         case 1 :
+            op->fn = (y == 6) ? op_out_c_0 : op_out_c_r;
+            op->x = y;
+            op->t += 4;
+            break;
+         case 2 :
+            op->fn = q ? op_adc_hl : op_sbc_hl;
+            op->y = reg16(p, Z80BB_H);
+            op->t += 7;
+            break;
+         case 3 :
+            op->nn = fetch_byte(f);
+            op->nn |= fetch_byte(f) << 8;
+            op->fn = q ? op_ld_rr_inn : op_ld_inn_rr;
+            op->x = reg16(p, Z80BB_H);
+            op->t += 12;
+            break;
+         case 4 :
+            op->fn = op_neg;
+            break;
+         case 5 :
+            op->fn = (y == 1) ? op_reti : op_retn;
+            op->t += 6;
+            op->end = 1;
+            break;
+         case 6 :
+            op->fn = op_im;
+            op->n = im_mode[y & 3];
+            break;
+         case 7 :
+            switch (y)
+               {
+                case 0 :
+                   op->fn = op_ld_i_a;
+                   op->t += 1;
+                   break;
+                case 1 :
+                   op->fn = op_ld_r_a;
+                   op->t += 1;
+                   break;
+                case 2 :
+                   op->fn = op_ld_a_i;
+                   op->t += 1;
+                   break;
+                case 3 :
+                   op->fn = op_ld_a_r;
+                   op->t += 1;
+                   break;
+                case 4 :
+                   op->fn = op_rrd;
+                   op->t += 10;
+                   break;
+                case 5 :
+                   op->fn = op_rld;
+                   op->t += 10;
+                   break;
+               }
+            break;
+        }
+    }
+ else
+    if ((x == 2) && (z <= 3) && (y >= 4))
+       {
+        op->fn = block_ops[z];
+        op->d = (y & 1) ? -1 : 1;
+        op->y = (y >= 6);
+        op->t += 8;
+        op->end = op->y;
+       }
+}
+
+static void decode_main (fetch_t *f, z80bb_op_t *op, int opc, int idx)
+{
+ int x = opc >> 6;
+ int y = (opc >> 3) & 7;
+ int z = opc & 7;
+ int p = y >> 1;
+ int q = y & 1;
+ int8_t d;
+
+ op->fn = op_nop;
+
+ // fetch the displacement for (IX+d) and (IY+d) memory operands
+ if ((idx != Z80BB_H) &&
+    (((x == 0) && (z >= 4) && (z <= 6) && (y == 6)) ||
+    ((x == 1) && ((y == 6) ^ (z == 6))) ||
+    ((x == 2) && (z == 6))))
+    {
+     op->d = (int8_t)fetch_byte(f);
+     op->t += (opc == 0x36) ? 5 : 8;
+    }
+
+ switch (x)
+    {
+     case 0 :
+        switch (z)
+           {
+            case 0 :
+               switch (y)
+                  {
+                   case 0 :
+                      op->t += 4;
+                      break;
+                   case 1 :
+                      op->fn = op_ex_af;
+                      op->t += 4;
+                      break;
+                   case 2 :
+                      d = (int8_t)fetch_byte(f);
+                      op->fn = op_djnz;
+                      op->nn = f->pc + d;
+                      op->t += 8;
+                      op->end = 1;
+                      break;
+                   case 3 :
+                      d = (int8_t)fetch_byte(f);
+                      op->fn = op_jr;
+                      op->nn = f->pc + d;
+                      op->t += 12;
+                      op->end = 1;
+                      break;
+                   default :
+                      d = (int8_t)fetch_byte(f);
+                      op->fn = op_jr_cc;
+                      op->x = y - 4;
+                      op->nn = f->pc + d;
+                      op->t += 7;
+                      op->end = 1;
+                      break;
+                  }
+               break;
+            case 1 :
+               if (q)
+                  {
+                   op->fn = op_add_rr;
+                   op->x = idx;
+                   op->y = reg16(p, idx);
+                   op->t += 11;
+                  }
+               else
+                  {
+                   op->nn = fetch_byte(f);
+                   op->nn |= fetch_byte(f) << 8;
+                   op->fn = op_ld_rr_nn;
+                   op->x = reg16(p, idx);
+                   op->t += 10;
+                  }
+               break;
+            case 2 :
+               switch (p)
+                  {
+                   case 0 :
+                   case 1 :
+                      op->fn = q ? op_ld_a_rr : op_ld_rr_a;
+                      op->x = p ? Z80BB_D : Z80BB_B;
+                      op->t += 7;
+                      break;
+                   case 2 :
+                      op->nn = fetch_byte(f);
+                      op->nn |= fetch_byte(f) << 8;
+                      op->fn = q ? op_ld_rr_inn : op_ld_inn_rr;
+                      op->x = idx;
+                      op->t += 16;
+                      break;
+                   case 3 :
+                      op->nn = fetch_byte(f);
+                      op->nn |= fetch_byte(f) << 8;
+                      op->fn = q ? op_ld_a_nn : op_ld_nn_a;
+                      op->t += 13;
+                      break;
+                  }
+               break;
+            case 3 :
+               op->fn = q ? op_dec_rr : op_inc_rr;
+               op->x = reg16(p, idx);
+               op->t += 6;
+               break;
+            case 4 :
+            case 5 :
+               if (y == 6)
+                  {
+                   op->fn = (z == 4) ? op_inc_m : op_dec_m;
+                   op->t += 11;
+                  }
+               else
+                  {
+                   op->fn = (z == 4) ? op_inc_r : op_dec_r;
+                   op->x = reg8(y, idx);
+                   op->t += 4;
+                  }
+               break;
+            case 6 :
+               op->n = fetch_byte(f);
+               if (y == 6)
+                  {
+                   op->fn = op_ld_m_n;
+                   op->t += 10;
+                  }
+               else
+                  {
+                   op->fn = op_ld_r_n;
+                   op->x = reg8(y, idx);
+                   op->t += 7;
+                  }
+               break;
+            case 7 :
+               {
+                static const z80bb_fn_t acc_ops[8] =
+                   {op_rlca, op_rrca, op_rla, op_rra, op_daa, op_cpl, op_scf, op_ccf};
+                op->fn = acc_ops[y];
+                op->t += 4;
+               }
+               break;
+           }
+        break;
+     case 1 :
+        if (opc == 0x76)
+           {
+            op->fn = op_halt;
+            op->t += 4;
+            op->end = 1;
+           }
+        else
+           if (y == 6)
+              {
+               op->fn = op_ld_m_r;
+               op->y = z;
+               op->t += 7;
+              }
+           else
+              if (z == 6)
+                 {
+                  op->fn = op_ld_r_m;
+                  op->x = y;
+                  op->t += 7;
+                 }
+              else
+                 {
+                  op->fn = op_ld_r_r;
+                  op->x = reg8(y, idx);
+                  op->y = reg8(z, idx);
+                  op->t += 4;
+                 }
+        break;
+     case 2 :
+        if (z == 6)
+           {
+            op->fn = alu_m_ops[y];
+            op->t += 7;
+           }
+        else
+           {
+            op->fn = alu_r_ops[y];
+            op->x = reg8(z, idx);
+            op->t += 4;
+           }
+        break;
+     case 3 :
+        switch (z)
+           {
+            case 0 :
+               op->fn = op_ret_cc;
+               op->x = y;
+               op->t += 5;
+               op->end = 1;
+               break;
+            case 1 :
+               if (! q)
+                  {
+                   op->fn = (p == 3) ? op_pop_af : op_pop;
+                   op->x = reg16(p, idx);
+                   op->t += 10;
+                  }
+               else
+                  switch (p)
+                     {
+                      case 0 :
+                         op->fn = op_ret;
+                         op->t += 10;
+                         op->end = 1;
+                         break;
+                      case 1 :
+                         op->fn = op_exx;
+                         op->t += 4;
+                         break;
+                      case 2 :
+                         op->fn = op_jp_rr;
+                         op->x = idx;
+                         op->t += 4;
+                         op->end = 1;
+                         break;
+                      case 3 :
+                         op->fn = op_ld_sp_rr;
+                         op->x = idx;
+                         op->t += 6;
+                         break;
+                     }
+               break;
+            case 2 :
+               op->nn = fetch_byte(f);
+               op->nn |= fetch_byte(f) << 8;
+               op->fn = op_jp_cc;
+               op->x = y;
+               op->t += 10;
+               op->end = 1;
+               break;
+            case 3 :
+               switch (y)
+                  {
+                   case 0 :
+                      op->nn = fetch_byte(f);
+                      op->nn |= fetch_byte(f) << 8;
+                      op->fn = op_jp;
+                      op->t += 10;
+                      op->end = 1;
+                      break;
+                   case 2 :
+                      op->n = fetch_byte(f);
+                      op->fn = op_out_n_a;
+                      op->t += 11;
+                      break;
+                   case 3 :
+                      op->n = fetch_byte(f);
+                      op->fn = op_in_a_n;
+                      op->t += 11;
+                      break;
+                   case 4 :
+                      op->fn = op_ex_sp_rr;
+                      op->x = idx;
+                      op->t += 19;
+                      break;
+                   case 5 :
+                      op->fn = op_ex_de_hl;
+                      op->t += 4;
+                      break;
+                   case 6 :
+                      op->fn = op_di;
+                      op->t += 4;
+                      break;
+                   case 7 :
+                      op->fn = op_ei;
+                      op->t += 4;
+                      op->end = 1;
+                      break;
+                  }
+               break;
+            case 4 :
+               op->nn = fetch_byte(f);
+               op->nn |= fetch_byte(f) << 8;
+               op->fn = op_call_cc;
+               op->x = y;
+               op->t += 10;
+               op->end = 1;
+               break;
+            case 5 :
+               if (! q)
+                  {
+                   op->fn = (p == 3) ? op_push_af : op_push;
+                   op->x = reg16(p, idx);
+                   op->t += 11;
+                  }
+               else
+                  {
+                   op->nn = fetch_byte(f);
+                   op->nn |= fetch_byte(f) << 8;
+                   op->fn = op_call;
+                   op->t += 17;
+                   op->end = 1;
+                  }
+               break;
+            case 6 :
+               op->n = fetch_byte(f);
+               op->fn = alu_n_ops[y];
+               op->t += 7;
+               break;
+            case 7 :
+               op->fn = op_rst;
+               op->nn = y * 8;
+               op->t += 11;
+               op->end = 1;
+               break;
+           }
+        break;
+    }
+}
+
+//==============================================================================
+// Decode one instruction.
+//
+// DD and FD prefixes followed by another prefix are decoded as a 4 tstate
+// NOP in the same way that z80ex executes them as a separate step.
+//
+//   pass: fetch_t *f
+//         z80bb_op_t *op
+// return: void
+//==============================================================================
+static void z80bb_decode (fetch_t *f, z80bb_op_t *op)
+{
+ int idx = Z80BB_H;
+ int opc;
+ int nxt;
+
+ memset(op, 0, sizeof(z80bb_op_t));
+ op->idx = Z80BB_H;
+ op->r = 1;
+
+ opc = fetch_byte(f);
+
+ if ((opc == 0xDD) || (opc == 0xFD))
+    {
+     nxt = peek_byte(f);
+     if ((nxt == 0xDD) || (nxt == 0xFD) || (nxt == 0xED))
+        {
+         op->fn = op_nop;
+         op->t = 4;
+         op->next = f->pc;
+         return;
+        }
+     idx = (opc == 0xDD) ? Z80BB_IXH : Z80BB_IYH;
+     op->idx = idx;
+     op->t = 4;
+     op->r = 2;
+     opc = fetch_byte(f);
+    }
+
+ if (opc == 0xCB)
+    {
+     if (idx != Z80BB_H)
+        {
+         op->d = (int8_t)fetch_byte(f);
+         decode_xycb(f, op, fetch_byte(f));
+        }
+     else
+        {
+         op->r = 2;
+         decode_cb(f, op, fetch_byte(f));
+        }
+    }
+ else
+    if (opc == 0xED)
+       {
+        op->r = 2;
+        decode_ed(f, op, fetch_byte(f));
+       }
+    else
+       decode_main(f, op, opc, idx);
+
+ op->next = f->pc;
+}
+
+//==============================================================================
+// Compile a block of operations for a code page.
+//
+//   pass: code_page_t *cp
+//         uint16_t pc
+// return: const z80bb_op_t *           block or NULL if not cacheable
+//==============================================================================
+static const z80bb_op_t *z80bb_compile (code_page_t *cp, uint16_t pc)
+{
+ z80bb_op_t *start = &arena[arena_used];
+ z80bb_op_t *op = start;
+ fetch_t f;
+ int off;
+ int n;
+
+ f.host = cp->hp->host;
+ f.off = pc & MEMMAP_OFFSET;
+ f.pc = pc;
+ f.cross = 0;
+
+ for (n = 0; n < BLOCK_OPS_MAX; n++)
+    {
+     off = f.off;
+     z80bb_decode(&f, op);
+
+     // an instruction crossing the page boundary is left for the uncached
+     // path as the following page may be mapped to anything.
+     if (f.cross)
+        break;
+
+     while (off < f.off)
+        cp->hp->used[off++] = 1;
+
+     if ((op++)->end)
+        break;
+     if (f.off >= CODE_PAGE_SIZE)
+        break;
+    }
+
+ if (op == start)
+    return NULL;
+
+ op[-1].end = 1;
+ arena_used += op - start;
+ cp->entry[pc & MEMMAP_OFFSET] = start;
+
+ return start;
+}
+
+//==============================================================================
+// Find or compile the block for the current PC.
+//
+//   pass: void
+// return: const z80bb_op_t *           block or NULL if not cacheable
+//==============================================================================
+static const z80bb_op_t *z80bb_lookup (void)
+{
+ int page = cpu.pc >> MEMMAP_SHIFT;
+ code_page_t *cp;
+ const z80bb_op_t *op;
+
+ if (memhook)
+    return NULL;
+
+ if (flush_pending || (arena_used > ARENA_OPS - BLOCK_OPS_MAX))
+    z80bb_flush_all();
+
+ cp = code_r[page];
+ if (cp == NULL)
+    {
+     if (z80_mem_rp[page] == NULL)
+        return NULL;
+     cp = z80bb_create_page(z80_mem_rp[page], page);
+    }
+
+ op = cp->entry[cpu.pc & MEMMAP_OFFSET];
+ if (op == NULL)
+    op = z80bb_compile(cp, cpu.pc);
+
+ return op;
+}
+
+//==============================================================================
+// Initialise the basic block engine.
+//
+//   pass: z80bb_reti_fn_t reti         RETI call back function
+// return: int                          0 if success, -1 if error
+//==============================================================================
+int z80bb_init (z80bb_reti_fn_t reti)
+{
+ int i;
+ int p;
+
+ for (i = 0; i < 256; i++)
+    {
+     sz53[i] = (i & (FLAG_S | FLAG_5 | FLAG_3)) | (i ? 0 : FLAG_Z);
+     p = i ^ (i >> 4);
+     p ^= p >> 2;
+     p ^= p >> 1;
+     sz53p[i] = sz53[i] | ((p & 1) ? 0 : FLAG_P);
+    }
+
+ reti_fn = reti;
+
+ if (arena == NULL)
+    arena = malloc(sizeof(z80bb_op_t) * ARENA_OPS);
+ if (pages == NULL)
+    pages = malloc(sizeof(code_page_t) * CODE_PAGES_MAX);
+ if (hosts == NULL)
+    hosts = malloc(sizeof(code_host_t) * CODE_PAGES_MAX);
+
+ if ((arena == NULL) || (pages == NULL) || (hosts == NULL))
+    {
+     xprintf("z80bb_init: Unable to allocate memory for the block cache\n");
+     z80bb_deinit();
+     return -1;
+    }
+
+ rd_pages = memhook ? no_pages : z80_mem_rp;
+ wr_pages = memhook ? no_pages : z80_mem_wp;
+
+ z80bb_flush_all();
+ z80bb_reset();
+
+ return 0;
+}
+
+//==============================================================================
+// De-initialise the basic block engine.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int z80bb_deinit (void)
+{
+ free(arena);
+ free(pages);
+ free(hosts);
+ arena = NULL;
+ pages = NULL;
+ hosts = NULL;
+
+ memset(code_hash, 0, sizeof(code_hash));
+ memset(code_r, 0, sizeof(code_r));
+ memset(code_w, 0, sizeof(code_w));
+ hosts_used = 0;
+ pages_used = 0;
+ arena_used = 0;
+
+ return 0;
+}
+
+//==============================================================================
+// Reset the CPU.
+//
+// The register values after reset are the same as used by z80ex.  All
+// decoded blocks are discarded as the ROMs may have been reloaded.
+//
+//   pass: void
+// return: int                          0
+//==============================================================================
+int z80bb_reset (void)
+{
+ memset(&cpu, 0, sizeof(cpu));
+ REG_A = 0xff;
+ REG_F = 0xff;
+ set16(Z80BB_SPH, 0xffff);
+ cpu.af_p = 0xffff;
+
+ flush_pending = 1;
+ stop = 1;
+
+ return 0;
+}
+
+//==============================================================================
+// Execute Z80 code until the tstate count reaches the limit.
+//
+// The tstate count is updated after each instruction.  Execution returns
+// early if z80bb_break() is called and after each HALT tstate step if
+// halt_stop is non zero.  A change to the memory map or to decoded code ends
+// the current block so that the next block is looked up again.
+//
+//   pass: int *tstates                 tstate counter
+//         int limit                    stop when *tstates >= limit
+//         int halt_stop                return after each HALT step
+// return: void
+//==============================================================================
+void z80bb_execute (int *tstates, int limit, int halt_stop)
+{
+ const z80bb_op_t *op;
+ z80bb_op_t tmp;
+ fetch_t f;
+ int t;
+
+ brk = 0;
+
+ while (*tstates < limit)
+    {
+     if (cpu.halted)
+        {
+         *tstates += 4;
+         cpu.r++;
+         if (halt_stop)
+            return;
+         continue;
+        }
+
+     op = z80bb_lookup();
+     if (op == NULL)
+        {
+         f.host = NULL;
+         f.off = 0;
+         f.pc = cpu.pc;
+         f.cross = 0;
+         z80bb_decode(&f, &tmp);
+         tmp.end = 1;
+         op = &tmp;
+        }
+
+     // interrupts are allowed again once the instruction after EI starts,
+     // EI always ends a block.
+     cpu.noint_once = 0;
+     stop = 0;
+
+     for (;;)
+        {
+         cpu.pc = op->next;
+         cpu.r += op->r;
+         t = (*op->fn)(op);
+         *tstates += op->t + t;
+         if (op->end || stop || (*tstates >= limit))
+            break;
+         op++;
+        }
+
+     if (brk || (cpu.halted && halt_stop))
+        return;
+    }
+}
+
+//==============================================================================
+// Request z80bb_execute() to return after the current instruction.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void z80bb_break (void)
+{
+ brk = 1;
+ stop = 1;
+}
+
+//==============================================================================
+// Return non zero if the CPU is halted.
+//
+//   pass: void
+// return: int
+//==============================================================================
+int z80bb_doing_halt (void)
+{
+ return cpu.halted;
+}
+
+//==============================================================================
+// Return 1 if a maskable interrupt can be accepted.
+//
+//   pass: void
+// return: int
+//==============================================================================
+int z80bb_int_possible (void)
+{
+ return (cpu.iff1 && ! cpu.noint_once);
+}
+
+//==============================================================================
+// Maskable interrupt.
+//
+// Mode 0 is only supported for RST instructions placed on the data bus.
+//
+//   pass: int vector                   data bus value
+// return: int                          tstates used, 0 if not accepted
+//==============================================================================
+int z80bb_int (int vector)
+{
+ if (! z80bb_int_possible())
+    return 0;
+
+ if (cpu.halted)
+    {
+     cpu.pc++;
+     cpu.halted = 0;
+    }
+
+ cpu.iff1 = 0;
+ cpu.iff2 = 0;
+ cpu.r++;
+ stop = 1;
+
+ push(cpu.pc);
+
+ switch (cpu.im)
+    {
+     case 0 :
+        cpu.pc = vector & 0x38;
+        cpu.memptr = cpu.pc;
+        return 13;
+     case 1 :
+        cpu.pc = 0x0038;
+        cpu.memptr = cpu.pc;
+        return 13;
+     default :
+        cpu.pc = rd16((cpu.i << 8) | (vector & 0xff));
+        cpu.memptr = cpu.pc;
+        return 19;
+    }
+}
+
+//==============================================================================
+// Non maskable interrupt.
+//
+//   pass: void
+// return: int                          tstates used
+//==============================================================================
+int z80bb_nmi (void)
+{
+ if (cpu.halted)
+    {
+     cpu.pc++;
+     cpu.halted = 0;
+    }
+
+ cpu.iff1 = 0;
+ cpu.r++;
+ stop = 1;
+
+ push(cpu.pc);
+ cpu.pc = 0x0066;
+ cpu.memptr = cpu.pc;
+
+ return 11;
+}
+
+//==============================================================================
+// Return all Z80 registers.
+//
+//   pass: z80regs_t *z80regs
+// return: void
+//==============================================================================
+void z80bb_get_regs (z80regs_t *z80regs)
+{
+ z80regs->af = (REG_A << 8) | REG_F;
+ z80regs->bc = r16(Z80BB_B);
+ z80regs->de = r16(Z80BB_D);
+ z80regs->hl = r16(Z80BB_H);
+
+ z80regs->af_p = cpu.af_p;
+ z80regs->bc_p = cpu.bc_p;
+ z80regs->de_p = cpu.de_p;
+ z80regs->hl_p = cpu.hl_p;
+
+ z80regs->ix = r16(Z80BB_IXH);
+ z80regs->iy = r16(Z80BB_IYH);
+ z80regs->pc = cpu.pc;
+ z80regs->sp = r16(Z80BB_SPH);
+
+ z80regs->i = cpu.i;
+ z80regs->r = (cpu.r & 0x7f) | cpu.r7;
+
+ z80regs->iff1 = cpu.iff1;
+ z80regs->iff2 = cpu.iff2;
+ z80regs->im = cpu.im;
+}
+
+//==============================================================================
+// Set all Z80 registers.
+//
+//   pass: z80regs_t *z80regs
+// return: void
+//==============================================================================
+void z80bb_set_regs (z80regs_t *z80regs)
+{
+ REG_A = z80regs->af >> 8;
+ REG_F = z80regs->af & 0xff;
+ set16(Z80BB_B, z80regs->bc);
+ set16(Z80BB_D, z80regs->de);
+ set16(Z80BB_H, z80regs->hl);
+
+ cpu.af_p = z80regs->af_p;
+ cpu.bc_p = z80regs->bc_p;
+ cpu.de_p = z80regs->de_p;
+ cpu.hl_p = z80regs->hl_p;
+
+ set16(Z80BB_IXH, z80regs->ix);
+ set16(Z80BB_IYH, z80regs->iy);
+ cpu.pc = z80regs->pc;
+ set16(Z80BB_SPH, z80regs->sp);
+
+ cpu.i = z80regs->i;
+ cpu.r = z80regs->r;
+ cpu.r7 = z80regs->r & 0x80;
+
+ stop = 1;
+}
+
+//==============================================================================
+// Set the interrupt flip-flops and interrupt mode.
+//
+//   pass: z80regs_t *z80regs
+// return: void
+//==============================================================================
+void z80bb_set_intr_state (z80regs_t *z80regs)
+{
+ cpu.iff1 = z80regs->iff1 != 0;
+ cpu.iff2 = z80regs->iff2 != 0;
+ cpu.im = z80regs->im;
+}
+
+//==============================================================================
+// Get and set the Program Counter (PC).
+//==============================================================================
+int z80bb_getpc (void)
+{
+ return cpu.pc;
+}
+
+void z80bb_setpc (int addr)
+{
+ cpu.pc = addr;
+ stop = 1;
+}
+
+//==============================================================================
+// Set the debug memory hook.
+//
+// While a hook is set all memory accesses go through the handler functions
+// and no blocks are used so that every instruction fetch is reported.
+//
+//   pass: z80api_memhook hook
+// return: void
+//==============================================================================
+void z80bb_set_memhook (z80api_memhook hook)
+{
+ memhook = hook;
+ rd_pages = memhook ? no_pages : z80_mem_rp;
+ wr_pages = memhook ? no_pages : z80_mem_wp;
+ stop = 1;
+}
+
+//==============================================================================
+// Memory map has changed.
+//
+// Called by memmap_configure() after the z80_mem_rp[] and z80_mem_wp[]
+// tables have been rebuilt for a new bank configuration.  The blocks
+// already decoded for each host page are kept.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void z80bb_memmap_update (void)
+{
+ int i;
+
+ if (pages == NULL)
+    return;
+
+ for (i = 0; i < MEMMAP_BLOCKS; i++)
+    {
+     code_r[i] = z80bb_find_page(z80_mem_rp[i], i);
+     code_w[i] = z80bb_find_host(memmap_write_host(i));
+    }
+
+ stop = 1;
+}
+
+//==============================================================================
+// Memory has been written to from outside of the engine.
+//
+//   pass: int addr
+// return: void
+//==============================================================================
+void z80bb_mem_written (int addr)
+{
+ code_host_t *hp = code_w[(addr & 0xffff) >> MEMMAP_SHIFT];
+
+ if (hp && hp->used[addr & MEMMAP_OFFSET])
+    z80bb_invalidate_host(hp);
+}
+
+//==============================================================================
+// Discard all decoded blocks.
+//
+// Used when Z80 memory has been changed directly without using the Z80 API.
+// The flush is deferred until the next block is looked up as an instruction
+// may currently be executing.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void z80bb_flush (void)
+{
+ flush_pending = 1;
+ stop = 1;
+}
@@ -0,0 +1,69 @@
+/* Z80 basic block engine Header */
+
+#ifndef HEADER_Z80BB_H
+#define HEADER_Z80BB_H
+
+#include <stdint.h>
+
+#include "z80api.h"
+
+// 8 bit register indexes, 0-7 follow the Z80 opcode register encoding
+// with (HL) replaced by F.  Register pairs are stored high byte first.
+#define Z80BB_B    0
+#define Z80BB_C    1
+#define Z80BB_D    2
+#define Z80BB_E    3
+#define Z80BB_H    4
+#define Z80BB_L    5
+#define Z80BB_F    6
+#define Z80BB_A    7
+#define Z80BB_IXH  8
+#define Z80BB_IXL  9
+#define Z80BB_IYH  10
+#define Z80BB_IYL  11
+#define Z80BB_SPH  12
+#define Z80BB_SPL  13
+#define Z80BB_TMP  14
+#define Z80BB_REGS 16
+
+typedef struct z80bb_cpu_t
+{
+ uint8_t r8[Z80BB_REGS];
+ uint16_t pc;
+ uint16_t memptr;
+ uint16_t af_p;
+ uint16_t bc_p;
+ uint16_t de_p;
+ uint16_t hl_p;
+ uint8_t i;
+ uint8_t r;
+ uint8_t r7;
+ uint8_t iff1;
+ uint8_t iff2;
+ uint8_t im;
+ int halted;
+ int noint_once;
+}z80bb_cpu_t;
+
+typedef void (*z80bb_reti_fn_t)(void);
+
+int z80bb_init (z80bb_reti_fn_t reti);
+int z80bb_deinit (void);
+int z80bb_reset (void);
+void z80bb_execute (int *tstates, int limit, int halt_stop);
+void z80bb_break (void);
+int z80bb_doing_halt (void);
+int z80bb_int_possible (void);
+int z80bb_int (int vector);
+int z80bb_nmi (void);
+void z80bb_get_regs (z80regs_t *z80regs);
+void z80bb_set_regs (z80regs_t *z80regs);
+void z80bb_set_intr_state (z80regs_t *z80regs);
+int z80bb_getpc (void);
+void z80bb_setpc (int addr);
+void z80bb_set_memhook (z80api_memhook hook);
+void z80bb_memmap_update (void);
+void z80bb_mem_written (int addr);
+void z80bb_flush (void);
+
+#endif     /* HEADER_Z80BB_H */
@@ -32,6 +32,12 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - Changes to z80debug_fill_bank(), z80debug_load_bank() and
+//   z80debug_set_bank() to call z80api_code_flush() as the memory banks are
+//   written to directly.
+// - Added z80debug_rstep() function for --db-rstep option.
+//
 // v6.0.0 - 1 January 2017, K Duckmanton
 // - Microbee memory is now an array of uint8_t rather than char.
 //
@@ -195,6 +201,7 @@
 #include "vdu.h"
 #include "console.h"
 #include "gui.h"
+#include "rewind.h"
 
 #include "macros.h"
 
@@ -1950,6 +1957,7 @@ int z80debug_fill_bank (char *p)
  else
     memset(b.ptr, value, b.size);
 
+ z80api_code_flush();
  return 0;
 }
 
@@ -2549,6 +2557,7 @@ int z80debug_load_bank (char *p)
     if (fread(b.ptr, b.size, 1, fp) != 1)
        ; // no error
  fclose(fp);
+ z80api_code_flush();
  return 0;
 }
 
@@ -2730,6 +2739,7 @@ int z80debug_set_bank (char *p)
         }
     }
 
+ z80api_code_flush();
  return 0;
 }
 
@@ -3098,6 +3108,47 @@ int z80debug_step (char *p)
  return 0;
 }
 
+//==============================================================================
+// Process --db-rstep option.
+//
+// --db-rstep n|bp
+//
+// Step back n instructions or to the last break point reached.  Only
+// possible while stopped in the debugger and with rewinding enabled.
+//
+//   pass: char *p              parameter
+// return: int                  0 if no error else -1
+//==============================================================================
+int z80debug_rstep (char *p)
+{
+ char sp[100];
+
+ int res;
+ int to_bp;
+
+ get_next_parameter(p, ',', sp, &res, sizeof(sp)-1);
+
+ to_bp = (strcmp(sp, "bp") == 0);
+ if ((res < 0) && (! to_bp))
+    return -1;
+ if ((res == 0) && (! to_bp))
+    return 0;
+
+ if (debug.mode != Z80DEBUG_MODE_STOP)
+    {
+     xprintf("Can't step back unless code execution is stopped\n");
+     return 0;
+    }
+
+ if (rewind_step_back(res, to_bp) == 0)
+    {
+     crtc_set_redraw();
+     z80debug_print_console_prompt();
+    }
+
+ return 0;
+}
+
 //==============================================================================
 // Process --bp, --db-bp option.
 //
@@ -78,6 +78,7 @@ int z80debug_pop_regs (char *p);
 int z80debug_push_regs (char *p);
 int z80debug_pop_mem (char *p);
 int z80debug_push_mem (char *p);
+int z80debug_rstep (char *p);
 int z80debug_step (char *p);
 int z80debug_pc_breakpoint_set (char *p);
 int z80debug_pc_breakpoint_setr (char *p);
@@ -31,6 +31,28 @@
 //==============================================================================
 // ChangeLog (most recent entries are at top)
 //==============================================================================
+// v6.0.0 - 16 October 2026, agent
+// - z80api_code_flush() now calls rewind_invalidate() as the rewind history
+//   does not see memory changed directly.
+// - Added z80api_snapshot() function for machine snapshots.
+// - Added z80api_finish_instruction() function, used by z80api_set_pc()
+//   and z80api_snapshot().
+// - z80api_get_regs() now includes the IFF1, IFF2 and interrupt mode
+//   values, these are only restored by z80api_snapshot().
+// - PIO polling is now a periodic event in the T-state event scheduler
+//   (sched.c).  z80api_execute() runs the Z80 to the next scheduled
+//   deadline and then calls sched_run() instead of counting down
+//   poll_wait_tstates after each instruction.
+// - Added z80api_break() function.
+// - Added the basic block engine (z80bb.c) as an alternative to z80ex. The
+//   API functions call the z80bb_*() functions when emu.z80engine is
+//   Z80API_ENGINE_BLOCK.  z80ex is still used for disassembly.
+// - Added z80api_memmap_update() and z80api_code_flush() functions.
+// - Changes to read_mem_cb(), read_mem_debug_cb(), write_mem_cb() and
+//   write_mem_debug_cb() to access plain RAM/ROM pages directly using the
+//   z80_mem_rp[] and z80_mem_wp[] page pointers from memmap.c.  The handler
+//   is only called for pages without a direct pointer.
+//
 // v5.7.0 - 21 July 2015, uBee
 // - Changes to read_mem_cb(), read_mem_debug_cb(), write_mem_cb() and
 //   write_mem_debug_cb() to use new define values of MEMMAP_MASK and
@@ -95,6 +117,10 @@
 #include <z80ex/z80ex_dasm.h>
 
 #include "z80api.h"
+#include "z80bb.h"
+#include "sched.h"
+#include "snapshot.h"
+#include "rewind.h"
 #include "z80.h"
 #include "memmap.h"
 #include "ubee512.h"
@@ -109,9 +135,11 @@ static Z80EX_CONTEXT *z80;
 static int exec_tstates;
 static int poll_want_tstates;
 static int poll_want_tstates_def;
-static int poll_wait_tstates;
 static int poll_repeats;
 
+static void z80api_poll_event (void);
+static sched_event_t poll_event = {0, z80api_poll_event, "pio_poll", 0};
+
 static int intr_vector;
 
 static int z80_action_count;
@@ -131,6 +159,10 @@ extern char port_inp_state[];
 
 extern struct z80_memory_read_byte z80_mem_r[];
 extern struct z80_memory_write_byte z80_mem_w[];
+#ifdef MEMMAP_HANDLER_1
+extern uint8_t *z80_mem_rp[];
+extern uint8_t *z80_mem_wp[];
+#endif
 
 extern uint16_t (*z80_ports_r[])(uint16_t, struct z80_port_read *);
 extern void (*z80_ports_w[])(uint16_t, uint8_t, struct z80_port_write *);
@@ -156,6 +188,7 @@ Z80EX_BYTE read_interrupt_vector_cb (Z80EX_CONTEXT *cpu, void *user_data);
 Z80EX_BYTE read_byte_cb (Z80EX_WORD addr, void *user_data);
 
 void z80api_reti(Z80EX_CONTEXT *z80, void *data);
+static void z80api_bb_reti (void);
 void z80api_do_intr(void);
 void z80api_do_reti(void);
 int z80api_ieo(void);
@@ -164,7 +197,7 @@ int z80api_ieo(void);
 // Z80 Initilization
 //
 //   pass: void
-// return: int                          0
+// return: int                          0 if success, -1 if error
 //==============================================================================
 int z80api_init (void)
 {
@@ -184,6 +217,13 @@ int z80api_init (void)
  z80_int_scratch.intack = &z80api_do_reti;
  z80ex_set_reti_callback(z80, &z80api_reti, NULL);
 
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    {
+     if (z80bb_init(z80api_bb_reti) == -1)
+        return -1;
+     z80bb_set_memhook(z80_memhook);
+    }
+
  return 0;
 }
 
@@ -195,6 +235,9 @@ int z80api_init (void)
 //==============================================================================
 int z80api_deinit (void)
 {
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    z80bb_deinit();
+
  z80ex_destroy(z80);
  z80 = NULL;
  return 0;
@@ -217,6 +260,12 @@ int z80api_reset (void)
  // set the Z80 PC execution address
  z80ex_set_reg(z80, regPC, modelx.bootaddr);
 
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    {
+     z80bb_reset();
+     z80bb_setpc(modelx.bootaddr);
+    }
+
  exec_tstates = 0;
 
  poll_want_tstates_def = 300;
@@ -224,6 +273,8 @@ int z80api_reset (void)
  poll_want_tstates = poll_want_tstates_def;
  poll_repeats = 0;
 
+ sched_add(&poll_event, z80api_get_tstates() + poll_want_tstates);
+
  return 0;
 }
 
@@ -235,6 +286,9 @@ int z80api_reset (void)
 //==============================================================================
 int z80api_getpc (void)
 {
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    return z80bb_getpc();
+
  return z80ex_get_reg(z80, regPC);
 }
 
@@ -265,8 +319,48 @@ void z80api_set_poll_tstates_def (int tstates)
 void z80api_set_poll_tstates (int tstates, int repeats)
 {
  poll_want_tstates = tstates;
- poll_wait_tstates = 0;
  poll_repeats = repeats;
+
+ // poll again after the current instruction
+ sched_add(&poll_event, z80api_get_tstates());
+}
+
+//==============================================================================
+// PIO polling event.
+//
+// Called by the event scheduler each time a PIO poll is due and adds itself
+// again for the next poll.
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void z80api_poll_event (void)
+{
+ pio_polling();
+
+ if (poll_repeats)
+    poll_repeats--;
+ else
+    poll_want_tstates = poll_want_tstates_def;
+
+ sched_add(&poll_event, z80api_get_tstates() +
+ ((poll_want_tstates < 1) ? 1 : poll_want_tstates));
+}
+
+//==============================================================================
+// Request the Z80 engine to return to z80api_execute() after the current
+// instruction.
+//
+// Called by the event scheduler when an earlier deadline has been added.
+// The z80ex engine already returns after each instruction.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void z80api_break (void)
+{
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    z80bb_break();
 }
 
 //==============================================================================
@@ -320,6 +414,43 @@ void z80api_call_actions (z80_event_t when)
     (*z80actions[i].function)();
 }
 
+//==============================================================================
+// Execute Z80 tstates using the basic block engine.
+//
+// The engine runs straight through to the next scheduled event deadline.
+// The exec_tstates value is updated by the engine after each instruction so
+// z80api_get_tstates() returns the correct value to any port handlers.
+//
+//   pass: int tstates
+// return: void
+//==============================================================================
+static void z80api_execute_bb (int tstates)
+{
+ uint64_t now;
+ int limit;
+
+ while (exec_tstates < tstates)
+    {
+     now = emu.z80_cycles + exec_tstates;
+     if (sched_deadline <= now)
+        limit = exec_tstates + 1;
+     else
+        if (sched_deadline - now < (uint64_t)(tstates - exec_tstates))
+           limit = exec_tstates + (int)(sched_deadline - now);
+        else
+           limit = tstates;
+
+     z80bb_execute(&exec_tstates, limit, z80_action_count);
+
+     if (z80_action_count && z80bb_doing_halt())
+        z80api_call_actions(Z80_HALT);
+
+     now = emu.z80_cycles + exec_tstates;
+     if (now >= sched_deadline)
+        sched_run(now);
+    }
+}
+
 //==============================================================================
 // Execute Z80 tstates.
 //
@@ -328,31 +459,25 @@ void z80api_call_actions (z80_event_t when)
 //==============================================================================
 void z80api_execute (int tstates)
 {
- int ts;
  exec_tstates = 0;
 
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    {
+     z80api_execute_bb(tstates);
+     emu.z80_cycles += exec_tstates;
+     exec_tstates = 0;
+     return;
+    }
+
  while (exec_tstates < tstates)
     {
-     ts = z80ex_step(z80);
-     exec_tstates += ts;
+     exec_tstates += z80ex_step(z80);
 
      if (z80ex_doing_halt(z80))
          z80api_call_actions(Z80_HALT);
 
-     // FIXME - can the actions() mechanism be generalised to
-     //  encompass this sort of periodic callback?
-
-     poll_wait_tstates -= ts;
-
-     if (poll_wait_tstates < 1)
-        {
-         pio_polling();
-         if (poll_repeats)
-            poll_repeats--;
-         else
-            poll_want_tstates = poll_want_tstates_def;
-         poll_wait_tstates = poll_want_tstates;
-        }
+     if (emu.z80_cycles + exec_tstates >= sched_deadline)
+        sched_run(emu.z80_cycles + exec_tstates);
     }
 
  emu.z80_cycles += exec_tstates;
@@ -374,6 +499,11 @@ void z80api_execute_complete (void)
  z80api_execute(1);
  if (debug.piopoll)
     pio_polling();
+
+ // the block engine always executes complete instructions
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    return;
+
  while (z80ex_last_op_type(z80) != 0)
     {
      z80api_execute(1);
@@ -382,6 +512,27 @@ void z80api_execute_complete (void)
     }
 }
 
+//==============================================================================
+// Finish an unfinished instruction.
+//
+// z80api_execute() may return after a dd/fd/cb/ed prefix has been executed,
+// the prefix is held in the z80ex context and not in the registers.  This
+// executes the rest of the instruction so the registers describe the whole
+// machine state.  Nothing is executed if the last instruction completed.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void z80api_finish_instruction (void)
+{
+ // the block engine always executes complete instructions
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    return;
+
+ while (z80ex_last_op_type(z80) != 0)
+    z80api_execute(1);
+}
+
 //==============================================================================
 // Set the PC register to a new address.
 //
@@ -395,8 +546,13 @@ void z80api_execute_complete (void)
 //==============================================================================
 void z80api_set_pc (int addr)
 {
- while (z80ex_last_op_type(z80) != 0)
-    z80api_execute(1);
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    {
+     z80bb_setpc(addr);
+     return;
+    }
+
+ z80api_finish_instruction();
 
  z80ex_set_reg(z80, regPC, addr);
 }
@@ -450,6 +606,12 @@ void z80api_register_interrupting_device (z80_device_interrupt_t *scratch,
 //==============================================================================
 void z80api_nonmaskable_intr (void)
 {
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    {
+     emu.z80_cycles += z80bb_nmi();
+     return;
+    }
+
  emu.z80_cycles += z80ex_nmi(z80);
 }
 
@@ -461,6 +623,13 @@ void z80api_nonmaskable_intr (void)
 //==============================================================================
 void z80api_maskable_intr (int vector)
 {
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    {
+     intr_vector = vector;
+     emu.z80_cycles += z80bb_int(vector);
+     return;
+    }
+
  if (z80ex_int_possible(z80) == 1)
     {
      intr_vector = vector;
@@ -476,6 +645,9 @@ void z80api_maskable_intr (int vector)
 //==============================================================================
 int z80api_intr_possible (void)
 {
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    return z80bb_int_possible();
+
  return z80ex_int_possible(z80);
 }
 
@@ -518,6 +690,17 @@ void z80api_reti (Z80EX_CONTEXT *z80, void *data)
                                  * priority level (none!) */
 }
 
+//==============================================================================
+// RETI callback function, called from the basic block engine
+//
+//   pass: void
+// return: void
+//==============================================================================
+static void z80api_bb_reti (void)
+{
+ z80api_reti(NULL, NULL);
+}
+
 //==============================================================================
 // Return all Z80 registers (not called during execution of an instruction)
 //
@@ -526,6 +709,12 @@ void z80api_reti (Z80EX_CONTEXT *z80, void *data)
 //==============================================================================
 void z80api_get_regs (z80regs_t *z80regs)
 {
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    {
+     z80bb_get_regs(z80regs);
+     return;
+    }
+
  z80regs->af = z80ex_get_reg(z80, regAF);
  z80regs->bc = z80ex_get_reg(z80, regBC);
  z80regs->de = z80ex_get_reg(z80, regDE);
@@ -543,6 +732,10 @@ void z80api_get_regs (z80regs_t *z80regs)
 
  z80regs->i = z80ex_get_reg(z80, regI);
  z80regs->r = z80ex_get_reg(z80, regR);
+
+ z80regs->iff1 = z80ex_get_reg(z80, regIFF1);
+ z80regs->iff2 = z80ex_get_reg(z80, regIFF2);
+ z80regs->im = z80ex_get_reg(z80, regIM);
 }
 
 //==============================================================================
@@ -553,6 +746,12 @@ void z80api_get_regs (z80regs_t *z80regs)
 //==============================================================================
 void z80api_set_regs (z80regs_t *z80regs)
 {
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    {
+     z80bb_set_regs(z80regs);
+     return;
+    }
+
  z80ex_set_reg(z80, regAF, z80regs->af);
  z80ex_set_reg(z80, regBC, z80regs->bc);
  z80ex_set_reg(z80, regDE, z80regs->de);
@@ -683,6 +882,9 @@ Z80EX_BYTE z80api_read_mem (int addr)
 void z80api_write_mem (int addr, uint8_t value)
 {
  write_mem_cb(NULL, addr, value, NULL);
+
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    z80bb_mem_written(addr);
 }
 
 //==============================================================================
@@ -801,8 +1003,11 @@ Z80EX_BYTE read_mem_cb (Z80EX_CONTEXT *cpu, Z80EX_WORD addr, int m1_state,
                         void *user_data)
 {
 #ifdef MEMMAP_HANDLER_1
- return (Z80EX_BYTE)z80_mem_r[(addr & MEMMAP_MASK) >> 
- MEMMAP_SHIFT].memory_call(addr, NULL);
+ int page = (addr & MEMMAP_MASK) >> MEMMAP_SHIFT;
+
+ if (z80_mem_rp[page])
+    return z80_mem_rp[page][addr & MEMMAP_OFFSET];
+ return (Z80EX_BYTE)z80_mem_r[page].memory_call(addr, NULL);
 #else
  int i;
 
@@ -831,8 +1036,11 @@ Z80EX_BYTE read_mem_debug_cb (Z80EX_CONTEXT *cpu, Z80EX_WORD addr, int m1_state,
  z80_memhook(addr, 0);
 
 #ifdef MEMMAP_HANDLER_1
- return (Z80EX_BYTE)z80_mem_r[(addr & MEMMAP_MASK) >>
- MEMMAP_SHIFT].memory_call(addr, NULL);
+ int page = (addr & MEMMAP_MASK) >> MEMMAP_SHIFT;
+
+ if (z80_mem_rp[page])
+    return z80_mem_rp[page][addr & MEMMAP_OFFSET];
+ return (Z80EX_BYTE)z80_mem_r[page].memory_call(addr, NULL);
 #else
  int i;
 
@@ -861,7 +1069,12 @@ void write_mem_cb (Z80EX_CONTEXT *cpu, Z80EX_WORD addr, Z80EX_BYTE value,
                    void *user_data)
 {
 #ifdef MEMMAP_HANDLER_1
- z80_mem_w[(addr & MEMMAP_MASK) >> MEMMAP_SHIFT].memory_call(addr, value, NULL);
+ int page = (addr & MEMMAP_MASK) >> MEMMAP_SHIFT;
+
+ if (z80_mem_wp[page])
+    z80_mem_wp[page][addr & MEMMAP_OFFSET] = value;
+ else
+    z80_mem_w[page].memory_call(addr, value, NULL);
 #else
  int i;
 
@@ -893,7 +1106,12 @@ void write_mem_debug_cb (Z80EX_CONTEXT *cpu, Z80EX_WORD addr, Z80EX_BYTE value,
                          void *user_data)
 {
 #ifdef MEMMAP_HANDLER_1
- z80_mem_w[(addr & MEMMAP_MASK) >> MEMMAP_SHIFT].memory_call(addr, value, NULL);
+ int page = (addr & MEMMAP_MASK) >> MEMMAP_SHIFT;
+
+ if (z80_mem_wp[page])
+    z80_mem_wp[page][addr & MEMMAP_OFFSET] = value;
+ else
+    z80_mem_w[page].memory_call(addr, value, NULL);
 #else
  int i;
 
@@ -980,4 +1198,118 @@ void z80api_set_memhook (z80api_memhook hook)
      z80ex_set_memread_callback(z80, read_mem_cb, NULL);
      z80ex_set_memwrite_callback(z80, write_mem_cb, NULL);
     }
+
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    z80bb_set_memhook(z80_memhook);
+}
+
+//==============================================================================
+// Memory map has changed.
+//
+// Called by memmap_configure() after the memory handlers and page pointers
+// have been set up for a new bank configuration.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void z80api_memmap_update (void)
+{
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    z80bb_memmap_update();
+}
+
+//==============================================================================
+// Z80 code may have changed.
+//
+// Must be called after Z80 memory has been changed directly (not using
+// z80api_write_mem()) such as when loading files into memory.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void z80api_code_flush (void)
+{
+ rewind_invalidate();
+
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    z80bb_flush();
+}
+
+//==============================================================================
+// Set the interrupt flip-flops and interrupt mode.
+//
+// Only used when loading a machine snapshot, z80api_set_regs() leaves these
+// alone.
+//
+//   pass: z80regs_t *z80regs
+// return: void
+//==============================================================================
+static void z80api_set_intr_state (z80regs_t *z80regs)
+{
+ if (emu.z80engine == Z80API_ENGINE_BLOCK)
+    {
+     z80bb_set_intr_state(z80regs);
+     return;
+    }
+
+ z80ex_set_reg(z80, regIFF1, z80regs->iff1);
+ z80ex_set_reg(z80, regIFF2, z80regs->iff2);
+ z80ex_set_reg(z80, regIM, z80regs->im);
+}
+
+//==============================================================================
+// Save or load the Z80 state for a machine snapshot.
+//
+// The tstate count is part of the state as the timing of other devices is
+// based on it.  Only called between frames so exec_tstates is always 0.
+//
+// A z80ex instruction left part way through a prefix is finished first,
+// before saving so the PC and registers are at an instruction boundary and
+// before loading so no stale prefix is applied to the loaded state.  The
+// CPU chunk is the first one, anything the instruction changes on loading
+// is replaced by the chunks that follow.
+//
+//   pass: void
+// return: void
+//==============================================================================
+void z80api_snapshot (void)
+{
+ z80regs_t z80regs;
+
+ if (snapshot_chunk("CPU "))
+    return;
+
+ z80api_finish_instruction();
+ z80api_get_regs(&z80regs);
+
+ snapshot_int(&z80regs.af);
+ snapshot_int(&z80regs.bc);
+ snapshot_int(&z80regs.de);
+ snapshot_int(&z80regs.hl);
+ snapshot_int(&z80regs.af_p);
+ snapshot_int(&z80regs.bc_p);
+ snapshot_int(&z80regs.de_p);
+ snapshot_int(&z80regs.hl_p);
+ snapshot_int(&z80regs.ix);
+ snapshot_int(&z80regs.iy);
+ snapshot_int(&z80regs.pc);
+ snapshot_int(&z80regs.sp);
+ snapshot_int(&z80regs.i);
+ snapshot_int(&z80regs.r);
+ snapshot_int(&z80regs.iff1);
+ snapshot_int(&z80regs.iff2);
+ snapshot_int(&z80regs.im);
+ snapshot_u64(&emu.z80_cycles);
+ snapshot_int(&poll_want_tstates);
+ snapshot_int(&poll_repeats);
+
+ if (! snapshot_loading())
+    return;
+
+ // the PC is left at a HALT instruction while halted so the HALT is
+ // simply executed again.
+ z80api_set_regs(&z80regs);
+ z80api_set_intr_state(&z80regs);
+ exec_tstates = 0;
+ sched_add(&poll_event, z80api_get_tstates());
 }